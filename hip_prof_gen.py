@@ -448,7 +448,11 @@ if len(sys.argv) > 3: OUTPUT = sys.argv[3]
 # API declaration map
 api_map = {
   'hipHccModuleLaunchKernel': '',
-  'hipExtModuleLaunchKernel': ''
+  'hipExtModuleLaunchKernel': '',
+  'hipExtLaunchKernelBatch': '',
+  'hipExtMallocCacheGetStats': '',
+  'hipExtMallocCacheResetPeakStats': '',
+  'hipExtMallocCacheTrim': ''
 }
 # API options map
 opts_map = {}
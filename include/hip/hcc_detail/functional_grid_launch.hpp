@@ -33,6 +33,7 @@ THE SOFTWARE.
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 hipError_t ihipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList, int numDevices,
                                                unsigned int flags, hip_impl::program_state& ps);
@@ -117,6 +118,90 @@ inline hip_impl::kernarg make_kernarg(
                            std::move(kernarg));
 }
 
+// Upper bound on the packed size of a kernarg segment for the given formals,
+// known at compile time so that the segment can live on the stack.
+template <typename... Ts>
+struct kernarg_capacity : std::integral_constant<std::size_t, 0> {};
+
+template <typename T, typename... Ts>
+struct kernarg_capacity<T, Ts...>
+    : std::integral_constant<
+        std::size_t,
+        sizeof(T) + alignof(T) - 1 + kernarg_capacity<Ts...>::value> {};
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n == sizeof...(Ts)>::type* = nullptr>
+inline void pack_kernarg(
+    const std::tuple<Ts...>&, const kernargs_size_align&, std::uint8_t*) {}
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n != sizeof...(Ts)>::type* = nullptr>
+inline void pack_kernarg(
+    const std::tuple<Ts...>& formals,
+    const kernargs_size_align& size_align,
+    std::uint8_t* kernarg) {
+    using T = typename std::tuple_element<n, std::tuple<Ts...>>::type;
+
+    static_assert(
+        !std::is_reference<T>{},
+        "A __global__ function cannot have a reference as one of its "
+            "arguments.");
+    #if defined(HIP_STRICT)
+        static_assert(
+            std::is_trivially_copyable<T>{},
+            "Only TriviallyCopyable types can be arguments to a __global__ "
+                "function");
+    #endif
+
+    std::memcpy(
+        kernarg + size_align.offset(n), &std::get<n>(formals), size_align.size(n));
+    pack_kernarg<n + 1>(formals, size_align, kernarg);
+}
+
+// Kernarg segment packed with the per-kernel layout cached by program_state.
+// Storage is inline; the heap is only used if the layout from the code object
+// metadata is larger than the host-side bound.
+template <typename... Formals>
+class packed_kernarg {
+    static constexpr std::size_t capacity = kernarg_capacity<Formals...>::value;
+
+    alignas(16) std::uint8_t inline_[capacity ? capacity : 1]{};
+    std::vector<std::uint8_t> overflow_;
+    std::size_t size_{};
+public:
+    template <typename... Actuals>
+    packed_kernarg(void (*kernel)(Formals...), std::tuple<Actuals...> actuals) {
+        static_assert(sizeof...(Formals) == sizeof...(Actuals),
+            "The count of formal arguments must match the count of actuals.");
+
+        if (sizeof...(Formals) == 0) return;
+
+        std::tuple<Formals...> to_formals{std::move(actuals)};
+        const auto size_align = get_program_state().get_kernargs_size_align(
+            reinterpret_cast<std::uintptr_t>(kernel));
+
+        size_ = size_align.total_size();
+        if (size_ > capacity) overflow_.resize(size_);
+
+        pack_kernarg<0>(to_formals, size_align, data());
+    }
+
+    std::uint8_t* data() {
+        return overflow_.empty() ? inline_ : overflow_.data();
+    }
+
+    std::size_t size() const { return size_; }
+};
+
+template <typename... Formals, typename... Actuals>
+inline packed_kernarg<Formals...> make_packed_kernarg(
+    void (*kernel)(Formals...), std::tuple<Actuals...> actuals) {
+    return packed_kernarg<Formals...>{kernel, std::move(actuals)};
+}
 
 HIP_INTERNAL_EXPORTED_API hsa_agent_t target_agent(hipStream_t stream);
 
@@ -177,7 +262,8 @@ void hipLaunchKernelGGL(F kernel, const dim3& numBlocks, const dim3& dimBlocks,
                         std::uint32_t sharedMemBytes, hipStream_t stream,
                         Args... args) {
     hip_impl::hip_init();
-    auto kernarg = hip_impl::make_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
+    auto kernarg = hip_impl::make_packed_kernarg(
+        kernel, std::tuple<Args...>{std::move(args)...});
     std::size_t kernarg_size = kernarg.size();
 
     void* config[]{
@@ -128,6 +128,34 @@ typedef struct hipFuncAttributes {
 
 typedef struct ihipEvent_t* hipEvent_t;
 
+typedef struct ihipMemPool_t* hipMemPool_t;
+
+/**
+ * Attributes of a memory pool, for hipMemPoolSetAttribute and hipMemPoolGetAttribute
+ */
+typedef enum hipMemPoolAttr {
+    /// int: reuse memory freed on another stream once an event recorded after the free has
+    /// been waited for. Not supported, always 0.
+    hipMemPoolReuseFollowEventDependencies = 0x1,
+    /// int: reuse memory freed on another stream once the free is known to have completed.
+    /// Always 1.
+    hipMemPoolReuseAllowOpportunistic = 0x2,
+    /// int: reuse memory freed on another stream by making the allocating stream wait for the
+    /// free. 1 by default.
+    hipMemPoolReuseAllowInternalDependencies = 0x3,
+    /// uint64_t: unused memory the pool keeps when the host synchronizes with the device.
+    /// UINT64_MAX by default.
+    hipMemPoolAttrReleaseThreshold = 0x4,
+    /// uint64_t: memory currently held by the pool. Read only.
+    hipMemPoolAttrReservedMemCurrent = 0x5,
+    /// uint64_t: high-water mark of the memory held by the pool. Can only be reset to 0.
+    hipMemPoolAttrReservedMemHigh = 0x6,
+    /// uint64_t: memory currently allocated from the pool. Read only.
+    hipMemPoolAttrUsedMemCurrent = 0x7,
+    /// uint64_t: high-water mark of the memory allocated from the pool. Can only be reset to 0.
+    hipMemPoolAttrUsedMemHigh = 0x8
+} hipMemPoolAttr;
+
 enum hipLimit_t {
     hipLimitMallocHeapSize = 0x02,
 };
@@ -1303,6 +1331,95 @@ hipError_t hipMemAllocPitch(hipDeviceptr_t* dptr, size_t* pitch, size_t widthInB
  */
 hipError_t hipFree(void* ptr);
 
+/**
+ *  @brief Allocate memory in stream order, from the default memory pool of the stream's device
+ *
+ *  @param[out] ptr Pointer to the allocated memory
+ *  @param[in]  size Requested memory size
+ *  @param[in]  stream Stream the memory is used on
+ *
+ *  The memory can be used by work queued on @p stream after the call, and by other streams once
+ *  they are ordered after it. Memory freed with hipFreeAsync on the same stream is reused without
+ *  synchronization.
+ *  If size is 0, no memory is allocated, *ptr returns nullptr, and hipSuccess is returned.
+ *
+ *  @return #hipSuccess, #hipErrorOutOfMemory, #hipErrorInvalidValue
+ *
+ *  @see hipFreeAsync, hipMallocFromPoolAsync, hipDeviceGetDefaultMemPool
+ */
+hipError_t hipMallocAsync(void** ptr, size_t size, hipStream_t stream);
+
+/**
+ *  @brief Allocate memory in stream order from a memory pool
+ *
+ *  @param[out] ptr Pointer to the allocated memory
+ *  @param[in]  size Requested memory size
+ *  @param[in]  memPool Pool to allocate from
+ *  @param[in]  stream Stream the memory is used on
+ *
+ *  @return #hipSuccess, #hipErrorOutOfMemory, #hipErrorInvalidValue
+ *
+ *  @see hipMallocAsync, hipFreeAsync, hipDeviceGetDefaultMemPool
+ */
+hipError_t hipMallocFromPoolAsync(void** ptr, size_t size, hipMemPool_t memPool,
+                                  hipStream_t stream);
+
+/**
+ *  @brief Free memory in stream order
+ *
+ *  The memory is freed once the work queued on @p stream before the call has completed; the
+ *  host does not wait for it. Later work on @p stream may reuse the memory right away.
+ *  If pointer is NULL, hipSuccess is returned.
+ *
+ *  @param[in] ptr Pointer to memory to be freed
+ *  @param[in] stream Stream the memory was last used on
+ *  @return #hipSuccess, #hipErrorInvalidDevicePointer
+ *
+ *  @see hipMallocAsync, hipFree
+ */
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream);
+
+/**
+ *  @brief Returns the default memory pool of a device, which hipMallocAsync allocates from
+ *
+ *  @param[out] memPool Default memory pool
+ *  @param[in]  device Device ordinal
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceGetDefaultMemPool(hipMemPool_t* memPool, int device);
+
+/**
+ *  @brief Sets an attribute of a memory pool
+ *
+ *  @param[in] memPool Memory pool
+ *  @param[in] attr Attribute, see #hipMemPoolAttr for the type of its value
+ *  @param[in] value Pointer to the value
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ */
+hipError_t hipMemPoolSetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value);
+
+/**
+ *  @brief Gets an attribute of a memory pool
+ *
+ *  @param[in]  memPool Memory pool
+ *  @param[in]  attr Attribute, see #hipMemPoolAttr for the type of its value
+ *  @param[out] value Pointer to the value
+ *  @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipMemPoolGetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value);
+
+/**
+ *  @brief Returns unused memory of a pool to the device
+ *
+ *  Waits for the pending frees of the pool, then releases unused memory until at most
+ *  @p minBytesToKeep bytes are held.
+ *
+ *  @param[in] memPool Memory pool
+ *  @param[in] minBytesToKeep Memory the pool may keep
+ *  @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipMemPoolTrimTo(hipMemPool_t memPool, size_t minBytesToKeep);
+
 /**
  *  @brief Free memory allocated by the hcc hip host memory allocation API.  [Deprecated]
  *
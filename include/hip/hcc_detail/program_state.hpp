@@ -88,6 +88,8 @@ class kernargs_size_align {
 public:
     std::size_t size(std::size_t n) const;
     std::size_t alignment(std::size_t n) const;
+    std::size_t offset(std::size_t n) const;
+    std::size_t total_size() const;
     const void* getHandle() const {return handle;};
 private:
     const void* handle;
@@ -109,9 +109,223 @@ hipError_t hipHccModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
                                     hipEvent_t stopEvent = nullptr)
                                     __attribute__((deprecated("use hipExtModuleLaunchKernel instead")));
 
+/**
+ * @brief One kernel launch of a batch, see hipExtLaunchKernelBatch
+ */
+typedef struct hipExtKernelLaunchParams_t {
+    hipFunction_t function;  ///< Kernel to launch
+    dim3 gridDim;            ///< Grid dimensions, in blocks
+    dim3 blockDim;           ///< Block dimensions, in work-items
+    size_t sharedMem;        ///< Dynamic shared memory, in bytes
+    void** kernelParams;     ///< Kernel arguments, as for hipModuleLaunchKernel
+    void** extra;            ///< Packed kernel arguments, as for hipModuleLaunchKernel
+} hipExtKernelLaunchParams;
+
+/**
+ * @brief Launches a batch of kernels on a stream, in order
+ *
+ * Behaves like calling hipModuleLaunchKernel for each element of launchParamsList in turn, but
+ * resolves the stream once for the whole batch and stages the arguments of all the launches
+ * before dispatching them back to back. Meant for workloads that issue many small kernels. On
+ * the HCC path the stream stays locked for the whole batch, so no work from other threads is
+ * interleaved with it; on the VDI path, work that other threads submit to the same stream
+ * meanwhile may be.
+ *
+ * All the launches are checked and set up before any of them is dispatched: if one is invalid or
+ * cannot be set up, none is launched.
+ *
+ * @param [in] launchParamsList  Launches, dispatched in array order.
+ * @param [in] numLaunches       Size of the launchParamsList array.
+ * @param [in] stream            Stream where the kernels should be dispatched.  May be 0, in which
+ case the default stream is used with associated synchronization rules.
+ * @param [in] flags             As for hipExtModuleLaunchKernel, applied to every launch.
+ *
+ * @returns hipSuccess, hipErrorInvalidDevice, hipErrorInvalidValue, hipErrorNotInitialized,
+ hipErrorInvalidResourceHandle, hipErrorInvalidConfiguration
+ */
+HIP_PUBLIC_API
+hipError_t hipExtLaunchKernelBatch(const hipExtKernelLaunchParams* launchParamsList,
+                                   unsigned int numLaunches, hipStream_t stream,
+                                   unsigned int flags = 0);
+
+/**
+ * @brief Statistics of the cache hipMalloc sub-allocates device memory from, see
+ * hipExtMallocCacheGetStats
+ */
+typedef struct hipExtMallocCacheStats_t {
+    size_t reservedBytes;            ///< Device memory held by the cache
+    size_t allocatedBytes;           ///< Memory allocated and not freed, rounded up
+    size_t pendingFreeBytes;         ///< Freed memory that work queued before the free may use
+    size_t peakReservedBytes;        ///< High-water mark of reservedBytes
+    size_t peakAllocatedBytes;       ///< High-water mark of allocatedBytes
+    size_t segmentCount;             ///< Device allocations held by the cache
+    unsigned long long cacheHits;    ///< Allocations served from cached memory
+    unsigned long long cacheMisses;  ///< Allocations that needed new device memory
+} hipExtMallocCacheStats;
+
+/**
+ * @brief Returns the statistics of the cache hipMalloc allocates from on a device
+ *
+ * hipMalloc sub-allocates device memory from segments the runtime keeps across hipFree calls, and
+ * hipFree makes memory available again once the work queued before it has completed rather than
+ * synchronizing the devices. Setting HIP_MALLOC_CACHE=0 disables the cache. Without a cache, all
+ * the statistics are 0.
+ *
+ * @param [in]  device  Device ordinal.
+ * @param [out] stats   Statistics of the device's cache.
+ *
+ * @returns hipSuccess, hipErrorInvalidDevice, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtMallocCacheGetStats(int device, hipExtMallocCacheStats* stats);
+
+/**
+ * @brief Resets the high-water marks of the hipMalloc cache of a device to the current values
+ *
+ * @param [in] device  Device ordinal.
+ *
+ * @returns hipSuccess, hipErrorInvalidDevice
+ */
+HIP_PUBLIC_API
+hipError_t hipExtMallocCacheResetPeakStats(int device);
+
+/**
+ * @brief Returns unused memory of the hipMalloc cache of a device to the device
+ *
+ * Waits for the work that freed memory may still be used by, then releases unused segments until
+ * at most minBytesToKeep bytes are reserved. Memory that is still allocated is not affected.
+ *
+ * @param [in] device          Device ordinal.
+ * @param [in] minBytesToKeep  Bytes the cache may keep reserved.
+ *
+ * @returns hipSuccess, hipErrorInvalidDevice
+ */
+HIP_PUBLIC_API
+hipError_t hipExtMallocCacheTrim(int device, size_t minBytesToKeep);
+
+/**
+ * @brief Number of launch shapes hipExtKernelLaunchStats reports separately
+ */
+#define HIP_EXT_KERNEL_LAUNCH_SHAPES 8
+
+/**
+ * @brief Launches of a kernel with the same grid, block and dynamic shared memory sizes
+ */
+typedef struct hipExtKernelLaunchShape_t {
+    dim3 gridDim;                 ///< Blocks
+    dim3 blockDim;                ///< Threads per block
+    unsigned int sharedMemBytes;  ///< Dynamic shared memory per block
+    unsigned long long launches;
+} hipExtKernelLaunchShape;
+
+/**
+ * @brief Distribution of a duration, in nanoseconds. Percentiles are rounded up by at most 12.5%.
+ */
+typedef struct hipExtLatencyStats_t {
+    unsigned long long totalNs;
+    unsigned long long p50Ns;
+    unsigned long long p90Ns;
+    unsigned long long p99Ns;
+    unsigned long long maxNs;
+} hipExtLatencyStats;
+
+/**
+ * @brief Launch statistics of a kernel, see hipExtKernelGetLaunchStats
+ */
+typedef struct hipExtKernelLaunchStats_t {
+    unsigned long long launches;
+    unsigned int shapeCount;                ///< Entries of shapes in use
+    unsigned long long otherShapeLaunches;  ///< Launches with a shape not in shapes
+    hipExtKernelLaunchShape shapes[HIP_EXT_KERNEL_LAUNCH_SHAPES];  ///< In order of first launch
+    hipExtLatencyStats enqueue;   ///< Time the host took to enqueue each launch
+    hipExtLatencyStats lockWait;  ///< Part of enqueue spent waiting for the stream or function lock
+} hipExtKernelLaunchStats;
+
+/**
+ * @brief Returns the launch statistics of a kernel
+ *
+ * Statistics are only collected when the HIP_KERNEL_STATS environment variable is set, and are
+ * printed to stderr at exit. They are kept by kernel name: the functions of a kernel on every
+ * device and in every module share them. Without HIP_KERNEL_STATS, all the statistics are 0.
+ *
+ * @param [in]  f      Kernel.
+ * @param [out] stats  Statistics of the kernel.
+ *
+ * @returns hipSuccess, hipErrorInvalidResourceHandle, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtKernelGetLaunchStats(hipFunction_t f, hipExtKernelLaunchStats* stats);
+
+/**
+ * @brief Rounding of hipExtConvertFloatToHalf and hipExtConvertFloatToBfloat16
+ */
+typedef enum hipExtRoundingMode {
+    hipExtRoundNearestEven = 0,  ///< Round to nearest, ties to even
+    hipExtRoundTowardZero = 1    ///< Truncate
+} hipExtRoundingMode;
+
+/**
+ * @brief Converts an array of floats to half precision on the host
+ *
+ * The result is the same as converting each value with __float2half_rn, or with __float2half_rz
+ * for hipExtRoundTowardZero, and NaNs become a quiet NaN of the same sign. The conversion uses
+ * the widest of F16C, AVX2 and AVX-512 the CPU supports. It does not initialize the runtime.
+ *
+ * @param [out] dst    Bit patterns of the halves, count elements.
+ * @param [in]  src    Floats to convert, count elements.
+ * @param [in]  count  Number of values.
+ * @param [in]  mode   Rounding.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtConvertFloatToHalf(uint16_t* dst, const float* src, size_t count,
+                                    hipExtRoundingMode mode = hipExtRoundNearestEven);
+
+/**
+ * @brief Converts an array of half precision values to floats on the host, exactly
+ *
+ * @param [out] dst    Floats, count elements.
+ * @param [in]  src    Bit patterns of the halves, count elements.
+ * @param [in]  count  Number of values.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtConvertHalfToFloat(float* dst, const uint16_t* src, size_t count);
+
+/**
+ * @brief Converts an array of floats to bfloat16 on the host
+ *
+ * The result is the same as constructing a hip_bfloat16 from each value, or with
+ * hip_bfloat16::truncate for hipExtRoundTowardZero.
+ *
+ * @param [out] dst    Bit patterns of the bfloat16 values, count elements.
+ * @param [in]  src    Floats to convert, count elements.
+ * @param [in]  count  Number of values.
+ * @param [in]  mode   Rounding.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtConvertFloatToBfloat16(uint16_t* dst, const float* src, size_t count,
+                                        hipExtRoundingMode mode = hipExtRoundNearestEven);
+
+/**
+ * @brief Converts an array of bfloat16 values to floats on the host, exactly
+ *
+ * @param [out] dst    Floats, count elements.
+ * @param [in]  src    Bit patterns of the bfloat16 values, count elements.
+ * @param [in]  count  Number of values.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue
+ */
+HIP_PUBLIC_API
+hipError_t hipExtConvertBfloat16ToFloat(float* dst, const uint16_t* src, size_t count);
+
 //#if !__HIP_VDI__ && defined(__cplusplus)
 #if defined(__HIP_PLATFORM_HCC__) && GENERIC_GRID_LAUNCH == 1 && defined(__HCC__)
-//kernel_descriptor and hip_impl::make_kernarg are in "grid_launch_GGL.hpp"
+//kernel_descriptor and hip_impl::make_packed_kernarg are in "grid_launch_GGL.hpp"
 
 namespace hip_impl {
 inline
@@ -147,8 +361,8 @@ void hipExtLaunchKernelGGL(F kernel, const dim3& numBlocks,
                            hipEvent_t stopEvent, std::uint32_t flags,
                            Args... args) {
     hip_impl::hip_init();
-    auto kernarg =
-        hip_impl::make_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
+    auto kernarg = hip_impl::make_packed_kernarg(
+        kernel, std::tuple<Args...>{std::move(args)...});
     std::size_t kernarg_size = kernarg.size();
 
     void* config[]{
@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host-side cost of entering a HIP API with API logging disabled.
+// Run without AMD_LOG_LEVEL / AMD_LOG_MASK set; the per-call cost of the cheap HIP APIs
+// below should be close to the cost of a bare out-of-line call with the same arguments.
+
+#include "hip/hip_runtime.h"
+#include <iostream>
+#include <chrono>
+
+#define CALL_COUNT 10000000
+
+__attribute__((noinline)) hipError_t BareCall(int* device, hipStream_t stream, size_t size) {
+    asm volatile("" : : "r"(device), "r"(stream), "r"(size) : "memory");
+    return hipSuccess;
+}
+
+template <typename F>
+double ns_per_call(F f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < CALL_COUNT; ++i) {
+        f();
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / CALL_COUNT;
+}
+
+int main() {
+    int device = 0;
+    hipStream_t stream;
+    hipSetDevice(0);
+    hipStreamCreate(&stream);
+
+    // Warm up the runtime so one-time initialization is not measured
+    hipGetDevice(&device);
+    hipStreamQuery(stream);
+
+    double bare = ns_per_call([&]() { BareCall(&device, stream, 0); });
+    double getDevice = ns_per_call([&]() { hipGetDevice(&device); });
+    double peekError = ns_per_call([&]() { hipPeekAtLastError(); });
+    double streamQuery = ns_per_call([&]() { hipStreamQuery(stream); });
+
+    printf("\n bare function call   : %.1f ns\n", bare);
+    printf(" hipGetDevice         : %.1f ns (+%.1f ns)\n", getDevice, getDevice - bare);
+    printf(" hipPeekAtLastError   : %.1f ns (+%.1f ns)\n", peekError, peekError - bare);
+    printf(" hipStreamQuery       : %.1f ns (+%.1f ns)\n", streamQuery, streamQuery - bare);
+
+    hipStreamDestroy(stream);
+}
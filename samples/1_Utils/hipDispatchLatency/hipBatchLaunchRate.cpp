@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Dispatch rate of many small kernels issued one hipModuleLaunchKernel at a time and as
+// hipExtLaunchKernelBatch calls of growing size. The enqueue rate only times the host side; the
+// completed rate also waits for the GPU to finish the kernels.
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#define LAUNCH_COUNT 100000
+
+#define FILE_NAME "test_kernel.code"
+#define KERNEL_NAME "test_args"
+
+#define CHECK(cmd)                                                                                 \
+    {                                                                                              \
+        hipError_t error = cmd;                                                                    \
+        if (error != hipSuccess) {                                                                 \
+            fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error), error,         \
+                    __FILE__, __LINE__);                                                           \
+            exit(EXIT_FAILURE);                                                                    \
+        }                                                                                          \
+    }
+
+// Issues LAUNCH_COUNT launches, grouped in calls of batch launches each.
+template <typename F>
+void measure(const char* test, int batch, hipStream_t stream, F launch) {
+    // Warm up so one-time initialization is not counted
+    for (int i = 0; i < 100; ++i) {
+        launch();
+    }
+    CHECK(hipStreamSynchronize(stream));
+
+    const int calls = LAUNCH_COUNT / batch;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < calls; ++i) {
+        launch();
+    }
+    auto enqueued = std::chrono::high_resolution_clock::now();
+    CHECK(hipStreamSynchronize(stream));
+    auto completed = std::chrono::high_resolution_clock::now();
+
+    const double launches = (double)calls * batch;
+    double enqueueUs = std::chrono::duration<double, std::micro>(enqueued - start).count();
+    double completeUs = std::chrono::duration<double, std::micro>(completed - start).count();
+    printf("\n %s, batch %4d: %.0f launches/s enqueued, %.0f launches/s completed\n", test,
+           batch, launches / (enqueueUs * 1e-6), launches / (completeUs * 1e-6));
+}
+
+int main() {
+    hipStream_t stream;
+    CHECK(hipStreamCreate(&stream));
+    hipModule_t module;
+    hipFunction_t function;
+    CHECK(hipModuleLoad(&module, FILE_NAME));
+    CHECK(hipModuleGetFunction(&function, module, KERNEL_NAME));
+
+    int* out = nullptr;
+    float f = 1.0f;
+    double d = 2.0;
+    char c = 'c';
+    void* params[] = {&out, &f, &d, &c};
+
+    measure("hipModuleLaunchKernel  ", 1, stream, [&]() {
+        CHECK(hipModuleLaunchKernel(function, 1, 1, 1, 1, 1, 1, 0, stream, params, nullptr));
+    });
+
+    for (int batch : {1, 8, 64, 512, 4096}) {
+        hipExtKernelLaunchParams launch{};
+        launch.function = function;
+        launch.gridDim = dim3(1);
+        launch.blockDim = dim3(1);
+        launch.kernelParams = params;
+        std::vector<hipExtKernelLaunchParams> launches(batch, launch);
+
+        measure("hipExtLaunchKernelBatch", batch, stream, [&]() {
+            CHECK(hipExtLaunchKernelBatch(launches.data(), launches.size(), stream));
+        });
+    }
+
+    CHECK(hipModuleUnload(module));
+    CHECK(hipStreamDestroy(stream));
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Launch rate of hipModuleLaunchKernel and hipLaunchKernelGGL together with the number of
+// heap allocations the runtime performs per launch. Allocations are counted by replacing the
+// global operator new, which also covers allocations made inside the HIP runtime library.
+
+#include "hip/hip_runtime.h"
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#define LAUNCH_COUNT 100000
+
+#define FILE_NAME "test_kernel.code"
+#define KERNEL_NAME "test_args"
+
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+__global__ void ArgsKernel(int* out, float f, double d, char c) { }
+
+template <typename F>
+void measure(const char* test, hipStream_t stream, F launch) {
+    // Warm up so one-time initialization is not counted
+    for (int i = 0; i < 100; ++i) {
+        launch();
+    }
+    hipStreamSynchronize(stream);
+
+    size_t allocations = g_allocations.load();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < LAUNCH_COUNT; ++i) {
+        launch();
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    allocations = g_allocations.load() - allocations;
+    hipStreamSynchronize(stream);
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf("\n %s: %.0f launches/s, %.2f allocations/launch\n", test,
+           LAUNCH_COUNT / (us * 1e-6), (double)allocations / LAUNCH_COUNT);
+}
+
+int main() {
+    hipStream_t stream;
+    hipStreamCreate(&stream);
+    hipModule_t module;
+    hipFunction_t function;
+    hipModuleLoad(&module, FILE_NAME);
+    hipModuleGetFunction(&function, module, KERNEL_NAME);
+
+    int* out = nullptr;
+    float f = 1.0f;
+    double d = 2.0;
+    char c = 'c';
+    void* params[] = {&out, &f, &d, &c};
+
+    struct {
+        int* out;
+        float f;
+        double d;
+        char c;
+    } args{out, f, d, c};
+    size_t argsSize = sizeof(args);
+    void* config[] = {HIP_LAUNCH_PARAM_BUFFER_POINTER, &args, HIP_LAUNCH_PARAM_BUFFER_SIZE,
+                      &argsSize, HIP_LAUNCH_PARAM_END};
+
+    measure("hipModuleLaunchKernel (kernelParams)", stream, [&]() {
+        hipModuleLaunchKernel(function, 1, 1, 1, 1, 1, 1, 0, stream, params, nullptr);
+    });
+    measure("hipModuleLaunchKernel (extra)", stream, [&]() {
+        hipModuleLaunchKernel(function, 1, 1, 1, 1, 1, 1, 0, stream, nullptr, config);
+    });
+    measure("hipLaunchKernelGGL", stream, [&]() {
+        hipLaunchKernelGGL(ArgsKernel, dim3(1), dim3(1), 0, stream, out, f, d, c);
+    });
+
+    hipModuleUnload(module);
+    hipStreamDestroy(stream);
+}
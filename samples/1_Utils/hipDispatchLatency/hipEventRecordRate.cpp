@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host throughput of the event calls a graph-style scheduler issues: creating and destroying
+// events, recording them, and making other streams wait on them. Each pass records an event on
+// every stream and makes the next stream wait on it, with and without timing.
+
+#include "hip/hip_runtime.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#define ITERATIONS 100000
+#define STREAMS 4
+
+#define CHECK(cmd)                                                                                 \
+    {                                                                                              \
+        hipError_t error = cmd;                                                                    \
+        if (error != hipSuccess) {                                                                 \
+            fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error), error,         \
+                    __FILE__, __LINE__);                                                           \
+            exit(EXIT_FAILURE);                                                                    \
+        }                                                                                          \
+    }
+
+__global__ void EmptyKernel() {}
+
+// Runs op ITERATIONS times and prints the rate of calls it makes.
+template <typename F>
+void measure(const char* test, int callsPerOp, F op) {
+    // Warm up so one-time initialization is not counted
+    for (int i = 0; i < 100; ++i) {
+        op(i);
+    }
+    CHECK(hipDeviceSynchronize());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        op(i);
+    }
+    auto enqueued = std::chrono::high_resolution_clock::now();
+    CHECK(hipDeviceSynchronize());
+
+    double us = std::chrono::duration<double, std::micro>(enqueued - start).count();
+    printf("\n %-36s: %.0f calls/s, %.3f us/call\n", test,
+           (double)ITERATIONS * callsPerOp / (us * 1e-6), us / ((double)ITERATIONS * callsPerOp));
+}
+
+void recordWait(const char* test, unsigned flags, bool launch) {
+    hipStream_t streams[STREAMS];
+    hipEvent_t events[STREAMS];
+    for (int i = 0; i < STREAMS; ++i) {
+        CHECK(hipStreamCreate(&streams[i]));
+        CHECK(hipEventCreateWithFlags(&events[i], flags));
+    }
+
+    measure(test, 2 * STREAMS, [&](int) {
+        for (int i = 0; i < STREAMS; ++i) {
+            if (launch) {
+                hipLaunchKernelGGL(EmptyKernel, dim3(1), dim3(1), 0, streams[i]);
+            }
+            CHECK(hipEventRecord(events[i], streams[i]));
+            CHECK(hipStreamWaitEvent(streams[(i + 1) % STREAMS], events[i], 0));
+        }
+    });
+
+    for (int i = 0; i < STREAMS; ++i) {
+        CHECK(hipEventDestroy(events[i]));
+        CHECK(hipStreamDestroy(streams[i]));
+    }
+}
+
+int main() {
+    measure("hipEventCreate/hipEventDestroy", 2, [](int) {
+        hipEvent_t event;
+        CHECK(hipEventCreate(&event));
+        CHECK(hipEventDestroy(event));
+    });
+
+    recordWait("record/wait", hipEventDefault, false);
+    recordWait("record/wait, timing disabled", hipEventDisableTiming, false);
+    recordWait("launch+record/wait", hipEventDefault, true);
+    recordWait("launch+record/wait, timing disabled", hipEventDisableTiming, true);
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Aggregate hipLaunchKernelGGL rate of 1, 2, 4, ... up to N threads, each launching a rotating set
+// of KERNEL_COUNT distinct kernels into its own stream. With the host function lookup serialized
+// on a global lock the aggregate rate stays flat as threads are added; otherwise it should scale
+// until the submission path itself saturates.
+//
+// Usage: hipLaunchRateMT.out [max_threads]
+
+#include <stdio.h>
+#include "hip/hip_runtime.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#define KERNEL_COUNT 16
+#define WARMUP_RUN_COUNT 10
+#define TIMING_RUN_COUNT 2000
+
+template <int n>
+__global__ void RateKernel() {}
+
+template <int n>
+void launch_all(hipStream_t stream) {
+    hipLaunchKernelGGL((RateKernel<n>), dim3(1), dim3(1), 0, stream);
+    launch_all<n - 1>(stream);
+}
+
+template <>
+void launch_all<-1>(hipStream_t) {}
+
+// Returns launches per second achieved by this thread once all threads are running.
+double launch_rate(std::atomic_int* shared, int max_threads) {
+    hipStream_t stream;
+    hipStreamCreate(&stream);
+
+    for (auto i = 0; i < WARMUP_RUN_COUNT; ++i) {
+        launch_all<KERNEL_COUNT - 1>(stream);
+    }
+    hipStreamSynchronize(stream);
+
+    //synchronize all threads, before running
+    shared->fetch_add(1, std::memory_order_release);
+    while (max_threads != shared->load(std::memory_order_acquire)) {}
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto i = 0; i < TIMING_RUN_COUNT; ++i) {
+        launch_all<KERNEL_COUNT - 1>(stream);
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    hipStreamSynchronize(stream);
+    hipStreamDestroy(stream);
+
+    double s = std::chrono::duration<double>(stop - start).count();
+    return (double(TIMING_RUN_COUNT) * KERNEL_COUNT) / s;
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = (argc > 1) ? atoi(argv[1]) : std::thread::hardware_concurrency();
+    if (max_threads < 1) {
+        fprintf(stderr, "Run test as 'hipLaunchRateMT <max_threads>'\n");
+        return -1;
+    }
+
+    // Create the context and resolve every kernel before the first timed run.
+    hipFree(nullptr);
+
+    printf("\n %8s %20s %20s\n", "threads", "launches/s", "launches/s/thread");
+    for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        std::atomic_int shared{0};
+        std::vector<std::future<double>> results;
+        for (int i = 0; i < threads; ++i) {
+            results.push_back(std::async(std::launch::async, launch_rate, &shared, threads));
+        }
+
+        double total = 0;
+        for (auto&& r : results) {
+            total += r.get();
+        }
+        printf(" %8d %20.0f %20.0f\n", threads, total, total / threads);
+
+        if (threads == max_threads) break;
+    }
+
+    return 0;
+}
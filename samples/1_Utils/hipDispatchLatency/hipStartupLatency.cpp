@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Startup cost of an application that links many HIP shared libraries. The same source builds
+// both the synthetic libraries (with -DSTARTUP_LIBRARY_ID=<i>, see the Makefile), each carrying
+// a fat binary with STARTUP_KERNEL_COUNT kernels, and the driver, which dlopen-s the first N of
+// them and reports the latency of the first kernel launch, of the first launch into the last
+// library, and of a warm launch.
+//
+// Usage: hipStartupLatency.out [N]
+
+#include "hip/hip_runtime.h"
+
+#define STARTUP_KERNEL_COUNT 64
+
+#if defined(STARTUP_LIBRARY_ID)
+
+#define STARTUP_CAT_(a, b) a##b
+#define STARTUP_CAT(a, b) STARTUP_CAT_(a, b)
+
+// Every library gets kernels of its own, rather than instances of one template that the dynamic
+// linker may resolve to the first library loaded.
+namespace STARTUP_CAT(startup_library_, STARTUP_LIBRARY_ID) {
+
+template <int n>
+__global__ void startup_kernel(int* out) {
+    out[0] = n + STARTUP_LIBRARY_ID;
+}
+
+template <int n>
+void launch_kernel(int k, int* out) {
+    if (k == n) {
+        hipLaunchKernelGGL(startup_kernel<n>, dim3(1), dim3(1), 0, 0, out);
+    } else {
+        launch_kernel<n - 1>(k, out);
+    }
+}
+
+template <>
+void launch_kernel<-1>(int, int*) {}
+
+}  // namespace
+
+extern "C" void hipStartupLaunch(int k, int* out) {
+    STARTUP_CAT(startup_library_, STARTUP_LIBRARY_ID)::launch_kernel<STARTUP_KERNEL_COUNT - 1>(k, out);
+}
+
+#else
+
+#include <dlfcn.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define LIBRARY_COUNT 32
+
+typedef void (*launch_t)(int, int*);
+
+template <typename F>
+double measure_us(F f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    const int n = (argc > 1) ? atoi(argv[1]) : LIBRARY_COUNT;
+
+    std::vector<launch_t> launches;
+    double dlopen_us = measure_us([&]() {
+        for (int i = 0; i < n; ++i) {
+            std::string lib = "./libhipStartupKernels" + std::to_string(i) + ".so";
+            void* h = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (!h) {
+                printf("failed to load %s: %s\n", lib.c_str(), dlerror());
+                exit(EXIT_FAILURE);
+            }
+            launches.push_back(reinterpret_cast<launch_t>(dlsym(h, "hipStartupLaunch")));
+        }
+    });
+    if (launches.empty()) return EXIT_FAILURE;
+
+    int* out = nullptr;
+    double init_us = measure_us([&]() { hipMalloc(&out, sizeof(int)); });
+
+    double first_us = measure_us([&]() {
+        launches.front()(0, out);
+        hipDeviceSynchronize();
+    });
+
+    double last_us = measure_us([&]() {
+        launches.back()(STARTUP_KERNEL_COUNT - 1, out);
+        hipDeviceSynchronize();
+    });
+
+    // The launch must have reached the last library's own kernel.
+    int last = -1;
+    hipMemcpy(&last, out, sizeof(int), hipMemcpyDeviceToHost);
+    if (last != STARTUP_KERNEL_COUNT - 1 + n - 1) {
+        printf("last library ran the wrong kernel: %d\n", last);
+        return EXIT_FAILURE;
+    }
+
+    double warm_us = measure_us([&]() {
+        launches.front()(0, out);
+        hipDeviceSynchronize();
+    });
+
+    printf("\n %d libraries x %d kernels\n", n, STARTUP_KERNEL_COUNT);
+    printf(" %-28s%10.0f us\n", "dlopen:", dlopen_us);
+    printf(" %-28s%10.0f us\n", "runtime init (hipMalloc):", init_us);
+    printf(" %-28s%10.0f us\n", "first launch:", first_us);
+    printf(" %-28s%10.0f us\n", "first launch, last library:", last_us);
+    printf(" %-28s%10.0f us\n", "warm launch:", warm_us);
+
+    hipFree(out);
+    return 0;
+}
+
+#endif
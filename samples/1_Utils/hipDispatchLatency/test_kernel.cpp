@@ -22,3 +22,6 @@ THE SOFTWARE.
 extern "C" __global__ void test() {
 }
 
+
+extern "C" __global__ void test_args(int* out, float f, double d, char c) {
+}
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2020-present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host throughput of converting float tensors to half and bfloat16 with the bulk
+// hipExtConvert* routines, against converting one value at a time. Usage:
+//   hipHostConvert [MB of floats, default 256]
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
+#include "hip/hip_bfloat16.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define CHECK(cmd)                                                                                 \
+    {                                                                                              \
+        hipError_t error = cmd;                                                                    \
+        if (error != hipSuccess) {                                                                 \
+            fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error), error,         \
+                    __FILE__, __LINE__);                                                           \
+            exit(EXIT_FAILURE);                                                                    \
+        }                                                                                          \
+    }
+
+// The runtime's scalar float to half conversion
+extern "C" unsigned short __gnu_f2h_ieee(float f);
+extern "C" float __gnu_h2f_ieee(unsigned short h);
+
+// Best of a few runs, in GB/s of floats read or written
+template <typename F>
+double measure(size_t count, F convert) {
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::high_resolution_clock::now();
+        convert();
+        auto stop = std::chrono::high_resolution_clock::now();
+        double s = std::chrono::duration<double>(stop - start).count();
+        best = std::max(best, count * sizeof(float) / s / 1e9);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    const size_t mb = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 256;
+    const size_t count = mb * 1024 * 1024 / sizeof(float);
+
+    std::vector<float> src(count), back(count);
+    std::vector<uint16_t> bulk(count), scalar(count);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal(0.0f, 100.0f);
+    for (auto& f : src) {
+        f = normal(rng);
+    }
+
+    printf("%zu MB of floats\n", mb);
+    printf("%-24s %12s %12s\n", "", "scalar GB/s", "bulk GB/s");
+
+    double s = measure(count, [&]() {
+        for (size_t i = 0; i < count; ++i) scalar[i] = __gnu_f2h_ieee(src[i]);
+    });
+    double b = measure(count, [&]() {
+        CHECK(hipExtConvertFloatToHalf(bulk.data(), src.data(), count));
+    });
+    if (memcmp(bulk.data(), scalar.data(), count * sizeof(uint16_t)) != 0) {
+        fprintf(stderr, "error: float to half results differ\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-24s %12.2f %12.2f\n", "float -> half", s, b);
+
+    s = measure(count, [&]() {
+        for (size_t i = 0; i < count; ++i) back[i] = __gnu_h2f_ieee(bulk[i]);
+    });
+    b = measure(count, [&]() {
+        CHECK(hipExtConvertHalfToFloat(back.data(), bulk.data(), count));
+    });
+    printf("%-24s %12.2f %12.2f\n", "half -> float", s, b);
+
+    s = measure(count, [&]() {
+        for (size_t i = 0; i < count; ++i) scalar[i] = hip_bfloat16(src[i]).data;
+    });
+    b = measure(count, [&]() {
+        CHECK(hipExtConvertFloatToBfloat16(bulk.data(), src.data(), count));
+    });
+    if (memcmp(bulk.data(), scalar.data(), count * sizeof(uint16_t)) != 0) {
+        fprintf(stderr, "error: float to bfloat16 results differ\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-24s %12.2f %12.2f\n", "float -> bfloat16", s, b);
+
+    s = measure(count, [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            hip_bfloat16 h;
+            h.data = bulk[i];
+            back[i] = float(h);
+        }
+    });
+    b = measure(count, [&]() {
+        CHECK(hipExtConvertBfloat16ToFloat(back.data(), bulk.data(), count));
+    });
+    printf("%-24s %12.2f %12.2f\n", "bfloat16 -> float", s, b);
+
+    s = measure(count, [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            scalar[i] = hip_bfloat16::round_to_bfloat16(src[i], hip_bfloat16::truncate).data;
+        }
+    });
+    b = measure(count, [&]() {
+        CHECK(hipExtConvertFloatToBfloat16(bulk.data(), src.data(), count, hipExtRoundTowardZero));
+    });
+    if (memcmp(bulk.data(), scalar.data(), count * sizeof(uint16_t)) != 0) {
+        fprintf(stderr, "error: truncating float to bfloat16 results differ\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-24s %12.2f %12.2f\n", "float -> bfloat16 (rz)", s, b);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Prints the occupancy of every kernel of code objects or offload bundles, as
+// computed by the HIP runtime, without a GPU: the blocks per CU at a few block
+// sizes, and the block and grid sizes hipOccupancyMaxPotentialBlockSize would
+// suggest.
+
+#include "occupancy.inl"
+#include "kernel_descriptor.inl"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace hip_impl;
+
+static void usage() {
+    printf("Usage: hipOccupancy [options] <code object or offload bundle>...\n"
+           "  --cus N          compute units of the device (default 60)\n"
+           "  --lds BYTES      LDS per compute unit (default 65536)\n"
+           "  --sgprs N        SGPRs per SIMD (default 800, 512 before gfx8)\n"
+           "  --wave N         wavefront size (default 64)\n"
+           "  --dyn-lds BYTES  dynamic LDS per block (default 0)\n"
+           "  --block N        block size to report, may be repeated\n"
+           "                   (default 64 128 256 512 1024)\n");
+}
+
+static void printTable(const Elf_image& image, const Occupancy_limits& limits,
+                       const std::vector<int>& blocks, size_t dynLds) {
+    printf("%-40s %5s %5s %6s |", "kernel", "VGPRs", "SGPRs", "LDS");
+    for (int b : blocks) printf(" %5d", b);
+    printf(" | %5s %6s\n", "block", "grid");
+
+    bool found = false;
+    for_each_kernel_descriptor(image, [&](const std::string& name, const Kernel_resources& k) {
+        found = true;
+        printf("%-40s %5zu %5zu %6zu |", name.c_str(), k.vgprs, k.sgprs, k.lds);
+        for (int b : blocks) printf(" %5d", max_active_blocks_per_cu(limits, k, b, dynLds));
+        int gridSize = 0, blockSize = 0;
+        max_potential_block_size(limits, k, dynLds, 0, &gridSize, &blockSize);
+        printf(" | %5d %6d\n", blockSize, gridSize);
+    });
+    if (!found) printf("(no kernels)\n");
+}
+
+int main(int argc, char* argv[]) {
+    Occupancy_limits limits;
+    limits.cu_count = 60;
+    size_t dynLds = 0;
+    std::vector<int> blocks;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--cus") == 0 && hasValue) {
+            limits.cu_count = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(arg, "--lds") == 0 && hasValue) {
+            limits.lds_per_cu = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(arg, "--sgprs") == 0 && hasValue) {
+            limits.sgprs_per_simd = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(arg, "--wave") == 0 && hasValue) {
+            limits.wavefront_size = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(arg, "--dyn-lds") == 0 && hasValue) {
+            dynLds = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(arg, "--block") == 0 && hasValue) {
+            blocks.push_back(atoi(argv[++i]));
+        } else if (strcmp(arg, "--help") == 0 || arg[0] == '-') {
+            usage();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty() || limits.wavefront_size == 0) {
+        usage();
+        return 1;
+    }
+    if (blocks.empty()) blocks = {64, 128, 256, 512, 1024};
+    // Registers per SIMD of 64 KiB, whatever the wavefront size
+    limits.vgprs_per_simd = 64 * 1024 / limits.wavefront_size / limits.simds_per_cu;
+
+    int status = 0;
+    for (const char* path : files) {
+        const Mapped_file file{path};
+        const bool ok = file && for_each_code_object(
+            Blob_view{file.data(), file.size()},
+            [&](const std::string& triple, const Elf_image& image) {
+                printf("%s%s%s\n", path, triple.empty() ? "" : ": ", triple.c_str());
+                printTable(image, limits, blocks, dynLds);
+                printf("\n");
+            });
+        if (!ok) {
+            fprintf(stderr, "error: %s is not a code object or an offload bundle\n", path);
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Converts a binary API trace, written by the HIP runtime when HIP_TRACE_FILE
+// is set, to the Chrome trace event JSON that about://tracing and
+// https://ui.perfetto.dev load.
+
+#include "api_trace.inl"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace hip_impl;
+
+static void usage() {
+    printf("Usage: hipTraceConvert <trace file> [-o <json file>]\n"
+           "  Writes the JSON to stdout unless -o is given.\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* input = nullptr;
+    const char* output = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(arg, "--help") == 0 || arg[0] == '-' || input) {
+            usage();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        } else {
+            input = arg;
+        }
+    }
+    if (!input) {
+        usage();
+        return 1;
+    }
+
+    std::ifstream in{input, std::ios::binary};
+    if (!in) {
+        fprintf(stderr, "error: cannot open %s\n", input);
+        return 1;
+    }
+    const std::vector<char> data{std::istreambuf_iterator<char>{in},
+                                 std::istreambuf_iterator<char>{}};
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "error: cannot open %s\n", output);
+        return 1;
+    }
+
+    const bool ok = write_chrome_trace(data.data(), data.size(), out);
+    if (output) fclose(out);
+    if (!ok) {
+        fprintf(stderr, "error: %s is not a HIP API trace\n", input);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,590 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Binary API trace: every traced call becomes one fixed-size record, pushed
+// into a ring owned by the calling thread. A background thread drains the
+// rings into a file, so the calling threads neither format strings nor take
+// locks. A full ring drops records rather than stall the application; the
+// number of dropped records is written to the file.
+//
+// The file starts with an Api_trace_file_header, followed by chunks, each an
+// Api_trace_chunk header and its payload:
+//   - names:   u32 id of the first name, then NUL-terminated API names;
+//   - records: Api_trace_record[];
+//   - lost:    u32 tid, u32 reserved, u64 records dropped since the last one.
+// write_chrome_trace converts a file to the JSON about://tracing and Perfetto
+// read.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace hip_impl {
+
+namespace api_trace {
+    constexpr char magic[8]{'H', 'I', 'P', 'T', 'R', 'A', 'C', 'E'};
+    constexpr std::uint32_t version{1};
+
+    constexpr std::uint32_t chunk_names{1};
+    constexpr std::uint32_t chunk_records{2};
+    constexpr std::uint32_t chunk_lost{3};
+
+    constexpr std::size_t arg_count{3};
+}  // namespace api_trace
+
+struct Api_trace_file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t ticks_per_second;
+    std::uint32_t pid;
+    std::uint32_t reserved;
+};
+
+struct Api_trace_chunk {
+    std::uint32_t kind;
+    std::uint32_t size;  // of the payload, in bytes
+};
+
+struct Api_trace_record {
+    std::uint32_t api;  // id of the name of the API
+    std::uint32_t tid;
+    std::uint64_t seq;
+    std::uint64_t begin;  // ticks
+    std::uint64_t end;
+    std::int32_t status;
+    std::uint32_t reserved;
+    std::uint64_t args[api_trace::arg_count];
+};
+static_assert(sizeof(Api_trace_record) == 64, "trace records must stay one cache line");
+
+// What is known of a call when it begins.
+struct Api_trace_args {
+    std::uint32_t api;
+    std::uint64_t seq;
+    std::uint64_t args[api_trace::arg_count];
+};
+
+// Arguments are packed into 64 bits: integers and enumerations by value,
+// floating-point values by their bits as a double, pointers by address, and
+// anything else as 0.
+template<typename T>
+inline
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value,
+                        std::uint64_t>::type
+trace_arg(const T& x)
+{
+    return static_cast<std::uint64_t>(x);
+}
+
+template<typename T>
+inline
+typename std::enable_if<std::is_floating_point<T>::value, std::uint64_t>::type
+trace_arg(const T& x)
+{
+    const double d = x;
+    std::uint64_t r;
+    std::memcpy(&r, &d, sizeof(r));
+    return r;
+}
+
+template<typename T>
+inline
+typename std::enable_if<std::is_pointer<T>::value, std::uint64_t>::type
+trace_arg(const T& x)
+{
+    return reinterpret_cast<std::uintptr_t>(x);
+}
+
+template<typename T>
+inline
+typename std::enable_if<std::is_array<T>::value, std::uint64_t>::type
+trace_arg(const T& x)
+{
+    return reinterpret_cast<std::uintptr_t>(&x[0]);
+}
+
+template<typename T>
+inline
+typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_enum<T>::value &&
+                            !std::is_pointer<T>::value && !std::is_array<T>::value,
+                        std::uint64_t>::type
+trace_arg(const T&)
+{
+    return 0;
+}
+
+inline
+void pack_trace_args(std::uint64_t*, std::size_t) {}
+
+template<typename T, typename... Ts>
+inline
+void pack_trace_args(std::uint64_t* out, std::size_t n, const T& x, const Ts&... xs)
+{
+    if (n == 0) return;
+
+    *out = trace_arg(x);
+    pack_trace_args(out + 1, n - 1, xs...);
+}
+
+// Packs the first api_trace::arg_count arguments of a call.
+template<typename... Ts>
+inline
+Api_trace_args make_api_trace_args(const Ts&... xs)
+{
+    Api_trace_args r{};
+    pack_trace_args(r.args, api_trace::arg_count, xs...);
+
+    return r;
+}
+
+// Single producer, single consumer ring of records: the producer is the thread
+// that owns it, the consumer the thread flushing the trace.
+class Api_trace_ring {
+    // head_ and tail_ are kept on separate cache lines.
+    std::vector<Api_trace_record> records_;
+    char pad0_[64];
+    std::atomic<std::uint64_t> head_{0};
+    char pad1_[64];
+    std::atomic<std::uint64_t> tail_{0};
+    char pad2_[64];
+    std::atomic<std::uint64_t> lost_{0};
+    std::uint64_t lost_reported_{0};  // by the consumer
+    std::atomic<bool> retired_{false};
+    std::atomic<std::uint32_t> tid_{0};
+public:
+    // capacity must be a power of two.
+    explicit
+    Api_trace_ring(std::size_t capacity) : records_(capacity) {}
+
+    std::size_t capacity() const { return records_.size(); }
+    std::uint32_t tid() const { return tid_.load(std::memory_order_relaxed); }
+    bool retired() const { return retired_.load(std::memory_order_acquire); }
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+    // A ring is adopted by a thread, with the registry of the trace locked,
+    // and retired when the thread exits or moves on to another trace.
+    void adopt(std::uint32_t tid)
+    {
+        tid_.store(tid, std::memory_order_relaxed);
+        retired_.store(false, std::memory_order_release);
+    }
+    void retire() { retired_.store(true, std::memory_order_release); }
+
+    // Returns the number of records in the ring after the push, or 0 if the
+    // ring was full and the record was dropped.
+    std::size_t push(const Api_trace_record& r)
+    {
+        const auto head = head_.load(std::memory_order_relaxed);
+        const auto tail = tail_.load(std::memory_order_acquire);
+        if (head - tail == records_.size()) {
+            lost_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        records_[head & (records_.size() - 1)] = r;
+        head_.store(head + 1, std::memory_order_release);
+
+        return head + 1 - tail;
+    }
+
+    // Invokes fn(const Api_trace_record*, std::size_t) for the contiguous
+    // spans of records pushed so far, then releases them to the producer.
+    template<typename F>
+    std::size_t drain(F fn)
+    {
+        const auto head = head_.load(std::memory_order_acquire);
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        const std::size_t mask = records_.size() - 1;
+
+        for (auto i = tail; i != head;) {
+            const std::size_t first = i & mask;
+            const std::size_t n = std::min<std::uint64_t>(head - i, records_.size() - first);
+            fn(&records_[first], n);
+            i += n;
+        }
+        tail_.store(head, std::memory_order_release);
+
+        return head - tail;
+    }
+
+    // Records dropped since the last call; consumer only.
+    std::uint64_t take_lost()
+    {
+        const auto lost = lost_.load(std::memory_order_relaxed);
+        const auto r = lost - lost_reported_;
+        lost_reported_ = lost;
+
+        return r;
+    }
+};
+
+// The ring of the calling thread, and the trace it belongs to.
+struct Api_trace_thread {
+    std::uint64_t trace{0};
+    std::shared_ptr<Api_trace_ring> ring;
+
+    ~Api_trace_thread() { if (ring) ring->retire(); }
+};
+
+inline
+Api_trace_thread& api_trace_thread()
+{
+    static thread_local Api_trace_thread r;
+
+    return r;
+}
+
+class Api_trace_writer {
+    std::FILE* out_;
+    std::size_t ring_records_;
+    std::chrono::milliseconds period_;
+    std::uint64_t id_;
+
+    std::mutex registry_mutex_;
+    std::vector<std::shared_ptr<Api_trace_ring>> rings_;
+    std::vector<std::string> names_;
+
+    // Held while draining: by the flusher, by flush() and by close().
+    std::mutex drain_mutex_;
+    std::size_t names_written_{0};
+    std::uint64_t lost_{0};
+    bool closed_{false};
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stop_{false};
+    std::thread flusher_;
+
+    static
+    std::uint64_t next_id()
+    {
+        static std::atomic<std::uint64_t> r{1};
+
+        return r.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void write_chunk(std::uint32_t kind, const void* p, std::size_t size)
+    {
+        const Api_trace_chunk c{kind, static_cast<std::uint32_t>(size)};
+        std::fwrite(&c, sizeof(c), 1, out_);
+        std::fwrite(p, 1, size, out_);
+    }
+
+    std::shared_ptr<Api_trace_ring> acquire_ring(std::uint32_t tid)
+    {
+        std::lock_guard<std::mutex> lck{registry_mutex_};
+
+        // Rings of exited threads are reused once the flusher has emptied
+        // them, so thread churn does not grow the trace.
+        for (auto&& x : rings_) {
+            if (x->retired() && x->empty()) {
+                x->adopt(tid);
+                return x;
+            }
+        }
+
+        rings_.push_back(std::make_shared<Api_trace_ring>(ring_records_));
+        rings_.back()->adopt(tid);
+
+        return rings_.back();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lck{wake_mutex_};
+        while (!stop_) {
+            wake_.wait_for(lck, period_);
+            lck.unlock();
+            flush();
+            lck.lock();
+        }
+    }
+public:
+    // Writes the trace to out, which the caller closes after close(). Each
+    // thread buffers up to ring_records records, rounded up to a power of
+    // two; the rings are drained every period, or sooner once one is half
+    // full. A period of zero starts no flusher: records are written by
+    // flush() and close() only.
+    Api_trace_writer(std::FILE* out, std::uint64_t ticks_per_second, std::uint32_t pid,
+                     std::size_t ring_records = 8192,
+                     std::chrono::milliseconds period = std::chrono::milliseconds{100})
+        : out_{out}, ring_records_{2}, period_{period}, id_{next_id()}
+    {
+        while (ring_records_ < ring_records) ring_records_ *= 2;
+
+        Api_trace_file_header h{};
+        std::memcpy(h.magic, api_trace::magic, sizeof(h.magic));
+        h.version = api_trace::version;
+        h.record_size = sizeof(Api_trace_record);
+        h.ticks_per_second = ticks_per_second;
+        h.pid = pid;
+        std::fwrite(&h, sizeof(h), 1, out_);
+
+        if (period_.count() != 0) flusher_ = std::thread{&Api_trace_writer::run, this};
+    }
+
+    Api_trace_writer(const Api_trace_writer&) = delete;
+    Api_trace_writer& operator=(const Api_trace_writer&) = delete;
+
+    ~Api_trace_writer() { close(); }
+
+    // Returns the id records of the API called name refer to. Call once per
+    // API and keep the id: this takes a lock.
+    std::uint32_t name_id(const char* name)
+    {
+        std::lock_guard<std::mutex> lck{registry_mutex_};
+
+        const auto it = std::find(names_.cbegin(), names_.cend(), name);
+        if (it != names_.cend()) return it - names_.cbegin();
+
+        names_.emplace_back(name);
+
+        return names_.size() - 1;
+    }
+
+    void record(std::uint32_t tid, const Api_trace_args& a, std::uint64_t begin,
+                std::uint64_t end, std::int32_t status)
+    {
+        auto& t = api_trace_thread();
+        if (t.trace != id_) {
+            if (t.ring) t.ring->retire();
+            t.ring = acquire_ring(tid);
+            t.trace = id_;
+        }
+
+        Api_trace_record r;
+        r.api = a.api;
+        r.tid = tid;
+        r.seq = a.seq;
+        r.begin = begin;
+        r.end = end;
+        r.status = status;
+        r.reserved = 0;
+        std::copy_n(a.args, api_trace::arg_count, r.args);
+
+        if (t.ring->push(r) == ring_records_ / 2) wake_.notify_one();
+    }
+
+    // Writes the records buffered so far.
+    void flush()
+    {
+        std::lock_guard<std::mutex> lck{drain_mutex_};
+        if (closed_) return;
+
+        std::vector<std::shared_ptr<Api_trace_ring>> rings;
+        std::string names;
+        std::uint32_t first_name = names_written_;
+        {
+            std::lock_guard<std::mutex> registry{registry_mutex_};
+            rings = rings_;
+            names.append(reinterpret_cast<const char*>(&first_name), sizeof(first_name));
+            for (; names_written_ != names_.size(); ++names_written_) {
+                names.append(names_[names_written_].c_str(), names_[names_written_].size() + 1);
+            }
+        }
+        if (names.size() > sizeof(first_name)) {
+            write_chunk(api_trace::chunk_names, names.data(), names.size());
+        }
+
+        // Chunks hold up to 4 GiB; cap them well below that.
+        static constexpr std::size_t max_chunk_records{1u << 16};
+        for (auto&& x : rings) {
+            x->drain([&](const Api_trace_record* p, std::size_t n) {
+                for (std::size_t i = 0; i < n; i += max_chunk_records) {
+                    const std::size_t m = std::min(n - i, max_chunk_records);
+                    write_chunk(api_trace::chunk_records, p + i, m * sizeof(Api_trace_record));
+                }
+            });
+
+            const auto lost = x->take_lost();
+            if (lost == 0) continue;
+
+            lost_ += lost;
+            struct { std::uint32_t tid; std::uint32_t reserved; std::uint64_t count; }
+                payload{x->tid(), 0, lost};
+            write_chunk(api_trace::chunk_lost, &payload, sizeof(payload));
+        }
+
+        std::fflush(out_);
+    }
+
+    // Stops the flusher and writes the records buffered so far. Records of
+    // later calls are dropped.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lck{wake_mutex_};
+            if (stop_) return;
+            stop_ = true;
+        }
+        wake_.notify_one();
+        if (flusher_.joinable()) flusher_.join();
+
+        flush();
+        std::lock_guard<std::mutex> lck{drain_mutex_};
+        closed_ = true;
+    }
+
+    // Records dropped because a ring was full, as of the last flush.
+    std::uint64_t lost()
+    {
+        std::lock_guard<std::mutex> lck{drain_mutex_};
+
+        return lost_;
+    }
+};
+
+// Writes the API trace in data as Chrome trace event JSON, with one complete
+// event per call and an instant event wherever records were dropped. Returns
+// false if data is not an API trace; a truncated trace is converted up to the
+// last complete chunk.
+inline
+bool write_chrome_trace(const char* data, std::size_t size, std::FILE* out)
+{
+    Api_trace_file_header h;
+    if (size < sizeof(h)) return false;
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, api_trace::magic, sizeof(h.magic)) != 0 ||
+        h.version != api_trace::version || h.record_size != sizeof(Api_trace_record) ||
+        h.ticks_per_second == 0) return false;
+
+    // Names may follow the first records that use them, so they are all
+    // read before anything is written.
+    std::vector<std::string> names;
+    std::vector<std::pair<const char*, Api_trace_chunk>> chunks;
+    for (std::size_t dx = sizeof(h); size - dx >= sizeof(Api_trace_chunk);) {
+        Api_trace_chunk c;
+        std::memcpy(&c, data + dx, sizeof(c));
+        dx += sizeof(c);
+        if (size - dx < c.size) break;
+
+        const char* p = data + dx;
+        dx += c.size;
+        if (c.kind != api_trace::chunk_names) {
+            chunks.emplace_back(p, c);
+            continue;
+        }
+        if (c.size < sizeof(std::uint32_t)) continue;
+
+        std::uint32_t id;
+        std::memcpy(&id, p, sizeof(id));
+        const char* const last = p + c.size;
+        for (p += sizeof(id); p != last; ++id) {
+            const char* const nul = std::find(p, last, '\0');
+            if (names.size() <= id) names.resize(id + 1);
+            names[id].assign(p, nul);
+            p = nul == last ? last : nul + 1;
+        }
+    }
+
+    // Microseconds with three decimals, as integers so that absolute
+    // timestamps keep nanosecond precision.
+    const auto us = [&](std::uint64_t ticks) {
+        const std::uint64_t f = h.ticks_per_second;
+        const std::uint64_t ns = ticks / f * 1000000000u + ticks % f * 1000000000u / f;
+        char s[32];
+        std::snprintf(s, sizeof(s), "%llu.%03llu",
+                      static_cast<unsigned long long>(ns / 1000),
+                      static_cast<unsigned long long>(ns % 1000));
+        return std::string{s};
+    };
+    const auto name = [&](std::uint32_t id) {
+        std::string r;
+        if (id >= names.size() || names[id].empty()) return "api#" + std::to_string(id);
+        for (char c : names[id]) {
+            if (c == '"' || c == '\\') r += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) r += c;
+        }
+        return r;
+    };
+
+    std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    std::fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+                      "\"args\":{\"name\":\"HIP API\"}}", h.pid);
+
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> last_end;  // by tid
+    for (auto&& x : chunks) {
+        if (x.second.kind == api_trace::chunk_records) {
+            for (std::size_t i = 0; i + sizeof(Api_trace_record) <= x.second.size;
+                 i += sizeof(Api_trace_record)) {
+                Api_trace_record r;
+                std::memcpy(&r, x.first + i, sizeof(r));
+
+                const std::uint64_t dur = r.end >= r.begin ? r.end - r.begin : 0;
+                std::fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"hip_api\",\"ph\":\"X\","
+                                  "\"pid\":%u,\"tid\":%u,\"ts\":%s,\"dur\":%s,"
+                                  "\"args\":{\"seq\":%llu,\"status\":%d,\"args\":[",
+                             name(r.api).c_str(), h.pid, r.tid, us(r.begin).c_str(),
+                             us(dur).c_str(), static_cast<unsigned long long>(r.seq),
+                             r.status);
+                for (std::size_t j = 0; j != api_trace::arg_count; ++j) {
+                    std::fprintf(out, "%s\"0x%llx\"", j ? "," : "",
+                                 static_cast<unsigned long long>(r.args[j]));
+                }
+                std::fprintf(out, "]}}");
+
+                const auto it = std::find_if(last_end.begin(), last_end.end(),
+                    [&](const std::pair<std::uint32_t, std::uint64_t>& y) {
+                        return y.first == r.tid;
+                    });
+                if (it == last_end.end()) last_end.emplace_back(r.tid, r.end);
+                else it->second = std::max(it->second, r.end);
+            }
+        } else if (x.second.kind == api_trace::chunk_lost && x.second.size >= 16) {
+            std::uint32_t tid;
+            std::uint64_t count;
+            std::memcpy(&tid, x.first, sizeof(tid));
+            std::memcpy(&count, x.first + 8, sizeof(count));
+
+            // The records were dropped at some point after the last one of
+            // the thread that made it to the file.
+            std::uint64_t ts = 0;
+            for (auto&& y : last_end) if (y.first == tid) ts = y.second;
+            std::fprintf(out, ",\n{\"name\":\"%llu records lost\",\"cat\":\"hip_api\","
+                              "\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%u,\"ts\":%s}",
+                         static_cast<unsigned long long>(count), h.pid, tid, us(ts).c_str());
+        }
+    }
+    std::fprintf(out, "\n]}\n");
+
+    return true;
+}
+
+}  // namespace hip_impl
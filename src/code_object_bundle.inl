@@ -200,4 +200,42 @@ Bundled_code_header::Bundled_code_header(RandomAccessIterator f, RandomAccessIte
     : Bundled_code_header{} {
     read(f, l, *this);
 }
+
+// Invokes fn(const std::string& triple, const char* code, std::size_t size) for
+// every code object held in the sequence of offload bundles in [f, l). Unlike
+// Bundled_code_header, the code objects are not copied; code points into
+// [f, l). Iteration stops at the first malformed or truncated bundle.
+template <typename F>
+inline void for_each_bundled_code(const char* f, const char* l, F fn) {
+    static constexpr auto magic_string_sz = sizeof(magic_string_) - 1;
+
+    while (static_cast<std::size_t>(l - f) >= magic_string_sz + sizeof(std::uint64_t) &&
+           std::equal(f, f + magic_string_sz, magic_string_)) {
+        std::uint64_t bundle_cnt{};
+        std::copy_n(f + magic_string_sz, sizeof(bundle_cnt),
+                    reinterpret_cast<char*>(&bundle_cnt));
+
+        const std::size_t sz = l - f;
+        auto it = f + magic_string_sz + sizeof(bundle_cnt);
+        std::uint64_t bundled_code_size{0};
+        while (bundle_cnt--) {
+            Bundled_code::Header h;
+            if (static_cast<std::size_t>(l - it) < sizeof(h.cbuf)) return;
+            std::copy_n(it, sizeof(h.cbuf), h.cbuf);
+            it += sizeof(h.cbuf);
+
+            if (static_cast<std::size_t>(l - it) < h.triple_sz) return;
+            const std::string triple(it, it + h.triple_sz);
+            it += h.triple_sz;
+
+            if (h.offset > sz || h.bundle_sz > sz - h.offset) return;
+            if (h.bundle_sz) fn(triple, f + h.offset, h.bundle_sz);
+
+            bundled_code_size = std::max(bundled_code_size, h.offset + h.bundle_sz);
+        }
+
+        if (bundled_code_size == 0) return;
+        f += bundled_code_size;
+    }
+}
 }  // Namespace hip_impl.
@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Fan-out of code object loading across agents and code objects. This is
+// independent of HSA: the reader / executable types and the calls that create
+// and load them are template parameters, which lets the scheduling be tested
+// against a stubbed loader.
+
+#include "mapped_elf.inl"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+// A fixed set of threads that run the tasks posted to them, in order.
+class Worker_pool {
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_{false};
+    std::vector<std::thread> threads_;
+
+    void run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lck{mutex_};
+                ready_.wait(lck, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+public:
+    explicit
+    Worker_pool(std::size_t thread_cnt)
+    {
+        for (auto i = 0u; i != thread_cnt; ++i) {
+            threads_.emplace_back(&Worker_pool::run, this);
+        }
+    }
+
+    Worker_pool(const Worker_pool&) = delete;
+    Worker_pool& operator=(const Worker_pool&) = delete;
+
+    // Runs the tasks already posted, then stops the threads.
+    ~Worker_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            stop_ = true;
+        }
+        ready_.notify_all();
+
+        for (auto&& x : threads_) x.join();
+    }
+
+    std::size_t size() const noexcept { return threads_.size(); }
+
+    void post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            tasks_.push_back(std::move(task));
+        }
+        ready_.notify_one();
+    }
+};
+
+// The pool code objects are loaded on: together with the thread that asks for
+// them, at most 16 threads, and no more than there are hardware threads. It
+// is created on first use and never destroyed, so that loads may still be
+// requested during static destruction.
+inline
+Worker_pool& code_object_load_pool() {
+    static Worker_pool* r{new Worker_pool{std::min<std::size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), 16u) - 1}};
+
+    return *r;
+}
+
+// Runs fn(i) for every i in [0, n) on the calling thread and on the threads of
+// pool, and returns once all have completed. The first exception thrown by fn
+// is rethrown in the calling thread; the remaining indices are skipped.
+//
+// The calling thread never waits for a pool thread to pick work up, only for
+// the calls already under way to end, so fn may itself call parallel_for on
+// the same pool.
+template<typename F>
+inline
+void parallel_for(Worker_pool& pool, std::size_t n, F fn) {
+    if (n == 0) return;
+
+    // Shared with the pool threads, some of which may only get to it after
+    // every index has been handed out, and the call has returned.
+    struct State {
+        std::size_t n;
+        F fn;
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> done{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable all_done;
+
+        State(std::size_t cnt, F f) : n{cnt}, fn(std::move(f)) {}
+    };
+    const auto state = std::make_shared<State>(n, std::move(fn));
+
+    const auto work = [](State& s) {
+        for (auto i = s.next++; i < s.n; i = s.next++) {
+            if (!s.failed) {
+                #if defined(__cpp_exceptions)
+                    try {
+                        s.fn(i);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lck{s.mutex};
+                        if (!s.error) s.error = std::current_exception();
+                        s.failed = true;
+                    }
+                #else
+                    s.fn(i);
+                #endif
+            }
+
+            if (++s.done == s.n) {
+                std::lock_guard<std::mutex> lck{s.mutex};
+                s.all_done.notify_all();
+            }
+        }
+    };
+
+    for (auto i = std::min(n - 1, pool.size()); i != 0; --i) {
+        pool.post([=]() { work(*state); });
+    }
+
+    work(*state);
+
+    std::unique_lock<std::mutex> lck{state->mutex};
+    state->all_done.wait(lck, [&]() { return state->done == n; });
+
+    if (state->error) std::rethrow_exception(state->error);
+}
+
+// A code object together with the reader that is created for it on first use
+// and then shared by every agent that loads it.
+template<typename Reader>
+struct Shared_code_object {
+    Blob_view blob;
+    std::once_flag reader_created;
+    Reader reader{};
+
+    explicit
+    Shared_code_object(Blob_view b) : blob{b} {}
+};
+
+// Loads every (agent, code object) pair of work on pool. create_reader(const
+// Blob_view&) -> Reader is invoked once per code object, load(Agent, Reader,
+// const Blob_view&) -> Executable once per pair. The result holds, for each
+// entry of work and in the same order, the executables in the order of its
+// code objects.
+template<
+    typename Agent,
+    typename Reader,
+    typename Executable,
+    typename Create_reader,
+    typename Load>
+inline
+std::vector<std::vector<Executable>> load_executables(
+    const std::vector<
+        std::pair<Agent, std::vector<Shared_code_object<Reader>*>>>& work,
+    Worker_pool& pool,
+    Create_reader create_reader,
+    Load load) {
+    std::vector<std::vector<Executable>> r(work.size());
+    std::vector<std::pair<std::size_t, std::size_t>> tasks;
+    for (auto i = 0u; i != work.size(); ++i) {
+        r[i].resize(work[i].second.size());
+        for (auto j = 0u; j != work[i].second.size(); ++j) tasks.emplace_back(i, j);
+    }
+
+    parallel_for(pool, tasks.size(), [&](std::size_t t) {
+        const auto i = tasks[t].first;
+        const auto j = tasks[t].second;
+        auto& code_object = *work[i].second[j];
+
+        std::call_once(code_object.reader_created, [&]() {
+            code_object.reader = create_reader(code_object.blob);
+        });
+
+        r[i][j] = load(work[i].first, code_object.reader, code_object.blob);
+    });
+
+    return r;
+}
+
+}  // namespace hip_impl
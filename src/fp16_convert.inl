@@ -0,0 +1,401 @@
+/*
+Copyright (c) 2018 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Conversion routines between float and the 16-bit half and bfloat16 formats, one value at a
+// time and in bulk. The bulk routines pick the widest instruction set the CPU supports at run
+// time and produce the same bits as the scalar ones, NaNs included.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HIP_CONVERT_X86 1
+#endif
+
+// conversion routines between float and half precision
+static inline std::uint32_t f32_as_u32(float f) { union { float f; std::uint32_t u; } v; v.f = f; return v.u; }
+static inline float u32_as_f32(std::uint32_t u) { union { float f; std::uint32_t u; } v; v.u = u; return v.f; }
+static inline int clamp_int(int i, int l, int h) { return std::min(std::max(i, l), h); }
+
+// half to float, the f16 is in the low 16 bits of the input argument a
+static inline float __convert_half_to_float(std::uint32_t a) noexcept {
+  std::uint32_t u = ((a << 13) + 0x70000000U) & 0x8fffe000U;
+  std::uint32_t v = f32_as_u32(u32_as_f32(u) * u32_as_f32(0x77800000U)/*0x1.0p+112f*/) + 0x38000000U;
+  u = (a & 0x7fff) != 0 ? v : u;
+  return u32_as_f32(u) * u32_as_f32(0x07800000U)/*0x1.0p-112f*/;
+}
+
+// float to half with nearest even rounding
+// The lower 16 bits of the result is the bit pattern for the f16
+static inline std::uint32_t __convert_float_to_half(float a) noexcept {
+  std::uint32_t u = f32_as_u32(a);
+  int e = static_cast<int>((u >> 23) & 0xff) - 127 + 15;
+  std::uint32_t m = ((u >> 11) & 0xffe) | ((u & 0xfff) != 0);
+  std::uint32_t i = 0x7c00 | (m != 0 ? 0x0200 : 0);
+  std::uint32_t n = ((std::uint32_t)e << 12) | m;
+  std::uint32_t s = (u >> 16) & 0x8000;
+  int b = clamp_int(1-e, 0, 13);
+  std::uint32_t d = (0x1000 | m) >> b;
+  d |= (d << b) != (0x1000 | m);
+  std::uint32_t v = e < 1 ? d : n;
+  v = (v >> 2) + (((v & 0x7) == 3) | ((v & 0x7) > 5));
+  v = e > 30 ? 0x7c00 : v;
+  v = e == 143 ? i : v;
+  return s | v;
+}
+
+// float to half rounding toward zero: finite values too large for a half become the largest
+// finite half, and NaNs become the same quiet NaN as with nearest even rounding
+static inline std::uint32_t __convert_float_to_half_rtz(float a) noexcept {
+  std::uint32_t u = f32_as_u32(a);
+  std::uint32_t s = (u >> 16) & 0x8000;
+  std::uint32_t au = u & 0x7fffffff;
+  if (au > 0x7f800000U) {
+    return s | 0x7e00;
+  }
+  if (au == 0x7f800000U) {
+    return s | 0x7c00;
+  }
+  int e = static_cast<int>(au >> 23) - 127 + 15;
+  if (e > 30) {
+    return s | 0x7bff;
+  }
+  if (e > 0) {
+    return s | ((std::uint32_t)e << 10) | ((au >> 13) & 0x3ff);
+  }
+  int b = 14 - e;
+  return s | (b < 32 ? ((au & 0x7fffff) | 0x800000) >> b : 0);
+}
+
+// float to bfloat16 with nearest even rounding, as hip_bfloat16::round_to_bfloat16
+static inline std::uint32_t __convert_float_to_bfloat16(float a) noexcept {
+  std::uint32_t u = f32_as_u32(a);
+  if (~u & 0x7f800000) {
+    u += 0x7fff + ((u >> 16) & 1);
+  } else if (u & 0xffff) {
+    u |= 0x10000;  // Preserve signaling NaN
+  }
+  return u >> 16;
+}
+
+// float to bfloat16 by truncation, preserving signaling NaN, as
+// hip_bfloat16::round_to_bfloat16(f, hip_bfloat16::truncate)
+static inline std::uint32_t __convert_float_to_bfloat16_rtz(float a) noexcept {
+  std::uint32_t u = f32_as_u32(a);
+  return (u >> 16) | (!(~u & 0x7f800000) && (u & 0xffff));
+}
+
+static inline float __convert_bfloat16_to_float(std::uint32_t a) noexcept {
+  return u32_as_f32(a << 16);
+}
+
+namespace hip_impl {
+
+// Instruction sets the bulk conversions are implemented with, in increasing order
+enum class ConvertIsa { Scalar, F16c, Avx2, Avx512 };
+
+static inline const char* convertIsaName(ConvertIsa isa) {
+  switch (isa) {
+    case ConvertIsa::F16c:   return "F16C";
+    case ConvertIsa::Avx2:   return "AVX2";
+    case ConvertIsa::Avx512: return "AVX-512";
+    default:                 return "scalar";
+  }
+}
+
+// Widest instruction set the CPU and OS support
+static inline ConvertIsa bestConvertIsa() {
+#ifdef HIP_CONVERT_X86
+  static const ConvertIsa isa = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return ConvertIsa::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+      return ConvertIsa::Avx2;
+    }
+    if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+      return ConvertIsa::F16c;
+    }
+    return ConvertIsa::Scalar;
+  }();
+  return isa;
+#else
+  return ConvertIsa::Scalar;
+#endif
+}
+
+static inline void floatToHalfScalar(std::uint16_t* dst, const float* src, size_t count,
+                                     bool truncate) {
+  if (truncate) {
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = (std::uint16_t)__convert_float_to_half_rtz(src[i]);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = (std::uint16_t)__convert_float_to_half(src[i]);
+    }
+  }
+}
+
+static inline void halfToFloatScalar(float* dst, const std::uint16_t* src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = __convert_half_to_float(src[i]);
+  }
+}
+
+static inline void floatToBfloat16Scalar(std::uint16_t* dst, const float* src, size_t count,
+                                         bool truncate) {
+  if (truncate) {
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = (std::uint16_t)__convert_float_to_bfloat16_rtz(src[i]);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = (std::uint16_t)__convert_float_to_bfloat16(src[i]);
+    }
+  }
+}
+
+static inline void bfloat16ToFloatScalar(float* dst, const std::uint16_t* src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = __convert_bfloat16_to_float(src[i]);
+  }
+}
+
+#ifdef HIP_CONVERT_X86
+
+// The hardware keeps the payload of a NaN, while the scalar routines return the sign and
+// 0x7e00, so NaN lanes are patched afterwards
+
+template <int Rounding>
+__attribute__((target("avx,f16c")))
+static void floatToHalfF16c(std::uint16_t* dst, const float* src, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 f = _mm256_loadu_ps(src + i);
+    __m128i h = _mm256_cvtps_ph(f, Rounding | _MM_FROUND_NO_EXC);
+    __m256 nan = _mm256_cmp_ps(f, f, _CMP_UNORD_Q);
+    if (_mm256_movemask_ps(nan) != 0) {
+      __m256i fi = _mm256_castps_si256(f);
+      __m128i sign = _mm_packs_epi32(_mm_srai_epi32(_mm256_castsi256_si128(fi), 16),
+                                     _mm_srai_epi32(_mm256_extractf128_si256(fi, 1), 16));
+      __m128i fix = _mm_or_si128(_mm_and_si128(sign, _mm_set1_epi16((short)0x8000)),
+                                 _mm_set1_epi16(0x7e00));
+      __m256i nani = _mm256_castps_si256(nan);
+      __m128i mask = _mm_packs_epi32(_mm256_castsi256_si128(nani),
+                                     _mm256_extractf128_si256(nani, 1));
+      h = _mm_or_si128(_mm_andnot_si128(mask, h), _mm_and_si128(mask, fix));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+  floatToHalfScalar(dst + i, src + i, count - i, Rounding == _MM_FROUND_TO_ZERO);
+}
+
+__attribute__((target("avx,f16c")))
+static void halfToFloatF16c(float* dst, const std::uint16_t* src, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  halfToFloatScalar(dst + i, src + i, count - i);
+}
+
+// 16 values at a time; the results are shifted down to 16 bits and sign extended, so the
+// saturating pack keeps them intact
+template <bool Truncate>
+__attribute__((target("avx2")))
+static inline __m256i bfloat16FromBitsAvx2(__m256i u) {
+  const __m256i expMask = _mm256_set1_epi32(0x7f800000);
+  const __m256i lowMask = _mm256_set1_epi32(0xffff);
+  __m256i special = _mm256_cmpeq_epi32(_mm256_and_si256(u, expMask), expMask);
+  __m256i lowZero = _mm256_cmpeq_epi32(_mm256_and_si256(u, lowMask), _mm256_setzero_si256());
+  // Exponent all ones with payload in the low bits: set the low bit of the result
+  __m256i nanBit = _mm256_andnot_si256(lowZero, special);
+  if (Truncate) {
+    __m256i r = _mm256_srai_epi32(u, 16);
+    return _mm256_or_si256(r, _mm256_and_si256(nanBit, _mm256_set1_epi32(1)));
+  }
+  __m256i odd = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+  __m256i rounded = _mm256_add_epi32(u, _mm256_add_epi32(_mm256_set1_epi32(0x7fff), odd));
+  __m256i nan = _mm256_or_si256(u, _mm256_and_si256(nanBit, _mm256_set1_epi32(0x10000)));
+  return _mm256_srai_epi32(_mm256_blendv_epi8(rounded, nan, special), 16);
+}
+
+template <bool Truncate>
+__attribute__((target("avx2")))
+static void floatToBfloat16Avx2(std::uint16_t* dst, const float* src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i a = bfloat16FromBitsAvx2<Truncate>(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+    __m256i b = bfloat16FromBitsAvx2<Truncate>(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8)));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+  }
+  floatToBfloat16Scalar(dst + i, src + i, count - i, Truncate);
+}
+
+__attribute__((target("avx2")))
+static void bfloat16ToFloatAvx2(float* dst, const std::uint16_t* src, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m256i u = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), u);
+  }
+  bfloat16ToFloatScalar(dst + i, src + i, count - i);
+}
+
+template <int Rounding>
+__attribute__((target("avx512f")))
+static void floatToHalfAvx512(std::uint16_t* dst, const float* src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m512 f = _mm512_loadu_ps(src + i);
+    __m256i h = _mm512_cvtps_ph(f, Rounding | _MM_FROUND_NO_EXC);
+    __mmask16 nan = _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q);
+    if (nan != 0) {
+      __m512i fi = _mm512_castps_si512(f);
+      __m512i fix = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi32(fi, 16),
+                                                     _mm512_set1_epi32(0x8000)),
+                                    _mm512_set1_epi32(0x7e00));
+      h = _mm512_cvtepi32_epi16(_mm512_mask_blend_epi32(nan, _mm512_cvtepu16_epi32(h), fix));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+  }
+  floatToHalfScalar(dst + i, src + i, count - i, Rounding == _MM_FROUND_TO_ZERO);
+}
+
+__attribute__((target("avx512f")))
+static void halfToFloatAvx512(float* dst, const std::uint16_t* src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+  }
+  halfToFloatScalar(dst + i, src + i, count - i);
+}
+
+template <bool Truncate>
+__attribute__((target("avx512f")))
+static void floatToBfloat16Avx512(std::uint16_t* dst, const float* src, size_t count) {
+  const __m512i expMask = _mm512_set1_epi32(0x7f800000);
+  const __m512i lowMask = _mm512_set1_epi32(0xffff);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m512i u = _mm512_loadu_si512(src + i);
+    __mmask16 special = _mm512_cmpeq_epi32_mask(_mm512_and_si512(u, expMask), expMask);
+    __mmask16 nanBit = special & _mm512_test_epi32_mask(u, lowMask);
+    __m512i r;
+    if (Truncate) {
+      r = _mm512_mask_or_epi32(_mm512_srli_epi32(u, 16), nanBit, _mm512_srli_epi32(u, 16),
+                               _mm512_set1_epi32(1));
+    } else {
+      __m512i odd = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+      __m512i rounded = _mm512_add_epi32(u, _mm512_add_epi32(_mm512_set1_epi32(0x7fff), odd));
+      __m512i nan = _mm512_mask_or_epi32(u, nanBit, u, _mm512_set1_epi32(0x10000));
+      r = _mm512_srli_epi32(_mm512_mask_blend_epi32(special, rounded, nan), 16);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtepi32_epi16(r));
+  }
+  floatToBfloat16Scalar(dst + i, src + i, count - i, Truncate);
+}
+
+__attribute__((target("avx512f")))
+static void bfloat16ToFloatAvx512(float* dst, const std::uint16_t* src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_si512(dst + i, _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+  }
+  bfloat16ToFloatScalar(dst + i, src + i, count - i);
+}
+
+#endif  // HIP_CONVERT_X86
+
+// Bulk conversions with the given instruction set, which must not be wider than
+// bestConvertIsa()
+
+static inline void floatToHalf(std::uint16_t* dst, const float* src, size_t count, bool truncate,
+                               ConvertIsa isa = bestConvertIsa()) {
+#ifdef HIP_CONVERT_X86
+  if (isa == ConvertIsa::Avx512) {
+    return truncate ? floatToHalfAvx512<_MM_FROUND_TO_ZERO>(dst, src, count)
+                    : floatToHalfAvx512<_MM_FROUND_TO_NEAREST_INT>(dst, src, count);
+  }
+  if (isa >= ConvertIsa::F16c) {
+    return truncate ? floatToHalfF16c<_MM_FROUND_TO_ZERO>(dst, src, count)
+                    : floatToHalfF16c<_MM_FROUND_TO_NEAREST_INT>(dst, src, count);
+  }
+#endif
+  floatToHalfScalar(dst, src, count, truncate);
+}
+
+static inline void halfToFloat(float* dst, const std::uint16_t* src, size_t count,
+                               ConvertIsa isa = bestConvertIsa()) {
+#ifdef HIP_CONVERT_X86
+  if (isa == ConvertIsa::Avx512) {
+    return halfToFloatAvx512(dst, src, count);
+  }
+  if (isa >= ConvertIsa::F16c) {
+    return halfToFloatF16c(dst, src, count);
+  }
+#endif
+  halfToFloatScalar(dst, src, count);
+}
+
+static inline void floatToBfloat16(std::uint16_t* dst, const float* src, size_t count,
+                                   bool truncate, ConvertIsa isa = bestConvertIsa()) {
+#ifdef HIP_CONVERT_X86
+  if (isa == ConvertIsa::Avx512) {
+    return truncate ? floatToBfloat16Avx512<true>(dst, src, count)
+                    : floatToBfloat16Avx512<false>(dst, src, count);
+  }
+  if (isa == ConvertIsa::Avx2) {
+    return truncate ? floatToBfloat16Avx2<true>(dst, src, count)
+                    : floatToBfloat16Avx2<false>(dst, src, count);
+  }
+#endif
+  floatToBfloat16Scalar(dst, src, count, truncate);
+}
+
+static inline void bfloat16ToFloat(float* dst, const std::uint16_t* src, size_t count,
+                                   ConvertIsa isa = bestConvertIsa()) {
+#ifdef HIP_CONVERT_X86
+  if (isa == ConvertIsa::Avx512) {
+    return bfloat16ToFloatAvx512(dst, src, count);
+  }
+  if (isa == ConvertIsa::Avx2) {
+    return bfloat16ToFloatAvx2(dst, src, count);
+  }
+#endif
+  bfloat16ToFloatScalar(dst, src, count);
+}
+
+}  // namespace hip_impl
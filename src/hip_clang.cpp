@@ -20,6 +20,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <fstream>
@@ -27,6 +30,7 @@ THE SOFTWARE.
 #include "hip/hip_runtime.h"
 #include "hip_hcc_internal.h"
 #include "hip_fatbin.h"
+#include "launch_config_stack.inl"
 #include "trace_helper.h"
 #include "program_state.inl"
 
@@ -34,7 +38,117 @@ THE SOFTWARE.
 #pragma GCC visibility push (default)
 #endif
 
-extern "C" std::vector<hipModule_t>*
+namespace {
+// The device code of one fat binary. Registration only records the bundle
+// that targets each device; the executable for a device is loaded the first
+// time a kernel or variable of the fat binary is used on it, or at
+// registration when HIP_EAGER_CODE_OBJECT_LOAD is set.
+class FatBinary {
+  const __ClangOffloadBundleHeader* header_;
+  std::vector<const __ClangOffloadBundleDesc*> bundles_;
+  std::unique_ptr<std::once_flag[]> loaded_;
+  // Published by load(), read without the latch by loadedModule().
+  std::unique_ptr<std::atomic<hipModule_t>[]> modules_;
+
+  void load(int deviceId) {
+    hsa_agent_t agent = g_allAgents[deviceId + 1];
+
+    char name[64] = {};
+    hsa_agent_get_info(agent, HSA_AGENT_INFO_NAME, name);
+
+    const __ClangOffloadBundleDesc* desc = bundles_[deviceId];
+    if (!desc) {
+      fprintf(stderr, "No device code bundle for %s\n", name);
+      return;
+    }
+
+    ihipModule_t* module = new ihipModule_t;
+    if (!module) {
+      return;
+    }
+
+    hsa_executable_create_alt(HSA_PROFILE_FULL, HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT, nullptr,
+                              &module->executable);
+
+    const char* image = reinterpret_cast<const char*>(header_) + desc->offset;
+    if (HIP_DUMP_CODE_OBJECT)
+      __hipDumpCodeObject(std::string{image, desc->size});
+    module->executable = hip_impl::get_program_state().load_executable_no_copy(
+      image, desc->size, module->executable, agent);
+
+    if (module->executable.handle) {
+      hip_impl::program_state_impl::read_kernarg_metadata(image, desc->size, module->kernargs);
+      modules_[deviceId].store(module, std::memory_order_release);
+
+      tprintf(DB_FB, "Loaded code object for %s, args size=%ld\n", name, module->kernargs.size());
+    } else {
+      fprintf(stderr, "Failed to load code object for %s\n", name);
+      abort();
+    }
+  }
+public:
+  explicit
+  FatBinary(const __ClangOffloadBundleHeader* header)
+    : header_{header}, bundles_(g_deviceCnt), loaded_{new std::once_flag[g_deviceCnt]},
+      modules_{new std::atomic<hipModule_t>[g_deviceCnt]()} {}
+  FatBinary(const FatBinary&) = delete;
+  ~FatBinary() {
+    for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
+      delete modules_[deviceId].load(std::memory_order_relaxed);
+    }
+  }
+
+  FatBinary& operator=(const FatBinary&) = delete;
+
+  void setBundle(int deviceId, const __ClangOffloadBundleDesc* desc) {
+    bundles_[deviceId] = desc;
+  }
+
+  // The module for deviceId, loaded on first use; nullptr if the fat binary
+  // has no code for the device.
+  hipModule_t module(int deviceId) {
+    std::call_once(loaded_[deviceId], [=]() { load(deviceId); });
+    return modules_[deviceId].load(std::memory_order_acquire);
+  }
+
+  // The module for deviceId if it has been loaded, nullptr otherwise.
+  hipModule_t loadedModule(int deviceId) const {
+    return modules_[deviceId].load(std::memory_order_acquire);
+  }
+};
+
+// A kernel of a fat binary, resolved per device on first launch.
+struct DeviceFunction {
+  FatBinary* fatBinary;
+  std::string deviceName;
+  std::unique_ptr<std::once_flag[]> resolved;
+  std::unique_ptr<hipFunction_t[]> functions;
+
+  hipFunction_t get(int deviceId) {
+    std::call_once(resolved[deviceId], [=]() {
+      hipModule_t module = fatBinary->module(deviceId);
+      hipFunction_t function = nullptr;
+      hsa_agent_t agent = g_allAgents[deviceId + 1];
+      if (module &&
+          (hipSuccess == hipModuleGetFunctionEx(&function, module, deviceName.c_str(), &agent) ||
+          // With code-object-v3, we need to match the kernel descriptor symbol name
+          (hipSuccess == hipModuleGetFunctionEx(
+                             &function, module, (deviceName + std::string(".kd")).c_str(),
+                             &agent
+                         ))) && function != nullptr) {
+        functions[deviceId] = function;
+      }
+      else {
+        tprintf(DB_FB, "__hipRegisterFunction cannot find kernel %s for"
+            " device %d\n", deviceName.c_str(), deviceId);
+      }
+    });
+    return functions[deviceId];
+  }
+};
+} // Unnamed namespace.
+
+extern "C" FatBinary*
 __hipRegisterFatBinary(const void* data)
 {
   hip_impl::hip_init();
@@ -51,11 +165,18 @@ __hipRegisterFatBinary(const void* data)
     return nullptr;
   }
 
-  auto modules = new std::vector<hipModule_t>(g_deviceCnt);
-  if (!modules) {
+  auto fatBinary = new FatBinary{header};
+  if (!fatBinary) {
     return nullptr;
   }
 
+  std::vector<std::string> names(g_deviceCnt);
+  for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
+    char name[64] = {};
+    hsa_agent_get_info(g_allAgents[deviceId + 1], HSA_AGENT_INFO_NAME, name);
+    names[deviceId] = name;
+  }
+
   const __ClangOffloadBundleDesc* desc = &header->desc[0];
   for (uint64_t i = 0; i < header->numBundles; ++i,
        desc = reinterpret_cast<const __ClangOffloadBundleDesc*>(
@@ -70,61 +191,45 @@ __hipRegisterFatBinary(const void* data)
     tprintf(DB_FB, "Found bundle for %s\n", target.c_str());
 
     for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
-      hsa_agent_t agent = g_allAgents[deviceId + 1];
-
-      char name[64] = {};
-      hsa_agent_get_info(agent, HSA_AGENT_INFO_NAME, name);
-      if (target.compare(name)) {
-         continue;
-      }
-
-      ihipModule_t* module = new ihipModule_t;
-      if (!module) {
-        continue;
-      }
-
-      hsa_executable_create_alt(HSA_PROFILE_FULL, HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT, nullptr,
-                                &module->executable);
-
-      std::string image{reinterpret_cast<const char*>(
-          reinterpret_cast<uintptr_t>(header) + desc->offset), desc->size};
-      if (HIP_DUMP_CODE_OBJECT)
-        __hipDumpCodeObject(image);
-      module->executable = hip_impl::get_program_state().load_executable_no_copy(
-        reinterpret_cast<const char*>(header) + desc->offset, desc->size,
-        module->executable, agent);
-
-      if (module->executable.handle) {
-         hip_impl::program_state_impl::read_kernarg_metadata(image, module->kernargs);
-         modules->at(deviceId) = module;
-
-         tprintf(DB_FB, "Loaded code object for %s, args size=%ld\n", name, module->kernargs.size());
-      } else {
-        fprintf(stderr, "Failed to load code object for %s\n", name);
-        abort();
+      if (!target.compare(names[deviceId])) {
+        fatBinary->setBundle(deviceId, desc);
       }
     }
   }
 
-  for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
-    hsa_agent_t agent = g_allAgents[deviceId + 1];
-
-    char name[64] = {};
-    hsa_agent_get_info(agent, HSA_AGENT_INFO_NAME, name);
-    if (!(*modules)[deviceId]) {
-      fprintf(stderr, "No device code bundle for %s\n", name);
-      abort();
+  if (HIP_EAGER_CODE_OBJECT_LOAD) {
+    for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
+      fatBinary->module(deviceId);
     }
   }
 
-  tprintf(DB_FB, "__hipRegisterFatBinary succeeds and returns %p\n", modules);
-  return modules;
+  tprintf(DB_FB, "__hipRegisterFatBinary succeeds and returns %p\n", fatBinary);
+  return fatBinary;
 }
 
-std::map<const void*, std::vector<hipFunction_t>> g_functions;
+// Kernels by host stub. Entries are never erased, so the per-thread caches
+// of findFunction() never dangle.
+std::unordered_map<const void*, DeviceFunction> g_functions;
+std::mutex g_functionsLock;
+
+// Looks the stub up in a per-thread cache first, so that a thread only takes
+// g_functionsLock the first time it launches a given kernel.
+static DeviceFunction* findFunction(const void* hostFunction)
+{
+  thread_local std::unordered_map<const void*, DeviceFunction*> cache;
+
+  auto it = cache.find(hostFunction);
+  if (it != cache.end()) return it->second;
+
+  std::lock_guard<std::mutex> lck{g_functionsLock};
+  auto it0 = g_functions.find(hostFunction);
+  if (it0 == g_functions.end()) return nullptr;
+
+  return cache.emplace(hostFunction, &it0->second).first->second;
+}
 
 extern "C" void __hipRegisterFunction(
-  std::vector<hipModule_t>* modules,
+  FatBinary*   fatBinary,
   const void*  hostFunction,
   char*        deviceFunction,
   const char*  deviceName,
@@ -135,29 +240,22 @@ extern "C" void __hipRegisterFunction(
   dim3*        gridDim,
   int*         wSize)
 {
-  HIP_INIT_API(NONE, modules, hostFunction, deviceFunction, deviceName);
-  std::vector<hipFunction_t> functions(g_deviceCnt);
+  HIP_INIT_API(NONE, fatBinary, hostFunction, deviceFunction, deviceName);
 
-  assert(modules && modules->size() >= g_deviceCnt);
-  for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
-    hipFunction_t function;
-    hsa_agent_t agent = g_allAgents[deviceId + 1];
-    if ((hipSuccess == hipModuleGetFunctionEx(&function, modules->at(deviceId), deviceName, &agent) ||
-        // With code-object-v3, we need to match the kernel descriptor symbol name
-        (hipSuccess == hipModuleGetFunctionEx(
-                           &function, modules->at(deviceId),
-                           (std::string(deviceName) + std::string(".kd")).c_str(),
-                           &agent
-                       ))) && function != nullptr) {
-      functions[deviceId] = function;
-    }
-    else {
-      tprintf(DB_FB, "__hipRegisterFunction cannot find kernel %s for"
-          " device %d\n", deviceName, deviceId);
-    }
+  assert(fatBinary);
+  DeviceFunction* function;
+  {
+    std::lock_guard<std::mutex> lck{g_functionsLock};
+    function = &g_functions.emplace(hostFunction, DeviceFunction{
+      fatBinary, deviceName, std::unique_ptr<std::once_flag[]>{new std::once_flag[g_deviceCnt]},
+      std::unique_ptr<hipFunction_t[]>{new hipFunction_t[g_deviceCnt]()}}).first->second;
   }
 
-  g_functions.insert(std::make_pair(hostFunction, std::move(functions)));
+  if (HIP_EAGER_CODE_OBJECT_LOAD) {
+    for (int deviceId = 0; deviceId < g_deviceCnt; ++deviceId) {
+      function->get(deviceId);
+    }
+  }
 }
 
 static inline const char* hsa_strerror(hsa_status_t status) {
@@ -192,13 +290,16 @@ struct DeviceVar {
   void* shadowVptr;
   std::string hostVar;
   size_t size;
-  std::vector<hipModule_t>* modules;
-  std::vector<RegisteredVar> rvars;
+  FatBinary* fatBinary;
+  std::vector<RegisteredVar> rvars;  // Per device, filled in by resolveVar
+  std::unique_ptr<std::once_flag[]> resolved;
   bool dyn_undef;
 };
 
 std::unordered_multimap<std::string, DeviceVar > g_vars;
 
+static const RegisteredVar& resolveVar(DeviceVar& dvar, int deviceId);
+
 //The logic follows PlatformState::getGlobalVar in VDI RT
 static DeviceVar* findVar(std::string hostVar, int deviceId, hipModule_t hmod) {
   DeviceVar* dvar = nullptr;
@@ -206,7 +307,7 @@ static DeviceVar* findVar(std::string hostVar, int deviceId, hipModule_t hmod) {
     // If module is provided, then get the var only from that module
     auto var_range = g_vars.equal_range(hostVar);
     for (auto it = var_range.first; it != var_range.second; ++it) {
-      if ((*it->second.modules)[deviceId] == hmod) {
+      if (it->second.fatBinary->loadedModule(deviceId) == hmod) {
         dvar = &(it->second);
         break;
       }
@@ -254,10 +355,11 @@ hipError_t ihipGetGlobalVar(hipDeviceptr_t* dev_ptr, size_t* size_ptr,
   DeviceVar* dvar = findVar(std::string(hostVar), deviceId, hmod);
   if (dvar == nullptr) return hipErrorInvalidValue;
 
-  if (dvar->rvars[deviceId].getdeviceptr() == nullptr) return hipErrorInvalidValue;
+  const RegisteredVar& rvar = resolveVar(*dvar, deviceId);
+  if (rvar.getdeviceptr() == nullptr) return hipErrorInvalidValue;
 
-  *size_ptr = dvar->rvars[deviceId].getvarsize();
-  *dev_ptr = dvar->rvars[deviceId].getdeviceptr();
+  *size_ptr = rvar.getvarsize();
+  *dev_ptr = rvar.getdeviceptr();
   return hipSuccess;
 }
 
@@ -328,7 +430,7 @@ static bool createGlobalVarObj(const hsa_executable_t& hsaExecutable, const hsa_
 // executions.
 // The basic logic is taken from VDI RT, but there is much difference.
 extern "C" void __hipRegisterVar(
-  std::vector<hipModule_t>* modules,   // The device modules containing code object
+  FatBinary*  fatBinary, // The fat binary containing the code objects
   char*       var,       // The shadow variable in host code
   char*       hostVar,   // Variable name in host code
   const char* deviceVar, // Variable name in device code
@@ -337,22 +439,35 @@ extern "C" void __hipRegisterVar(
   int         constant,  // Whether this variable is constant
   int         global)    // Unknown, always 0
 {
-    HIP_INIT_API(__hipRegisterVar, modules, var, hostVar, deviceVar, ext, size, constant, global);
+    HIP_INIT_API(__hipRegisterVar, fatBinary, var, hostVar, deviceVar, ext, size, constant, global);
+
+    auto it = g_vars.emplace(std::string(hostVar), DeviceVar{
+        var, std::string{ hostVar }, static_cast<size_t>(size), fatBinary,
+        std::vector<RegisteredVar>{ g_deviceCnt },
+        std::unique_ptr<std::once_flag[]>{ new std::once_flag[g_deviceCnt] }, false });
 
-    DeviceVar dvar{var, std::string{ hostVar }, static_cast<size_t>(size), modules,
-           std::vector<RegisteredVar>{ g_deviceCnt }, false };
+    if (HIP_EAGER_CODE_OBJECT_LOAD) {
+        for (int deviceId = 0; deviceId < g_deviceCnt; deviceId++) {
+            resolveVar(it->second, deviceId);
+        }
+    }
+}
 
-    for (int deviceId = 0; deviceId < g_deviceCnt; deviceId++) {
+// Looks the variable up in the executable for deviceId, loading it if needed,
+// the first time the variable is used on that device.
+static const RegisteredVar& resolveVar(DeviceVar& dvar, int deviceId) {
+    std::call_once(dvar.resolved[deviceId], [&]() {
         auto device = ihipGetDevice(deviceId);
-        if(!device) {
-           continue;
+        hipModule_t module = dvar.fatBinary->module(deviceId);
+        if(!device || !module) {
+           return;
         }
-        hsa_executable_t& executable = (*modules)[deviceId]->executable;
         hsa_agent_t& agent = g_allAgents[deviceId + 1];
         size_t bytes = 0;
         hipDeviceptr_t devicePtr = nullptr;
 
-        bool success = createGlobalVarObj(executable, agent, hostVar, &devicePtr, &bytes);
+        bool success = createGlobalVarObj(module->executable, agent, dvar.hostVar.c_str(),
+                                          &devicePtr, &bytes);
         if(!success) {
            return;
         }
@@ -367,15 +482,28 @@ extern "C" void __hipRegisterVar(
     #else
         hc::am_memtracker_update(devicePtr, device->_deviceId, 0u);
     #endif
-    }
-    g_vars.insert(std::make_pair(std::string(hostVar), dvar));
+    });
+    return dvar.rvars[deviceId];
+}
+
+extern "C" void __hipUnregisterFatBinary(FatBinary* fatBinary)
+{
+  delete fatBinary;
 }
 
-extern "C" void __hipUnregisterFatBinary(std::vector<hipModule_t>* modules)
+namespace {
+// Launch configurations pushed by this thread and not yet launched.
+thread_local hip_impl::Launch_config_stack<ihipExec_t> execStack;
+
+hipError_t pushConfiguration(const ihipExec_t& exec)
 {
-  std::for_each(modules->begin(), modules->end(), [](hipModule_t module){ delete module; });
-  delete modules;
+  if (!execStack.push(exec)) {
+    tprintf(DB_WARN, "too many nested launch configurations\n");
+    return hipErrorInvalidConfiguration;
+  }
+  return hipSuccess;
 }
+} // Unnamed namespace.
 
 hipError_t hipConfigureCall(
   dim3 gridDim,
@@ -383,12 +511,7 @@ hipError_t hipConfigureCall(
   size_t sharedMem,
   hipStream_t stream)
 {
-  GET_TLS();
-  auto ctx = ihipGetTlsDefaultCtx();
-  LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-
-  crit->_execStack.push(ihipExec_t{gridDim, blockDim, sharedMem, stream});
-  return hipSuccess;
+  return pushConfiguration(ihipExec_t{gridDim, blockDim, sharedMem, stream});
 }
 
 
@@ -398,12 +521,7 @@ extern "C" hipError_t __hipPushCallConfiguration(
   size_t sharedMem,
   hipStream_t stream)
 {
-  GET_TLS();
-  auto ctx = ihipGetTlsDefaultCtx();
-  LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-
-  crit->_execStack.push(ihipExec_t{gridDim, blockDim, sharedMem, stream});
-  return hipSuccess;
+  return pushConfiguration(ihipExec_t{gridDim, blockDim, sharedMem, stream});
 }
 
 extern "C" hipError_t __hipPopCallConfiguration(
@@ -412,13 +530,10 @@ extern "C" hipError_t __hipPopCallConfiguration(
   size_t *sharedMem,
   hipStream_t *stream)
 {
-  GET_TLS();
-  auto ctx = ihipGetTlsDefaultCtx();
-  LockedAccessor_CtxCrit_t crit(ctx->criticalData());
+  if (execStack.empty()) return hipErrorInvalidConfiguration;
 
-  ihipExec_t exec;
-  exec = std::move(crit->_execStack.top());
-  crit->_execStack.pop();
+  const ihipExec_t& exec = execStack.top().config();
+  execStack.pop();
 
   *gridDim = exec._gridDim;
   *blockDim = exec._blockDim;
@@ -437,11 +552,9 @@ int getCurrentDeviceId()
 
   if(!ctx) return deviceId;
 
-  LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-
-  if(crit->_execStack.size() != 0)
+  if(!execStack.empty())
   {
-    auto &exec = crit->_execStack.top();
+    auto &exec = execStack.top().config();
 
     if (exec._hStream) {
       deviceId = exec._hStream->getDevice()->_deviceId;
@@ -457,11 +570,11 @@ int getCurrentDeviceId()
 hipFunction_t ihipGetDeviceFunction(const void *hostFunction)
 {
   int deviceId = getCurrentDeviceId();
-  auto it = g_functions.find(hostFunction);
-  if (it == g_functions.end() || !it->second[deviceId]) {
+  DeviceFunction* function = findFunction(hostFunction);
+  if (!function) {
     return nullptr;
   }
-  return it->second[deviceId];
+  return function->get(deviceId);
 }
 
 hipError_t hipSetupArgument(
@@ -470,28 +583,21 @@ hipError_t hipSetupArgument(
   size_t offset)
 {
   HIP_INIT_API(hipSetupArgument, arg, size, offset);
-  auto ctx = ihipGetTlsDefaultCtx();
-  LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-  auto& arguments = crit->_execStack.top()._arguments;
-
-  if (arguments.size() < offset + size) {
-    arguments.resize(offset + size);
-  }
+  if (execStack.empty()) return ihipLogStatus(hipErrorInvalidConfiguration);
 
-  ::memcpy(&arguments[offset], arg, size);
+  execStack.top().set_arg(offset, arg, size);
   return hipSuccess;
 }
 
 hipError_t hipLaunchByPtr(const void *hostFunction)
 {
   HIP_INIT_API(hipLaunchByPtr, hostFunction);
-  ihipExec_t exec;
-  {
-    auto ctx = ihipGetTlsDefaultCtx();
-    LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-    exec = std::move(crit->_execStack.top());
-    crit->_execStack.pop();
-  }
+  if (execStack.empty()) return ihipLogStatus(hipErrorInvalidConfiguration);
+
+  // The popped entry, arguments included, stays valid until the next push.
+  const auto& entry = execStack.top();
+  const ihipExec_t& exec = entry.config();
+  execStack.pop();
 
   int deviceId;
   if (exec._hStream) {
@@ -505,22 +611,23 @@ hipError_t hipLaunchByPtr(const void *hostFunction)
   }
 
   hipError_t e = hipSuccess;
-  decltype(g_functions)::iterator it;
-  if ((it = g_functions.find(hostFunction)) == g_functions.end() ||
-      !it->second[deviceId]) {
+  DeviceFunction* it;
+  hipFunction_t function = nullptr;
+  if (!(it = findFunction(hostFunction)) ||
+      !(function = it->get(deviceId))) {
     e = hipErrorUnknown;
     fprintf(stderr, "hipLaunchByPtr cannot find kernel with stub address %p"
         " for device %d!\n", hostFunction, deviceId);
     abort();
   } else {
-    size_t size = exec._arguments.size();
+    size_t size = entry.args_size();
     void *extra[] = {
-        HIP_LAUNCH_PARAM_BUFFER_POINTER, &exec._arguments[0],
+        HIP_LAUNCH_PARAM_BUFFER_POINTER, const_cast<char*>(entry.args()),
         HIP_LAUNCH_PARAM_BUFFER_SIZE, &size,
         HIP_LAUNCH_PARAM_END
       };
 
-    e = hipModuleLaunchKernel(it->second[deviceId],
+    e = hipModuleLaunchKernel(function,
       exec._gridDim.x, exec._gridDim.y, exec._gridDim.z,
       exec._blockDim.x, exec._blockDim.y, exec._blockDim.z,
       exec._sharedMem, exec._hStream, nullptr, extra);
@@ -142,7 +142,11 @@ hipError_t hipSetDevice(int deviceId) {
 
 hipError_t hipDeviceSynchronize(void) {
     HIP_INIT_SPECIAL_API(hipDeviceSynchronize, TRACE_SYNC);
-    return ihipLogStatus(ihipSynchronize(tls));
+    hipError_t e = ihipSynchronize(tls);
+    if (auto* ctx = ihipGetTlsDefaultCtx()) {
+        ihipMemPoolReleaseAboveThreshold(ctx->getDeviceNum());
+    }
+    return ihipLogStatus(e);
 }
 
 hipError_t hipDeviceReset(void) {
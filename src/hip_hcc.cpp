@@ -65,13 +65,14 @@ const char* API_COLOR_END = KNRM;
 
 int HIP_LAUNCH_BLOCKING = 0;
 std::string HIP_LAUNCH_BLOCKING_KERNELS;
-std::vector<std::string> g_hipLaunchBlockingKernels;
+std::string HIP_LAUNCH_POLICY;
 int HIP_API_BLOCKING = 0;
 
 
 int HIP_PRINT_ENV = 0;
 int HIP_TRACE_API = 0;
 std::string HIP_TRACE_API_COLOR("green");
+std::string HIP_TRACE_FILE;
 
 // TODO - DB_START/STOP need more testing.
 std::string HIP_DB_START_API;
@@ -85,6 +86,12 @@ int HIP_FAIL_SOC = 0;
 int HIP_DENY_PEER_ACCESS = 0;
 
 int HIP_HIDDEN_FREE_MEM = 256;
+// Chunk size (in KB) and number of chunks of the per-thread staging ring used
+// for copies from / to pageable host memory.
+int HIP_STAGING_SIZE = 1024;
+int HIP_STAGING_BUFFERS = 3;
+// Budget (in MB) for pageable host memory kept pinned across copies.
+int HIP_PIN_CACHE_SIZE = 0;
 // Force async copies to actually use the synchronous copy interface.
 int HIP_FORCE_SYNC_COPY = 0;
 
@@ -101,6 +108,10 @@ int HIP_SYNC_STREAM_WAIT = 0;
 int HIP_FORCE_NULL_STREAM = 0;
 
 int HIP_DUMP_CODE_OBJECT = 0;
+int HIP_EAGER_CODE_OBJECT_LOAD = 0;
+int HIP_KERNEL_STATS = 0;
+int HIP_STREAM_QUEUES = 0;
+int HIP_STREAM_QUEUE_ASSIGNMENT = 0;
 
 
 #if (__hcc_workweek__ >= 17300)
@@ -140,22 +151,45 @@ std::atomic<int> g_lastShortTid(1);
 std::vector<ProfTrigger> g_dbStartTriggers;
 std::vector<ProfTrigger> g_dbStopTriggers;
 
+hip_impl::Api_trace_writer* g_apiTrace = nullptr;
+static FILE* g_apiTraceFile = nullptr;
+
+// Never deleted: kernels may still be launched while the process exits.
+hip_impl::Launch_stats_table* g_launchStats = nullptr;
+hip_impl::Launch_policy_table* g_launchPolicies = nullptr;
+
 //=================================================================================================
 // Top-level "free" functions:
 //=================================================================================================
-uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::string& apiStr) {
+// Returns whether the current API of the thread is traced: threads are traced from the start,
+// unless HIP_DB_START_API is set, and then from their start triggers to their stop triggers.
+// Each thread only reads and pops its own triggers.
+bool apiTraceWindow(TlsData* tls) {
+    if (tls->apiTraceWindow < 0) {
+        tls->apiTraceWindow = g_dbStartTriggers.empty();
+    }
+
     auto apiSeqNum = tls->tidInfo.apiSeqNum();
     auto tid = tls->tidInfo.tid();
 
     if ((tid < g_dbStartTriggers.size()) && (apiSeqNum >= g_dbStartTriggers[tid].nextTrigger())) {
         printf("info: resume profiling at %lu\n", apiSeqNum);
-        g_dbStartTriggers.pop_back();
+        g_dbStartTriggers[tid].pop();
+        tls->apiTraceWindow = 1;
     };
     if ((tid < g_dbStopTriggers.size()) && (apiSeqNum >= g_dbStopTriggers[tid].nextTrigger())) {
         printf("info: stop profiling at %lu\n", apiSeqNum);
-        g_dbStopTriggers.pop_back();
+        g_dbStopTriggers[tid].pop();
+        tls->apiTraceWindow = 0;
     };
 
+    return tls->apiTraceWindow;
+}
+
+uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::string& apiStr) {
+    auto apiSeqNum = tls->tidInfo.apiSeqNum();
+    auto tid = tls->tidInfo.tid();
+
     fullStr->reserve(16 + apiStr.length());
     *fullStr = std::to_string(tid) + ".";
     *fullStr += std::to_string(apiSeqNum);
@@ -264,6 +298,8 @@ ihipStream_t::ihipStream_t(ihipCtx_t* ctx, hc::accelerator_view av, unsigned int
 
 //---
 ihipStream_t::~ihipStream_t() {
+    _ctx->getWriteableDevice()->_queuePool.release(_queueLease);
+
     GET_TLS();
     for (auto mem : coopMemsTracker) {
         hip_internal::ihipHostFree(tls, mem->mgs);
@@ -429,21 +465,9 @@ LockedAccessor_StreamCrit_t ihipStream_t::lockopen_preKernelCommand() {
 //---
 // Must be called after kernel finishes, this releases the lock on the stream so other commands can
 // submit.
-void ihipStream_t::lockclose_postKernelCommand(const char* kernelName, hc::accelerator_view* av, bool unlockPostponed) {
-    bool blockThisKernel = false;
-
-    if (!g_hipLaunchBlockingKernels.empty()) {
-        std::string kernelNameString(kernelName);
-        for (auto o = g_hipLaunchBlockingKernels.begin(); o != g_hipLaunchBlockingKernels.end();
-             o++) {
-            if ((*o == kernelNameString)) {
-                // printf ("force blocking for kernel %s\n", o->c_str());
-                blockThisKernel = true;
-            }
-        }
-    }
-
-    if (HIP_LAUNCH_BLOCKING || blockThisKernel) {
+void ihipStream_t::lockclose_postKernelCommand(const char* kernelName, hc::accelerator_view* av,
+                                               bool unlockPostponed, uint32_t launchPolicy) {
+    if (HIP_LAUNCH_BLOCKING || (launchPolicy & hip_impl::launch_policy_block)) {
         // TODO - fix this so it goes through proper stream::wait() call.// direct wait OK since we
         // know the stream is locked.
         av->wait(hc::hcWaitModeActive);
@@ -575,6 +599,38 @@ ihipDevice_t::ihipDevice_t(unsigned deviceId, unsigned deviceCnt, hc::accelerato
 
     initProperties(&_props);
 
+    if (_props.warpSize > 0) {
+        hip_impl::Occupancy_limits limits;
+        limits.wavefront_size = _props.warpSize;
+        limits.max_waves_per_cu =
+            std::min<std::size_t>(_props.maxThreadsPerMultiProcessor / _props.warpSize, 32);
+        // TODO: at the moment there is no way to query the count of registers
+        //       available per CU, therefore we hardcode it to 64 KiRegisters.
+        limits.vgprs_per_simd = (_props.regsPerBlock ? _props.regsPerBlock : 64 * 1024) /
+                                limits.wavefront_size / limits.simds_per_cu;
+        limits.sgprs_per_simd = (_props.gcnArch < 800) ? 512 : 800;
+        limits.lds_per_cu = _props.maxSharedMemoryPerMultiProcessor;
+        limits.max_threads_per_block = _props.maxThreadsPerBlock;
+        limits.cu_count = _props.multiProcessorCount;
+        _occupancy.reset(limits);
+    }
+
+    // Note these are execute_any_order queues: CUDA stream behavior is that all kernels submitted
+    // will automatically wait for prev to complete, this behaviour will be maintained by
+    // hipModuleLaunchKernel. execute_any_order will help hipExtModuleLaunchKernel, which uses a
+    // special flag.
+    _queuePool.reset(
+        [this](int priority) {
+#if defined(__HCC__) && (__hcc_major__ < 3) && (__hcc_minor__ < 3)
+            return _acc.create_view();
+#else
+            return _acc.create_view(Kalmar::execute_any_order, Kalmar::queuing_mode_automatic,
+                                    (Kalmar::queue_priority)priority);
+#endif
+        },
+        HIP_STREAM_QUEUES > 0 ? HIP_STREAM_QUEUES : 0,
+        HIP_STREAM_QUEUE_ASSIGNMENT == 1 ? hip_impl::Hw_queue_assignment::round_robin
+                                         : hip_impl::Hw_queue_assignment::least_loaded);
 
     _primaryCtx = new ihipCtx_t(this, deviceCnt, hipDeviceMapHost);
 }
@@ -618,6 +674,10 @@ void ihipDevice_t::locked_reset() {
     // reset _primaryCtx
     _primaryCtx->locked_reset();
     tprintf(DB_SYNC, " _primaryCtx cleanup %s\n", ToString(_primaryCtx).c_str());
+
+    // Every stream is gone, so are the queues they shared.
+    _queuePool.trim();
+
     // Reset and release all memory stored in the tracker:
     // Reset will remove peer mapping so don't need to do this explicitly.
     // FIXME - This is clearly a non-const action!  Is this a context reset or a device reset -
@@ -1304,6 +1364,30 @@ void parseTrigger(std::string triggerString, std::vector<ProfTrigger>& profTrigg
 }
 
 
+static void closeApiTrace() {
+    // Threads still running keep pushing to their rings, which are never drained again: the
+    // writer is not deleted.
+    g_apiTrace->close();
+    fclose(g_apiTraceFile);
+}
+
+static void openApiTrace(std::string path) {
+    const auto pid = getpid();
+    for (auto i = path.find("%p"); i != std::string::npos; i = path.find("%p", i)) {
+        path.replace(i, 2, std::to_string(pid));
+    }
+
+    g_apiTraceFile = fopen(path.c_str(), "wb");
+    if (!g_apiTraceFile) {
+        fprintf(stderr, "warning: cannot open HIP_TRACE_FILE=%s, tracing to stderr\n", path.c_str());
+        return;
+    }
+
+    g_apiTrace = new hip_impl::Api_trace_writer{g_apiTraceFile, hc::get_tick_frequency(),
+                                                static_cast<uint32_t>(pid)};
+    std::atexit(closeApiTrace);
+}
+
 void HipReadEnv() {
     /*
      * Environment variables
@@ -1320,8 +1404,25 @@ void HipReadEnv() {
     READ_ENV_S(release, HIP_LAUNCH_BLOCKING_KERNELS, 0,
                "Comma-separated list of kernel names to make host-synchronous, so they block until "
                "completed.");
-    if (!HIP_LAUNCH_BLOCKING_KERNELS.empty()) {
-        tokenize(HIP_LAUNCH_BLOCKING_KERNELS, ',', &g_hipLaunchBlockingKernels);
+    READ_ENV_S(release, HIP_LAUNCH_POLICY, 0,
+               "Comma-separated list of pattern:policy rules, where the pattern is a glob over "
+               "kernel names and the policy is block, serialize, trace or sample=N, joined with +.");
+    if (!HIP_LAUNCH_BLOCKING_KERNELS.empty() || !HIP_LAUNCH_POLICY.empty()) {
+        auto policies = new hip_impl::Launch_policy_table;
+        std::vector<std::string> rules;
+        tokenize(HIP_LAUNCH_BLOCKING_KERNELS, ',', &rules);
+        for (auto&& name : rules) {
+            if (!name.empty()) policies->add(name, hip_impl::launch_policy_block);
+        }
+        rules.clear();
+        tokenize(HIP_LAUNCH_POLICY, ',', &rules);
+        for (auto&& rule : rules) {
+            if (!rule.empty() && !policies->add(rule)) {
+                fprintf(stderr, "warning: ignoring malformed HIP_LAUNCH_POLICY rule '%s'\n",
+                        rule.c_str());
+            }
+        }
+        g_launchPolicies = policies;
     }
     READ_ENV_I(release, HIP_API_BLOCKING, 0,
                "Make HIP APIs 'host-synchronous', so they block until completed.  Impacts "
@@ -1335,7 +1436,11 @@ void HipReadEnv() {
                "Print debug info.  Bitmask (HIP_DB=0xff) or flags separated by '+' "
                "(HIP_DB=api+sync+mem+copy+fatbin)",
                HIP_DB_callback);
-    if ((HIP_DB & (1 << DB_API)) && (HIP_TRACE_API == 0)) {
+    READ_ENV_S(release, HIP_TRACE_FILE, 0,
+               "Write the HIP_TRACE_API trace to this file as compact binary records, rather than "
+               "to stderr as text. %p is replaced with the process id. Convert the file with "
+               "hipTraceConvert.");
+    if (((HIP_DB & (1 << DB_API)) || !HIP_TRACE_FILE.empty()) && (HIP_TRACE_API == 0)) {
         // Set HIP_TRACE_API default before we read it, so it is printed correctly.
         HIP_TRACE_API = 1;
     }
@@ -1365,6 +1470,16 @@ void HipReadEnv() {
                "2=always return false for hipDeviceCanAccessPeer");
     READ_ENV_I(release, HIP_FORCE_SYNC_COPY, 0,
                "Force all copies (even hipMemcpyAsync) to use sync copies");
+    READ_ENV_I(release, HIP_STAGING_SIZE, 0,
+               "Size of each chunk of the staging buffer used for copies from / to pageable "
+               "host memory, in KB.");
+    READ_ENV_I(release, HIP_STAGING_BUFFERS, 0,
+               "Number of staging chunks in flight for copies from / to pageable host memory. "
+               "1 disables overlapping the host memcpy with the DMA.");
+    READ_ENV_I(release, HIP_PIN_CACHE_SIZE, 0,
+               "Amount of pageable host memory, in MB, that copies larger than the staging ring "
+               "may keep pinned for reuse by later copies. Requires userfaultfd, through which "
+               "released memory is dropped from the cache. 0 disables the cache.");
     READ_ENV_I(release, HIP_FAIL_SOC, 0,
                "Fault on Sub-Optimal-Copy, rather than use a slower but functional implementation. "
                " Bit 0x1=Fail on async copy with unpinned memory.  Bit 0x2=Fail peer copy rather "
@@ -1401,6 +1516,22 @@ void HipReadEnv() {
     READ_ENV_I(release, HIP_DUMP_CODE_OBJECT, 0,
                "If set, dump code object as __hip_dump_code_object[nnnn].o in the current directory,"
                "where nnnn is the index number.");
+    READ_ENV_I(release, HIP_EAGER_CODE_OBJECT_LOAD, 0,
+               "If set, load the code objects of hip-clang fat binaries for every device when "
+               "they are registered, rather than on first use on each device.");
+    READ_ENV_I(release, HIP_KERNEL_STATS, 0,
+               "If set, collect the launch count, launch shapes and host enqueue latency of every "
+               "kernel, for hipExtKernelGetLaunchStats, and print them to stderr at exit.");
+    READ_ENV_I(release, HIP_STREAM_QUEUES, 0,
+               "If set, the number of hardware queues per priority that the streams of each device "
+               "share, rather than creating a queue for every stream.");
+    READ_ENV_I(release, HIP_STREAM_QUEUE_ASSIGNMENT, 0,
+               "How streams are assigned to the HIP_STREAM_QUEUES queues: 0 = to the queue with the "
+               "fewest streams, 1 = round-robin.");
+    if (HIP_KERNEL_STATS) {
+        g_launchStats = new hip_impl::Launch_stats_table;
+        std::atexit([]() { g_launchStats->dump(stderr); });
+    }
 
     // Some flags have both compile-time and runtime flags - generate a warning if user enables the
     // runtime flag but the compile-time flag is disabled.
@@ -1454,6 +1585,10 @@ void HipReadEnv() {
 
     parseTrigger(HIP_DB_START_API, g_dbStartTriggers);
     parseTrigger(HIP_DB_STOP_API, g_dbStopTriggers);
+
+    if (!HIP_TRACE_FILE.empty()) {
+        openApiTrace(HIP_TRACE_FILE);
+    }
 };
 
 
@@ -1655,13 +1790,54 @@ void ihipPrintKernelLaunch(const char* kernelName, const grid_launch_parm* lp,
     }
 }
 
+// Prints a launch selected by the trace launch policy, whether or not HIP_TRACE_API is set.
+static void ihipTraceKernelLaunch(const char* kernelName, const grid_launch_parm* lp,
+                                  const hipStream_t stream) {
+    GET_TLS();
+    std::stringstream os;
+    os << "<<hip-launch pid:" << tls->tidInfo.pid() << " tid:" << tls->tidInfo.tid() << "."
+       << tls->tidInfo.apiSeqNum() << " '" << kernelName << "'"
+       << " gridDim:" << lp->grid_dim << " groupDim:" << lp->group_dim << " sharedMem:+"
+       << lp->dynamic_group_mem_bytes << " " << *stream << ">>";
+    fprintf(stderr, "%s\n", os.str().c_str());
+}
+
 // Called just before a kernel is launched from hipLaunchKernel.
 // Allows runtime to track some information about the stream.
 hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_launch_parm* lp,
                                 const char* kernelNameStr, bool lockAcquired) {
+    return ihipPreLaunchKernel(stream, grid, block, lp, kernelNameStr, lockAcquired, nullptr);
+}
+
+
+// Like ihipPreLaunchKernel, also returning in lockWaitNs how long the launch waited for the
+// stream lock, for the launches that HIP_KERNEL_STATS records.
+hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_launch_parm* lp,
+                                const char* kernelNameStr, bool lockAcquired,
+                                uint64_t* lockWaitNs) {
     if (stream == nullptr || stream != stream->getCtx()->_defaultStream) {
         stream = ihipSyncAndResolveStream(stream, lockAcquired);
     }
+    if (lockWaitNs) *lockWaitNs = 0;
+    if (!lockAcquired) {
+        if (lockWaitNs) {
+            const uint64_t start = hip_impl::launch_stats_now();
+            stream->lockopen_preKernelCommand();
+            *lockWaitNs = hip_impl::launch_stats_now() - start;
+        } else {
+            stream->lockopen_preKernelCommand();
+        }
+    }
+    ihipPreLaunchKernelLocked(stream, grid, block, lp, kernelNameStr);
+
+    return (stream);
+}
+
+
+// Like ihipPreLaunchKernel, for a stream that is already resolved and locked by the caller, e.g.
+// for every launch of a batch after the first.
+void ihipPreLaunchKernelLocked(hipStream_t stream, dim3 grid, dim3 block, grid_launch_parm* lp,
+                               const char* kernelNameStr) {
     lp->grid_dim.x = grid.x;
     lp->grid_dim.y = grid.y;
     lp->grid_dim.z = grid.z;
@@ -1670,7 +1846,6 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_
     lp->group_dim.z = block.z;
     lp->barrier_bit = barrier_bit_queue_default;
 
-    if (!lockAcquired) stream->lockopen_preKernelCommand();
     auto &crit = stream->criticalData();
     lp->av = &(crit._av);
     lp->cf = nullptr;
@@ -1682,8 +1857,6 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_
         (rel << HSA_PACKET_HEADER_SCRELEASE_FENCE_SCOPE);
     crit._last_op_was_a_copy = false;
     ihipPrintKernelLaunch(kernelNameStr, lp, stream);
-
-    return (stream);
 }
 
 
@@ -1709,9 +1882,26 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, size_t grid, size_t block, g
 // Called after kernel finishes execution.
 // This releases the lock on the stream.
 void ihipPostLaunchKernel(const char* kernelName, hipStream_t stream, grid_launch_parm& lp, bool unlockPostponed) {
+    ihipPostLaunchKernel(kernelName, stream, lp, unlockPostponed, ihipLaunchPolicy(kernelName));
+}
+
+
+// Like ihipPostLaunchKernel, with the launch policy already resolved from the function.
+void ihipPostLaunchKernel(const char* kernelName, hipStream_t stream, grid_launch_parm& lp,
+                          bool unlockPostponed, uint32_t launchPolicy) {
+    if (launchPolicy & hip_impl::launch_policy_trace) {
+        ihipTraceKernelLaunch(kernelName, &lp, stream);
+    }
     tprintf(DB_SYNC, "ihipPostLaunchKernel, unlocking stream\n");
 
-    stream->lockclose_postKernelCommand(kernelName, lp.av, unlockPostponed);
+    stream->lockclose_postKernelCommand(kernelName, lp.av, unlockPostponed, launchPolicy);
+}
+
+
+// The launch policy of a kernel launched by name rather than through its hipFunction_t, which
+// costs a lookup in the policy table.
+uint32_t ihipLaunchPolicy(const char* kernelName) {
+    return g_launchPolicies ? g_launchPolicies->find(kernelName).next_launch() : 0;
 }
 
 //=================================================================================================
@@ -33,6 +33,11 @@ THE SOFTWARE.
 #include "hip_prof_api.h"
 #include "hip_util.h"
 #include "env.h"
+#include "occupancy.inl"
+#include "api_trace.inl"
+#include "launch_stats.inl"
+#include "launch_policy.inl"
+#include "hw_queue_pool.inl"
 #include <unordered_map>
 
 #if (__hcc_workweek__ < 16354)
@@ -67,6 +72,8 @@ extern int HIP_PRINT_ENV;
 extern int HIP_ATP;
 extern int HIP_DB;
 extern int HIP_STAGING_SIZE;    /* size of staging buffers, in KB */
+extern int HIP_STAGING_BUFFERS; /* number of staging buffers in flight */
+extern int HIP_PIN_CACHE_SIZE;  /* pageable host memory kept pinned, in MB */
 extern int HIP_STREAM_SIGNALS;  /* number of signals to allocate at stream creation */
 extern int HIP_VISIBLE_DEVICES; /* Contains a comma-separated sequence of GPU identifiers */
 extern int HIP_FORCE_P2P_HOST;
@@ -86,6 +93,16 @@ extern int HIP_FORCE_NULL_STREAM;
 extern int HIP_SYNC_FREE;
 
 extern int HIP_DUMP_CODE_OBJECT;
+extern int HIP_EAGER_CODE_OBJECT_LOAD;
+extern int HIP_KERNEL_STATS;
+extern int HIP_STREAM_QUEUES;
+extern int HIP_STREAM_QUEUE_ASSIGNMENT;
+
+// Per-kernel launch statistics, when HIP_KERNEL_STATS is set.
+extern hip_impl::Launch_stats_table* g_launchStats;
+
+// Per-kernel launch policies, when HIP_LAUNCH_POLICY or HIP_LAUNCH_BLOCKING_KERNELS is set.
+extern hip_impl::Launch_policy_table* g_launchPolicies;
 
 // TODO - remove when this is standard behavior.
 extern int HCC_OPT_FLUSH;
@@ -172,6 +189,7 @@ struct ProfTrigger {
 
     uint64_t nextTrigger() { return _profTrigger.empty() ? MAX_TRIGGER : _profTrigger.back(); };
     void add(uint64_t trigger) { _profTrigger.push_back(trigger); };
+    void pop() { _profTrigger.pop_back(); };
     void sort() { std::sort(_profTrigger.begin(), _profTrigger.end(), std::greater<int>()); };
 
    private:
@@ -187,6 +205,7 @@ struct TlsData {
         lastHipError = hipSuccess;
         getPrimaryCtx = true;
         defaultCtx = nullptr;
+        apiTraceWindow = -1;
     }
 
     hipError_t lastHipError;
@@ -197,6 +216,13 @@ struct TlsData {
     // Stack of contexts
     std::stack<ihipCtx_t*> ctxStack;
     bool getPrimaryCtx;
+    // Staging buffer for kernel arguments, reused by every launch from this thread.
+    std::vector<char> kernargs;
+    // (offset, size) of the arguments of each launch of a batch within kernargs.
+    std::vector<std::pair<std::size_t, std::size_t>> kernargRanges;
+    // Whether this thread is inside its HIP_DB_START_API / HIP_DB_STOP_API window, -1 until its
+    // first traced API.
+    int apiTraceWindow;
 };
 TlsData* tls_get_ptr();
 #define GET_TLS() TlsData *tls = tls_get_ptr()
@@ -204,6 +230,9 @@ TlsData* tls_get_ptr();
 extern std::vector<ProfTrigger> g_dbStartTriggers;
 extern std::vector<ProfTrigger> g_dbStopTriggers;
 
+// Binary API trace, when HIP_TRACE_FILE is set.
+extern hip_impl::Api_trace_writer* g_apiTrace;
+
 //---
 // Forward defs:
 class ihipStream_t;
@@ -306,24 +335,40 @@ static inline uint64_t getTicks() { return hc::get_system_ticks(); }
 
 //---
 extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::string& apiStr);
+extern bool apiTraceWindow(TlsData* tls);
 
+// With HIP_TRACE_FILE, the arguments are packed into a record when the API begins and the record
+// is pushed to the binary trace when it ends: no strings are built.
 #if (COMPILE_HIP_TRACE_API & 0x1)
 #define API_TRACE(forceTrace, ...)                                                                 \
     GET_TLS();                                                                                     \
     uint64_t hipApiStartTick = 0;                                                                  \
+    hip_impl::Api_trace_args hipApiTraceArgs;                                                      \
     {                                                                                              \
         tls->tidInfo.incApiSeqNum();                                                               \
-        if (forceTrace ||                                                                          \
-            (COMPILE_HIP_DB && (HIP_TRACE_API & (1 << TRACE_ALL)))) {         \
-            std::string apiStr = std::string(__func__) + " (" + ToString(__VA_ARGS__) + ')';       \
-            std::string fullStr;                                                                   \
-            hipApiStartTick = recordApiTrace(tls, &fullStr, apiStr);                               \
+        if ((forceTrace ||                                                                         \
+             (COMPILE_HIP_DB && (HIP_TRACE_API & (1 << TRACE_ALL)))) && apiTraceWindow(tls)) {     \
+            if (g_apiTrace) {                                                                      \
+                static const uint32_t hipApiTraceName = g_apiTrace->name_id(__func__);             \
+                hipApiTraceArgs = hip_impl::make_api_trace_args(__VA_ARGS__);                      \
+                hipApiTraceArgs.api = hipApiTraceName;                                             \
+                hipApiTraceArgs.seq = tls->tidInfo.apiSeqNum();                                    \
+                hipApiStartTick = getTicks();                                                      \
+            } else {                                                                               \
+                std::string apiStr = std::string(__func__) + " (" + ToString(__VA_ARGS__) + ')';   \
+                std::string fullStr;                                                               \
+                hipApiStartTick = recordApiTrace(tls, &fullStr, apiStr);                           \
+            }                                                                                      \
         }                                                                                          \
     }
 
 #else
 // Swallow API_TRACE
-#define API_TRACE(IS_CMD, ...) GET_TLS(); tls->tidInfo.incApiSeqNum();
+#define API_TRACE(IS_CMD, ...)                                                                     \
+    GET_TLS();                                                                                     \
+    tls->tidInfo.incApiSeqNum();                                                                   \
+    uint64_t hipApiStartTick = 0;                                                                  \
+    hip_impl::Api_trace_args hipApiTraceArgs;
 #endif
 
 #define ihipGetTlsDefaultCtx() iihipGetTlsDefaultCtx(tls)
@@ -357,7 +402,11 @@ extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::st
         hipError_t localHipStatus = hipStatus; /*local copy so hipStatus only evaluated once*/        \
         tls->lastHipError = localHipStatus;                                                           \
                                                                                                       \
-        if ((COMPILE_HIP_TRACE_API & 0x2) && HIP_TRACE_API & (1 << TRACE_ALL)) {                      \
+        if (g_apiTrace && hipApiStartTick) {                                                          \
+            g_apiTrace->record(tls->tidInfo.tid(), hipApiTraceArgs, hipApiStartTick, getTicks(),      \
+                               localHipStatus);                                                       \
+        } else if ((COMPILE_HIP_TRACE_API & 0x2) && HIP_TRACE_API & (1 << TRACE_ALL) &&              \
+                   hipApiStartTick) {                                                                 \
             auto ticks = getTicks() - hipApiStartTick;                                                \
             fprintf(stderr, "  %ship-api pid:%d tid:%d.%lu %-30s ret=%2d (%s)>> +%lu ns%s\n",         \
                     (localHipStatus == 0) ? API_COLOR : KRED, tls->tidInfo.pid(), tls->tidInfo.tid(), \
@@ -606,7 +655,8 @@ class ihipStream_t {
     // Member functions that begin with locked_ are thread-safe accessors - these acquire / release
     // the critical mutex.
     LockedAccessor_StreamCrit_t lockopen_preKernelCommand();
-    void lockclose_postKernelCommand(const char* kernelName, hc::accelerator_view* av, bool unlockNotNeeded = 0);
+    void lockclose_postKernelCommand(const char* kernelName, hc::accelerator_view* av,
+                                     bool unlockNotNeeded, uint32_t launchPolicy);
 
     void locked_wait(bool& waited);
     void locked_wait();
@@ -645,6 +695,9 @@ class ihipStream_t {
 
     std::vector<mg_info*>  coopMemsTracker;
 
+    // The queue of this stream in the device's pool, with HIP_STREAM_QUEUES.
+    hip_impl::Hw_queue_lease _queueLease;
+
    public:
     //---
     // Public member vars - these are set at initialization and never change:
@@ -842,6 +895,12 @@ class ihipDevice_t {
     // Node id reported by kfd for this device
     uint32_t _driver_node_id;
 
+    // Memoized occupancy of kernels on this device, based on _props.
+    hip_impl::Occupancy_calculator _occupancy;
+
+    // The hardware queues that streams share, with HIP_STREAM_QUEUES.
+    hip_impl::Hw_queue_pool<hc::accelerator_view> _queuePool;
+
     ihipCtx_t* _primaryCtx;
 
     int _state;  // 1 if device is set otherwise 0
@@ -862,7 +921,6 @@ struct ihipExec_t {
   dim3 _blockDim;
   size_t _sharedMem;
   hipStream_t _hStream;
-  std::vector<char> _arguments;
 };
 
 //=============================================================================
@@ -903,8 +961,6 @@ class ihipCtxCriticalBase_t : LockedBase<MUTEX_TYPE> {
 
     // TODO - move private
     std::list<ihipCtx_t*> _peers;  // list of enabled peer devices.
-    //--- Execution stack:
-    std::stack<ihipExec_t> _execStack; // Execution stack for this device.
 
     friend class LockedAccessor<ihipCtxCriticalBase_t>;
 
@@ -1007,8 +1063,22 @@ hipError_t hipModuleGetFunctionEx(hipFunction_t* hfunc, hipModule_t hmod,
 
 
 hipStream_t ihipSyncAndResolveStream(hipStream_t, bool lockAcquired = 0);
+hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_launch_parm* lp,
+                                const char* kernelNameStr, bool lockAcquired,
+                                uint64_t* lockWaitNs);
+void ihipPreLaunchKernelLocked(hipStream_t stream, dim3 grid, dim3 block, grid_launch_parm* lp,
+                               const char* kernelNameStr);
+void ihipPostLaunchKernel(const char* kernelName, hipStream_t stream, grid_launch_parm& lp,
+                          bool unlockPostponed, uint32_t launchPolicy);
+uint32_t ihipLaunchPolicy(const char* kernelName);
 hipError_t ihipStreamSynchronize(TlsData *tls, hipStream_t stream);
 
+// The default memory pools of the devices, behind hipMallocAsync and hipFreeAsync.
+bool ihipMemPoolFree(void* ptr, hipStream_t stream);
+bool ihipMemPoolFind(const void* ptr, void** base, size_t* size);
+void ihipMemPoolForgetStream(hipStream_t stream);
+void ihipMemPoolReleaseAboveThreshold(int device);
+
 /**
  * @brief Copies the memory address and size of symbol @p symbolName
  *
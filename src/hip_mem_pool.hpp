@@ -0,0 +1,584 @@
+/* Copyright (c) 2020-present Advanced Micro Devices, Inc.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+#ifndef HIP_MEM_POOL_H
+#define HIP_MEM_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace hip {
+
+/// Caching allocator behind the stream-ordered hipMallocAsync and
+/// hipFreeAsync of both runtimes, and behind hipMalloc and hipFree on VDI.
+/// Memory is carved out of segments allocated from the device and kept across
+/// frees, so allocating temporaries every iteration neither goes to the device
+/// allocator nor synchronizes the device to free them.
+///
+/// Requests up to SmallSize share small segments, larger ones get their own
+/// large segments, so small blocks do not fragment large ones. Free blocks are
+/// kept in power-of-two size bins and the best fit is split; a freed block is
+/// coalesced with its free neighbours.
+///
+/// A free does not wait for the device: it captures a fence of the work that
+/// may still use the block, on every stream for free() or on one stream for a
+/// stream-ordered free, and the block stays pending until the fence has
+/// completed. Work later queued on the stream a block was freed on is ordered
+/// after its last use, so allocations on that stream reuse pending blocks
+/// right away. Allocations on other streams can also take a pending block, by
+/// making their stream wait for its fence, unless internal dependencies are
+/// disabled.
+///
+/// Ops abstracts the device, which lets the allocator be tested without one:
+///   using Fence;                             // Default-constructible
+///   void* allocate(size_t);                  // A new segment, or nullptr
+///   void deallocate(void*);                  // Returns a segment to the device
+///   void fence(Fence&, const void* stream);  // Captures the work queued so far
+///                                            // on stream, or on every stream if
+///                                            // nullptr
+///   void copy(Fence& to, const Fence& from);
+///   bool completed(Fence&);                  // Does not block
+///   void wait(Fence&);                       // Blocks the host
+///   void streamWait(const void* stream, Fence&);  // Orders later work on
+///                                            // stream after the fence
+///   void release(Fence&);                    // Drops what fence() captured
+template <typename Ops>
+class MemoryPool {
+ public:
+  struct Stats {
+    /// Bytes held in segments
+    size_t reserved_ = 0;
+    /// Bytes handed out and not freed, including rounding
+    size_t allocated_ = 0;
+    /// Bytes freed whose fence has not completed yet
+    size_t pending_ = 0;
+    size_t peakReserved_ = 0;
+    size_t peakAllocated_ = 0;
+    size_t segments_ = 0;
+    /// Allocations served from cached memory and from new segments
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+  };
+
+  static constexpr size_t MinBlockSize = 512;
+  /// Largest request served from small segments
+  static constexpr size_t SmallSize = 1 << 20;
+  static constexpr size_t SmallSegment = 2 << 20;
+  /// Requests below MinLargeAlloc share LargeSegment sized segments, larger
+  /// ones get a segment rounded up to RoundLarge
+  static constexpr size_t MinLargeAlloc = 10 << 20;
+  static constexpr size_t LargeSegment = 20 << 20;
+  static constexpr size_t RoundLarge = 2 << 20;
+
+ private:
+  struct Pending;
+
+  struct Block {
+    enum State { Free, Allocated, Pending };
+    uintptr_t ptr_;
+    size_t size_;
+    /// Size asked for, for an allocated block
+    size_t requested_ = 0;
+    bool small_;
+    State state_ = Free;
+    /// Neighbours in the segment
+    Block* prev_ = nullptr;
+    Block* next_ = nullptr;
+    /// For a pending block: the work that may still use it, the list it is
+    /// pending on and its place there
+    typename Ops::Fence fence_;
+    MemoryPool::Pending* owner_ = nullptr;
+    typename std::list<Block*>::iterator order_;
+
+    Block(uintptr_t ptr, size_t size, bool small) : ptr_(ptr), size_(size), small_(small) {}
+  };
+
+  struct BySize {
+    bool operator()(const Block* a, const Block* b) const {
+      return (a->size_ != b->size_) ? (a->size_ < b->size_) : (a->ptr_ < b->ptr_);
+    }
+  };
+  typedef std::set<Block*, BySize> Bin;
+  static constexpr unsigned Bins = 64;
+
+  /// Blocks freed on one stream, in the order they were freed, which is also
+  /// the order their fences complete in
+  struct Pending {
+    const void* stream_ = nullptr;
+    std::list<Block*> order_;
+    Bin bySize_;
+  };
+
+  Ops ops_;
+  std::mutex lock_;
+  Bin small_[Bins];
+  Bin large_[Bins];
+  /// Allocated blocks by address
+  std::map<uintptr_t, Block*> allocated_;
+  /// Pending blocks by the stream they were freed on; nullptr for free()
+  std::unordered_map<const void*, Pending> pending_;
+  /// Pending blocks of streams that have been destroyed
+  std::list<Pending> retired_;
+  /// First block of each segment, which stays the first while blocks merge
+  std::set<Block*> segments_;
+  Stats stats_;
+  /// Unused memory kept when releaseAboveThreshold() is called
+  size_t releaseThreshold_ = std::numeric_limits<size_t>::max();
+  bool reuseInternalDependencies_ = true;
+
+  static unsigned binOf(size_t size) {
+    unsigned bin = 0;
+    while (size >>= 1) {
+      ++bin;
+    }
+    return bin;
+  }
+
+  Bin* bins(bool small) { return small ? small_ : large_; }
+
+  static size_t roundSize(size_t size) {
+    if (size < MinBlockSize) {
+      return size_t(MinBlockSize);
+    }
+    return (size + MinBlockSize - 1) & ~(MinBlockSize - 1);
+  }
+
+  static size_t segmentSize(size_t size) {
+    if (size <= SmallSize) {
+      return SmallSegment;
+    }
+    if (size < MinLargeAlloc) {
+      return LargeSegment;
+    }
+    return (size + RoundLarge - 1) / RoundLarge * RoundLarge;
+  }
+
+  /// Whether the rest of a block of \p size is worth splitting off
+  static bool worthSplitting(size_t remaining, bool small) {
+    return small ? (remaining >= MinBlockSize) : (remaining > SmallSize);
+  }
+
+  void insert(Block* block) { bins(block->small_)[binOf(block->size_)].insert(block); }
+  void erase(Block* block) { bins(block->small_)[binOf(block->size_)].erase(block); }
+
+  /// Takes the smallest free block of at least \p size out of its bin
+  Block* takeFree(size_t size, bool small) {
+    Bin* bin = bins(small);
+    Block key(0, size, small);
+    for (unsigned i = binOf(size); i < Bins; ++i) {
+      auto it = (i == binOf(size)) ? bin[i].lower_bound(&key) : bin[i].begin();
+      if (it != bin[i].end()) {
+        Block* block = *it;
+        bin[i].erase(it);
+        return block;
+      }
+    }
+    return nullptr;
+  }
+
+  void addPending(Block* block, Pending& pending, typename std::list<Block*>::iterator pos) {
+    block->state_ = Block::Pending;
+    block->owner_ = &pending;
+    block->order_ = pending.order_.insert(pos, block);
+    pending.bySize_.insert(block);
+    stats_.pending_ += block->size_;
+  }
+
+  void removePending(Block* block) {
+    block->owner_->order_.erase(block->order_);
+    block->owner_->bySize_.erase(block);
+    block->owner_ = nullptr;
+    stats_.pending_ -= block->size_;
+  }
+
+  /// Takes the smallest block of at least \p size pending on \p pending, with
+  /// its fence. The rest of the block stays pending.
+  Block* takePending(Pending& pending, size_t size, bool small) {
+    Block key(0, size, small);
+    auto it = pending.bySize_.lower_bound(&key);
+    while (it != pending.bySize_.end() && (*it)->small_ != small) {
+      ++it;
+    }
+    if (it == pending.bySize_.end()) {
+      return nullptr;
+    }
+    Block* block = *it;
+    const size_t remaining = block->size_ - size;
+    auto pos = std::next(block->order_);
+    removePending(block);
+    if (worthSplitting(remaining, small)) {
+      Block* tail = new Block(block->ptr_ + size, remaining, small);
+      tail->prev_ = block;
+      tail->next_ = block->next_;
+      if (block->next_ != nullptr) {
+        block->next_->prev_ = tail;
+      }
+      block->next_ = tail;
+      block->size_ = size;
+      ops_.copy(tail->fence_, block->fence_);
+      addPending(tail, pending, pos);
+    }
+    return block;
+  }
+
+  Block* newSegment(size_t size, bool small) {
+    const size_t bytes = segmentSize(size);
+    void* ptr = ops_.allocate(bytes);
+    if (ptr == nullptr) {
+      return nullptr;
+    }
+    Block* block = new Block(reinterpret_cast<uintptr_t>(ptr), bytes, small);
+    segments_.insert(block);
+    ++stats_.segments_;
+    stats_.reserved_ += bytes;
+    if (stats_.reserved_ > stats_.peakReserved_) {
+      stats_.peakReserved_ = stats_.reserved_;
+    }
+    return block;
+  }
+
+  /// Marks \p block free, merging it with its free neighbours
+  void makeFree(Block* block) {
+    block->state_ = Block::Free;
+    Block* prev = block->prev_;
+    if (prev != nullptr && prev->state_ == Block::Free) {
+      erase(prev);
+      prev->size_ += block->size_;
+      prev->next_ = block->next_;
+      if (block->next_ != nullptr) {
+        block->next_->prev_ = prev;
+      }
+      delete block;
+      block = prev;
+    }
+    Block* next = block->next_;
+    if (next != nullptr && next->state_ == Block::Free) {
+      erase(next);
+      block->size_ += next->size_;
+      block->next_ = next->next_;
+      if (next->next_ != nullptr) {
+        next->next_->prev_ = block;
+      }
+      delete next;
+    }
+    insert(block);
+  }
+
+  /// Makes the blocks of \p pending whose fence has completed free
+  void reclaim(Pending& pending) {
+    while (!pending.order_.empty() && ops_.completed(pending.order_.front()->fence_)) {
+      Block* block = pending.order_.front();
+      removePending(block);
+      ops_.release(block->fence_);
+      makeFree(block);
+    }
+  }
+
+  void reclaim() {
+    for (auto& it : pending_) {
+      reclaim(it.second);
+    }
+    for (auto it = retired_.begin(); it != retired_.end();) {
+      reclaim(*it);
+      it = it->order_.empty() ? retired_.erase(it) : std::next(it);
+    }
+  }
+
+  void waitPending() {
+    for (auto& it : pending_) {
+      for (Block* block : it.second.order_) {
+        ops_.wait(block->fence_);
+      }
+    }
+    for (auto& pending : retired_) {
+      for (Block* block : pending.order_) {
+        ops_.wait(block->fence_);
+      }
+    }
+    reclaim();
+  }
+
+  /// Returns unused segments to the device until at most \p keep bytes are
+  /// reserved, largest first
+  void releaseSegments(size_t keep) {
+    std::vector<Block*> unused;
+    for (bool small : {false, true}) {
+      Bin* bin = bins(small);
+      for (unsigned i = Bins; i-- > 0;) {
+        for (auto it = bin[i].rbegin(); it != bin[i].rend(); ++it) {
+          if ((*it)->prev_ == nullptr && (*it)->next_ == nullptr) {
+            unused.push_back(*it);
+          }
+        }
+      }
+    }
+    for (Block* block : unused) {
+      if (stats_.reserved_ <= keep) {
+        break;
+      }
+      erase(block);
+      segments_.erase(block);
+      --stats_.segments_;
+      stats_.reserved_ -= block->size_;
+      ops_.deallocate(reinterpret_cast<void*>(block->ptr_));
+      delete block;
+    }
+  }
+
+ public:
+  explicit MemoryPool(const Ops& ops = Ops()) : ops_(ops) {}
+
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  /// Waits for pending frees and returns every segment to the device
+  ~MemoryPool() {
+    waitPending();
+    for (Block* segment : segments_) {
+      ops_.deallocate(reinterpret_cast<void*>(segment->ptr_));
+      for (Block* block = segment; block != nullptr;) {
+        Block* next = block->next_;
+        delete block;
+        block = next;
+      }
+    }
+  }
+
+  /// Allocates memory for work on \p stream, or on any stream if nullptr.
+  /// Returns nullptr if the device is out of memory even after the cache has
+  /// been emptied.
+  void* allocate(size_t size, const void* stream = nullptr) {
+    if (size == 0) {
+      return nullptr;
+    }
+    const size_t rounded = roundSize(size);
+    if (rounded < size) {
+      return nullptr;
+    }
+    const bool small = rounded <= SmallSize;
+
+    std::lock_guard<std::mutex> lock(lock_);
+    reclaim();
+
+    // Blocks freed on the same stream need no wait
+    Block* block = nullptr;
+    if (stream != nullptr) {
+      auto it = pending_.find(stream);
+      if (it != pending_.end()) {
+        block = takePending(it->second, rounded, small);
+      }
+    }
+    if (block == nullptr) {
+      block = takeFree(rounded, small);
+    }
+    // Blocks freed elsewhere once the stream waits for them
+    if (block == nullptr && stream != nullptr && reuseInternalDependencies_) {
+      for (auto it = pending_.begin(); block == nullptr && it != pending_.end(); ++it) {
+        if (it->first != stream) {
+          block = takePending(it->second, rounded, small);
+        }
+      }
+      for (auto it = retired_.begin(); block == nullptr && it != retired_.end(); ++it) {
+        block = takePending(*it, rounded, small);
+      }
+      if (block != nullptr) {
+        ops_.streamWait(stream, block->fence_);
+      }
+    }
+
+    if (block != nullptr) {
+      ++stats_.hits_;
+      if (block->state_ == Block::Pending) {
+        ops_.release(block->fence_);
+      }
+    } else {
+      block = newSegment(rounded, small);
+      if (block == nullptr) {
+        // Out of memory: give cached segments back, then wait for the frees
+        // still in flight
+        releaseSegments(0);
+        block = newSegment(rounded, small);
+      }
+      if (block == nullptr && stats_.pending_ != 0) {
+        waitPending();
+        block = takeFree(rounded, small);
+        if (block == nullptr) {
+          releaseSegments(0);
+          block = newSegment(rounded, small);
+        }
+      }
+      if (block == nullptr) {
+        return nullptr;
+      }
+      ++stats_.misses_;
+    }
+
+    // Split off the tail of a free block if it is worth keeping
+    const size_t remaining = block->size_ - rounded;
+    if (block->state_ == Block::Free && worthSplitting(remaining, small)) {
+      Block* tail = new Block(block->ptr_ + rounded, remaining, small);
+      tail->prev_ = block;
+      tail->next_ = block->next_;
+      if (block->next_ != nullptr) {
+        block->next_->prev_ = tail;
+      }
+      block->next_ = tail;
+      block->size_ = rounded;
+      insert(tail);
+    }
+
+    block->state_ = Block::Allocated;
+    block->requested_ = size;
+    allocated_[block->ptr_] = block;
+    stats_.allocated_ += block->size_;
+    if (stats_.allocated_ > stats_.peakAllocated_) {
+      stats_.peakAllocated_ = stats_.allocated_;
+    }
+    return reinterpret_cast<void*>(block->ptr_);
+  }
+
+  /// Frees an allocation without waiting for the work that may still use it:
+  /// the work queued so far on \p stream, or on every stream if nullptr.
+  /// Returns false if \p ptr was not returned by allocate().
+  bool free(void* ptr, const void* stream = nullptr) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = allocated_.find(reinterpret_cast<uintptr_t>(ptr));
+    if (it == allocated_.end()) {
+      return false;
+    }
+    Block* block = it->second;
+    allocated_.erase(it);
+    stats_.allocated_ -= block->size_;
+
+    Pending& pending = pending_[stream];
+    pending.stream_ = stream;
+    ops_.fence(block->fence_, stream);
+    addPending(block, pending, pending.order_.end());
+    reclaim();
+    return true;
+  }
+
+  /// Forgets \p stream, which is being destroyed, so that a new stream at the
+  /// same address does not reuse its blocks without waiting
+  void forgetStream(const void* stream) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = pending_.find(stream);
+    if (it == pending_.end()) {
+      return;
+    }
+    retired_.push_back(std::move(it->second));
+    pending_.erase(it);
+    Pending& retired = retired_.back();
+    retired.stream_ = nullptr;
+    for (Block* block : retired.order_) {
+      block->owner_ = &retired;
+    }
+  }
+
+  /// Finds the allocation that contains \p ptr
+  bool find(const void* ptr, void** base, size_t* size) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = allocated_.upper_bound(address);
+    if (it == allocated_.begin()) {
+      return false;
+    }
+    --it;
+    if (address >= it->first + it->second->size_) {
+      return false;
+    }
+    *base = reinterpret_cast<void*>(it->first);
+    *size = it->second->requested_;
+    return true;
+  }
+
+  /// Waits for pending frees, then returns unused segments to the device
+  /// until at most \p keep bytes are reserved
+  void trim(size_t keep) {
+    std::lock_guard<std::mutex> lock(lock_);
+    waitPending();
+    releaseSegments(keep);
+  }
+
+  /// Returns unused segments to the device while more than the release
+  /// threshold is reserved, without waiting for pending frees. Called when
+  /// the host has synchronized with the device.
+  void releaseAboveThreshold() {
+    std::lock_guard<std::mutex> lock(lock_);
+    reclaim();
+    if (stats_.reserved_ > releaseThreshold_) {
+      releaseSegments(releaseThreshold_);
+    }
+  }
+
+  size_t releaseThreshold() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return releaseThreshold_;
+  }
+
+  void setReleaseThreshold(size_t threshold) {
+    std::lock_guard<std::mutex> lock(lock_);
+    releaseThreshold_ = threshold;
+  }
+
+  bool reuseInternalDependencies() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return reuseInternalDependencies_;
+  }
+
+  void setReuseInternalDependencies(bool enable) {
+    std::lock_guard<std::mutex> lock(lock_);
+    reuseInternalDependencies_ = enable;
+  }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(lock_);
+    reclaim();
+    return stats_;
+  }
+
+  /// Resets the peaks to the current values
+  void resetPeakReserved() {
+    std::lock_guard<std::mutex> lock(lock_);
+    stats_.peakReserved_ = stats_.reserved_;
+  }
+
+  void resetPeakAllocated() {
+    std::lock_guard<std::mutex> lock(lock_);
+    stats_.peakAllocated_ = stats_.allocated_;
+  }
+
+  void resetPeaks() {
+    resetPeakReserved();
+    resetPeakAllocated();
+  }
+};
+
+};
+
+#endif // HIP_MEM_POOL_H
@@ -25,11 +25,20 @@ THE SOFTWARE.
 #include "hsa/hsa_ext_amd.h"
 
 #include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
 #include "hip_hcc_internal.h"
+#include "hip_mem_pool.hpp"
 #include "trace_helper.h"
+#include "pin_cache.inl"
+#include "staged_copy.inl"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <fstream>
+#include <limits>
+#include <vector>
 
 #if __HIP_ENABLE_DEVICE_MALLOC__
 __device__ char __hip_device_heap[__HIP_SIZE_OF_HEAP];
@@ -158,43 +167,110 @@ namespace {
         return r;
     }
 
-    constexpr size_t staging_sz{4 * 1024 * 1024};     // 2 Pages.
     constexpr size_t max_h2d_std_memcpy_sz{8 * 1024}; // 8 KiB.
     constexpr size_t max_d2h_std_memcpy_sz{64};       // 1 cacheline.
 
-    thread_local const std::unique_ptr<void, void (*)(void *)> staging_buffer{
-        []() {
-            hsa_region_t r{};
-            throwing_result_check(hsa_agent_iterate_regions(
-                cpu_agent(), [](hsa_region_t x, void *p) {
-                hsa_region_segment_t seg{};
-                throwing_result_check(
-                    hsa_region_get_info(x, HSA_REGION_INFO_SEGMENT, &seg),
-                    __FILE__, __func__, __LINE__);
+    inline
+    hsa_region_t staging_region()
+    {
+        hsa_region_t r{};
+        throwing_result_check(hsa_agent_iterate_regions(
+            cpu_agent(), [](hsa_region_t x, void *p) {
+            hsa_region_segment_t seg{};
+            throwing_result_check(
+                hsa_region_get_info(x, HSA_REGION_INFO_SEGMENT, &seg),
+                __FILE__, __func__, __LINE__);
 
-                if (seg != HSA_REGION_SEGMENT_GLOBAL) return HSA_STATUS_SUCCESS;
+            if (seg != HSA_REGION_SEGMENT_GLOBAL) return HSA_STATUS_SUCCESS;
 
-                uint32_t flags{};
-                throwing_result_check(hsa_region_get_info(
-                    x, HSA_REGION_INFO_GLOBAL_FLAGS, &flags),
-                    __FILE__, __func__, __LINE__);
+            uint32_t flags{};
+            throwing_result_check(hsa_region_get_info(
+                x, HSA_REGION_INFO_GLOBAL_FLAGS, &flags),
+                __FILE__, __func__, __LINE__);
 
-                if (flags & HSA_REGION_GLOBAL_FLAG_COARSE_GRAINED) {
-                    *static_cast<hsa_region_t *>(p) = x;
+            if (flags & HSA_REGION_GLOBAL_FLAG_COARSE_GRAINED) {
+                *static_cast<hsa_region_t *>(p) = x;
 
-                    return HSA_STATUS_INFO_BREAK;
-                }
+                return HSA_STATUS_INFO_BREAK;
+            }
 
-                return HSA_STATUS_SUCCESS;
-            }, &r), __FILE__, __func__, __LINE__);
+            return HSA_STATUS_SUCCESS;
+        }, &r), __FILE__, __func__, __LINE__);
 
-            void *tp{};
-            throwing_result_check(hsa_memory_allocate(r, staging_sz, &tp),
-                                  __FILE__, __func__, __LINE__);
+        return r;
+    }
+
+    // Per-thread ring of HIP_STAGING_BUFFERS pinned chunks of HIP_STAGING_SIZE
+    // KiB each, with one completion signal per chunk; it is allocated on the
+    // first copy that needs it, and lives as long as the thread.
+    class Staging {
+        hip_impl::Staging_ring ring_{};
+        std::vector<hsa_signal_t> signals_;
+    public:
+        Staging()
+        {
+            ring_.chunk = std::max(HIP_STAGING_SIZE, 4) * size_t{1024};
+            ring_.depth = std::min<size_t>(std::max(HIP_STAGING_BUFFERS, 1),
+                                           hip_impl::max_staging_depth);
 
-            return tp;
-        }(),
-        [](void *ptr) { hsa_memory_free(ptr); }};
+            void* p{};
+            throwing_result_check(
+                hsa_memory_allocate(staging_region(), ring_.chunk * ring_.depth, &p),
+                __FILE__, __func__, __LINE__);
+            ring_.base = static_cast<char*>(p);
+
+            hsa_agent_t cpu{cpu_agent()};
+            signals_.resize(ring_.depth);
+            for (auto&& x : signals_) {
+                throwing_result_check(hsa_signal_create(0, 1, &cpu, &x),
+                                      __FILE__, __func__, __LINE__);
+            }
+        }
+        Staging(const Staging&) = delete;
+        ~Staging()
+        {
+            for (auto&& x : signals_) hsa_signal_destroy(x);
+            hsa_memory_free(ring_.base);
+        }
+
+        Staging& operator=(const Staging&) = delete;
+
+        const hip_impl::Staging_ring& ring() const noexcept { return ring_; }
+
+        // The DMA engine driven by hip_impl::staged_{h2d,d2h}_copy.
+        class Dma {
+            hsa_agent_t agent_;
+            const hsa_signal_t* signals_;
+        public:
+            Dma(hsa_agent_t agent, const Staging& s)
+                : agent_{agent}, signals_{s.signals_.data()} {}
+
+            void start(size_t slot, void* dst, const void* src, size_t n)
+            {
+                hsa_signal_silent_store_relaxed(signals_[slot], 1);
+                throwing_result_check(
+                    hsa_amd_memory_async_copy(dst, agent_, src, agent_, n, 0,
+                                              nullptr, signals_[slot]),
+                    __FILE__, __func__, __LINE__);
+            }
+
+            void wait(size_t slot)
+            {
+                while (hsa_signal_wait_relaxed(signals_[slot],
+                                               HSA_SIGNAL_CONDITION_EQ, 0,
+                                               UINT64_MAX,
+                                               HSA_WAIT_STATE_ACTIVE));
+            }
+        };
+    };
+
+    inline
+    Staging& staging()
+    {
+        thread_local Staging r;
+
+        return r;
+    }
 
     thread_local hsa_signal_t copy_signal{[]() {
         hsa_agent_t cpu{cpu_agent()};
@@ -243,24 +319,36 @@ void d2h_copy(void* __restrict dst, const void* __restrict src, size_t n,
     }
     
     if (is_locked) {
-        dst = static_cast<char*>(di.agentBaseAddress) +
-              (static_cast<char*>(dst) -
-               static_cast<char*>(di.hostBaseAddress));
+        // Ranges held by the pin cache are locked as well; the handle keeps
+        // them from being unpinned during the copy.
+        const auto pinned = hip_impl::host_pin_cache().empty()
+            ? hip_impl::Pin_cache::Handle{}
+            : hip_impl::host_pin_cache().find(dst, n);
+
+        dst = pinned ? pinned.get()
+                     : static_cast<char*>(di.agentBaseAddress) +
+                       (static_cast<char*>(dst) -
+                        static_cast<char*>(di.hostBaseAddress));
         do_copy(dst, src, n, si.agentOwner, si.agentOwner);
     }
-    else if (n <= staging_sz) {
-        do_copy(staging_buffer.get(), src, n, si.agentOwner, si.agentOwner);
-        std::memcpy(dst, staging_buffer.get(), n);
-    }
     else {
-        std::unique_ptr<void, void (*)(void*)> lck{
-            dst, [](void* p) { hsa_amd_memory_unlock(p); }};
+        // Ranges held by the pin cache are reported as locked, so one that
+        // holds dst was unlocked behind its back and is stale.
+        hip_impl::host_pin_cache().invalidate(dst, 1);
 
-        throwing_result_check(hsa_amd_memory_lock(dst, n, &si.agentOwner, 1,
-                                                  const_cast<void**>(&dst)),
-                              __FILE__, __func__, __LINE__);
+        auto& s = staging();
+        const auto pinned = n > s.ring().chunk * s.ring().depth
+            ? hip_impl::host_pin_cache().acquire(dst, n)
+            : hip_impl::Pin_cache::Handle{};
 
-        do_copy(dst, src, n, si.agentOwner, si.agentOwner);
+        if (pinned) {
+            do_copy(pinned.get(), src, n, si.agentOwner, si.agentOwner);
+        }
+        else {
+            Staging::Dma dma{si.agentOwner, s};
+
+            hip_impl::staged_d2h_copy(dst, src, n, s.ring(), dma);
+        }
     }
 }
 
@@ -281,25 +369,36 @@ void h2d_copy(void* __restrict dst, const void* __restrict src, size_t n,
     }
 
     if (is_locked) {
-        src = static_cast<char*>(si.agentBaseAddress) +
-            (static_cast<const char*>(src) -
-            static_cast<char*>(si.hostBaseAddress));
+        // Ranges held by the pin cache are locked as well; the handle keeps
+        // them from being unpinned during the copy.
+        const auto pinned = hip_impl::host_pin_cache().empty()
+            ? hip_impl::Pin_cache::Handle{}
+            : hip_impl::host_pin_cache().find(src, n);
+
+        src = pinned ? pinned.get()
+                     : static_cast<char*>(si.agentBaseAddress) +
+                       (static_cast<const char*>(src) -
+                        static_cast<char*>(si.hostBaseAddress));
         do_copy(dst, src, n, di.agentOwner, di.agentOwner);
     }
-    else if (n <= staging_sz) {
-        std::memcpy(staging_buffer.get(), src, n);
-        do_copy(dst, staging_buffer.get(), n, di.agentOwner, di.agentOwner);
-    }
     else {
-        std::unique_ptr<void, void (*)(void*)> lck{
-            const_cast<void*>(src), [](void* p) { hsa_amd_memory_unlock(p); }};
+        // Ranges held by the pin cache are reported as locked, so one that
+        // holds src was unlocked behind its back and is stale.
+        hip_impl::host_pin_cache().invalidate(src, 1);
 
-        throwing_result_check(hsa_amd_memory_lock(const_cast<void*>(src), n,
-                                                  &di.agentOwner, 1,
-                                                  const_cast<void**>(&src)),
-                              __FILE__, __func__, __LINE__);
+        auto& s = staging();
+        const auto pinned = n > s.ring().chunk * s.ring().depth
+            ? hip_impl::host_pin_cache().acquire(src, n)
+            : hip_impl::Pin_cache::Handle{};
 
-        do_copy(dst, src, n, di.agentOwner, di.agentOwner);
+        if (pinned) {
+            do_copy(dst, pinned.get(), n, di.agentOwner, di.agentOwner);
+        }
+        else {
+            Staging::Dma dma{di.agentOwner, s};
+
+            hip_impl::staged_h2d_copy(dst, src, n, s.ring(), dma);
+        }
     }
 }
 
@@ -325,6 +424,10 @@ void generic_copy(void* __restrict dst, const void* __restrict src, size_t n,
 inline
 void memcpy_impl(void* __restrict dst, const void* __restrict src, size_t n,
                  hipMemcpyKind k) {
+    // A cached range whose memory was unmapped still looks locked to HSA
+    // until the cache lets go of it.
+    hip_impl::host_pin_cache().drop_unmapped();
+
     auto si{info(src)};
     auto di{info(dst)};
 
@@ -557,6 +660,10 @@ hipError_t ihipHostMalloc(TlsData *tls, void** ptr, size_t sizeBytes, unsigned i
 
             if (sizeBytes && (*ptr == NULL)) {
                 hip_status = hipErrorOutOfMemory;
+            } else {
+                // The pages may have been pinned for copies while they were
+                // pageable.
+                hip_impl::host_pin_cache().invalidate(*ptr, sizeBytes);
             }
         }
     }
@@ -584,6 +691,7 @@ hipError_t ihipHostFree(TlsData *tls, void* ptr) {
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
         if (status == AM_SUCCESS) {
             if (amPointerInfo._hostPointer == ptr) {
+                hip_impl::host_pin_cache().invalidate(ptr, amPointerInfo._sizeBytes);
                 hc::am_free(ptr);
                 hipStatus = hipSuccess;
             }
@@ -1179,6 +1287,9 @@ hipError_t hipHostRegister(void* hostPtr, size_t sizeBytes, unsigned int flags)
         if (hostPtr == NULL) {
             return ihipLogStatus(hipErrorInvalidValue);
         }
+        // The range, or part of it, may still be pinned for earlier copies.
+        hip_impl::host_pin_cache().invalidate(hostPtr, sizeBytes);
+
         // TODO-test : multi-gpu access to registered host memory.
         if (ctx) {
             if ((flags == hipHostRegisterDefault) || (flags & hipHostRegisterPortable) ||
@@ -1236,10 +1347,14 @@ hipError_t hipHostUnregister(void* hostPtr) {
     if (hostPtr == NULL) {
         hip_status = hipErrorInvalidValue;
     } else {
+        // Ranges pinned by hipMemcpy are not registered with HC, but
+        // unregistering them unpins them as well.
+        const auto cached = hip_impl::host_pin_cache().invalidate(hostPtr, 1);
+
         auto device = ctx->getWriteableDevice();
         am_status_t am_status = hc::am_memory_host_unlock(device->_acc, hostPtr);
         tprintf(DB_MEM, " %s unregistered ptr=%p\n", __func__, hostPtr);
-        if (am_status != AM_SUCCESS) {
+        if (am_status != AM_SUCCESS && !cached) {
             hip_status = hipErrorHostMemoryNotRegistered;
         }
     }
@@ -2345,7 +2460,10 @@ hipError_t hipFree(void* ptr) {
 
     hipError_t hipStatus = hipErrorInvalidDevicePointer;
 
-    if (ptr) {
+    if (ptr && ihipMemPoolFree(ptr, nullptr)) {
+        // Memory from hipMallocAsync goes back to its pool once the work that may use it is done.
+        hipStatus = hipSuccess;
+    } else if (ptr) {
         hc::accelerator acc;
 #if (__hcc_workweek__ >= 17332)
         hc::AmPointerInfo amPointerInfo(NULL, NULL, NULL, 0, acc, 0, 0);
@@ -2379,6 +2497,8 @@ hipError_t hipFree(void* ptr) {
                     ctx->locked_waitAllStreams();  // ignores non-blocking streams, this waits
                                                    // for all activity to finish.
                 }
+                // Managed memory lives in pages that copies may have pinned.
+                hip_impl::host_pin_cache().invalidate(ptr, amPointerInfo._sizeBytes);
                 hc::am_free(ptr);
                 hipStatus = hipSuccess;
             }
@@ -2442,8 +2562,14 @@ hipError_t hipMemGetAddressRange(hipDeviceptr_t* pbase, size_t* psize, hipDevice
 #else
     hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
 #endif
+    void* base;
+    size_t size;
     am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, dptr);
-    if (status == AM_SUCCESS) {
+    if (ihipMemPoolFind(dptr, &base, &size)) {
+        // The tracker only knows the segment the allocation was carved out of.
+        *pbase = base;
+        *psize = size;
+    } else if (status == AM_SUCCESS) {
         *pbase = amPointerInfo._devicePointer;
         *psize = amPointerInfo._sizeBytes;
     } else
@@ -2557,3 +2683,342 @@ hipError_t hipIpcCloseMemHandle(void* devPtr) {
 // hipError_t hipIpcOpenEventHandle(hipEvent_t* event, hipIpcEventHandle_t handle){
 //     return hipSuccess;
 // }
+
+// HCC allocates device memory directly, so there is no hipMalloc cache to report on or trim.
+
+hipError_t hipExtMallocCacheGetStats(int device, hipExtMallocCacheStats* stats) {
+    HIP_INIT_API(hipExtMallocCacheGetStats, device, stats);
+    if ((device < 0) || (device >= g_deviceCnt)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+    if (stats == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    *stats = hipExtMallocCacheStats{};
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipExtMallocCacheResetPeakStats(int device) {
+    HIP_INIT_API(hipExtMallocCacheResetPeakStats, device);
+    if ((device < 0) || (device >= g_deviceCnt)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipExtMallocCacheTrim(int device, size_t minBytesToKeep) {
+    HIP_INIT_API(hipExtMallocCacheTrim, device, minBytesToKeep);
+    if ((device < 0) || (device >= g_deviceCnt)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+    return ihipLogStatus(hipSuccess);
+}
+
+// The stream-ordered allocator: the default pool of each device caches the memory that
+// hipMallocAsync allocates, and hipFreeAsync returns it to the pool without waiting. A freed block
+// is fenced by a marker on its stream, so later work on that stream reuses it at once, and other
+// streams wait for the marker on the device.
+
+// hip::MemoryPool operations on the memory of one device; streams are ihipStream_t.
+struct ihipPoolMemoryOps {
+    typedef std::vector<hc::completion_future> Fence;
+
+    int _deviceId;
+
+    void* allocate(size_t sizeBytes) {
+        return hip_internal::allocAndSharePtr("device_mem", sizeBytes,
+                                              ihipGetPrimaryCtx(_deviceId),
+                                              false /*shareWithAll*/, 0 /*amFlags*/,
+                                              0 /*hipFlags*/, 0);
+    }
+
+    void deallocate(void* ptr) { hc::am_free(ptr); }
+
+    // Marks the work queued so far on stream, or on every stream of the device if nullptr.
+    void fence(Fence& fence, const void* stream) {
+        auto capture = [&fence](ihipStream_t* s) {
+            LockedAccessor_StreamCrit_t crit(s->criticalData());
+            if (!crit->_av.get_is_empty()) {
+                fence.push_back(crit->_av.create_marker(hc::accelerator_scope));
+            }
+        };
+
+        if (stream) {
+            capture(static_cast<ihipStream_t*>(const_cast<void*>(stream)));
+            return;
+        }
+        LockedAccessor_CtxCrit_t crit(ihipGetPrimaryCtx(_deviceId)->criticalData());
+        for (auto s : crit->const_streams()) {
+            capture(s);
+        }
+    }
+
+    void copy(Fence& to, const Fence& from) { to = from; }
+
+    bool completed(Fence& fence) {
+        for (auto& cf : fence) {
+            if (!cf.is_ready()) return false;
+        }
+        return true;
+    }
+
+    void wait(Fence& fence) {
+        for (auto& cf : fence) {
+            cf.wait();
+        }
+    }
+
+    void streamWait(const void* stream, Fence& fence) {
+        if (fence.empty()) return;
+
+        auto s = static_cast<ihipStream_t*>(const_cast<void*>(stream));
+        LockedAccessor_StreamCrit_t crit(s->criticalData());
+        for (auto& cf : fence) {
+            crit->_av.create_blocking_marker(cf, hc::accelerator_scope);
+        }
+    }
+
+    void release(Fence& fence) { fence.clear(); }
+};
+
+struct ihipMemPool_t {
+    int _deviceId;
+    hip::MemoryPool<ihipPoolMemoryOps> _pool;
+
+    explicit ihipMemPool_t(int deviceId)
+        : _deviceId(deviceId), _pool(ihipPoolMemoryOps{deviceId}) {}
+};
+
+static ihipMemPool_t* ihipDefaultMemPool(int device) {
+    static std::deque<ihipMemPool_t>* pools = []() {
+        auto pools = new std::deque<ihipMemPool_t>;
+        for (unsigned i = 0; i < g_deviceCnt; i++) {
+            pools->emplace_back(i);
+        }
+        return pools;
+    }();
+    return &(*pools)[device];
+}
+
+static bool ihipIsMemPool(hipMemPool_t memPool) {
+    for (unsigned i = 0; i < g_deviceCnt; i++) {
+        if (memPool == ihipDefaultMemPool(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns ptr, allocated by hipMallocAsync, to its pool once the work queued so far on stream, or
+// on every stream if nullptr, is done. False if the pools do not hold ptr.
+bool ihipMemPoolFree(void* ptr, hipStream_t stream) {
+    for (unsigned i = 0; i < g_deviceCnt; i++) {
+        if (ihipDefaultMemPool(i)->_pool.free(ptr, stream)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ihipMemPoolFind(const void* ptr, void** base, size_t* size) {
+    for (unsigned i = 0; i < g_deviceCnt; i++) {
+        if (ihipDefaultMemPool(i)->_pool.find(ptr, base, size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ihipMemPoolForgetStream(hipStream_t stream) {
+    for (unsigned i = 0; i < g_deviceCnt; i++) {
+        ihipDefaultMemPool(i)->_pool.forgetStream(stream);
+    }
+}
+
+void ihipMemPoolReleaseAboveThreshold(int device) {
+    ihipDefaultMemPool(device)->_pool.releaseAboveThreshold();
+}
+
+static hipError_t ihipMallocAsync(void** ptr, size_t sizeBytes, ihipMemPool_t* memPool,
+                                  hipStream_t stream) {
+    if (ptr == nullptr) {
+        return hipErrorInvalidValue;
+    }
+    *ptr = nullptr;
+    if (sizeBytes == 0) {
+        return hipSuccess;
+    }
+    stream = ihipSyncAndResolveStream(stream);
+    if (stream == nullptr) {
+        return hipErrorInvalidValue;
+    }
+    *ptr = memPool->_pool.allocate(sizeBytes, stream);
+    tprintf(DB_MEM, " %s ptr=%p from pool of device %d\n", __func__, *ptr, memPool->_deviceId);
+    return (*ptr == nullptr) ? hipErrorOutOfMemory : hipSuccess;
+}
+
+hipError_t hipMallocAsync(void** ptr, size_t sizeBytes, hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipMallocAsync, (TRACE_MEM), ptr, sizeBytes, stream);
+    HIP_SET_DEVICE();
+
+    ihipCtx_t* ctx = (stream == hipStreamNull) ? ihipGetTlsDefaultCtx() : stream->getCtx();
+    if (ctx == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    return ihipLogStatus(ihipMallocAsync(ptr, sizeBytes,
+                                         ihipDefaultMemPool(ctx->getDeviceNum()), stream));
+}
+
+hipError_t hipMallocFromPoolAsync(void** ptr, size_t sizeBytes, hipMemPool_t memPool,
+                                  hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipMallocFromPoolAsync, (TRACE_MEM), ptr, sizeBytes, memPool, stream);
+
+    if (!ihipIsMemPool(memPool)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    return ihipLogStatus(ihipMallocAsync(ptr, sizeBytes, memPool, stream));
+}
+
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipFreeAsync, (TRACE_MEM), ptr, stream);
+
+    if (ptr == nullptr) {
+        return ihipLogStatus(hipSuccess);
+    }
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    // Later work on the stream reuses the memory without waiting.
+    if (ihipMemPoolFree(ptr, stream)) {
+        return ihipLogStatus(hipSuccess);
+    }
+
+    hc::accelerator acc;
+#if (__hcc_workweek__ >= 17332)
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, NULL, 0, acc, 0, 0);
+#else
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+#endif
+    if (hc::am_memtracker_getinfo(&amPointerInfo, ptr) != AM_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidDevicePointer);
+    }
+
+    // Memory allocated outside the pools is freed once the work queued on the stream so far is
+    // done; HIP_SYNC_FREE does not apply.
+    stream->locked_wait();
+    hc::am_free(ptr);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipDeviceGetDefaultMemPool(hipMemPool_t* memPool, int device) {
+    HIP_INIT_API(hipDeviceGetDefaultMemPool, memPool, device);
+    if (memPool == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if ((device < 0) || (device >= g_deviceCnt)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+    *memPool = ihipDefaultMemPool(device);
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipMemPoolSetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value) {
+    HIP_INIT_API(hipMemPoolSetAttribute, memPool, attr, value);
+    if (!ihipIsMemPool(memPool) || (value == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    auto& pool = memPool->_pool;
+    hipError_t e = hipSuccess;
+    switch (attr) {
+        case hipMemPoolReuseFollowEventDependencies:
+            // Streams are ordered by the pool itself, not by the application's events.
+            e = (*static_cast<int*>(value) == 0) ? hipSuccess : hipErrorNotSupported;
+            break;
+        case hipMemPoolReuseAllowOpportunistic:
+            e = (*static_cast<int*>(value) != 0) ? hipSuccess : hipErrorNotSupported;
+            break;
+        case hipMemPoolReuseAllowInternalDependencies:
+            pool.setReuseInternalDependencies(*static_cast<int*>(value) != 0);
+            break;
+        case hipMemPoolAttrReleaseThreshold: {
+            const uint64_t threshold = *static_cast<uint64_t*>(value);
+            pool.setReleaseThreshold((threshold < std::numeric_limits<size_t>::max())
+                                         ? static_cast<size_t>(threshold)
+                                         : std::numeric_limits<size_t>::max());
+            break;
+        }
+        case hipMemPoolAttrReservedMemHigh:
+            if (*static_cast<uint64_t*>(value) != 0) {
+                e = hipErrorInvalidValue;
+            } else {
+                pool.resetPeakReserved();
+            }
+            break;
+        case hipMemPoolAttrUsedMemHigh:
+            if (*static_cast<uint64_t*>(value) != 0) {
+                e = hipErrorInvalidValue;
+            } else {
+                pool.resetPeakAllocated();
+            }
+            break;
+        default:
+            e = hipErrorInvalidValue;
+            break;
+    }
+    return ihipLogStatus(e);
+}
+
+hipError_t hipMemPoolGetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value) {
+    HIP_INIT_API(hipMemPoolGetAttribute, memPool, attr, value);
+    if (!ihipIsMemPool(memPool) || (value == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    auto& pool = memPool->_pool;
+    hipError_t e = hipSuccess;
+    switch (attr) {
+        case hipMemPoolReuseFollowEventDependencies:
+            *static_cast<int*>(value) = 0;
+            break;
+        case hipMemPoolReuseAllowOpportunistic:
+            *static_cast<int*>(value) = 1;
+            break;
+        case hipMemPoolReuseAllowInternalDependencies:
+            *static_cast<int*>(value) = pool.reuseInternalDependencies() ? 1 : 0;
+            break;
+        case hipMemPoolAttrReleaseThreshold: {
+            const size_t threshold = pool.releaseThreshold();
+            *static_cast<uint64_t*>(value) = (threshold == std::numeric_limits<size_t>::max())
+                                                 ? std::numeric_limits<uint64_t>::max()
+                                                 : threshold;
+            break;
+        }
+        case hipMemPoolAttrReservedMemCurrent:
+            *static_cast<uint64_t*>(value) = pool.stats().reserved_;
+            break;
+        case hipMemPoolAttrReservedMemHigh:
+            *static_cast<uint64_t*>(value) = pool.stats().peakReserved_;
+            break;
+        case hipMemPoolAttrUsedMemCurrent:
+            *static_cast<uint64_t*>(value) = pool.stats().allocated_;
+            break;
+        case hipMemPoolAttrUsedMemHigh:
+            *static_cast<uint64_t*>(value) = pool.stats().peakAllocated_;
+            break;
+        default:
+            e = hipErrorInvalidValue;
+            break;
+    }
+    return ihipLogStatus(e);
+}
+
+hipError_t hipMemPoolTrimTo(hipMemPool_t memPool, size_t minBytesToKeep) {
+    HIP_INIT_API(hipMemPoolTrimTo, memPool, minBytesToKeep);
+    if (!ihipIsMemPool(memPool)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    memPool->_pool.trim(minBytesToKeep);
+    return ihipLogStatus(hipSuccess);
+}
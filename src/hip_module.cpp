@@ -109,8 +109,10 @@ struct ihipModuleSymbol_t {
     uint64_t _object{};  // The kernel object.
     amd_kernel_code_t const* _header{};
     string _name;  // TODO - review for performance cost.  Name is just used for debug.
-    vector<pair<size_t, size_t>> _kernarg_layout{};
+    hip_impl::Kernarg_layout _kernarg_layout{};
     bool _is_code_object_v3{};
+    hip_impl::Launch_stats_ref _launch_stats{};
+    hip_impl::Launch_policy_ref _launch_policy{};
 };
 
 template <>
@@ -134,6 +136,124 @@ extern hipError_t ihipGetDeviceProperties(hipDeviceProp_t* props, int device);
         return ihipLogStatus(hipStatus);                                                           \
     }
 
+namespace {
+// Packs the arguments of a launch of f at offset dx of kernargs: the explicit ones, passed as
+// kernelParams or extra, followed by the implicit ones, suitably aligned. On success size holds
+// the number of bytes used and implicitOffset where the implicit arguments start, relative to dx.
+hipError_t ihipPackKernargs(hipFunction_t f, void** kernelParams, void** extra,
+                            std::vector<char>& kernargs, size_t dx, size_t* size,
+                            size_t* implicitOffset) {
+    using namespace hip_impl;
+
+    const Kernarg_layout& layout = f->_kernarg_layout;
+    const char* extraArgs = nullptr;
+    size_t explicitSize = 0;
+    if (kernelParams) {
+        if (extra) return hipErrorInvalidValue;
+        explicitSize = layout.size;
+    } else if (extra) {
+        if (extra[0] == HIP_LAUNCH_PARAM_BUFFER_POINTER &&
+            extra[2] == HIP_LAUNCH_PARAM_BUFFER_SIZE && extra[4] == HIP_LAUNCH_PARAM_END) {
+            extraArgs = (const char*)extra[1];
+            explicitSize = *(size_t*)(extra[3]);
+        } else {
+            return hipErrorNotInitialized;
+        }
+
+    } 
+    else if (layout.size_align.size() != 0) {
+        return hipErrorInvalidValue;
+    }
+
+    // 56 bytes for implicit kernel arguments follow the explicit ones, suitably aligned.
+    *implicitOffset = round_up_to_next_multiple_nonnegative(
+        explicitSize, HIP_IMPLICIT_KERNARG_ALIGNMENT);
+    *size = *implicitOffset + HIP_IMPLICIT_KERNARG_SIZE;
+    if (kernargs.size() < dx + *size) kernargs.resize(dx + *size);
+    char* args = &kernargs[dx];
+
+    if (kernelParams) {
+        size_t end = 0;
+        for (size_t i = 0; i != layout.offsets.size(); ++i) {
+            memset(&args[end], 0, layout.offsets[i] - end);
+            memcpy(&args[layout.offsets[i]], kernelParams[i], layout.size_align[i].first);
+            end = layout.offsets[i] + layout.size_align[i].first;
+        }
+    } else if (extraArgs) {
+        memcpy(args, extraArgs, explicitSize);
+    }
+
+    // Only the padding and the implicit kernel arguments are zero filled.
+    memset(&args[explicitSize], 0, *size - explicitSize);
+
+    return hipSuccess;
+}
+
+void ihipInitDispatchPacket(hsa_kernel_dispatch_packet_t* aql, hipFunction_t f,
+                            uint32_t globalWorkSizeX, uint32_t globalWorkSizeY,
+                            uint32_t globalWorkSizeZ, uint32_t localWorkSizeX,
+                            uint32_t localWorkSizeY, uint32_t localWorkSizeZ,
+                            size_t sharedMemBytes, uint32_t flags, const grid_launch_parm& lp,
+                            uint32_t launchPolicy) {
+    memset(aql, 0, sizeof(*aql));
+
+    // aql->completion_signal._handle = 0;
+    // aql->kernarg_address = 0;
+
+    aql->workgroup_size_x = localWorkSizeX;
+    aql->workgroup_size_y = localWorkSizeY;
+    aql->workgroup_size_z = localWorkSizeZ;
+    aql->grid_size_x = globalWorkSizeX;
+    aql->grid_size_y = globalWorkSizeY;
+    aql->grid_size_z = globalWorkSizeZ;
+    if (f->_is_code_object_v3) {
+        const auto* header =
+            reinterpret_cast<const amd_kernel_code_v3_t*>(f->_header);
+        aql->group_segment_size =
+            header->group_segment_fixed_size + sharedMemBytes;
+        aql->private_segment_size =
+            header->private_segment_fixed_size;
+    } else {
+        aql->group_segment_size =
+            f->_header->workgroup_group_segment_byte_size + sharedMemBytes;
+        aql->private_segment_size =
+            f->_header->workitem_private_segment_byte_size;
+    }
+    aql->kernel_object = f->_object;
+    aql->setup = 3 << HSA_KERNEL_DISPATCH_PACKET_SETUP_DIMENSIONS;
+    aql->header =
+        (HSA_PACKET_TYPE_KERNEL_DISPATCH << HSA_PACKET_HEADER_TYPE);
+    if((flags & 0x1)== 0 ) {
+        //in_order
+        aql->header |= (1 << HSA_PACKET_HEADER_BARRIER);
+    }
+
+    if (launchPolicy & hip_impl::launch_policy_serialize) {
+        aql->header |= (1 << HSA_PACKET_HEADER_BARRIER) |
+                       (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_SCACQUIRE_FENCE_SCOPE) |
+                       (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_SCRELEASE_FENCE_SCOPE);
+    } else {
+        aql->header |= lp.launch_fence;
+    }
+}
+
+// The HIP_LAUNCH_POLICY flags that apply to this launch of f.
+uint32_t ihipLaunchPolicy(hipFunction_t f) {
+    return g_launchPolicies ? f->_launch_policy.next_launch(*g_launchPolicies, f->_name) : 0;
+}
+
+// Adds a launch of f, which started at start and waited lockWaitNs for the stream lock, to the
+// statistics of its kernel.
+void ihipRecordLaunch(hipFunction_t f, const dim3& grid, const dim3& block,
+                      size_t sharedMemBytes, uint64_t start, uint64_t lockWaitNs) {
+    const hip_impl::Launch_shape shape{{grid.x, grid.y, grid.z},
+                                       {block.x, block.y, block.z},
+                                       static_cast<uint32_t>(sharedMemBytes)};
+    f->_launch_stats.get(*g_launchStats, f->_name)
+        .record(shape, hip_impl::launch_stats_now() - start, lockWaitNs);
+}
+} // Unnamed namespace.
+
 hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t globalWorkSizeX,
                                   uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
                                   uint32_t localWorkSizeX, uint32_t localWorkSizeY,
@@ -143,6 +263,7 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
                                   void** impCoopParams = 0, hc::accelerator_view* coopAV = 0) {
     using namespace hip_impl;
 
+    const uint64_t launchStart = g_launchStats ? launch_stats_now() : 0;
     auto ctx = ihipGetTlsDefaultCtx();
     hipError_t ret = hipSuccess;
 
@@ -154,94 +275,40 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
         ihipDevice_t* currentDevice = ihipGetDevice(deviceId);
         hsa_agent_t gpuAgent = (hsa_agent_t)currentDevice->_hsaAgent;
 
-        std::vector<char> kernargs{};
-        if (kernelParams) {
-            if (extra) return hipErrorInvalidValue;
-
-            for (auto&& x : f->_kernarg_layout) {
-                const auto p{static_cast<const char*>(*kernelParams)};
-
-                kernargs.insert(
-                    kernargs.cend(),
-                    round_up_to_next_multiple_nonnegative(
-                        kernargs.size(), x.second) - kernargs.size(),
-                    '\0');
-                kernargs.insert(kernargs.cend(), p, p + x.first);
-
-                ++kernelParams;
-            }
-        } else if (extra) {
-            if (extra[0] == HIP_LAUNCH_PARAM_BUFFER_POINTER &&
-                extra[2] == HIP_LAUNCH_PARAM_BUFFER_SIZE && extra[4] == HIP_LAUNCH_PARAM_END) {
-                auto args = (char*)extra[1];
-                size_t argSize = *(size_t*)(extra[3]);
-                kernargs.insert(kernargs.end(), args, args+argSize);
-            } else {
-                return hipErrorNotInitialized;
-            }
-
-        } 
-        else if (f->_kernarg_layout.size() != 0) {
-            return hipErrorInvalidValue;
-        }
-
-        // Insert 56-bytes at the end for implicit kernel arguments and fill with value zero.
-        size_t padSize = (~kernargs.size() + 1) & (HIP_IMPLICIT_KERNARG_ALIGNMENT - 1);
-        kernargs.insert(kernargs.end(), padSize + HIP_IMPLICIT_KERNARG_SIZE, 0);
+        // Kernel arguments are staged in a per-thread buffer. dispatch_hsa_kernel copies them
+        // into the kernarg pool of the accelerator_view before it returns, so the buffer can be
+        // reused by the next launch from this thread without reallocating.
+        std::vector<char>& kernargs = tls->kernargs;
+        size_t kernargSize = 0;
+        size_t implicitOffset = 0;
+        ret = ihipPackKernargs(f, kernelParams, extra, kernargs, 0, &kernargSize,
+                               &implicitOffset);
+        if (ret != hipSuccess) return ret;
 
         if (impCoopParams) {
             const auto p{static_cast<const char*>(*impCoopParams)};
             // The sixth index is for multi-grid synchronization
             copy(p, p + HIP_IMPLICIT_KERNARG_ALIGNMENT,
-                    (kernargs.end() - HIP_IMPLICIT_KERNARG_SIZE) + 6 * HIP_IMPLICIT_KERNARG_ALIGNMENT);
+                    kernargs.begin() + implicitOffset + 6 * HIP_IMPLICIT_KERNARG_ALIGNMENT);
         }
 
         /*
           Kernel argument preparation.
         */
+        const uint32_t launchPolicy = ihipLaunchPolicy(f);
         grid_launch_parm lp;
         lp.dynamic_group_mem_bytes =
             sharedMemBytes;  // TODO - this should be part of preLaunchKernel.
+        uint64_t lockWaitNs = 0;
         hStream = ihipPreLaunchKernel(
             hStream, dim3(globalWorkSizeX/localWorkSizeX, globalWorkSizeY/localWorkSizeY, globalWorkSizeZ/localWorkSizeZ),
-            dim3(localWorkSizeX, localWorkSizeY, localWorkSizeZ), &lp, f->_name.c_str(), isStreamLocked);
+            dim3(localWorkSizeX, localWorkSizeY, localWorkSizeZ), &lp, f->_name.c_str(), isStreamLocked,
+            launchStart ? &lockWaitNs : nullptr);
 
         hsa_kernel_dispatch_packet_t aql;
-
-        memset(&aql, 0, sizeof(aql));
-
-        // aql.completion_signal._handle = 0;
-        // aql.kernarg_address = 0;
-
-        aql.workgroup_size_x = localWorkSizeX;
-        aql.workgroup_size_y = localWorkSizeY;
-        aql.workgroup_size_z = localWorkSizeZ;
-        aql.grid_size_x = globalWorkSizeX;
-        aql.grid_size_y = globalWorkSizeY;
-        aql.grid_size_z = globalWorkSizeZ;
-        if (f->_is_code_object_v3) {
-            const auto* header =
-                reinterpret_cast<const amd_kernel_code_v3_t*>(f->_header);
-            aql.group_segment_size =
-                header->group_segment_fixed_size + sharedMemBytes;
-            aql.private_segment_size =
-                header->private_segment_fixed_size;
-        } else {
-            aql.group_segment_size =
-                f->_header->workgroup_group_segment_byte_size + sharedMemBytes;
-            aql.private_segment_size =
-                f->_header->workitem_private_segment_byte_size;
-        }
-        aql.kernel_object = f->_object;
-        aql.setup = 3 << HSA_KERNEL_DISPATCH_PACKET_SETUP_DIMENSIONS;
-        aql.header =
-            (HSA_PACKET_TYPE_KERNEL_DISPATCH << HSA_PACKET_HEADER_TYPE);
-        if((flags & 0x1)== 0 ) {
-            //in_order
-            aql.header |= (1 << HSA_PACKET_HEADER_BARRIER);
-        }
-
-        aql.header |= lp.launch_fence;
+        ihipInitDispatchPacket(&aql, f, globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ,
+                               localWorkSizeX, localWorkSizeY, localWorkSizeZ, sharedMemBytes,
+                               flags, lp, launchPolicy);
 
         hc::completion_future cf;
 
@@ -249,7 +316,7 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
             lp.av = coopAV;
         }
 
-        lp.av->dispatch_hsa_kernel(&aql, kernargs.data(), kernargs.size(),
+        lp.av->dispatch_hsa_kernel(&aql, kernargs.data(), kernargSize,
                                    (startEvent || stopEvent) ? &cf : nullptr
 #if (__hcc_workweek__ > 17312)
                                    ,
@@ -265,9 +332,15 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
             stopEvent->attachToCompletionFuture(&cf, hStream, hipEventTypeStopCommand);
         }
 
-        ihipPostLaunchKernel(f->_name.c_str(), hStream, lp, isStreamLocked);
-
+        ihipPostLaunchKernel(f->_name.c_str(), hStream, lp, isStreamLocked, launchPolicy);
 
+        if (launchStart) {
+            ihipRecordLaunch(f, dim3(globalWorkSizeX / localWorkSizeX,
+                                     globalWorkSizeY / localWorkSizeY,
+                                     globalWorkSizeZ / localWorkSizeZ),
+                             dim3(localWorkSizeX, localWorkSizeY, localWorkSizeZ),
+                             sharedMemBytes, launchStart, lockWaitNs);
+        }
     }
 
     return ret;
@@ -321,6 +394,118 @@ hipError_t hipHccModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
         localWorkSizeZ, sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent, 0));
 }
 
+hipError_t ihipExtLaunchKernelBatch(TlsData* tls, const hipExtKernelLaunchParams* launchParamsList,
+                                    unsigned int numLaunches, hipStream_t hStream,
+                                    unsigned int flags) {
+    using namespace hip_impl;
+
+    if (numLaunches == 0) return hipSuccess;
+    if (launchParamsList == nullptr) return hipErrorInvalidValue;
+    if (ihipGetTlsDefaultCtx() == nullptr) return hipErrorInvalidDevice;
+
+    // Every launch is checked, and its arguments packed behind those of the previous one in the
+    // per-thread staging buffer, before the stream is locked; a bad entry launches nothing.
+    std::vector<char>& kernargs = tls->kernargs;
+    std::vector<std::pair<size_t, size_t>>& ranges = tls->kernargRanges;
+    ranges.resize(numLaunches);
+    size_t end = 0;
+    for (unsigned int i = 0; i != numLaunches; ++i) {
+        const hipExtKernelLaunchParams& l = launchParamsList[i];
+        if (l.function == nullptr) return hipErrorInvalidResourceHandle;
+        if (l.blockDim.x == 0 || l.blockDim.y == 0 || l.blockDim.z == 0 ||
+            (size_t)l.gridDim.x * (size_t)l.blockDim.x > UINT32_MAX ||
+            (size_t)l.gridDim.y * (size_t)l.blockDim.y > UINT32_MAX ||
+            (size_t)l.gridDim.z * (size_t)l.blockDim.z > UINT32_MAX) {
+            return hipErrorInvalidConfiguration;
+        }
+
+        const size_t dx = round_up_to_next_multiple_nonnegative(
+            end, HIP_IMPLICIT_KERNARG_ALIGNMENT);
+        size_t size = 0;
+        size_t implicitOffset = 0;
+        hipError_t e = ihipPackKernargs(l.function, l.kernelParams, l.extra, kernargs, dx, &size,
+                                        &implicitOffset);
+        if (e != hipSuccess) return e;
+        ranges[i] = std::make_pair(dx, size);
+        end = dx + size;
+    }
+
+    // The stream, and its HSA queue, stay locked for the whole batch, so no other thread can
+    // interleave work with it. Each launch still goes through the same fence selection, tracing
+    // and HIP_LAUNCH_BLOCKING handling as a single one.
+    uint64_t launchStart = g_launchStats ? launch_stats_now() : 0;
+    grid_launch_parm lp;
+    const hipExtKernelLaunchParams& first = launchParamsList[0];
+    lp.dynamic_group_mem_bytes = first.sharedMem;
+    uint64_t lockWaitNs = 0;
+    hStream = ihipPreLaunchKernel(hStream, first.gridDim, first.blockDim, &lp,
+                                  first.function->_name.c_str(), false,
+                                  launchStart ? &lockWaitNs : nullptr);
+#if (__hcc_workweek__ >= 19213)
+    lp.av->acquire_locked_hsa_queue();
+#endif
+
+    for (unsigned int i = 0; i != numLaunches; ++i) {
+        const hipExtKernelLaunchParams& l = launchParamsList[i];
+        const char* name = l.function->_name.c_str();
+        const uint32_t launchPolicy = ihipLaunchPolicy(l.function);
+        if (i != 0) {
+            lp.dynamic_group_mem_bytes = l.sharedMem;
+            ihipPreLaunchKernelLocked(hStream, l.gridDim, l.blockDim, &lp, name);
+        }
+
+        hsa_kernel_dispatch_packet_t aql;
+        ihipInitDispatchPacket(&aql, l.function, l.gridDim.x * l.blockDim.x,
+                               l.gridDim.y * l.blockDim.y, l.gridDim.z * l.blockDim.z,
+                               l.blockDim.x, l.blockDim.y, l.blockDim.z, l.sharedMem, flags, lp,
+                               launchPolicy);
+
+        lp.av->dispatch_hsa_kernel(&aql, &kernargs[ranges[i].first], ranges[i].second, nullptr
+#if (__hcc_workweek__ > 17312)
+                                   ,
+                                   name
+#endif
+        );
+
+        ihipPostLaunchKernel(name, hStream, lp, true /* unlocked below */, launchPolicy);
+
+        // Only the first launch of the batch waits for the stream lock.
+        if (launchStart) {
+            ihipRecordLaunch(l.function, l.gridDim, l.blockDim, l.sharedMem, launchStart,
+                             lockWaitNs);
+            launchStart = launch_stats_now();
+            lockWaitNs = 0;
+        }
+    }
+
+#if (__hcc_workweek__ >= 19213)
+    lp.av->release_locked_hsa_queue();
+#endif
+    hStream->criticalData().unlock();
+
+    return hipSuccess;
+}
+
+hipError_t hipExtLaunchKernelBatch(const hipExtKernelLaunchParams* launchParamsList,
+                                   unsigned int numLaunches, hipStream_t stream,
+                                   unsigned int flags) {
+    HIP_INIT_API(hipExtLaunchKernelBatch, launchParamsList, numLaunches, stream, flags);
+
+    return ihipLogStatus(ihipExtLaunchKernelBatch(tls, launchParamsList, numLaunches, stream,
+                                                  flags));
+}
+
+hipError_t hipExtKernelGetLaunchStats(hipFunction_t f, hipExtKernelLaunchStats* stats) {
+    HIP_INIT_API(hipExtKernelGetLaunchStats, f, stats);
+
+    if (stats == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    if (f == nullptr) return ihipLogStatus(hipErrorInvalidResourceHandle);
+
+    hip_impl::copy_launch_stats(g_launchStats ? g_launchStats->find(f->_name) : nullptr, stats);
+
+    return ihipLogStatus(hipSuccess);
+}
+
 __attribute__((visibility("default")))
 hipError_t ihipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList,
                                               int  numDevices, unsigned int  flags, hip_impl::program_state& ps) {
@@ -344,12 +529,11 @@ hipError_t ihipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList
         if (kds[i] == nullptr) {
             return hipErrorInvalidValue;
         }
-        if (!kds[i]->_kernarg_layout.empty()) continue;
+        if (!kds[i]->_kernarg_layout.size_align.empty()) continue;
 
         hip_impl::kernargs_size_align kargs = ps.get_kernargs_size_align(
                 reinterpret_cast<std::uintptr_t>(lp.func));
-        kds[i]->_kernarg_layout = *reinterpret_cast<const std::vector<std::pair<std::size_t, std::size_t>>*>(
-                kargs.getHandle());
+        kds[i]->_kernarg_layout = hip_impl::kernarg_layout(kargs);
     }
 
     // lock all streams before launching kernels to each device
@@ -407,86 +591,32 @@ hipError_t hipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList,
     return ihipExtLaunchMultiKernelMultiDevice(launchParamsList, numDevices, flags, ps);
 }
 
-void getGprsLdsUsage(hipFunction_t f, size_t* usedVGPRS, size_t* usedSGPRS, size_t* usedLDS)
+static hip_impl::Kernel_resources kernel_resources(hipFunction_t f)
 {
     if (f->_is_code_object_v3) {
         const auto header = reinterpret_cast<const amd_kernel_code_v3_t*>(f->_header);
-        // GRANULATED_WAVEFRONT_VGPR_COUNT is specified in 0:5 bits of COMPUTE_PGM_RSRC1
-        // the granularity for gfx6-gfx9 is max(0, ceil(vgprs_used / 4) - 1)
-        *usedVGPRS = ((header->compute_pgm_rsrc1 & 0x3F) + 1) << 2;
-        // GRANULATED_WAVEFRONT_SGPR_COUNT is specified in 6:9 bits of COMPUTE_PGM_RSRC1
-        // the granularity for gfx9+ is 2 * max(0, ceil(sgprs_used / 16) - 1)
-        *usedSGPRS = ((((header->compute_pgm_rsrc1 & 0x3C0) >> 6) >> 1) + 1) << 4;
-        *usedLDS = header->group_segment_fixed_size;
-    }
-    else {
-        const auto header = f->_header;
-        // VGPRs granularity is 4
-        *usedVGPRS = ((header->workitem_vgpr_count + 3) >> 2) << 2;
-        // adding 2 to take into account the 2 VCC registers & handle the granularity of 16
-        *usedSGPRS = header->wavefront_sgpr_count + 2;
-        *usedSGPRS = ((*usedSGPRS + 15) >> 4) << 4;
-        *usedLDS = header->workgroup_group_segment_byte_size;
+        return hip_impl::kernel_resources_v3(header->compute_pgm_rsrc1,
+                                             header->group_segment_fixed_size);
     }
+    const auto header = f->_header;
+    return hip_impl::kernel_resources_v2(header->workitem_vgpr_count,
+                                         header->wavefront_sgpr_count,
+                                         header->workgroup_group_segment_byte_size);
 }
 
 static hipError_t ihipOccupancyMaxActiveBlocksPerMultiprocessor(
    TlsData *tls, int* numBlocks, hipFunction_t f, int blockSize, size_t dynSharedMemPerBlk)
 {
-    using namespace hip_impl;
-
     auto ctx = ihipGetTlsDefaultCtx();
     if (ctx == nullptr) {
         return hipErrorInvalidDevice;
     }
-    if (numBlocks == nullptr) {
+    if (numBlocks == nullptr || f == nullptr || blockSize <= 0) {
         return hipErrorInvalidValue;
     }
 
-    hipDeviceProp_t prop{};
-    ihipGetDeviceProperties(&prop, ihipGetTlsDefaultCtx()->getDevice()->_deviceId);
-
-    if (blockSize > prop.maxThreadsPerBlock) {
-        *numBlocks = 0;
-        return hipSuccess;
-    }
-
-    prop.regsPerBlock = prop.regsPerBlock ? prop.regsPerBlock : 64 * 1024;
-
-    size_t usedVGPRS = 0;
-    size_t usedSGPRS = 0;
-    size_t usedLDS = 0;
-    getGprsLdsUsage(f, &usedVGPRS, &usedSGPRS, &usedLDS);
-
-    // Due to SPI and private memory limitations, the max of wavefronts per CU in 32
-    size_t wavefrontSize = prop.warpSize;
-    size_t maxWavefrontsPerCU = min(prop.maxThreadsPerMultiProcessor / wavefrontSize, 32);
-
-    const size_t simdPerCU = 4;
-    const size_t maxWavesPerSimd = maxWavefrontsPerCU / simdPerCU;
-
-    size_t numWavefronts = (blockSize + wavefrontSize - 1) / wavefrontSize;
-
-    size_t availableVGPRs = (prop.regsPerBlock / wavefrontSize / simdPerCU);
-    size_t vgprs_alu_occupancy = simdPerCU * (usedVGPRS == 0 ? maxWavesPerSimd
-        : std::min(maxWavesPerSimd, availableVGPRs / usedVGPRS));
-
-    // Calculate blocks occupancy per CU based on VGPR usage
-    *numBlocks = vgprs_alu_occupancy / numWavefronts;
-
-    const size_t availableSGPRs = (prop.gcnArch < 800) ? 512 : 800;
-    size_t sgprs_alu_occupancy = simdPerCU * (usedSGPRS == 0 ? maxWavesPerSimd
-        : std::min(maxWavesPerSimd, availableSGPRs / usedSGPRS));
-
-    // Calculate blocks occupancy per CU based on SGPR usage
-    *numBlocks = std::min(*numBlocks, (int) (sgprs_alu_occupancy / numWavefronts));
-
-    size_t total_used_lds = usedLDS + dynSharedMemPerBlk;
-    if (total_used_lds != 0) {
-      // Calculate LDS occupacy per CU. lds_per_cu / (static_lsd + dynamic_lds)
-      size_t lds_occupancy = prop.maxSharedMemoryPerMultiProcessor / total_used_lds;
-      *numBlocks = std::min(*numBlocks, (int) lds_occupancy);
-    }
+    *numBlocks = ctx->getDevice()->_occupancy.max_active_blocks_per_cu(
+        kernel_resources(f), blockSize, dynSharedMemPerBlk);
 
     return hipSuccess;
 }
@@ -536,8 +666,7 @@ hipError_t ihipLaunchCooperativeKernel(const void* f, dim3 gridDim,
     hip_impl::kernargs_size_align gwsKargs = ps.get_kernargs_size_align(
                     reinterpret_cast<std::uintptr_t>(&init_gws));
 
-    gwsKD->_kernarg_layout = *reinterpret_cast<const std::vector<
-            std::pair<std::size_t, std::size_t>>*>(gwsKargs.getHandle());
+    gwsKD->_kernarg_layout = hip_impl::kernarg_layout(gwsKargs);
 
     // Prepare the kernel descriptor for the main kernel
     hipFunction_t kd = ps.kernel_descriptor(
@@ -550,8 +679,7 @@ hipError_t ihipLaunchCooperativeKernel(const void* f, dim3 gridDim,
             ps.get_kernargs_size_align(
                     reinterpret_cast<std::uintptr_t>(f));
 
-    kd->_kernarg_layout = *reinterpret_cast<const std::vector<
-            std::pair<std::size_t, std::size_t>>*>(kargs.getHandle());
+    kd->_kernarg_layout = hip_impl::kernarg_layout(kargs);
 
     GET_TLS();
     int numBlocksPerSm = 0;
@@ -707,8 +835,7 @@ hipError_t ihipLaunchCooperativeKernelMultiDevice(hipLaunchParams* launchParamsL
         }
         hip_impl::kernargs_size_align gwsKargs = ps.get_kernargs_size_align(
                 reinterpret_cast<std::uintptr_t>(&init_gws));
-        gwsKds[i]->_kernarg_layout = *reinterpret_cast<const std::vector<std::pair<std::size_t, std::size_t>>*>(
-                gwsKargs.getHandle());
+        gwsKds[i]->_kernarg_layout = hip_impl::kernarg_layout(gwsKargs);
 
 
         kds.push_back(ps.kernel_descriptor(reinterpret_cast<std::uintptr_t>(lp.func),
@@ -718,8 +845,7 @@ hipError_t ihipLaunchCooperativeKernelMultiDevice(hipLaunchParams* launchParamsL
         }
         hip_impl::kernargs_size_align kargs = ps.get_kernargs_size_align(
                 reinterpret_cast<std::uintptr_t>(lp.func));
-        kds[i]->_kernarg_layout = *reinterpret_cast<const std::vector<std::pair<std::size_t, std::size_t>>*>(
-                kargs.getHandle());
+        kds[i]->_kernarg_layout = hip_impl::kernarg_layout(kargs);
 
         int numBlocksPerSm = 0;
         result = ihipOccupancyMaxActiveBlocksPerMultiprocessor(tls, &numBlocksPerSm, kds[i],
@@ -1326,11 +1452,8 @@ const amd_kernel_code_v3_t *header_v3(const ihipModuleSymbol_t& kd) {
 hipFuncAttributes make_function_attributes(TlsData *tls, ihipModuleSymbol_t& kd) {
     hipFuncAttributes r{};
 
-    hipDeviceProp_t prop{};
-    hipGetDeviceProperties(&prop, ihipGetTlsDefaultCtx()->getDevice()->_deviceId);
-    // TODO: at the moment there is no way to query the count of registers
-    //       available per CU, therefore we hardcode it to 64 KiRegisters.
-    prop.regsPerBlock = prop.regsPerBlock ? prop.regsPerBlock : 64 * 1024;
+    const ihipDevice_t* device = ihipGetTlsDefaultCtx()->getDevice();
+    const hipDeviceProp_t& prop = device->_props;
 
     if (kd._is_code_object_v3) {
         r.binaryVersion = 0; // FIXME: should it be the ISA version or code
@@ -1346,44 +1469,9 @@ hipFuncAttributes make_function_attributes(TlsData *tls, ihipModuleSymbol_t& kd)
     }
     r.maxDynamicSharedSizeBytes = prop.sharedMemPerBlock - r.sharedSizeBytes;
 
-    size_t usedVGPRS = 0;
-    size_t usedSGPRS = 0;
-    size_t usedLDS = 0;
-    getGprsLdsUsage(&kd, &usedVGPRS, &usedSGPRS, &usedLDS);
-
-    r.numRegs = usedVGPRS;
-
-    size_t wavefrontSize = prop.warpSize;
-    size_t maxWavefrontsPerBlock = prop.maxThreadsPerBlock / wavefrontSize;
-    size_t maxWavefrontsPerCU = min(prop.maxThreadsPerMultiProcessor / wavefrontSize, 32);
-    const size_t numSIMD = 4;
-    const size_t maxWavesPerSimd = maxWavefrontsPerCU / numSIMD;
-    size_t maxWaves = 0;
-    for (int i = 0; i < maxWavefrontsPerBlock; i++) {
-        size_t wavefronts = i + 1;
-
-        if (usedVGPRS > 0) {
-            size_t availableVGPRs = (prop.regsPerBlock / wavefrontSize / numSIMD);
-            size_t vgprs_alu_occupancy = numSIMD * std::min(maxWavesPerSimd, availableVGPRs / usedVGPRS);
-
-            // Calculate blocks occupancy per CU based on VGPR usage
-            if (vgprs_alu_occupancy < wavefronts)
-                break;
-        }
-
-        if (usedSGPRS > 0) {
-            const size_t availableSGPRs = (prop.gcnArch < 800) ? 512 : 800;
-            size_t sgprs_alu_occupancy = numSIMD * ((usedSGPRS == 0) ? maxWavesPerSimd
-                : std::min(maxWavesPerSimd, availableSGPRs / usedSGPRS));
-
-            // Calculate blocks occupancy per CU based on SGPR usage
-            if (sgprs_alu_occupancy < wavefronts)
-                break;
-        }
-        maxWaves = wavefronts;
-    }
-
-    r.maxThreadsPerBlock = maxWaves * wavefrontSize;
+    const auto resources = kernel_resources(&kd);
+    r.numRegs = resources.vgprs;
+    r.maxThreadsPerBlock = hip_impl::max_block_size(device->_occupancy.limits(), resources);
     r.ptxVersion = prop.major * 10 + prop.minor; // HIP currently presents itself as PTX 3.0.
 
     return r;
@@ -1535,110 +1623,16 @@ hipError_t ihipOccupancyMaxPotentialBlockSize(TlsData *tls, int* gridSize, int*
                                               hipFunction_t f, size_t dynSharedMemPerBlk,
                                               int blockSizeLimit)
 {
-    using namespace hip_impl;
-
     auto ctx = ihipGetTlsDefaultCtx();
     if (ctx == nullptr) {
         return hipErrorInvalidDevice;
     }
-
-    hipDeviceProp_t prop{};
-    ihipGetDeviceProperties(&prop, ihipGetTlsDefaultCtx()->getDevice()->_deviceId);
-
-    prop.regsPerBlock = prop.regsPerBlock ? prop.regsPerBlock : 64 * 1024;
-
-    size_t usedVGPRS = 0;
-    size_t usedSGPRS = 0;
-    size_t usedLDS = 0;
-    getGprsLdsUsage(f, &usedVGPRS, &usedSGPRS, &usedLDS);
-
-    // try different workgroup sizes to find the maximum potential occupancy
-    // based on the usage of VGPRs and LDS
-    size_t wavefrontSize = prop.warpSize;
-    size_t maxWavefrontsPerBlock = prop.maxThreadsPerBlock / wavefrontSize;
-
-    // Due to SPI and private memory limitations, the max of wavefronts per CU in 32
-    size_t maxWavefrontsPerCU = min(prop.maxThreadsPerMultiProcessor / wavefrontSize, 32);
-
-    const size_t numSIMD = 4;
-    size_t maxActivWaves = 0;
-    size_t maxWavefronts = 0;
-    for (int i = 0; i < maxWavefrontsPerBlock; i++) {
-        size_t wavefrontsPerWG = i + 1;
-
-        // workgroup per CU is 40 for WG size of 1 wavefront; otherwise it is 16
-        size_t maxWorkgroupPerCU = (wavefrontsPerWG == 1) ? 40 : 16;
-        size_t maxWavesWGLimited = min(wavefrontsPerWG * maxWorkgroupPerCU, maxWavefrontsPerCU);
-
-        // Compute VGPR limited wavefronts per block
-        size_t wavefrontsVGPRS;
-        if (usedVGPRS == 0) {
-            wavefrontsVGPRS = maxWavesWGLimited;
-        }
-        else {
-            // find how many VGPRs are available for each SIMD
-            size_t numVGPRsPerSIMD = (prop.regsPerBlock / wavefrontSize / numSIMD);
-            wavefrontsVGPRS = (numVGPRsPerSIMD / usedVGPRS) * numSIMD;
-        }
-
-        size_t maxWavesVGPRSLimited = 0;
-        if (wavefrontsVGPRS > maxWavesWGLimited) {
-            maxWavesVGPRSLimited = maxWavesWGLimited;
-        }
-        else {
-            maxWavesVGPRSLimited = (wavefrontsVGPRS / wavefrontsPerWG) * wavefrontsPerWG;
-        }
-
-        // Compute SGPR limited wavefronts per block
-        size_t wavefrontsSGPRS;
-        if (usedSGPRS == 0) {
-            wavefrontsSGPRS = maxWavesWGLimited;
-        }
-        else {
-            const size_t numSGPRsPerSIMD = (prop.gcnArch < 800) ? 512 : 800;
-            wavefrontsSGPRS = (numSGPRsPerSIMD / usedSGPRS) * numSIMD;
-        }
-
-        size_t maxWavesSGPRSLimited = 0;
-        if (wavefrontsSGPRS > maxWavesWGLimited) {
-            maxWavesSGPRSLimited = maxWavesWGLimited;
-        }
-        else {
-            maxWavesSGPRSLimited = (wavefrontsSGPRS / wavefrontsPerWG) * wavefrontsPerWG;
-        }
-
-        // Compute LDS limited wavefronts per block
-        size_t wavefrontsLDS;
-        if (usedLDS == 0) {
-            wavefrontsLDS = maxWorkgroupPerCU * wavefrontsPerWG;
-        }
-        else {
-            size_t availableSharedMemPerCU = prop.maxSharedMemoryPerMultiProcessor;
-            size_t workgroupPerCU = availableSharedMemPerCU / (usedLDS + dynSharedMemPerBlk);
-            wavefrontsLDS = min(workgroupPerCU, maxWorkgroupPerCU) * wavefrontsPerWG;
-        }
-
-        size_t maxWavesLDSLimited = min(wavefrontsLDS, maxWavefrontsPerCU);
-
-        size_t activeWavefronts = 0;
-        size_t tmp_min = (size_t)min(maxWavesLDSLimited, maxWavesWGLimited);
-        tmp_min = min(maxWavesSGPRSLimited, tmp_min);
-        activeWavefronts = min(maxWavesVGPRSLimited, tmp_min);
-
-        if (maxActivWaves <= activeWavefronts) {
-            maxActivWaves = activeWavefronts;
-            maxWavefronts = wavefrontsPerWG;
-        }
-    }
-
-    // determine the grid and block sizes for maximum potential occupancy
-    size_t maxThreadsCnt = prop.maxThreadsPerMultiProcessor*prop.multiProcessorCount;
-    if (blockSizeLimit > 0) {
-       maxThreadsCnt = min(maxThreadsCnt, blockSizeLimit);
+    if (gridSize == nullptr || blockSize == nullptr || f == nullptr) {
+        return hipErrorInvalidValue;
     }
 
-    *blockSize = maxWavefronts * wavefrontSize;
-    *gridSize = min((maxThreadsCnt + *blockSize - 1) / *blockSize, prop.multiProcessorCount);
+    ctx->getDevice()->_occupancy.max_potential_block_size(
+        kernel_resources(f), dynSharedMemPerBlk, blockSizeLimit, gridSize, blockSize);
 
     return hipSuccess;
 }
@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// The process-wide cache of pageable host ranges pinned for hipMemcpy, enabled
+// with HIP_PIN_CACHE_SIZE. HIP does not see the application release memory,
+// so the cached ranges are registered with a userfaultfd that reports them
+// being unmapped, remapped or discarded; a thread reads the reports and hands
+// them to the cache. Where the kernel does not offer this, the cache stays
+// disabled. Ranges are also dropped when HIP allocates, frees or registers
+// memory overlapping them, and by hipHostUnregister.
+
+#include "hsa/hsa.h"
+#include "hsa/hsa_ext_amd.h"
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc_internal.h"
+#include "pin_cache.inl"
+#include "trace_helper.h"
+
+#include <fcntl.h>
+#if defined(__linux__)
+    #include <linux/userfaultfd.h>
+#endif
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <thread>
+
+namespace {
+    void* pin(void* p, std::size_t n)
+    {
+        void* r{};
+        if (hsa_amd_memory_lock(p, n, nullptr, 0, &r) != HSA_STATUS_SUCCESS) {
+            return nullptr;
+        }
+
+        return r;
+    }
+
+    void unpin(void* p) { hsa_amd_memory_unlock(p); }
+
+#if defined(__NR_userfaultfd) && defined(UFFD_FEATURE_EVENT_UNMAP)
+    // Reports the unmapping of watched ranges to the cache. Registering a range
+    // for missing pages is the only way to receive its events, so the reading
+    // thread also supplies zero pages to faults on watched ranges whose pages
+    // were discarded before the cache let go of them.
+    class Unmap_watch {
+        int fd_;
+        std::size_t page_;
+
+        void read_events(hip_impl::Pin_cache& cache)
+        {
+            uffd_msg msgs[16];
+            for (;;) {
+                pollfd p{fd_, POLLIN, 0};
+                if (poll(&p, 1, -1) <= 0) continue;
+
+                // A thread that unmaps a watched range resumes once its event
+                // has been read, possibly before it has reached the cache.
+                cache.begin_unmapped();
+                const auto r = read(fd_, msgs, sizeof(msgs));
+                const std::size_t n = r > 0 ? r / sizeof(uffd_msg) : 0;
+                for (std::size_t i = 0; i != n; ++i) {
+                    const auto& m = msgs[i];
+                    switch (m.event) {
+                    case UFFD_EVENT_UNMAP:
+                        cache.unmapped(
+                            reinterpret_cast<void*>(m.arg.remove.start),
+                            m.arg.remove.end - m.arg.remove.start);
+                        break;
+                    case UFFD_EVENT_REMOVE:
+                        // The range stays mapped; it is unregistered at once
+                        // so that its next faults do not come here.
+                        cache.unmapped(
+                            reinterpret_cast<void*>(m.arg.remove.start),
+                            m.arg.remove.end - m.arg.remove.start);
+                        unwatch(reinterpret_cast<void*>(m.arg.remove.start),
+                                m.arg.remove.end - m.arg.remove.start);
+                        break;
+                    case UFFD_EVENT_REMAP:
+                        cache.unmapped(reinterpret_cast<void*>(m.arg.remap.from),
+                                       m.arg.remap.len);
+                        break;
+                    case UFFD_EVENT_PAGEFAULT: {
+                        uffdio_zeropage z{};
+                        z.range.start = m.arg.pagefault.address / page_ * page_;
+                        z.range.len = page_;
+                        ioctl(fd_, UFFDIO_ZEROPAGE, &z);
+                        break;
+                    }
+                    default: break;
+                    }
+                }
+                cache.end_unmapped();
+            }
+        }
+    public:
+        // Faults from the kernel must be served as well, which rules out
+        // UFFD_USER_MODE_ONLY; unprivileged processes therefore depend on
+        // vm.unprivileged_userfaultfd.
+        Unmap_watch(std::size_t page)
+            : fd_{static_cast<int>(
+                  syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK))},
+              page_{page}
+        {
+            if (fd_ < 0) return;
+
+            uffdio_api api{};
+            api.api = UFFD_API;
+            api.features = UFFD_FEATURE_EVENT_UNMAP | UFFD_FEATURE_EVENT_REMOVE |
+                           UFFD_FEATURE_EVENT_REMAP;
+            if (ioctl(fd_, UFFDIO_API, &api) != 0) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+
+        explicit operator bool() const noexcept { return fd_ >= 0; }
+
+        // The cache outlives main, hence the detached thread.
+        void start(hip_impl::Pin_cache& cache)
+        {
+            std::thread{[this, &cache]() { read_events(cache); }}.detach();
+        }
+
+        // Ranges whose faults cannot be served with zero pages, such as
+        // hugetlbfs mappings, are not watched.
+        bool watch(void* p, std::size_t n)
+        {
+            uffdio_register r{};
+            r.range.start = reinterpret_cast<std::uintptr_t>(p);
+            r.range.len = n;
+            r.mode = UFFDIO_REGISTER_MODE_MISSING;
+            if (ioctl(fd_, UFFDIO_REGISTER, &r) != 0) return false;
+            if (r.ioctls & (std::uint64_t{1} << _UFFDIO_ZEROPAGE)) return true;
+
+            unwatch(p, n);
+
+            return false;
+        }
+
+        // Part of the range may have been unmapped, which fails the whole
+        // request; what is still mapped is then unregistered piecewise.
+        void unwatch(void* p, std::size_t n)
+        {
+            uffdio_range r{reinterpret_cast<std::uintptr_t>(p), n};
+            if (ioctl(fd_, UFFDIO_UNREGISTER, &r) == 0 || errno != ENOMEM ||
+                n <= page_) return;
+
+            const auto h = n / 2 / page_ * page_;
+            unwatch(p, h);
+            unwatch(static_cast<char*>(p) + h, n - h);
+        }
+    };
+#else
+    struct Unmap_watch {
+        Unmap_watch(std::size_t) {}
+
+        explicit operator bool() const noexcept { return false; }
+
+        void start(hip_impl::Pin_cache&) {}
+        bool watch(void*, std::size_t) { return false; }
+        void unwatch(void*, std::size_t) {}
+    };
+#endif
+
+    void trace(const char* event, const void* p, std::size_t n,
+               const hip_impl::Pin_cache::Stats& s)
+    {
+        tprintf(DB_COPY,
+                "pin cache %s %p+%zu: hits=%zu misses=%zu evictions=%zu "
+                "invalidations=%zu pinned=%zuKB\n",
+                event, p, n, s.hits, s.misses, s.evictions, s.invalidations,
+                s.pinned_bytes / 1024);
+    }
+} // Unnamed namespace.
+
+namespace hip_impl {
+Pin_cache& host_pin_cache()
+{
+    static Pin_cache* r{[]() {
+        const auto sz = sysconf(_SC_PAGESIZE);
+        const auto page = sz > 0 ? static_cast<std::size_t>(sz) : 4096u;
+        auto budget =
+            static_cast<std::size_t>(std::max(HIP_PIN_CACHE_SIZE, 0)) << 20;
+
+        auto w = budget ? new Unmap_watch{page} : nullptr;
+        if (w && !*w) {
+            tprintf(DB_COPY, "pin cache disabled: userfaultfd is not "
+                             "available to watch for unmapped memory\n");
+            delete w;
+            w = nullptr;
+            budget = 0;
+        }
+
+        auto c = new Pin_cache{budget, pin, unpin, page};
+        c->set_observer(trace);
+        if (w) {
+            c->set_watch([w](void* p, std::size_t n) { return w->watch(p, n); },
+                         [w](void* p, std::size_t n) { w->unwatch(p, n); });
+            w->start(*c);
+        }
+
+        return c;
+    }()};
+
+    return *r;
+}
+} // Namespace hip_impl.
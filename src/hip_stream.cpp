@@ -59,25 +59,19 @@ hipError_t ihipStreamCreate(TlsData *tls, hipStream_t* stream, unsigned int flag
         } else if( NULL == stream ){
             e = hipErrorInvalidValue;
         } else {
-            hc::accelerator acc = ctx->getWriteableDevice()->_acc;
-
             // TODO - se try-catch loop to detect memory exception?
             //
-            // Note this is an execute_any_order queue,
-            // CUDA stream behavior is that all kernels submitted will automatically
-            // wait for prev to complete, this behaviour will be mainatined by
-            // hipModuleLaunchKernel. execute_any_order will help
-            // hipExtModuleLaunchKernel , which uses a special flag
+            // The queue is a new one, or with HIP_STREAM_QUEUES one shared with other streams
+            // of the same priority; see ihipDevice_t::_queuePool.
 
             {
                 // Obtain mutex access to the device critical data, release by destructor
                 LockedAccessor_CtxCrit_t ctxCrit(ctx->criticalData());
 
-#if defined(__HCC__) && (__hcc_major__ < 3) && (__hcc_minor__ < 3)
-                auto istream = new ihipStream_t(ctx, acc.create_view(), flags);
-#else
-                auto istream = new ihipStream_t(ctx, acc.create_view(Kalmar::execute_any_order, Kalmar::queuing_mode_automatic, (Kalmar::queue_priority)priority), flags);
-#endif
+                hip_impl::Hw_queue_lease lease;
+                auto av = ctx->getWriteableDevice()->_queuePool.acquire(priority, &lease);
+                auto istream = new ihipStream_t(ctx, av, flags);
+                istream->_queueLease = lease;
 
                 ctxCrit->addStream(istream);
                 *stream = istream;
@@ -184,7 +178,13 @@ hipError_t hipStreamQuery(hipStream_t stream) {
 hipError_t hipStreamSynchronize(hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipStreamSynchronize, TRACE_SYNC, stream);
 
-    return ihipLogStatus(ihipStreamSynchronize(tls, stream));
+    hipError_t e = ihipStreamSynchronize(tls, stream);
+    ihipCtx_t* ctx = (stream == hipStreamNull) ? ihipGetTlsDefaultCtx() : stream->getCtx();
+    if (ctx) {
+        ihipMemPoolReleaseAboveThreshold(ctx->getDeviceNum());
+    }
+
+    return ihipLogStatus(e);
 }
 
 
@@ -204,6 +204,9 @@ hipError_t hipStreamDestroy(hipStream_t stream) {
         }
     } else {
         stream->locked_wait();
+        // Memory freed on the stream must not be taken for free by a later stream at the same
+        // address.
+        ihipMemPoolForgetStream(stream);
 
         ihipCtx_t* ctx = stream->getCtx();
 
@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #include "../include/hip/hiprtc.h"
 #include "code_object_bundle.inl"
+#include "hiprtc_cache.inl"
 #include "../include/hip/hcc_detail/elfio/elfio.hpp"
 #include "../include/hip/hcc_detail/program_state.hpp"
 
@@ -48,6 +49,7 @@ THE SOFTWARE.
 #include <vector>
 
 #include <iostream>
+#include <ftw.h>
 #include <sys/stat.h>
 
 extern "C" const char* hiprtcGetErrorString(hiprtcResult x)
@@ -82,13 +84,6 @@ extern "C" const char* hiprtcGetErrorString(hiprtcResult x)
 }
 
 namespace hip_impl {
-inline bool create_directory(const std::string& path) {
-    mode_t mode = 0755;
-    int ret = mkdir(path.c_str(), mode);
-    if (ret == 0) return true;
-    return false;
-}
-
 inline bool fileExists (const std::string& name) {
   struct stat buffer;   
   return (stat (name.c_str(), &buffer) == 0); 
@@ -399,26 +394,34 @@ namespace
         std::string path_{};
     public:
         // CREATORS
-        Unique_temporary_path() : path_{std::tmpnam(nullptr)}
+        Unique_temporary_path()
         {
-            while (hip_impl::fileExists(path_)) {
-                path_ = std::tmpnam(nullptr);
-            }
+            const char* tmpdir{getenv("TMPDIR")};
+            std::string tmpl{(tmpdir ? tmpdir : "/tmp") + std::string{"/hiprtcXXXXXX"}};
+
+            if (mkdtemp(&tmpl[0])) path_ = std::move(tmpl);
         }
 
-        Unique_temporary_path(const Unique_temporary_path&) = default;
-        Unique_temporary_path(Unique_temporary_path&&) = default;
+        Unique_temporary_path(const Unique_temporary_path&) = delete;
+        Unique_temporary_path(Unique_temporary_path&& x) noexcept
+            : path_{std::move(x.path_)}
+        {
+            x.path_.clear();
+        }
 
         ~Unique_temporary_path() noexcept
         {
-            std::string s("rm -r " + path_);
-            system(s.c_str());
+            if (path_.empty()) return;
+
+            nftw(path_.c_str(), [](const char* p, const struct stat*, int,
+                                   struct FTW*) {
+                return std::remove(p);
+            }, 16, FTW_DEPTH | FTW_PHYS);
         }
 
         // MANIPULATORS
         Unique_temporary_path& operator=(
-            const Unique_temporary_path&) = default;
-        Unique_temporary_path& operator=(Unique_temporary_path&&) = default;
+            const Unique_temporary_path&) = delete;
 
         // ACCESSORS
         const std::string& path() const noexcept
@@ -428,6 +431,51 @@ namespace
     };
 } // Unnamed namespace.
 
+namespace
+{
+    // Compilation results are cached on disk when HIPRTC_CACHE_PATH is set.
+    // HIPRTC_CACHE_MAX_SIZE bounds the size of the cache in bytes (1 GiB by
+    // default), and HIPRTC_CACHE_STATS=1 prints the hits, misses and
+    // evictions of the process to stderr when it exits.
+    hip_impl::Code_object_cache* compilationCache()
+    {
+        static hip_impl::Code_object_cache* r{[]() {
+            const char* path{getenv("HIPRTC_CACHE_PATH")};
+            if (!path || !*path) return (hip_impl::Code_object_cache*)nullptr;
+
+            const char* max_size{getenv("HIPRTC_CACHE_MAX_SIZE")};
+            const char* stats{getenv("HIPRTC_CACHE_STATS")};
+            if (stats && std::atoi(stats)) {
+                std::atexit([]() {
+                    const auto c = compilationCache();
+                    std::fprintf(stderr,
+                                 "hiprtc cache %s: %zu hits, %zu misses, "
+                                 "%zu evictions\n",
+                                 c->path().c_str(), c->hits(), c->misses(),
+                                 c->evictions());
+                });
+            }
+
+            return new hip_impl::Code_object_cache{
+                path, max_size ? std::strtoull(max_size, nullptr, 0)
+                               : (1ull << 30)};
+        }()};
+
+        return r;
+    }
+
+    // The compiler itself is part of the key, so that an upgraded hipcc
+    // does not serve stale code objects.
+    std::string compilerIdentity(const std::string& hipcc)
+    {
+        struct stat s{};
+        stat(hipcc.c_str(), &s);
+
+        return hipcc + ':' + std::to_string(s.st_size) + ':' +
+               std::to_string(s.st_mtime);
+    }
+} // Unnamed namespace.
+
 namespace
 {
     const std::string& defaultTarget()
@@ -508,21 +556,41 @@ extern "C" hiprtcResult hiprtcCompileProgram(hiprtcProgram p, int n, const char*
         return HIPRTC_ERROR_INTERNAL_ERROR;
     }
 
-    Unique_temporary_path tmp{};
-    hip_impl::create_directory(tmp.path());
-
-    const auto src{p->writeTemporaryFiles(tmp.path())};
-
     vector<string> args{hipcc, "-fPIC -shared"};
     if (n) args.insert(args.cend(), o, o + n);
 
     handleTarget(args);
 
-    args.emplace_back(src);
-    args.emplace_back("-o");
-    args.emplace_back(tmp.path() + '/' + "hiprtc.out");
+    const auto compile = [&](string& log, vector<char>& elf) {
+        Unique_temporary_path tmp{};
+        if (tmp.path().empty()) return false;
+
+        auto compile_args = args;
+        compile_args.emplace_back(p->writeTemporaryFiles(tmp.path()));
+        compile_args.emplace_back("-o");
+        compile_args.emplace_back(tmp.path() + '/' + "hiprtc.out");
+
+        const bool r{p->compile(compile_args)};
+        log = p->log;
+        elf = p->elf;
+
+        return r;
+    };
+
+    auto cache = compilationCache();
+    if (cache) {
+        hip_impl::Code_object_cache::Key key;
+        key.add(compilerIdentity(hipcc)).add(p->name).add(p->source);
+        for (auto&& x : p->headers) key.add(x.first).add(x.second);
+        for (auto&& x : p->names) key.add(x.first);
+        for (auto&& x : args) key.add(x);
+
+        if (!cache->lookup_or_compile(key, p->log, p->elf, compile)) {
+            return HIPRTC_ERROR_INTERNAL_ERROR;
+        }
+    }
+    else if (!compile(p->log, p->elf)) return HIPRTC_ERROR_INTERNAL_ERROR;
 
-    if (!p->compile(args)) return HIPRTC_ERROR_INTERNAL_ERROR;
     if (!p->readLoweredNames()) return HIPRTC_ERROR_INTERNAL_ERROR;
 
     p->compiled = true;
@@ -0,0 +1,299 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Persistent, content-addressed cache of hiprtc compilation results.
+//
+// An entry is keyed on everything that can influence the produced code object
+// (source, headers, name expressions, compiler, options and target ISA). The
+// key is hashed to form the file name and stored verbatim inside the entry,
+// so that hash collisions are detected on lookup. Entries are published by
+// renaming a fully written temporary file, and the directory is kept below a
+// size bound by evicting the least recently used entries (the modification
+// time of an entry is refreshed on every hit).
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+class Code_object_cache {
+public:
+    // Key under construction; pieces are length-prefixed so that moving bytes
+    // between adjacent fields yields a different key.
+    class Key {
+        // DATA
+        std::string material_;
+    public:
+        // MANIPULATORS
+        Key& add(const std::string& x)
+        {
+            material_ += std::to_string(x.size());
+            material_ += ':';
+            material_ += x;
+
+            return *this;
+        }
+
+        // ACCESSORS
+        const std::string& material() const noexcept
+        {
+            return material_;
+        }
+
+        std::string hash() const
+        {
+            // Two independent FNV-1a 64-bit hashes; collisions are still
+            // resolved by comparing the stored key material.
+            std::uint64_t h0{0xcbf29ce484222325ull};
+            std::uint64_t h1{0x84222325cbf29ce4ull};
+            for (auto&& c : material_) {
+                h0 = (h0 ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+                h1 = (h1 * 0x100000001b3ull) ^ static_cast<unsigned char>(c);
+            }
+
+            char r[33]{};
+            std::snprintf(r, sizeof(r), "%016llx%016llx",
+                          static_cast<unsigned long long>(h0),
+                          static_cast<unsigned long long>(h1));
+
+            return r;
+        }
+    };
+
+    using Compiler = std::function<bool(std::string&, std::vector<char>&)>;
+
+private:
+    static constexpr std::size_t magic_size_{8};
+
+    static const char* magic() noexcept { return "HIPRTCC1"; }
+    static const std::string& extension()
+    {
+        static const std::string r{".hipco"};
+
+        return r;
+    }
+
+    // DATA
+    std::string path_;
+    std::size_t max_size_;
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+    std::atomic<std::size_t> evictions_{0};
+
+    // IMPLEMENTATION
+    static
+    bool create_directories(const std::string& path)
+    {
+        for (auto dx = path.find('/', 1); ; dx = path.find('/', dx + 1)) {
+            const auto p{path.substr(0, dx)};
+            if (mkdir(p.c_str(), 0755) != 0 && errno != EEXIST) return false;
+            if (dx == std::string::npos) return true;
+        }
+    }
+
+    static
+    void write_blob(std::ofstream& f, const char* p, std::uint64_t n)
+    {
+        f.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        f.write(p, n);
+    }
+
+    static
+    bool read_blob(std::ifstream& f, std::string& x)
+    {
+        std::uint64_t n{};
+        if (!f.read(reinterpret_cast<char*>(&n), sizeof(n))) return false;
+
+        x.resize(n);
+
+        return n == 0 || f.read(&x[0], n);
+    }
+
+    std::string entry_path(const Key& key) const
+    {
+        return path_ + '/' + key.hash() + extension();
+    }
+
+    bool read_entry(const std::string& file, const Key& key,
+                    std::string& log, std::vector<char>& code) const
+    {
+        std::ifstream f{file, std::ios::binary};
+        if (!f) return false;
+
+        char m[magic_size_]{};
+        if (!f.read(m, sizeof(m)) ||
+            !std::equal(m, m + sizeof(m), magic())) return false;
+
+        std::string material;
+        if (!read_blob(f, material) || material != key.material()) return false;
+
+        std::string elf;
+        if (!read_blob(f, log) || !read_blob(f, elf)) return false;
+
+        code.assign(elf.cbegin(), elf.cend());
+
+        return true;
+    }
+
+    void publish(const Key& key, const std::string& log,
+                 const std::vector<char>& code)
+    {
+        if (!create_directories(path_)) return;
+
+        const auto file{entry_path(key)};
+        const auto tmp{file + '.' + std::to_string(getpid()) + '.' +
+                       std::to_string(std::hash<std::thread::id>{}(
+                           std::this_thread::get_id())) + ".tmp"};
+        {
+            std::ofstream f{tmp, std::ios::binary | std::ios::trunc};
+            f.write(magic(), magic_size_);
+            write_blob(f, key.material().data(), key.material().size());
+            write_blob(f, log.data(), log.size());
+            write_blob(f, code.data(), code.size());
+
+            if (!f.flush()) {
+                f.close();
+                std::remove(tmp.c_str());
+                return;
+            }
+        }
+
+        // Readers only ever see complete entries.
+        if (std::rename(tmp.c_str(), file.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return;
+        }
+
+        evict(file);
+    }
+
+    void evict(const std::string& keep)
+    {
+        struct Entry {
+            std::string file;
+            std::size_t size;
+            timespec last_use;
+        };
+
+        std::vector<Entry> entries;
+        std::size_t total{0};
+
+        DIR* dir = opendir(path_.c_str());
+        if (!dir) return;
+        while (const dirent* x = readdir(dir)) {
+            const std::string name{x->d_name};
+            const auto ext{extension().size()};
+            if (name.size() <= ext ||
+                name.compare(name.size() - ext, ext, extension()) != 0) continue;
+
+            struct stat s;
+            const auto file{path_ + '/' + name};
+            if (stat(file.c_str(), &s) != 0) continue;
+
+            entries.push_back(Entry{file, static_cast<std::size_t>(s.st_size),
+                                    s.st_mtim});
+            total += s.st_size;
+        }
+        closedir(dir);
+
+        if (total <= max_size_) return;
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& x, const Entry& y) {
+            return x.last_use.tv_sec < y.last_use.tv_sec ||
+                   (x.last_use.tv_sec == y.last_use.tv_sec &&
+                    x.last_use.tv_nsec < y.last_use.tv_nsec);
+        });
+
+        for (auto&& x : entries) {
+            if (total <= max_size_) break;
+            if (x.file == keep) continue;
+
+            // Another process may have evicted it already.
+            if (std::remove(x.file.c_str()) == 0) ++evictions_;
+            total -= x.size;
+        }
+    }
+public:
+    // CREATORS
+    Code_object_cache(std::string path, std::size_t max_size)
+        : path_{std::move(path)}, max_size_{max_size}
+    {}
+
+    Code_object_cache(const Code_object_cache&) = delete;
+
+    // MANIPULATORS
+    Code_object_cache& operator=(const Code_object_cache&) = delete;
+
+    // Returns the cached result for key if there is one, otherwise invokes
+    // compile and publishes its result on success.
+    bool lookup_or_compile(const Key& key, std::string& log,
+                           std::vector<char>& code, const Compiler& compile)
+    {
+        const auto file{entry_path(key)};
+
+        if (read_entry(file, key, log, code)) {
+            // Mark as most recently used.
+            utimensat(AT_FDCWD, file.c_str(), nullptr, 0);
+            ++hits_;
+
+            return true;
+        }
+
+        ++misses_;
+        log.clear();
+        code.clear();
+
+        if (!compile(log, code)) return false;
+
+        publish(key, log, code);
+
+        return true;
+    }
+
+    // ACCESSORS
+    const std::string& path() const noexcept { return path_; }
+    std::size_t max_size() const noexcept { return max_size_; }
+    std::size_t hits() const noexcept { return hits_; }
+    std::size_t misses() const noexcept { return misses_; }
+    std::size_t evictions() const noexcept { return evictions_; }
+};
+
+}  // namespace hip_impl
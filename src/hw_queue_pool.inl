@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Pool of the hardware queues that the streams of a device share, selected
+// with HIP_STREAM_QUEUES. Every priority gets at most a fixed number of
+// queues, created on first use and kept until the pool is trimmed, so that
+// creating and destroying a stream does not create and destroy a queue.
+//
+// A stream leases one queue when it is created and keeps it for its whole
+// life, so its commands are ordered by the queue exactly as they are on a
+// queue of its own. Streams that share a queue are also ordered with respect
+// to each other, which only ever adds waits.
+//
+// The queues are made by a factory supplied by the owner, which keeps the
+// pool independent of HCC; the factory is invoked with the pool's lock held.
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hip_impl {
+
+// The queue of a stream in its pool; a stream with a queue of its own has
+// no slot.
+struct Hw_queue_lease {
+    static constexpr std::size_t no_slot{static_cast<std::size_t>(-1)};
+
+    int priority{0};
+    std::size_t slot{no_slot};
+
+    bool pooled() const { return slot != no_slot; }
+};
+
+enum class Hw_queue_assignment {
+    least_loaded,  // the queue with the fewest streams, lowest index first
+    round_robin    // the queues in turn
+};
+
+template<typename Queue>
+class Hw_queue_pool {
+public:
+    using Factory = std::function<Queue(int priority)>;
+private:
+    struct Slot {
+        std::unique_ptr<Queue> queue;
+        std::size_t streams{0};
+    };
+    struct Level {
+        std::vector<Slot> slots;
+        std::size_t next{0};
+    };
+
+    Factory factory_;
+    std::size_t queues_per_priority_{0};
+    Hw_queue_assignment assignment_{Hw_queue_assignment::least_loaded};
+    mutable std::mutex mutex_;
+    std::map<int, Level> levels_;
+
+    std::size_t pick_(Level& l) const
+    {
+        if (assignment_ == Hw_queue_assignment::round_robin) {
+            const auto r = l.next;
+            l.next = (l.next + 1) % l.slots.size();
+
+            return r;
+        }
+
+        std::size_t r = 0;
+        for (std::size_t i = 1; i != l.slots.size(); ++i) {
+            if (l.slots[i].streams < l.slots[r].streams) r = i;
+        }
+
+        return r;
+    }
+public:
+    Hw_queue_pool() = default;
+    Hw_queue_pool(const Hw_queue_pool&) = delete;
+    Hw_queue_pool& operator=(const Hw_queue_pool&) = delete;
+
+    // Sets up the pool, dropping any queues it holds. With no queues per
+    // priority every stream gets a queue of its own.
+    void reset(Factory factory, std::size_t queues_per_priority,
+               Hw_queue_assignment assignment)
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        factory_ = std::move(factory);
+        queues_per_priority_ = queues_per_priority;
+        assignment_ = assignment;
+        levels_.clear();
+    }
+
+    bool pooled() const
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        return queues_per_priority_ != 0;
+    }
+
+    // Returns the queue of a new stream with the given priority, and in
+    // lease what must be passed to release when the stream is destroyed.
+    Queue acquire(int priority, Hw_queue_lease* lease)
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        *lease = Hw_queue_lease{};
+        if (queues_per_priority_ == 0) return factory_(priority);
+
+        auto& l = levels_[priority];
+        if (l.slots.empty()) l.slots.resize(queues_per_priority_);
+
+        const auto dx = pick_(l);
+        auto& s = l.slots[dx];
+        if (!s.queue) s.queue.reset(new Queue{factory_(priority)});
+        ++s.streams;
+
+        lease->priority = priority;
+        lease->slot = dx;
+
+        return *s.queue;
+    }
+
+    void release(const Hw_queue_lease& lease)
+    {
+        if (!lease.pooled()) return;
+
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        const auto it = levels_.find(lease.priority);
+        if (it == levels_.cend() || lease.slot >= it->second.slots.size()) return;
+
+        auto& s = it->second.slots[lease.slot];
+        if (s.streams) --s.streams;
+    }
+
+    // The number of streams on each queue of a priority, or 0 for the
+    // queues not created yet.
+    std::vector<std::size_t> loads(int priority) const
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        std::vector<std::size_t> r;
+        const auto it = levels_.find(priority);
+        if (it == levels_.cend()) return r;
+        for (auto&& x : it->second.slots) r.push_back(x.streams);
+
+        return r;
+    }
+
+    // The number of queues created so far, for every priority.
+    std::size_t queue_count() const
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        std::size_t r = 0;
+        for (auto&& l : levels_) {
+            for (auto&& x : l.second.slots) r += static_cast<bool>(x.queue);
+        }
+
+        return r;
+    }
+
+    // Drops the queues that no stream uses; the others are kept.
+    void trim()
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        for (auto&& l : levels_) {
+            for (auto&& x : l.second.slots) {
+                if (x.streams == 0) x.queue.reset();
+            }
+        }
+    }
+};
+
+}  // namespace hip_impl
@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Kernel descriptors of AMDGPU code objects, read straight from the ELF image
+// rather than through HSA, so that tools can report the resources of the
+// kernels in a code object without a GPU. Clang offload bundles are split
+// into the code objects they contain.
+
+#include "mapped_elf.inl"
+#include "occupancy.inl"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace hip_impl {
+
+namespace elf {
+    // Code object v2 kernel symbols
+    constexpr unsigned char stt_amdgpu_hsa_kernel{10};
+}  // namespace elf
+
+// Invokes fn(const std::string& name, const Kernel_resources&) for every
+// kernel of a code object: the .kd symbols of code object v3, and the
+// STT_AMDGPU_HSA_KERNEL symbols of code object v2.
+template<typename F>
+inline
+void for_each_kernel_descriptor(const Elf_image& image, F fn)
+{
+    static constexpr std::size_t v3_size{64};
+    static constexpr std::size_t v2_size{256};
+    static constexpr char kd_suffix[]{".kd"};
+
+    auto symtab = image.section_by_type(elf::sht_symtab);
+    if (symtab.sh_type == elf::sht_null) symtab = image.section_by_type(elf::sht_dynsym);
+
+    const auto read_u16 = [](const char* p) {
+        std::uint16_t r;
+        std::memcpy(&r, p, sizeof(r));
+        return r;
+    };
+    const auto read_u32 = [](const char* p) {
+        std::uint32_t r;
+        std::memcpy(&r, p, sizeof(r));
+        return r;
+    };
+
+    image.for_each_symbol(symtab, [&](const elf::Sym& s, const char* name) {
+        const std::size_t len = std::strlen(name);
+        const bool v3 = s.type() == elf::stt_object && len > sizeof(kd_suffix) - 1 &&
+                        std::strcmp(name + len - (sizeof(kd_suffix) - 1), kd_suffix) == 0;
+        const bool v2 = s.type() == elf::stt_amdgpu_hsa_kernel;
+        if (!v3 && !v2) return true;
+
+        // The descriptor lives in the section the symbol is defined in.
+        const auto section = image.section_at(s.st_shndx);
+        const auto d = image.data(section);
+        const std::size_t size = v3 ? v3_size : v2_size;
+        if (s.st_shndx == elf::shn_undef || s.st_value < section.sh_addr ||
+            s.st_value - section.sh_addr > d.size() ||
+            d.size() - (s.st_value - section.sh_addr) < size) return true;
+
+        const char* p = d.data() + (s.st_value - section.sh_addr);
+        if (v3) {
+            // compute_pgm_rsrc1 is at offset 48 of amd_kernel_code_v3_t
+            fn(std::string{name, len - (sizeof(kd_suffix) - 1)},
+               kernel_resources_v3(read_u32(p + 48), read_u32(p)));
+        } else {
+            // amd_kernel_code_t: workgroup_group_segment_byte_size at 64,
+            // wavefront_sgpr_count at 84 and workitem_vgpr_count at 86
+            fn(std::string{name},
+               kernel_resources_v2(read_u16(p + 86), read_u16(p + 84), read_u32(p + 64)));
+        }
+
+        return true;
+    });
+}
+
+// Invokes fn(const std::string& triple, const Elf_image&) for every code
+// object of a Clang offload bundle, or once with an empty triple if the blob is
+// a code object itself. Returns false if it is neither.
+template<typename F>
+inline
+bool for_each_code_object(Blob_view blob, F fn)
+{
+    static constexpr char magic[]{"__CLANG_OFFLOAD_BUNDLE__"};
+    static constexpr std::size_t magic_size{sizeof(magic) - 1};
+
+    const auto read_u64 = [](const char* p) {
+        std::uint64_t r;
+        std::memcpy(&r, p, sizeof(r));
+        return r;
+    };
+
+    if (blob.size() < magic_size || std::memcmp(blob.data(), magic, magic_size) != 0) {
+        const Elf_image image{blob.data(), blob.size()};
+        if (!image) return false;
+
+        fn(std::string{}, image);
+        return true;
+    }
+
+    // The header is followed by (offset, size, triple size, triple) entries.
+    std::size_t dx = magic_size;
+    if (blob.size() - dx < sizeof(std::uint64_t)) return false;
+    auto count = read_u64(blob.data() + dx);
+    dx += sizeof(std::uint64_t);
+
+    for (; count != 0; --count) {
+        if (blob.size() - dx < 3 * sizeof(std::uint64_t)) return false;
+        const auto offset = read_u64(blob.data() + dx);
+        const auto size = read_u64(blob.data() + dx + 8);
+        const auto triple_size = read_u64(blob.data() + dx + 16);
+        dx += 3 * sizeof(std::uint64_t);
+
+        if (blob.size() - dx < triple_size) return false;
+        const std::string triple{blob.data() + dx, static_cast<std::size_t>(triple_size)};
+        dx += triple_size;
+
+        if (offset > blob.size() || size > blob.size() - offset) return false;
+        const Elf_image image{blob.data() + offset, static_cast<std::size_t>(size)};
+        if (image) fn(triple, image);
+    }
+
+    return true;
+}
+
+}  // namespace hip_impl
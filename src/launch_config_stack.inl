@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// The launch configurations pushed by <<<>>> and hipConfigureCall, and not yet
+// consumed by the launch, together with the arguments set by
+// hipSetupArgument. One stack is kept per thread, so launches never touch
+// shared state; its depth is fixed, and arguments live inline in each entry
+// unless they outgrow it, in which case the entry's spill buffer is reused by
+// later launches.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace hip_impl {
+
+template<typename Config,
+         std::size_t max_depth = 8,
+         std::size_t inline_args_size = 256>
+class Launch_config_stack {
+public:
+    class Entry {
+        friend class Launch_config_stack;
+
+        // DATA
+        Config config_{};
+        std::size_t args_size_{};
+        alignas(alignof(std::max_align_t)) char inline_args_[inline_args_size];
+        std::vector<char> spill_;
+        bool spilled_{};
+
+        // IMPLEMENTATION
+        void reset(const Config& x)
+        {
+            config_ = x;
+            args_size_ = 0;
+            spilled_ = false;
+        }
+    public:
+        // ACCESSORS
+        const Config& config() const noexcept { return config_; }
+        const char* args() const noexcept
+        {
+            return spilled_ ? spill_.data() : inline_args_;
+        }
+        std::size_t args_size() const noexcept { return args_size_; }
+
+        // MANIPULATORS
+        // Copies n bytes to offset dx of the arguments; any gap left before dx
+        // reads as zero.
+        void set_arg(std::size_t dx, const void* p, std::size_t n)
+        {
+            const auto sz = std::max(args_size_, dx + n);
+
+            if (!spilled_ && sz > inline_args_size) {
+                spill_.assign(inline_args_, inline_args_ + args_size_);
+                spilled_ = true;
+            }
+
+            char* args = inline_args_;
+            if (spilled_) {
+                spill_.resize(sz);
+                args = spill_.data();
+            }
+            if (dx > args_size_) std::memset(args + args_size_, 0, dx - args_size_);
+
+            std::memcpy(args + dx, p, n);
+            args_size_ = sz;
+        }
+    };
+
+    // MANIPULATORS
+    // False, leaving the stack unchanged, if it is full.
+    bool push(const Config& x) noexcept
+    {
+        if (size_ == max_depth) return false;
+
+        entries_[size_++].reset(x);
+
+        return true;
+    }
+
+    // The popped entry stays valid until the next push.
+    void pop() noexcept { --size_; }
+
+    Entry& top() noexcept { return entries_[size_ - 1]; }
+
+    // ACCESSORS
+    bool empty() const noexcept { return size_ == 0; }
+    std::size_t size() const noexcept { return size_; }
+    const Entry& top() const noexcept { return entries_[size_ - 1]; }
+private:
+    // DATA
+    std::array<Entry, max_depth> entries_;
+    std::size_t size_{};
+};
+
+}  // namespace hip_impl
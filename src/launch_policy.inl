@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Per-kernel launch policies, selected with HIP_LAUNCH_POLICY and
+// HIP_LAUNCH_BLOCKING_KERNELS. The rules are glob patterns over kernel names;
+// each kernel is matched against them once, the first time it is launched,
+// and its functions keep the result, so that a launch only tests a flag.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hip_impl {
+
+enum Launch_policy_flags : std::uint32_t {
+    launch_policy_block = 1u << 0,      // wait for the kernel after launching it
+    launch_policy_serialize = 1u << 1,  // start it after all prior work on its
+                                        // stream, with system scope fences
+    launch_policy_trace = 1u << 2       // print the launch to stderr
+};
+
+// Whether name matches pattern, in which '*' matches any sequence of
+// characters and '?' any single character.
+inline
+bool glob_match(const char* pattern, const char* name)
+{
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        }
+        else if (*pattern == '?' || *pattern == *name) {
+            ++pattern;
+            ++name;
+        }
+        else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        }
+        else return false;
+    }
+    while (*pattern == '*') ++pattern;
+
+    return *pattern == '\0';
+}
+
+// The policy of one kernel: its flags apply to one in every sample_period
+// launches of it.
+class Kernel_launch_policy {
+    std::uint32_t flags_;
+    std::uint32_t sample_period_;
+    mutable std::atomic<std::uint64_t> launches_{0};
+public:
+    Kernel_launch_policy(std::uint32_t flags, std::uint32_t sample_period)
+        : flags_{flags}, sample_period_{flags ? sample_period : 0}
+    {}
+
+    std::uint32_t flags() const { return flags_; }
+    std::uint32_t sample_period() const { return sample_period_; }
+
+    // The flags that apply to the next launch.
+    std::uint32_t next_launch() const
+    {
+        if (sample_period_ > 1 &&
+            launches_.fetch_add(1, std::memory_order_relaxed) % sample_period_ != 0) {
+            return 0;
+        }
+
+        return flags_;
+    }
+};
+
+class Launch_policy_table {
+    struct Rule {
+        std::string pattern;
+        std::uint32_t flags;
+        std::uint32_t sample_period;
+    };
+
+    std::vector<Rule> rules_;
+    mutable std::mutex mutex_;
+    mutable std::unordered_map<
+        std::string, std::unique_ptr<const Kernel_launch_policy>> kernels_;
+public:
+    bool empty() const { return rules_.empty(); }
+
+    void add(std::string pattern, std::uint32_t flags, std::uint32_t sample_period = 0)
+    {
+        rules_.push_back(Rule{std::move(pattern), flags, sample_period});
+    }
+
+    // Adds a rule written as "pattern:policy[+policy...]", where a policy is
+    // block, serialize, trace or sample=N. Returns false, and adds nothing,
+    // if the rule is malformed. Rules must all be added before the first
+    // lookup.
+    bool add(const std::string& rule)
+    {
+        const auto colon = rule.rfind(':');
+        if (colon == 0 || colon == std::string::npos) return false;
+
+        std::uint32_t flags = 0;
+        std::uint32_t sample_period = 0;
+        for (std::size_t dx = colon + 1; dx <= rule.size();) {
+            auto end = rule.find('+', dx);
+            if (end == std::string::npos) end = rule.size();
+            const std::string p = rule.substr(dx, end - dx);
+            if (p == "block") flags |= launch_policy_block;
+            else if (p == "serialize") flags |= launch_policy_serialize;
+            else if (p == "trace") flags |= launch_policy_trace;
+            else if (p.compare(0, 7, "sample=") == 0 && p.size() > 7) {
+                char* last = nullptr;
+                const unsigned long n = std::strtoul(p.c_str() + 7, &last, 10);
+                if (*last != '\0' || n == 0 || n > UINT32_MAX) return false;
+                sample_period = static_cast<std::uint32_t>(n);
+            }
+            else return false;
+            dx = end + 1;
+        }
+        if (!flags) return false;
+
+        add(rule.substr(0, colon), flags, sample_period);
+
+        return true;
+    }
+
+    // The policy of the kernel called name: the flags of every rule that
+    // matches it, sampled with the period of the last such rule that sets
+    // one. Kernels are matched once, and keep their policy for the life of
+    // the table.
+    const Kernel_launch_policy& find(const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        auto& r = kernels_[name];
+        if (!r) {
+            std::uint32_t flags = 0;
+            std::uint32_t sample_period = 0;
+            for (auto&& x : rules_) {
+                if (!glob_match(x.pattern.c_str(), name.c_str())) continue;
+                flags |= x.flags;
+                if (x.sample_period) sample_period = x.sample_period;
+            }
+            r.reset(new Kernel_launch_policy{flags, sample_period});
+        }
+
+        return *r;
+    }
+};
+
+// The policy of a function, looked up in the table on its first launch and
+// kept with the function from then on. Copies of a function look it up
+// again.
+class Launch_policy_ref {
+    mutable std::atomic<const Kernel_launch_policy*> p_{nullptr};
+public:
+    Launch_policy_ref() = default;
+    Launch_policy_ref(const Launch_policy_ref&) {}
+    Launch_policy_ref& operator=(const Launch_policy_ref&) { return *this; }
+
+    // The flags that apply to the next launch of the function.
+    std::uint32_t next_launch(const Launch_policy_table& table, const std::string& name) const
+    {
+        auto p = p_.load(std::memory_order_acquire);
+        if (!p) {
+            p = &table.find(name);
+            p_.store(p, std::memory_order_release);
+        }
+
+        return p->flags() ? p->next_launch() : 0;
+    }
+};
+
+}  // namespace hip_impl
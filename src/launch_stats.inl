@@ -0,0 +1,359 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Per-kernel launch statistics, collected by the HCC and VDI runtimes when
+// HIP_KERNEL_STATS is set: how often each kernel is launched, with which
+// shapes, how long the host takes to enqueue a launch and how much of that is
+// spent waiting for a lock. Launching threads only update relaxed atomics;
+// a lock is taken the first time a function is launched.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace hip_impl {
+
+inline
+std::uint64_t launch_stats_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Histogram of durations in nanoseconds, with 8 linear buckets per power of
+// two, so that percentiles are within 12.5% of the exact value. Durations
+// of 2^40 ns, about 18 minutes, or more share the last bucket.
+class Latency_histogram {
+public:
+    static constexpr unsigned sub_bucket_bits{3};
+    static constexpr unsigned max_bits{40};
+    static constexpr std::size_t bucket_count{
+        (max_bits - sub_bucket_bits + 1) << sub_bucket_bits};
+private:
+    std::atomic<std::uint64_t> buckets_[bucket_count];
+    std::atomic<std::uint64_t> total_{0};
+    std::atomic<std::uint64_t> max_{0};
+public:
+    static
+    std::size_t bucket(std::uint64_t ns)
+    {
+        static constexpr std::uint64_t sub{1u << sub_bucket_bits};
+
+        if (ns < sub) return ns;
+        if (ns >> max_bits) return bucket_count - 1;
+
+#if defined(__GNUC__)
+        const unsigned msb = 63 - __builtin_clzll(ns);
+#else
+        unsigned msb = 0;
+        for (std::uint64_t x = ns; x >>= 1;) ++msb;
+#endif
+        const unsigned shift = msb - sub_bucket_bits;
+
+        return ((shift + 1) << sub_bucket_bits) | ((ns >> shift) & (sub - 1));
+    }
+
+    // Largest duration that falls in bucket b.
+    static
+    std::uint64_t bucket_limit(std::size_t b)
+    {
+        static constexpr std::uint64_t sub{1u << sub_bucket_bits};
+
+        if (b < sub) return b;
+
+        const unsigned shift = (b >> sub_bucket_bits) - 1;
+        const std::uint64_t mantissa = sub | (b & (sub - 1));
+
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    Latency_histogram()
+    {
+        for (auto&& x : buckets_) x.store(0, std::memory_order_relaxed);
+    }
+
+    void record(std::uint64_t ns)
+    {
+        buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(ns, std::memory_order_relaxed);
+
+        auto m = max_.load(std::memory_order_relaxed);
+        while (ns > m &&
+               !max_.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+    }
+
+    std::uint64_t count() const
+    {
+        std::uint64_t r = 0;
+        for (auto&& x : buckets_) r += x.load(std::memory_order_relaxed);
+
+        return r;
+    }
+    std::uint64_t total() const { return total_.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // The duration that fraction p of the recorded ones do not exceed,
+    // rounded up to the limit of its bucket.
+    std::uint64_t percentile(double p) const
+    {
+        const std::uint64_t n = count();
+        if (n == 0) return 0;
+
+        const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p * n + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b != bucket_count; ++b) {
+            seen += buckets_[b].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(bucket_limit(b), max());
+        }
+
+        return max();
+    }
+};
+
+struct Launch_shape {
+    std::uint32_t grid[3];   // blocks
+    std::uint32_t block[3];  // threads
+    std::uint32_t dynamic_lds;
+
+    friend
+    bool operator==(const Launch_shape& x, const Launch_shape& y)
+    {
+        return std::equal(x.grid, x.grid + 3, y.grid) &&
+               std::equal(x.block, x.block + 3, y.block) &&
+               x.dynamic_lds == y.dynamic_lds;
+    }
+};
+
+// Launch counts of the first shapes a kernel is launched with; launches with
+// any other shape are only counted together.
+class Launch_shapes {
+public:
+    static constexpr std::size_t capacity{8};
+private:
+    enum : std::uint32_t { empty, writing, ready };
+
+    struct Slot {
+        std::atomic<std::uint32_t> state{empty};
+        Launch_shape shape{};  // immutable once ready
+        std::atomic<std::uint64_t> count{0};
+    };
+
+    Slot slots_[capacity];
+    std::atomic<std::uint64_t> other_{0};
+public:
+    void record(const Launch_shape& s)
+    {
+        for (auto&& x : slots_) {
+            auto state = x.state.load(std::memory_order_acquire);
+            if (state == empty &&
+                x.state.compare_exchange_strong(state, writing, std::memory_order_acquire)) {
+                x.shape = s;
+                x.state.store(ready, std::memory_order_release);
+                x.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // A shape is being added: it may be this one, which must not be
+            // added twice.
+            while (state == writing) {
+                std::this_thread::yield();
+                state = x.state.load(std::memory_order_acquire);
+            }
+            if (x.shape == s) {
+                x.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        other_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Invokes fn(const Launch_shape&, std::uint64_t count) for every shape
+    // recorded, in the order they were first seen.
+    template<typename F>
+    void for_each(F fn) const
+    {
+        for (auto&& x : slots_) {
+            if (x.state.load(std::memory_order_acquire) != ready) break;
+            fn(x.shape, x.count.load(std::memory_order_relaxed));
+        }
+    }
+
+    std::uint64_t other() const { return other_.load(std::memory_order_relaxed); }
+};
+
+struct Kernel_launch_stats {
+    const std::string name;
+    std::atomic<std::uint64_t> launches{0};
+    Launch_shapes shapes;
+    Latency_histogram enqueue;    // from entering the launch to returning
+    Latency_histogram lock_wait;  // part of enqueue spent acquiring a lock
+
+    explicit
+    Kernel_launch_stats(std::string n) : name{std::move(n)} {}
+
+    void record(const Launch_shape& shape, std::uint64_t enqueue_ns,
+                std::uint64_t lock_wait_ns)
+    {
+        launches.fetch_add(1, std::memory_order_relaxed);
+        shapes.record(shape);
+        enqueue.record(enqueue_ns);
+        lock_wait.record(lock_wait_ns);
+    }
+};
+
+// Statistics are kept by kernel name for the life of the process, so that the
+// functions of a kernel on every device share them, and kernels of unloaded
+// modules are still reported at exit.
+class Launch_stats_table {
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Kernel_launch_stats>> stats_;
+public:
+    Kernel_launch_stats& get(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        auto& r = stats_[name];
+        if (!r) r.reset(new Kernel_launch_stats{name});
+
+        return *r;
+    }
+
+    const Kernel_launch_stats* find(const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+
+        const auto it = stats_.find(name);
+
+        return it == stats_.cend() ? nullptr : it->second.get();
+    }
+
+    // Prints the kernels launched so far, by decreasing total enqueue time.
+    void dump(std::FILE* out) const
+    {
+        std::vector<const Kernel_launch_stats*> v;
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            for (auto&& x : stats_) v.push_back(x.second.get());
+        }
+        std::sort(v.begin(), v.end(), [](const Kernel_launch_stats* x,
+                                         const Kernel_launch_stats* y) {
+            return x->enqueue.total() > y->enqueue.total();
+        });
+
+        const auto us = [](std::uint64_t ns) { return ns / 1000.0; };
+        std::fprintf(out, "HIP kernel launch statistics, times in us:\n");
+        std::fprintf(out, "%10s %10s %8s %8s %8s %8s %8s  %s\n", "launches", "enqueue",
+                     "p50", "p99", "max", "lock p99", "lock max", "kernel");
+        for (auto&& x : v) {
+            std::fprintf(out, "%10llu %10.1f %8.1f %8.1f %8.1f %8.1f %8.1f  %s\n",
+                         static_cast<unsigned long long>(x->launches.load()),
+                         us(x->enqueue.total()), us(x->enqueue.percentile(0.5)),
+                         us(x->enqueue.percentile(0.99)), us(x->enqueue.max()),
+                         us(x->lock_wait.percentile(0.99)), us(x->lock_wait.max()),
+                         x->name.c_str());
+            x->shapes.for_each([&](const Launch_shape& s, std::uint64_t n) {
+                std::fprintf(out, "%10llu   grid(%u,%u,%u) block(%u,%u,%u) dynamic LDS %u\n",
+                             static_cast<unsigned long long>(n), s.grid[0], s.grid[1],
+                             s.grid[2], s.block[0], s.block[1], s.block[2], s.dynamic_lds);
+            });
+            if (x->shapes.other()) {
+                std::fprintf(out, "%10llu   other shapes\n",
+                             static_cast<unsigned long long>(x->shapes.other()));
+            }
+        }
+    }
+};
+
+// Copies k to a hipExtKernelLaunchStats, which is a template parameter so
+// that this file does not depend on the HIP headers.
+template<typename S>
+inline
+void copy_launch_stats(const Kernel_launch_stats* k, S* s)
+{
+    *s = S{};
+    if (!k) return;
+
+    const auto copy = [](const Latency_histogram& h, decltype(s->enqueue)& r) {
+        r.totalNs = h.total();
+        r.p50Ns = h.percentile(0.5);
+        r.p90Ns = h.percentile(0.9);
+        r.p99Ns = h.percentile(0.99);
+        r.maxNs = h.max();
+    };
+
+    s->launches = k->launches.load(std::memory_order_relaxed);
+    k->shapes.for_each([&](const Launch_shape& x, std::uint64_t n) {
+        constexpr std::size_t capacity = sizeof(s->shapes) / sizeof(s->shapes[0]);
+        if (s->shapeCount == capacity) {
+            s->otherShapeLaunches += n;
+            return;
+        }
+        auto& r = s->shapes[s->shapeCount++];
+        r.gridDim.x = x.grid[0];
+        r.gridDim.y = x.grid[1];
+        r.gridDim.z = x.grid[2];
+        r.blockDim.x = x.block[0];
+        r.blockDim.y = x.block[1];
+        r.blockDim.z = x.block[2];
+        r.sharedMemBytes = x.dynamic_lds;
+        r.launches = n;
+    });
+    s->otherShapeLaunches += k->shapes.other();
+    copy(k->enqueue, s->enqueue);
+    copy(k->lock_wait, s->lockWait);
+}
+
+// The statistics of a function, looked up in the table on its first launch
+// and kept with the function from then on. Copies of a function look them up
+// again.
+class Launch_stats_ref {
+    mutable std::atomic<Kernel_launch_stats*> p_{nullptr};
+public:
+    Launch_stats_ref() = default;
+    Launch_stats_ref(const Launch_stats_ref&) {}
+    Launch_stats_ref& operator=(const Launch_stats_ref&) { return *this; }
+
+    Kernel_launch_stats& get(Launch_stats_table& table, const std::string& name) const
+    {
+        auto p = p_.load(std::memory_order_acquire);
+        if (!p) {
+            p = &table.get(name);
+            p_.store(p, std::memory_order_release);
+        }
+
+        return *p;
+    }
+};
+
+}  // namespace hip_impl
@@ -87,7 +87,8 @@ namespace hip_impl
         //               locked_stream is deletable.
         using L = decltype(stream->lockopen_preKernelCommand());
 
-        stream->lockclose_postKernelCommand(kernel_name, acc_v);
+        stream->lockclose_postKernelCommand(kernel_name, acc_v, false,
+                                            ihipLaunchPolicy(kernel_name));
 
         delete static_cast<L*>(locked_stream);
         if(HIP_PROFILE_API) {
@@ -0,0 +1,337 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Read-only access to ELF64 images that are either memory mapped from disk or
+// already resident in memory (e.g. a code object blob). Only the file header,
+// the section header table and the sections that are explicitly asked for are
+// touched, so locating .kernel or .symtab in a large host DSO costs a handful
+// of page faults rather than a full parse. Nothing is copied: sections,
+// symbol names and notes are handed out as views into the image.
+//
+// The ELF structures are restated here rather than taken from <elf.h> so that
+// this header can coexist with ELFIO, which defines the same macros.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace hip_impl {
+
+// Non-owning view of a contiguous range of bytes.
+class Blob_view {
+    // DATA
+    const char* data_{};
+    std::size_t size_{};
+public:
+    // CREATORS
+    Blob_view() = default;
+    Blob_view(const char* data, std::size_t size) : data_{data}, size_{size} {}
+
+    // ACCESSORS
+    const char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    const char* begin() const noexcept { return data_; }
+    const char* end() const noexcept { return data_ + size_; }
+};
+
+namespace elf {
+    struct Ehdr {
+        unsigned char e_ident[16];
+        std::uint16_t e_type;
+        std::uint16_t e_machine;
+        std::uint32_t e_version;
+        std::uint64_t e_entry;
+        std::uint64_t e_phoff;
+        std::uint64_t e_shoff;
+        std::uint32_t e_flags;
+        std::uint16_t e_ehsize;
+        std::uint16_t e_phentsize;
+        std::uint16_t e_phnum;
+        std::uint16_t e_shentsize;
+        std::uint16_t e_shnum;
+        std::uint16_t e_shstrndx;
+    };
+
+    struct Shdr {
+        std::uint32_t sh_name;
+        std::uint32_t sh_type;
+        std::uint64_t sh_flags;
+        std::uint64_t sh_addr;
+        std::uint64_t sh_offset;
+        std::uint64_t sh_size;
+        std::uint32_t sh_link;
+        std::uint32_t sh_info;
+        std::uint64_t sh_addralign;
+        std::uint64_t sh_entsize;
+    };
+
+    struct Sym {
+        std::uint32_t st_name;
+        unsigned char st_info;
+        unsigned char st_other;
+        std::uint16_t st_shndx;
+        std::uint64_t st_value;
+        std::uint64_t st_size;
+
+        unsigned char type() const noexcept { return st_info & 0xf; }
+    };
+
+    struct Nhdr {
+        std::uint32_t n_namesz;
+        std::uint32_t n_descsz;
+        std::uint32_t n_type;
+    };
+
+    constexpr std::uint32_t sht_null{0};
+    constexpr std::uint32_t sht_symtab{2};
+    constexpr std::uint32_t sht_note{7};
+    constexpr std::uint32_t sht_nobits{8};
+    constexpr std::uint32_t sht_dynsym{11};
+
+    constexpr std::uint16_t shn_undef{0};
+    constexpr std::uint16_t shn_xindex{0xffff};
+
+    constexpr unsigned char stt_object{1};
+    constexpr unsigned char stt_func{2};
+}  // namespace elf
+
+// Section headers are returned by value, so the image need not be suitably
+// aligned; a missing section is reported as a SHT_NULL header, whose data is
+// empty.
+class Elf_image {
+    // DATA
+    const char* f_{};
+    std::size_t n_{};
+    const char* shdrs_{};
+    std::size_t shnum_{};
+    Blob_view shstrtab_{};
+
+    // IMPLEMENTATION
+    static
+    bool in_bounds_of(std::size_t n, std::uint64_t offset,
+                      std::uint64_t size) noexcept
+    {
+        return offset <= n && size <= n - offset;
+    }
+
+    static
+    elf::Shdr read_shdr(const char* p) noexcept
+    {
+        elf::Shdr r;
+        std::memcpy(&r, p, sizeof(r));
+
+        return r;
+    }
+
+    static
+    const char* string_at(Blob_view strtab, std::uint32_t offset) noexcept
+    {
+        if (offset >= strtab.size()) return "";
+
+        const auto p = strtab.data() + offset;
+
+        // Strings must be terminated inside their table.
+        return std::memchr(p, '\0', strtab.size() - offset) ? p : "";
+    }
+public:
+    // CREATORS
+    Elf_image() = default;
+    Elf_image(const char* f, std::size_t n)
+    {
+        static constexpr unsigned char ident[]{0x7f, 'E', 'L', 'F', 2 /*64-bit*/};
+
+        if (!f || n < sizeof(elf::Ehdr)) return;
+        if (std::memcmp(f, ident, sizeof(ident)) != 0) return;
+
+        elf::Ehdr h;
+        std::memcpy(&h, f, sizeof(h));
+
+        if (h.e_shoff == 0 || h.e_shentsize != sizeof(elf::Shdr)) return;
+        if (!in_bounds_of(n, h.e_shoff, sizeof(elf::Shdr))) return;
+
+        // Large section counts / indices spill into the first section header.
+        const auto shdr0 = read_shdr(f + h.e_shoff);
+        const std::size_t shnum = h.e_shnum ? h.e_shnum : shdr0.sh_size;
+        const std::size_t shstrndx =
+            (h.e_shstrndx == elf::shn_xindex) ? shdr0.sh_link : h.e_shstrndx;
+
+        if (shnum > n / sizeof(elf::Shdr) ||
+            !in_bounds_of(n, h.e_shoff, shnum * sizeof(elf::Shdr))) return;
+
+        f_ = f;
+        n_ = n;
+        shdrs_ = f + h.e_shoff;
+        shnum_ = shnum;
+        shstrtab_ = data(section_at(shstrndx));
+    }
+
+    // ACCESSORS
+    explicit operator bool() const noexcept { return shdrs_ != nullptr; }
+
+    const char* base() const noexcept { return f_; }
+    std::size_t size() const noexcept { return n_; }
+
+    std::size_t section_count() const noexcept { return shnum_; }
+
+    elf::Shdr section_at(std::size_t idx) const noexcept
+    {
+        return idx < shnum_ ? read_shdr(shdrs_ + idx * sizeof(elf::Shdr))
+                            : elf::Shdr{};
+    }
+
+    elf::Shdr section(const char* name) const noexcept
+    {
+        for (auto i = 0u; i != shnum_; ++i) {
+            const auto x = section_at(i);
+            if (std::strcmp(section_name(x), name) == 0) return x;
+        }
+
+        return elf::Shdr{};
+    }
+
+    elf::Shdr section_by_type(std::uint32_t type) const noexcept
+    {
+        for (auto i = 0u; i != shnum_; ++i) {
+            const auto x = section_at(i);
+            if (x.sh_type == type) return x;
+        }
+
+        return elf::Shdr{};
+    }
+
+    const char* section_name(const elf::Shdr& x) const noexcept
+    {
+        return string_at(shstrtab_, x.sh_name);
+    }
+
+    Blob_view data(const elf::Shdr& x) const noexcept
+    {
+        if (x.sh_type == elf::sht_null || x.sh_type == elf::sht_nobits) return {};
+        if (!in_bounds_of(n_, x.sh_offset, x.sh_size)) return {};
+
+        return Blob_view{f_ + x.sh_offset, static_cast<std::size_t>(x.sh_size)};
+    }
+
+    // Invokes fn(const elf::Sym&, const char* name) for every entry of a
+    // SHT_SYMTAB or SHT_DYNSYM section; stops early if fn returns false.
+    template<typename F>
+    void for_each_symbol(const elf::Shdr& symtab, F fn) const
+    {
+        const auto syms = data(symtab);
+        if (syms.empty() || symtab.sh_entsize != sizeof(elf::Sym)) return;
+
+        const auto strtab = data(section_at(symtab.sh_link));
+
+        for (auto p = syms.begin();
+             p + sizeof(elf::Sym) <= syms.end();
+             p += sizeof(elf::Sym)) {
+            elf::Sym s;
+            std::memcpy(&s, p, sizeof(s));
+
+            if (!fn(static_cast<const elf::Sym&>(s), string_at(strtab, s.st_name))) {
+                return;
+            }
+        }
+    }
+
+    // Invokes fn(std::uint32_t type, Blob_view name, Blob_view desc) for every
+    // note of a SHT_NOTE section; the name excludes its terminating NUL.
+    template<typename F>
+    void for_each_note(const elf::Shdr& notes, F fn) const
+    {
+        const auto d = data(notes);
+        const auto align = [](std::size_t x) { return (x + 3u) & ~std::size_t{3u}; };
+
+        for (std::size_t dx = 0; dx + sizeof(elf::Nhdr) <= d.size();) {
+            elf::Nhdr h;
+            std::memcpy(&h, d.data() + dx, sizeof(h));
+            dx += sizeof(h);
+
+            const auto name_sz = align(h.n_namesz);
+            const auto desc_sz = align(h.n_descsz);
+            if (!in_bounds_of(d.size(), dx, name_sz) ||
+                !in_bounds_of(d.size(), dx + name_sz, h.n_descsz)) return;
+
+            const Blob_view name{d.data() + dx, h.n_namesz ? h.n_namesz - 1u : 0u};
+            const Blob_view desc{d.data() + dx + name_sz, h.n_descsz};
+
+            fn(h.n_type, name, desc);
+
+            dx += name_sz + desc_sz;
+        }
+    }
+};
+
+// Read-only, private mapping of a whole file. The mapping outlives the file
+// descriptor, which is closed as soon as the mapping exists.
+class Mapped_file {
+    // DATA
+    void* p_{MAP_FAILED};
+    std::size_t n_{};
+public:
+    // CREATORS
+    Mapped_file() = default;
+    explicit
+    Mapped_file(const char* path)
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+
+        struct stat s;
+        if (fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0) {
+            n_ = static_cast<std::size_t>(s.st_size);
+            p_ = mmap(nullptr, n_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p_ == MAP_FAILED) n_ = 0;
+        }
+
+        close(fd);
+    }
+    Mapped_file(const Mapped_file&) = delete;
+    ~Mapped_file()
+    {
+        if (p_ != MAP_FAILED) munmap(p_, n_);
+    }
+
+    // MANIPULATORS
+    Mapped_file& operator=(const Mapped_file&) = delete;
+
+    // ACCESSORS
+    explicit operator bool() const noexcept { return p_ != MAP_FAILED; }
+
+    const char* data() const noexcept
+    {
+        return p_ != MAP_FAILED ? static_cast<const char*>(p_) : nullptr;
+    }
+    std::size_t size() const noexcept { return n_; }
+
+    Elf_image image() const noexcept { return Elf_image{data(), n_}; }
+};
+
+}  // namespace hip_impl
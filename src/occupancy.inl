@@ -0,0 +1,323 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Occupancy of AMDGPU kernels: how many blocks of a kernel can be resident on
+// one compute unit, and which block size keeps the most wavefronts resident.
+// The device is described by Occupancy_limits and the kernel only by the
+// registers and LDS it uses, so that the HCC and VDI runtimes share one model,
+// and tools that only have a code object on disk can use it without a GPU.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace hip_impl {
+
+// Resources of a compute unit, and the number of compute units. The defaults
+// are those of GCN devices from gfx8 on.
+struct Occupancy_limits {
+    std::size_t wavefront_size{64};
+    std::size_t simds_per_cu{4};
+    // Due to SPI and private memory limitations, the max of wavefronts per CU
+    // is 32
+    std::size_t max_waves_per_cu{32};
+    std::size_t vgprs_per_simd{256};
+    std::size_t sgprs_per_simd{800};
+    std::size_t lds_per_cu{64 * 1024};
+    std::size_t max_threads_per_block{1024};
+    // Workgroups per CU are limited to 16, or 40 for workgroups of a single
+    // wavefront
+    std::size_t max_blocks_per_cu{16};
+    std::size_t max_single_wave_blocks_per_cu{40};
+    std::size_t cu_count{1};
+};
+
+// Registers and static LDS used by a kernel; a register count of 0 does not
+// limit occupancy. The wavefront size and the VGPRs per SIMD override those of
+// the device if not 0, for runtimes that report them per kernel.
+struct Kernel_resources {
+    std::size_t vgprs{};
+    std::size_t sgprs{};
+    std::size_t lds{};
+    std::size_t wavefront_size{};
+    std::size_t vgprs_per_simd{};
+};
+
+// Decodes the resources of a code object v3 kernel descriptor.
+inline
+Kernel_resources kernel_resources_v3(std::uint32_t compute_pgm_rsrc1,
+                                     std::uint32_t group_segment_fixed_size)
+{
+    Kernel_resources r;
+    // GRANULATED_WAVEFRONT_VGPR_COUNT is specified in 0:5 bits of COMPUTE_PGM_RSRC1
+    // the granularity for gfx6-gfx9 is max(0, ceil(vgprs_used / 4) - 1)
+    r.vgprs = ((compute_pgm_rsrc1 & 0x3F) + 1) << 2;
+    // GRANULATED_WAVEFRONT_SGPR_COUNT is specified in 6:9 bits of COMPUTE_PGM_RSRC1
+    // the granularity for gfx9+ is 2 * max(0, ceil(sgprs_used / 16) - 1)
+    r.sgprs = ((((compute_pgm_rsrc1 & 0x3C0) >> 6) >> 1) + 1) << 4;
+    r.lds = group_segment_fixed_size;
+
+    return r;
+}
+
+// Decodes the resources of a code object v2 amd_kernel_code_t.
+inline
+Kernel_resources kernel_resources_v2(std::uint16_t workitem_vgpr_count,
+                                     std::uint16_t wavefront_sgpr_count,
+                                     std::uint32_t workgroup_group_segment_byte_size)
+{
+    Kernel_resources r;
+    // VGPRs granularity is 4
+    r.vgprs = ((workitem_vgpr_count + 3u) >> 2) << 2;
+    // adding 2 to take into account the 2 VCC registers & handle the granularity of 16
+    r.sgprs = ((wavefront_sgpr_count + 2u + 15u) >> 4) << 4;
+    r.lds = workgroup_group_segment_byte_size;
+
+    return r;
+}
+
+// Blocks of block_size threads that can be resident on one CU at once, each
+// with dynamic_lds bytes of LDS on top of the kernel's; 0 if the block is
+// empty or too large for the device.
+inline
+int max_active_blocks_per_cu(const Occupancy_limits& l, const Kernel_resources& k,
+                             int block_size, std::size_t dynamic_lds)
+{
+    if (block_size <= 0 || static_cast<std::size_t>(block_size) > l.max_threads_per_block) {
+        return 0;
+    }
+
+    const auto wavefront_size = k.wavefront_size ? k.wavefront_size : l.wavefront_size;
+    const auto vgprs_per_simd = k.vgprs_per_simd ? k.vgprs_per_simd : l.vgprs_per_simd;
+    const auto round_up = [](std::size_t x, std::size_t g) { return (x + g - 1) / g * g; };
+
+    // Wavefronts per SIMD, as limited by the register files
+    auto waves_per_simd = l.max_waves_per_cu / l.simds_per_cu;
+    if (k.vgprs) waves_per_simd = std::min(waves_per_simd, vgprs_per_simd / round_up(k.vgprs, 4));
+    if (k.sgprs) waves_per_simd = std::min(waves_per_simd, l.sgprs_per_simd / round_up(k.sgprs, 16));
+
+    const auto waves_per_block = (block_size + wavefront_size - 1) / wavefront_size;
+    auto blocks = l.simds_per_cu * waves_per_simd / waves_per_block;
+    blocks = std::min(blocks, (waves_per_block == 1) ? l.max_single_wave_blocks_per_cu
+                                                     : l.max_blocks_per_cu);
+
+    const auto lds = k.lds + dynamic_lds;
+    if (lds != 0) blocks = std::min(blocks, l.lds_per_cu / lds);
+
+    return static_cast<int>(blocks);
+}
+
+// The block size, no larger than block_size_limit unless that is 0, that keeps
+// the most wavefronts resident on a CU, preferring larger blocks on ties; and
+// the smallest grid that reaches that occupancy on every CU. Both are 0 if no
+// block fits.
+inline
+void max_potential_block_size(const Occupancy_limits& l, const Kernel_resources& k,
+                              std::size_t dynamic_lds, int block_size_limit,
+                              int* grid_size, int* block_size)
+{
+    const auto wavefront_size = k.wavefront_size ? k.wavefront_size : l.wavefront_size;
+
+    auto limit = l.max_threads_per_block;
+    if (block_size_limit > 0) limit = std::min(limit, static_cast<std::size_t>(block_size_limit));
+
+    int best_size = 0;
+    int best_blocks = 0;
+    std::size_t best_waves = 0;
+    const auto consider = [&](std::size_t threads) {
+        const int blocks = max_active_blocks_per_cu(l, k, static_cast<int>(threads), dynamic_lds);
+        const auto waves = blocks * ((threads + wavefront_size - 1) / wavefront_size);
+        if (blocks != 0 && waves >= best_waves) {
+            best_size = static_cast<int>(threads);
+            best_blocks = blocks;
+            best_waves = waves;
+        }
+    };
+
+    if (limit < wavefront_size) {
+        consider(limit);
+    }
+    for (auto threads = wavefront_size; threads <= limit; threads += wavefront_size) {
+        consider(threads);
+    }
+
+    *block_size = best_size;
+    *grid_size = static_cast<int>(best_blocks * l.cu_count);
+}
+
+// Largest block, in whole wavefronts, of which one can be resident on a CU.
+inline
+int max_block_size(const Occupancy_limits& l, const Kernel_resources& k)
+{
+    const auto wavefront_size = k.wavefront_size ? k.wavefront_size : l.wavefront_size;
+
+    for (auto threads = l.max_threads_per_block / wavefront_size * wavefront_size;
+         threads != 0; threads -= wavefront_size) {
+        if (max_active_blocks_per_cu(l, k, static_cast<int>(threads), 0) != 0) {
+            return static_cast<int>(threads);
+        }
+    }
+
+    return 0;
+}
+
+// Memoizes the occupancy queries of one device. Results are keyed by the
+// kernel's resources rather than by the kernel itself, so kernels with the
+// same usage share them and an unloaded kernel leaves nothing stale behind.
+// Thread safe; the computation runs outside the lock.
+class Occupancy_calculator {
+    // TYPES
+    struct Key {
+        Kernel_resources k;
+        std::size_t lds;
+        int block_size;
+        bool potential;
+
+        friend
+        bool operator==(const Key& x, const Key& y) noexcept
+        {
+            return x.k.vgprs == y.k.vgprs && x.k.sgprs == y.k.sgprs &&
+                   x.k.wavefront_size == y.k.wavefront_size &&
+                   x.k.vgprs_per_simd == y.k.vgprs_per_simd &&
+                   x.lds == y.lds && x.block_size == y.block_size &&
+                   x.potential == y.potential;
+        }
+    };
+
+    struct Key_hash {
+        std::size_t operator()(const Key& x) const noexcept
+        {
+            std::size_t h = x.potential;
+            for (auto v : {x.k.vgprs, x.k.sgprs, x.k.wavefront_size, x.k.vgprs_per_simd,
+                           x.lds, static_cast<std::size_t>(x.block_size)}) {
+                h = (h ^ v) * 0x100000001b3ull;
+            }
+
+            return h;
+        }
+    };
+
+    // Blocks per CU, or the grid size and block size of a potential block
+    // size query
+    struct Result {
+        int blocks;
+        int block_size;
+    };
+
+    // Bounds the memory held for callers that sweep many shapes
+    static constexpr std::size_t max_results_{4096};
+
+    // DATA
+    Occupancy_limits limits_{};
+    mutable std::mutex mtx_;
+    std::unordered_map<Key, Result, Key_hash> results_;
+
+    // IMPLEMENTATION
+    bool find(const Key& key, Result& r) const
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+
+        const auto it = results_.find(key);
+        if (it == results_.cend()) return false;
+
+        r = it->second;
+        return true;
+    }
+
+    void insert(const Key& key, const Result& r)
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+
+        if (results_.size() >= max_results_) results_.clear();
+        results_.emplace(key, r);
+    }
+public:
+    // CREATORS
+    Occupancy_calculator() = default;
+    explicit
+    Occupancy_calculator(const Occupancy_limits& limits) : limits_{limits} {}
+    Occupancy_calculator(const Occupancy_calculator&) = delete;
+
+    // MANIPULATORS
+    Occupancy_calculator& operator=(const Occupancy_calculator&) = delete;
+
+    // Replaces the limits and forgets the results computed with the old ones;
+    // must not race with queries.
+    void reset(const Occupancy_limits& limits)
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+
+        limits_ = limits;
+        results_.clear();
+    }
+
+    int max_active_blocks_per_cu(const Kernel_resources& k, int block_size,
+                                 std::size_t dynamic_lds)
+    {
+        const Key key{k, k.lds + dynamic_lds, block_size, false};
+
+        Result r;
+        if (!find(key, r)) {
+            r.blocks = hip_impl::max_active_blocks_per_cu(limits_, k, block_size, dynamic_lds);
+            r.block_size = block_size;
+            insert(key, r);
+        }
+
+        return r.blocks;
+    }
+
+    void max_potential_block_size(const Kernel_resources& k, std::size_t dynamic_lds,
+                                  int block_size_limit, int* grid_size, int* block_size)
+    {
+        if (block_size_limit < 0 ||
+            static_cast<std::size_t>(block_size_limit) >= limits_.max_threads_per_block) {
+            block_size_limit = 0;
+        }
+        const Key key{k, k.lds + dynamic_lds, block_size_limit, true};
+
+        Result r;
+        if (!find(key, r)) {
+            hip_impl::max_potential_block_size(limits_, k, dynamic_lds, block_size_limit,
+                                               &r.blocks, &r.block_size);
+            insert(key, r);
+        }
+
+        *grid_size = r.blocks;
+        *block_size = r.block_size;
+    }
+
+    // ACCESSORS
+    const Occupancy_limits& limits() const noexcept { return limits_; }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+
+        return results_.size();
+    }
+};
+
+}  // namespace hip_impl
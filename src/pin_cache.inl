@@ -0,0 +1,606 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Registration cache for pageable host ranges that are pinned for DMA. Pinned
+// ranges are kept after the copy that needed them, so that repeated copies of
+// the same buffers do not pay for locking and unlocking every time.
+//
+// Ranges are widened to whole pages and kept disjoint: a request overlapping
+// cached ranges replaces them with their union. Because entries never
+// overlap, an ordered map on the start address serves as the interval tree.
+// The pinned total is kept under a budget by evicting least recently used
+// ranges that no copy is using. Ranges are invalidated by the owner when it
+// learns that their memory is going away; ranges still in use at that point
+// are retired and unpinned once their last user lets go. The span of the
+// cached ranges is kept outside the lock, so that invalidating memory the
+// cache knows nothing about does not take it.
+//
+// Memory released by the application is not seen by the owner. Instead, each
+// pinned range is handed to a watcher, which reports the ranges that stop
+// being mapped through unmapped. The report only records the range, without
+// locking or allocating, as it may come from a context where either could
+// deadlock; the ranges are dropped by the next call into the cache.
+//
+// The pin / unpin and watch / unwatch calls are supplied by the owner, which
+// keeps this independent of HSA and of the kernel; they are never invoked
+// with the cache's lock held.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+class Pin_cache {
+public:
+    // Pins [p, p + n), returning the address through which the device sees p,
+    // or nullptr on failure.
+    using Pin = std::function<void*(void* p, std::size_t n)>;
+    // Releases a range pinned by Pin, given its host start address.
+    using Unpin = std::function<void(void* p)>;
+    // Starts watching the pinned range [p, p + n) for being unmapped,
+    // returning false if it cannot be watched, in which case it is not
+    // cached.
+    using Watch = std::function<bool(void* p, std::size_t n)>;
+    // Stops watching [p, p + n), which may be unmapped already.
+    using Unwatch = std::function<void(void* p, std::size_t n)>;
+
+    struct Stats {
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t evictions;
+        std::size_t invalidations;
+        std::size_t pinned_bytes;
+    };
+
+    // Invoked after each acquire with "hit", "miss" or "evict" (once per
+    // evicted range) and the range concerned; never with the lock held.
+    using Observer = std::function<void(const char* event, const void* p,
+                                        std::size_t n, const Stats& stats)>;
+private:
+    struct Entry {
+        std::uintptr_t begin;
+        std::uintptr_t end;
+        char* device; // Null while the range is being pinned.
+        std::size_t users;
+        bool retired;
+
+        std::size_t size() const noexcept { return end - begin; }
+    };
+    using Entries = std::list<Entry>;
+    using Dropped = std::vector<Entries::iterator>;
+    using Ranges = std::vector<std::pair<std::uintptr_t, std::uintptr_t>>;
+
+    // A range reported by unmapped.
+    struct Unmapped {
+        std::atomic<std::uintptr_t> begin;
+        std::atomic<std::uintptr_t> end;
+    };
+    static constexpr std::size_t max_unmapped = 64;
+
+    // DATA
+    mutable std::mutex mtx_;
+    Entries lru_;     // Cached ranges, most recently used first.
+    Entries retired_; // Out of the cache, but still pinned.
+    std::map<std::uintptr_t, Entries::iterator> by_begin_;
+    std::atomic<std::size_t> size_{0};
+    // [lo_, hi_) covers every cached range; it only shrinks once the cache
+    // is empty.
+    std::atomic<std::uintptr_t> lo_{UINTPTR_MAX};
+    std::atomic<std::uintptr_t> hi_{0};
+    std::size_t budget_;
+    std::size_t page_;
+    Stats stats_{};
+    Pin pin_;
+    Unpin unpin_;
+    Watch watch_;
+    Unwatch unwatch_;
+    Observer observer_;
+    // Orders watch_ calls with the unwatch_ calls of overlapping ranges.
+    std::mutex watch_mtx_;
+    // Ring of unmapped ranges, written by the reporting thread and consumed
+    // with mtx_ held; when it fills up, the whole cache is dropped instead.
+    Unmapped unmapped_[max_unmapped]{};
+    std::atomic<std::size_t> unmapped_head_{0};
+    std::atomic<std::size_t> unmapped_tail_{0};
+    std::atomic<bool> unmapped_overflow_{false};
+    std::atomic<unsigned int> reporting_{0};
+
+    // IMPLEMENTATION
+    // Requires mtx_ to be held.
+    void erased()
+    {
+        size_ = by_begin_.size();
+        if (!by_begin_.empty()) return;
+
+        lo_.store(UINTPTR_MAX, std::memory_order_relaxed);
+        hi_.store(0, std::memory_order_relaxed);
+    }
+
+    // First cached entry that may overlap [b, e).
+    std::map<std::uintptr_t, Entries::iterator>::iterator first_overlap(
+        std::uintptr_t b)
+    {
+        auto it = by_begin_.upper_bound(b);
+        if (it != by_begin_.begin() && std::prev(it)->second->end > b) --it;
+
+        return it;
+    }
+
+    // Takes the entry out of the cache. Unless it is in use, the caller is to
+    // unpin it through unpin_dropped; until then it stays visible in retired_,
+    // which keeps overlapping ranges from being pinned twice.
+    void retire(Entries::iterator x, Dropped& dropped)
+    {
+        by_begin_.erase(x->begin);
+        erased();
+        x->retired = true;
+        retired_.splice(retired_.end(), lru_, x);
+
+        if (x->users == 0) {
+            stats_.pinned_bytes -= x->size();
+            dropped.push_back(x);
+        }
+    }
+
+    // Requires mtx_ to be held. Retires the ranges reported by unmapped;
+    // waits for a report that is being read to be recorded first.
+    void drop_reported(Dropped& dropped)
+    {
+        while (reporting_.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        const auto head = unmapped_head_.load(std::memory_order_acquire);
+        if (unmapped_overflow_.exchange(false, std::memory_order_acquire)) {
+            while (!by_begin_.empty()) {
+                ++stats_.invalidations;
+                retire(by_begin_.begin()->second, dropped);
+            }
+        }
+        else {
+            for (auto t = unmapped_tail_.load(std::memory_order_relaxed);
+                 t != head; ++t) {
+                const auto& x = unmapped_[t % max_unmapped];
+                const auto b = x.begin.load(std::memory_order_relaxed);
+                const auto e = x.end.load(std::memory_order_relaxed);
+
+                for (auto it = first_overlap(b);
+                     it != by_begin_.end() && it->first < e;) {
+                    ++stats_.invalidations;
+                    retire((it++)->second, dropped);
+                }
+            }
+        }
+        unmapped_tail_.store(head, std::memory_order_release);
+    }
+
+    // Must not be called with mtx_ held. Stops watching the parts of the
+    // ranges that are not covered by cached or pending ranges, which may have
+    // taken them over.
+    void unwatch_ranges(const Ranges& ranges)
+    {
+        if (!unwatch_ || ranges.empty()) return;
+
+        std::lock_guard<std::mutex> wlck{watch_mtx_};
+
+        Ranges gaps;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            for (auto&& x : ranges) {
+                auto b = x.first;
+                for (auto it = first_overlap(b);
+                     it != by_begin_.end() && it->first < x.second; ++it) {
+                    if (b < it->first) gaps.emplace_back(b, it->first);
+                    b = std::max(b, it->second->end);
+                }
+                if (b < x.second) gaps.emplace_back(b, x.second);
+            }
+        }
+
+        for (auto&& x : gaps) {
+            unwatch_(reinterpret_cast<void*>(x.first), x.second - x.first);
+        }
+    }
+
+    // Must not be called with mtx_ held.
+    void unpin_dropped(const Dropped& dropped)
+    {
+        if (dropped.empty()) return;
+
+        Ranges ranges;
+        for (auto&& x : dropped) {
+            unpin_(reinterpret_cast<void*>(x->begin));
+            ranges.emplace_back(x->begin, x->end);
+        }
+
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+            for (auto&& x : dropped) retired_.erase(x);
+        }
+
+        unwatch_ranges(ranges);
+    }
+
+    void release(Entries::iterator x)
+    {
+        Dropped dropped;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            if (--x->users != 0 || !x->retired) return;
+
+            stats_.pinned_bytes -= x->size();
+            dropped.push_back(x);
+        }
+
+        unpin_dropped(dropped);
+    }
+public:
+    // A pinned range held for the duration of a copy.
+    class Handle {
+        friend class Pin_cache;
+
+        Pin_cache* cache_{};
+        Entries::iterator entry_{};
+        char* device_{};
+
+        Handle(Pin_cache* c, Entries::iterator x, char* device)
+            : cache_{c}, entry_{x}, device_{device} {}
+    public:
+        Handle() = default;
+        Handle(Handle&& x) noexcept
+            : cache_{x.cache_}, entry_{x.entry_}, device_{x.device_}
+        {
+            x.cache_ = nullptr;
+        }
+        Handle(const Handle&) = delete;
+        ~Handle()
+        {
+            if (cache_) cache_->release(entry_);
+        }
+
+        Handle& operator=(const Handle&) = delete;
+        Handle& operator=(Handle&& x) noexcept
+        {
+            std::swap(cache_, x.cache_);
+            std::swap(entry_, x.entry_);
+            std::swap(device_, x.device_);
+
+            return *this;
+        }
+
+        explicit operator bool() const noexcept { return cache_ != nullptr; }
+
+        // The address through which the device sees the start of the range
+        // passed to acquire.
+        void* get() const noexcept { return device_; }
+    };
+private:
+    // Requires mtx_ to be held.
+    Handle hit(std::uintptr_t b, std::size_t n)
+    {
+        const auto it = first_overlap(b);
+        if (it == by_begin_.end() || it->second->begin > b ||
+            it->second->end < b + n || !it->second->device) return Handle{};
+
+        const auto x = it->second;
+        ++x->users;
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, x);
+
+        return Handle{this, x, x->device + (b - x->begin)};
+    }
+public:
+    // CREATORS
+    Pin_cache(std::size_t budget, Pin pin, Unpin unpin,
+              std::size_t page = 4096)
+        : budget_{budget}, page_{page}, pin_{std::move(pin)},
+          unpin_{std::move(unpin)} {}
+    Pin_cache(const Pin_cache&) = delete;
+    ~Pin_cache()
+    {
+        for (auto&& x : lru_) unpin_(reinterpret_cast<void*>(x.begin));
+        for (auto&& x : retired_) unpin_(reinterpret_cast<void*>(x.begin));
+    }
+
+    // MANIPULATORS
+    Pin_cache& operator=(const Pin_cache&) = delete;
+
+    void set_observer(Observer observer) { observer_ = std::move(observer); }
+
+    // To be called before the cache is used.
+    void set_watch(Watch watch, Unwatch unwatch)
+    {
+        watch_ = std::move(watch);
+        unwatch_ = std::move(unwatch);
+    }
+
+    // Records that [p, p + n) is no longer mapped; its cached ranges are
+    // dropped by the next call into the cache. Neither locks nor allocates,
+    // and must only be called from one thread at a time.
+    void unmapped(const void* p, std::size_t n) noexcept
+    {
+        const auto b = reinterpret_cast<std::uintptr_t>(p);
+        const auto e = b + n;
+
+        if (e <= lo_.load(std::memory_order_acquire) ||
+            hi_.load(std::memory_order_acquire) <= b) return;
+
+        const auto head = unmapped_head_.load(std::memory_order_relaxed);
+        if (head - unmapped_tail_.load(std::memory_order_acquire) ==
+            max_unmapped) {
+            unmapped_overflow_.store(true, std::memory_order_release);
+            return;
+        }
+
+        unmapped_[head % max_unmapped].begin.store(b, std::memory_order_relaxed);
+        unmapped_[head % max_unmapped].end.store(e, std::memory_order_relaxed);
+        unmapped_head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Bracket reading the ranges to pass to unmapped, from the point where
+    // the memory may have been reused; the cache does not hand out ranges
+    // in between.
+    void begin_unmapped() noexcept
+    {
+        reporting_.fetch_add(1, std::memory_order_acq_rel);
+    }
+    void end_unmapped() noexcept
+    {
+        reporting_.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Drops the ranges reported by unmapped, if any, without taking the lock
+    // otherwise; to be called before asking HSA about host memory that the
+    // cache may have pinned.
+    void drop_unmapped()
+    {
+        if (!reporting_.load(std::memory_order_acquire) &&
+            unmapped_head_.load(std::memory_order_acquire) ==
+                unmapped_tail_.load(std::memory_order_relaxed) &&
+            !unmapped_overflow_.load(std::memory_order_acquire)) return;
+
+        Dropped dropped;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            drop_reported(dropped);
+        }
+
+        unpin_dropped(dropped);
+    }
+
+    // Returns a handle to a pinned range covering [p, p + n), pinning it if
+    // needed, or an empty handle if the range cannot be cached: it exceeds the
+    // budget, it overlaps a range that is in use or still being released, or
+    // pinning fails.
+    Handle acquire(const void* p, std::size_t n)
+    {
+        if (budget_ == 0) return Handle{};
+
+        const auto b0 = reinterpret_cast<std::uintptr_t>(p);
+        auto b = b0 / page_ * page_;
+        auto e = (b0 + n + page_ - 1) / page_ * page_;
+
+        Handle r;
+        bool is_hit = false;
+        bool needs_pin = false;
+        Entries::iterator pending;
+        Dropped dropped;
+        std::vector<std::pair<std::uintptr_t, std::size_t>> evicted;
+        Stats stats;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            drop_reported(dropped);
+            r = hit(b0, n);
+            is_hit = static_cast<bool>(r);
+            if (!is_hit) {
+                ++stats_.misses;
+
+                needs_pin = true;
+                for (auto it = first_overlap(b);
+                     it != by_begin_.end() && it->first < e; ++it) {
+                    if (it->second->users) needs_pin = false;
+                }
+                // Ranges that this call dropped are unpinned before it pins.
+                for (auto x = retired_.begin(); x != retired_.end(); ++x) {
+                    if (x->begin < e && b < x->end &&
+                        std::find(dropped.cbegin(), dropped.cend(), x) ==
+                            dropped.cend()) needs_pin = false;
+                }
+
+                // Merge with the ranges that the request overlaps.
+                for (auto it = first_overlap(b); needs_pin &&
+                     it != by_begin_.end() && it->first < e;) {
+                    const auto x = (it++)->second;
+                    b = std::min(b, x->begin);
+                    e = std::max(e, x->end);
+                    retire(x, dropped);
+                }
+
+                needs_pin = needs_pin && e - b <= budget_;
+            }
+            if (needs_pin) {
+                // Make room, least recently used first.
+                for (auto x = lru_.end();
+                     stats_.pinned_bytes + (e - b) > budget_ &&
+                     x != lru_.begin();) {
+                    --x;
+                    if (x->users) continue;
+
+                    const auto victim = x++;
+                    ++stats_.evictions;
+                    evicted.emplace_back(victim->begin, victim->size());
+                    retire(victim, dropped);
+                }
+
+                // Reserve the range, and its budget, while it is being
+                // pinned; concurrent requests overlapping it miss.
+                stats_.pinned_bytes += e - b;
+                lru_.push_front(Entry{b, e, nullptr, 1, false});
+                pending = lru_.begin();
+                by_begin_.emplace(b, pending);
+                size_ = by_begin_.size();
+                if (b < lo_.load(std::memory_order_relaxed)) {
+                    lo_.store(b, std::memory_order_release);
+                }
+                if (e > hi_.load(std::memory_order_relaxed)) {
+                    hi_.store(e, std::memory_order_release);
+                }
+            }
+            stats = stats_;
+        }
+
+        unpin_dropped(dropped);
+
+        if (needs_pin) {
+            auto device = static_cast<char*>(
+                pin_(reinterpret_cast<void*>(b), e - b));
+
+            // Watching only starts once the pages are present, so that it
+            // never has to supply them.
+            if (device && watch_) {
+                std::lock_guard<std::mutex> wlck{watch_mtx_};
+
+                if (!watch_(reinterpret_cast<void*>(b), e - b)) {
+                    unpin_(reinterpret_cast<void*>(b));
+                    device = nullptr;
+                }
+            }
+
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            if (device) {
+                pending->device = device;
+                r = Handle{this, pending, device + (b0 - b)};
+            }
+            else {
+                stats_.pinned_bytes -= e - b;
+                if (pending->retired) {
+                    retired_.erase(pending);
+                }
+                else {
+                    by_begin_.erase(b);
+                    erased();
+                    lru_.erase(pending);
+                }
+            }
+            stats = stats_;
+        }
+
+        if (observer_) {
+            for (auto&& x : evicted) {
+                observer_("evict", reinterpret_cast<void*>(x.first), x.second,
+                          stats);
+            }
+            observer_(is_hit ? "hit" : "miss", p, n, stats);
+        }
+
+        return r;
+    }
+
+    // Returns a handle to a cached range covering [p, p + n), if there is
+    // one; never pins.
+    Handle find(const void* p, std::size_t n)
+    {
+        Handle r;
+        Stats stats;
+        Dropped dropped;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            drop_reported(dropped);
+            r = hit(reinterpret_cast<std::uintptr_t>(p), n);
+            stats = stats_;
+        }
+
+        unpin_dropped(dropped);
+
+        if (r && observer_) observer_("hit", p, n, stats);
+
+        return r;
+    }
+
+    // Drops every range overlapping [p, p + n), returning how many there
+    // were; to be called before the memory is released. Ranges outside the
+    // span of the cache are rejected without taking the lock.
+    std::size_t invalidate(const void* p, std::size_t n)
+    {
+        const auto b = reinterpret_cast<std::uintptr_t>(p);
+        const auto e = b + n;
+
+        if (e <= lo_.load(std::memory_order_acquire) ||
+            hi_.load(std::memory_order_acquire) <= b) return 0;
+
+        std::size_t r = 0;
+        Dropped dropped;
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+
+            drop_reported(dropped);
+            for (auto it = first_overlap(b);
+                 it != by_begin_.end() && it->first < e; ++r) {
+                const auto x = (it++)->second;
+                ++stats_.invalidations;
+                retire(x, dropped);
+            }
+        }
+
+        unpin_dropped(dropped);
+
+        return r;
+    }
+
+    // ACCESSORS
+    // Cheap check, without taking the lock, for whether any range is cached.
+    bool empty() const noexcept
+    {
+        return size_.load(std::memory_order_relaxed) == 0;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+
+        return stats_;
+    }
+};
+
+// The process-wide cache used by hipMemcpy, sized by HIP_PIN_CACHE_SIZE;
+// defined in hip_pin_cache.cpp.
+Pin_cache& host_pin_cache();
+
+}  // namespace hip_impl
@@ -40,11 +40,19 @@ namespace hip_impl {
     }
 
     std::size_t kernargs_size_align::kernargs_size_align::size(std::size_t n) const{
-        return (*reinterpret_cast<const std::vector<std::pair<std::size_t, std::size_t>>*>(handle))[n].first;
+        return kernarg_layout(*this).size_align[n].first;
     }
 
     std::size_t kernargs_size_align::alignment(std::size_t n) const{
-        return (*reinterpret_cast<const std::vector<std::pair<std::size_t, std::size_t>>*>(handle))[n].second;
+        return kernarg_layout(*this).size_align[n].second;
+    }
+
+    std::size_t kernargs_size_align::offset(std::size_t n) const{
+        return kernarg_layout(*this).offsets[n];
+    }
+
+    std::size_t kernargs_size_align::total_size() const{
+        return kernarg_layout(*this).size;
     }
 
     program_state::program_state() : impl(new program_state_impl) {
@@ -89,13 +97,4 @@ namespace hip_impl {
         t.handle = reinterpret_cast<const void*>(&impl->kernargs_size_align(kernel));
         return t;
     }
-
-    std::mutex executables_cache_mutex;
-    std::vector<hsa_executable_t>& executables_cache(
-        std::string elf, hsa_isa_t isa, hsa_agent_t agent) {
-        static std::unordered_map<std::string,
-            std::unordered_map<hsa_isa_t,
-                std::unordered_map<hsa_agent_t, std::vector<hsa_executable_t>>>> cache;
-        return cache[elf][isa][agent];
-    }
 };
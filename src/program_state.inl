@@ -1,6 +1,8 @@
 #include "../include/hip/hcc_detail/program_state.hpp"
 
 #include "code_object_bundle.inl"
+#include "code_object_loader.inl"
+#include "mapped_elf.inl"
 #include "../include/hip/hcc_detail/hsa_helpers.hpp"
 
 #if !defined(__cpp_exceptions)
@@ -24,10 +26,13 @@
 
 #include <link.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -68,35 +73,38 @@ void hip_throw(const std::exception&);
 
 std::vector<hsa_agent_t> all_hsa_agents();
 
-extern std::mutex executables_cache_mutex;
-
-std::vector<hsa_executable_t>& executables_cache(std::string, hsa_isa_t, hsa_agent_t);
+// Explicit kernel argument layout, computed once per __global__ function.
+struct Kernarg_layout {
+    std::vector<std::pair<std::size_t, std::size_t>> size_align;
+    std::vector<std::size_t> offsets;
+    std::size_t size = 0;
+
+    Kernarg_layout() = default;
+    explicit
+    Kernarg_layout(std::vector<std::pair<std::size_t, std::size_t>> sa)
+        : size_align{std::move(sa)} {
+        offsets.reserve(size_align.size());
+        for (auto&& x : size_align) {
+            size = (size + x.second - 1) / x.second * x.second;
+            offsets.push_back(size);
+            size += x.first;
+        }
+    }
+};
 
-template<typename P>
 inline
-ELFIO::section* find_section_if(ELFIO::elfio& reader, P p) {
-    const auto it = std::find_if(
-        reader.sections.begin(), reader.sections.end(), std::move(p));
-
-    return it != reader.sections.end() ? *it : nullptr;
+const Kernarg_layout& kernarg_layout(const kernargs_size_align& x) {
+    return *static_cast<const Kernarg_layout*>(x.getHandle());
 }
 
-struct Symbol {
-    std::string name;
-    ELFIO::Elf64_Addr value = 0;
-    ELFIO::Elf_Xword size = 0;
-    ELFIO::Elf_Half sect_idx = 0;
-    std::uint8_t bind = 0;
-    std::uint8_t type = 0;
-    std::uint8_t other = 0;
-};
-
 class Kernel_descriptor {
     std::uint64_t kernel_object_{};
     amd_kernel_code_t const* header_{};
     std::string name_;
-    std::vector<std::pair<std::size_t, std::size_t>> kernarg_layout_{};
+    Kernarg_layout kernarg_layout_{};
     bool is_code_object_v3_{};
+    Launch_stats_ref launch_stats_{};
+    Launch_policy_ref launch_policy_{};
 public:
     Kernel_descriptor() = default;
     Kernel_descriptor(
@@ -145,57 +153,126 @@ public:
     }
 };
 
-class program_state_impl {
-
-public:
+// Code object index of a single loaded DSO. Only its name and address range
+// are recorded when the DSO is first seen; the rest is built from a read-only
+// mapping of the file the first time one of its __global__ functions (or one
+// of its host globals) is looked up. Code object blobs are views into that
+// mapping, which lives as long as the index does.
+struct Dso_index {
+    using Kernargs = std::unordered_map<
+        std::string, std::vector<std::pair<std::size_t, std::size_t>>>;
+    using Code_object = Shared_code_object<hsa_code_object_reader_t>;
+
+    std::string elf;
+    std::uintptr_t base{};
+    std::uintptr_t first{};
+    std::uintptr_t last{};
+    // Set once the dynamic linker no longer reports the DSO; the index is
+    // kept, so that references into it stay valid, but no address resolves
+    // to it anymore.
+    bool unloaded{false};
+
+    std::pair<std::once_flag, std::unique_ptr<Mapped_file>> file;
+
+    std::once_flag kernels_indexed;
+    std::unordered_map<hsa_isa_t, std::deque<Code_object>> code_object_blobs;
+    std::unordered_map<std::uintptr_t, std::string> function_names;
+    Kernargs kernargs;
+    std::unordered_map<std::uintptr_t, Kernarg_layout> kernarg_layouts;
 
     std::pair<
         std::once_flag,
         std::unordered_map<
             std::string,
-                std::unordered_map<
-                    hsa_isa_t,
-                    std::vector<std::string>>>> code_object_blobs;
-
-    std::pair<
-        std::once_flag,
-        std::unordered_map<
-            std::string, 
             std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>> symbol_addresses;
 
+    // Executables are built for an agent the first time it needs them;
+    // afterwards they are only read.
     std::unordered_map<
         hsa_agent_t,
-        std::pair<
-            std::once_flag,
-            std::vector<hsa_executable_t>>> executables;
+        std::pair<std::once_flag, std::vector<hsa_executable_t>>> executables;
 
     std::unordered_map<
         hsa_agent_t,
         std::pair<
             std::once_flag,
             std::unordered_map<
-                std::string,
-                std::vector<hsa_executable_symbol_t>>>> kernels;
+                std::uintptr_t,
+                Kernel_descriptor>>> functions;
+
+    Dso_index(std::string e, std::uintptr_t b, std::uintptr_t f, std::uintptr_t l,
+              const std::vector<hsa_agent_t>& agents)
+        : elf{std::move(e)}, base{b}, first{f}, last{l}
+    {
+        // Create placeholder for each agent for the per-agent members.
+        for (auto&& x : agents) {
+            (void)executables[x];
+            (void)functions[x];
+        }
+    }
 
+    Dso_index(const Dso_index&) = delete;
+    ~Dso_index()
+    {
+        for (auto&& isa_blobs : code_object_blobs) {
+            for (auto&& x : isa_blobs.second) {
+                if (x.reader.handle) hsa_code_object_reader_destroy(x.reader);
+            }
+        }
+    }
+
+    Dso_index& operator=(const Dso_index&) = delete;
+
+    bool contains(std::uintptr_t address) const noexcept
+    {
+        return first <= address && address < last;
+    }
+};
+
+class program_state_impl {
+
+    struct Function_key {
+        std::uintptr_t function;
+        decltype(hsa_agent_t::handle) agent;
+
+        bool operator==(const Function_key& x) const noexcept {
+            return function == x.function && agent == x.agent;
+        }
+    };
+
+    struct Function_key_hash {
+        std::size_t operator()(const Function_key& x) const noexcept {
+            return std::hash<std::uintptr_t>{}(x.function) ^
+                   (std::hash<decltype(x.agent)>{}(x.agent) << 1);
+        }
+    };
+
+public:
+
+    // Every DSO seen so far, in dl_iterate_phdr order; entries are never
+    // removed, so pointers to them remain valid.
     std::pair<
-        std::once_flag,
-        std::unordered_map<
-            std::string, std::vector<std::pair<std::size_t, std::size_t>>>> kernargs;
+        std::mutex,
+        std::deque<std::unique_ptr<Dso_index>>> dsos;
+    // The unload count of the dynamic linker at the last refresh. Requires
+    // dsos.first.
+    unsigned long long dso_unloads{0};
+
+    std::vector<hsa_agent_t> agents;
 
     std::pair<
         std::once_flag,
-        std::unordered_map<std::uintptr_t, std::string>> function_names;
+        std::unordered_map<
+            std::string, 
+            std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>> symbol_addresses;
 
     std::unordered_map<
         hsa_agent_t,
         std::pair<
             std::once_flag,
-            std::unordered_map<
-                std::uintptr_t,
-                Kernel_descriptor>>> functions;
-      
-    std::tuple<
-        std::once_flag,
+            std::vector<hsa_executable_t>>> executables;
+
+    std::pair<
         std::mutex,
         // map from string to pair<global_addr, pinned_addr>
         std::unordered_map<std::string, std::pair<void*, void*>>> globals;
@@ -207,156 +284,297 @@ public:
         std::mutex,
         std::deque<std::pair<std::string, RAII_code_reader>>> code_readers;
 
-    program_state_impl() {
+    program_state_impl() : agents{hip_impl::all_hsa_agents()} {
         // Create placeholder for each agent for the per-agent members.
-        for (auto&& x : hip_impl::all_hsa_agents()) {
+        for (auto&& x : agents) {
             (void)executables[x];
-            (void)kernels[x];
-            (void)functions[x];
         }
     }
 
-    const std::unordered_map<
-        std::string,
-            std::unordered_map<
-                hsa_isa_t,
-                std::vector<std::string>>>& get_code_object_blobs() {
+    // The number of DSOs the dynamic linker has unloaded so far; only its
+    // counters are read.
+    static
+    unsigned long long linker_unloads() {
+        unsigned long long unloads{0};
+        dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
+            *static_cast<unsigned long long*>(p) = info->dlpi_subs;
+            return 1;
+        }, &unloads);
+
+        return unloads;
+    }
+
+    // A per-thread memo of look-ups into the DSO index. It is dropped
+    // whenever the dynamic linker has unloaded a DSO since it was filled,
+    // since another DSO may have been mapped at the same addresses; this is
+    // checked on every use, as a hit never reaches the index.
+    template<typename K, typename V, typename H = std::hash<K>>
+    class Dso_memo {
+        unsigned long long unloads_{0};
+        std::unordered_map<K, const V*, H> entries_;
+    public:
+        std::unordered_map<K, const V*, H>& get() {
+            const auto unloads = linker_unloads();
+            if (unloads != unloads_) {
+                entries_.clear();
+                unloads_ = unloads;
+            }
 
-        std::call_once(code_object_blobs.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
-                ELFIO::elfio tmp;
+            return entries_;
+        }
+    };
+
+    // Whether the dynamic linker has unloaded a DSO since the last refresh.
+    // Requires dsos.first.
+    bool dsos_unloaded() const { return linker_unloads() != dso_unloads; }
+
+    // Registers the DSOs loaded since the last call and retires those that
+    // were unloaded; only the program headers handed out by the dynamic
+    // linker are inspected. Requires dsos.first.
+    void refresh_dsos() {
+        struct Refresh {
+            program_state_impl& impl;
+            std::vector<const Dso_index*> seen;
+            unsigned long long unloads;
+        } r{*this, {}, 0};
+
+        dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
+            auto& r = *static_cast<Refresh*>(p);
+            auto& impl = r.impl;
+            r.unloads = info->dlpi_subs;
+
+            const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
+                info->dlpi_name : "/proc/self/exe";
+
+            std::uintptr_t first{UINTPTR_MAX};
+            std::uintptr_t last{0};
+            for (auto i = 0u; i != info->dlpi_phnum; ++i) {
+                const auto& phdr = info->dlpi_phdr[i];
+                if (phdr.p_type != PT_LOAD) continue;
+
+                first = std::min<std::uintptr_t>(first, info->dlpi_addr + phdr.p_vaddr);
+                last = std::max<std::uintptr_t>(
+                    last, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+            }
 
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
+            if (last <= first) return 0;
 
-                if (!tmp.load(elf)) return 0;
+            for (auto&& x : impl.dsos.second) {
+                if (!x->unloaded && x->base == info->dlpi_addr && x->elf == elf) {
+                    r.seen.push_back(x.get());
 
-                const auto it = find_section_if(tmp, [](const ELFIO::section* x) {
-                    return x->get_name() == ".kernel";
-                });
+                    return 0;
+                }
+            }
+
+            impl.dsos.second.emplace_back(
+                new Dso_index{elf, info->dlpi_addr, first, last, impl.agents});
+            r.seen.push_back(impl.dsos.second.back().get());
 
-                if (!it) return 0;
+            return 0;
+        }, &r);
 
-                auto& impl = *static_cast<program_state_impl*>(p);
+        if (r.unloads == dso_unloads) return;
+        dso_unloads = r.unloads;
 
-                std::vector<char> multi_arch_blob(it->get_data(), it->get_data() + it->get_size());
-                auto blob_it = multi_arch_blob.begin();
-                while (blob_it != multi_arch_blob.end()) {
-                    Bundled_code_header tmp{blob_it, multi_arch_blob.end()};
+        for (auto&& x : dsos.second) {
+            if (x->unloaded) continue;
+            if (std::find(r.seen.cbegin(), r.seen.cend(), x.get()) != r.seen.cend()) {
+                continue;
+            }
+            x->unloaded = true;
+        }
+    }
 
-                    if (!valid(tmp)) break;
+    Dso_index* dso_index(std::uintptr_t address) {
+        std::lock_guard<std::mutex> lck{dsos.first};
 
-                    for (auto&& bundle : bundles(tmp)) {
-                        if(bundle.blob.size())
-                            impl.code_object_blobs.second[elf][triple_to_hsa_isa(bundle.triple)].push_back(bundle.blob);
-                    }
+        const auto find = [&]() -> Dso_index* {
+            for (auto&& x : dsos.second) {
+                if (!x->unloaded && x->contains(address)) return x.get();
+            }
+            return nullptr;
+        };
 
-                    blob_it += tmp.bundled_code_size;
-                };
+        // The DSO that held the address may have been replaced.
+        if (dsos_unloaded()) refresh_dsos();
 
-                return 0;
-            }, this);
-        });
+        if (auto r = find()) return r;
 
-        return code_object_blobs.second;
+        // The address may belong to a DSO that was dlopen-ed later on.
+        refresh_dsos();
+
+        return find();
     }
 
-    Symbol read_symbol(const ELFIO::symbol_section_accessor& section,
-                   unsigned int idx) {
-        assert(idx < section.get_symbols_num());
+    std::vector<Dso_index*> all_dsos() {
+        std::lock_guard<std::mutex> lck{dsos.first};
+
+        refresh_dsos();
 
-        Symbol r;
-        section.get_symbol(
-            idx, r.name, r.value, r.size, r.bind, r.type, r.sect_idx, r.other);
+        std::vector<Dso_index*> r;
+        for (auto&& x : dsos.second) {
+            if (!x->unloaded) r.push_back(x.get());
+        }
 
         return r;
     }
 
-    const std::unordered_map<
-        std::string,
-        std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>& get_symbol_addresses() {
+    static
+    const Mapped_file& mapped_file(Dso_index& dso) {
+        std::call_once(dso.file.first, [&dso]() {
+            dso.file.second.reset(new Mapped_file{dso.elf.c_str()});
+        });
 
-        std::call_once(symbol_addresses.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* psi_ptr) {
+        return *dso.file.second;
+    }
 
-                if (!psi_ptr)
-                    return 0;
+    // Locates .kernel and .symtab through the section headers of the mapped
+    // DSO and records views of its code objects, its function names and the
+    // kernarg layout of each of its __global__ functions.
+    void index_kernels(Dso_index& dso) {
+        std::call_once(dso.kernels_indexed, [&dso]() {
+            const auto image = mapped_file(dso).image();
 
-                program_state_impl* t = static_cast<program_state_impl*>(psi_ptr);
+            if (!image) return;
 
-                ELFIO::elfio tmp;
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
+            const auto kernel = image.data(image.section(".kernel"));
 
-                if (!tmp.load(elf)) return 0;
+            for_each_bundled_code(kernel.begin(), kernel.end(), [&](
+                const std::string& triple, const char* code, std::size_t size) {
+                #if !defined(DISABLE_REDUCED_GPU_BLOB_COPY)
+                    if (!get_all_gpuarch().count(triple)) return;
+                #endif
 
-                auto it = find_section_if(tmp, [](const ELFIO::section* x) { 
-                    return x->get_type() == SHT_SYMTAB;
-                });
+                dso.code_object_blobs[triple_to_hsa_isa(triple)].emplace_back(
+                    Blob_view{code, size});
+            });
 
-                if (!it) return 0;
+            image.for_each_symbol(
+                image.section_by_type(elf::sht_symtab),
+                [&](const elf::Sym& x, const char* name) {
+                if (x.type() != elf::stt_func) return true;
+                if (x.st_shndx == elf::shn_undef) return true;
+                if (*name == '\0') return true;
 
-                const ELFIO::symbol_section_accessor symtab{tmp, it};
+                dso.function_names.emplace(dso.base + x.st_value, name);
 
-                for (auto i = 0u; i != symtab.get_symbols_num(); ++i) {
-                    auto s = t->read_symbol(symtab, i);
+                return true;
+            });
 
-                    if (s.type != STT_OBJECT || s.sect_idx == SHN_UNDEF) continue;
+            for (auto&& isa_blobs : dso.code_object_blobs) {
+                for (auto&& x : isa_blobs.second) {
+                    read_kernarg_metadata(x.blob.data(), x.blob.size(), dso.kernargs);
+                }
+            }
 
-                    const auto addr = s.value + info->dlpi_addr;
-                    t->symbol_addresses.second.emplace(std::move(s.name), std::make_pair(addr, s.size));
+            for (auto&& function : dso.function_names) {
+                auto it = dso.kernargs.find(function.second);
+                if (it == dso.kernargs.end()) {
+                    it = dso.kernargs.find(function.second + ".kd");
+                    if (it == dso.kernargs.end()) continue;
                 }
 
-                return 0;
-            }, this);
+                dso.kernarg_layouts.emplace(function.first,
+                                            Kernarg_layout{it->second});
+            }
+        });
+    }
+
+    static
+    const std::unordered_map<
+        std::string,
+        std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>& get_symbol_addresses(
+            Dso_index& dso) {
+
+        std::call_once(dso.symbol_addresses.first, [&dso]() {
+            const auto image = mapped_file(dso).image();
+
+            image.for_each_symbol(
+                image.section_by_type(elf::sht_symtab),
+                [&](const elf::Sym& x, const char* name) {
+                if (x.type() != elf::stt_object || x.st_shndx == elf::shn_undef) {
+                    return true;
+                }
+
+                dso.symbol_addresses.second.emplace(
+                    name, std::make_pair(dso.base + x.st_value, x.st_size));
+
+                return true;
+            });
+        });
+
+        return dso.symbol_addresses.second;
+    }
+
+    const std::unordered_map<
+        std::string,
+        std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>& get_symbol_addresses() {
+
+        std::call_once(symbol_addresses.first, [this]() {
+            for (auto&& dso : all_dsos()) {
+                const auto& tmp = get_symbol_addresses(*dso);
+                symbol_addresses.second.insert(tmp.cbegin(), tmp.cend());
+            }
         });
 
         return symbol_addresses.second;
     }
 
     std::unordered_map<std::string, std::pair<void*, void*>>& get_globals() {
-        std::call_once(std::get<0>(globals), [this]() { 
-            std::get<2>(globals).reserve(get_symbol_addresses().size()); 
-        });
-        return std::get<2>(globals);
+        return globals.second;
     }
 
     std::mutex& get_globals_mutex() {
-        return std::get<1>(globals);
+        return globals.first;
+    }
+
+    // Looks the symbol up in the DSO that owns the code object first, so that
+    // only code objects which reference foreign host globals cause every
+    // loaded DSO to be scanned.
+    const std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>* find_symbol_address(
+        Dso_index* owner, const std::string& x) {
+        if (owner) {
+            const auto it = get_symbol_addresses(*owner).find(x);
+            if (it != get_symbol_addresses(*owner).cend()) return &it->second;
+        }
+
+        const auto it = get_symbol_addresses().find(x);
+
+        return (it != get_symbol_addresses().cend()) ? &it->second : nullptr;
     }
 
+    static
     std::vector<std::string> copy_names_of_undefined_symbols(
-        const ELFIO::symbol_section_accessor& section) {
+        const Elf_image& code_object) {
         std::vector<std::string> r;
 
-        for (auto i = 0u; i != section.get_symbols_num(); ++i) {
-            // TODO: this is boyscout code, caching the temporaries
-            //       may be of worth.
-            auto tmp = read_symbol(section, i);
-            if (tmp.sect_idx != SHN_UNDEF || tmp.name.empty()) continue;
+        code_object.for_each_symbol(
+            code_object.section_by_type(elf::sht_dynsym),
+            [&](const elf::Sym& x, const char* name) {
+            if (x.st_shndx == elf::shn_undef && *name != '\0') r.emplace_back(name);
 
-            r.push_back(std::move(tmp.name));
-        }
+            return true;
+        });
 
         return r;
     }
 
     void associate_code_object_symbols_with_host_allocation(
-        const ELFIO::elfio& reader,
-        ELFIO::section* code_object_dynsym,
+        const Elf_image& code_object,
+        Dso_index* owner,
         hsa_agent_t agent,
         hsa_executable_t executable) {
-        if (!code_object_dynsym) return;
+        const auto undefined_symbols = copy_names_of_undefined_symbols(code_object);
 
-        const auto undefined_symbols = copy_names_of_undefined_symbols(
-            ELFIO::symbol_section_accessor{reader, code_object_dynsym});
+        if (undefined_symbols.empty()) return;
 
         auto& g = get_globals();
         auto& g_mutex = get_globals_mutex();
         for (auto&& x : undefined_symbols) {
 
-            const auto it1 = get_symbol_addresses().find(x);
-            if (it1 == get_symbol_addresses().cend()) {
+            const auto it1 = find_symbol_address(owner, x);
+            if (!it1) {
                 // For a unknown symbol, initialize it with a magic poison
                 hsa_executable_agent_global_variable_define(
                     executable, agent, x.c_str(), 
@@ -381,8 +599,10 @@ public:
                 return (void*)nullptr;
             };
 
-            void* p = retrieve_pinned_address_from_cache(g, x);
-            if (p == nullptr) {
+            // Code objects are loaded concurrently, so the cache is only ever
+            // accessed under its lock.
+            void* p = nullptr;
+            {
                 std::lock_guard<std::mutex> lck{g_mutex};
                 p = retrieve_pinned_address_from_cache(g, x);
                 if (p == nullptr) {
@@ -391,14 +611,14 @@ public:
                         p = Kalmar::getContext()->getPrintfBufferPointerVA();
                     } 
                     else {
-                        status = hsa_amd_memory_lock(reinterpret_cast<void*>(it1->second.first),
-                                                     it1->second.second,
+                        status = hsa_amd_memory_lock(reinterpret_cast<void*>(it1->first),
+                                                     it1->second,
                                                      nullptr,  // All agents.
                                                      0, &p);
                         check_hsa_global_var_define_error(status);
                     }
                     // cache the global address and its pinned address
-                    g.emplace(x, std::make_pair(reinterpret_cast<void*>(it1->second.first), p));
+                    g.emplace(x, std::make_pair(reinterpret_cast<void*>(it1->first), p));
                 }
             }
             status = hsa_executable_agent_global_variable_define(
@@ -439,26 +659,102 @@ public:
             data = it->first.data();
         }
 
-        auto check_hsa_error = [](hsa_status_t s) {
-            if (s != HSA_STATUS_SUCCESS) {
-                const char* hsa_err_msg;
-                hsa_status_string(s, &hsa_err_msg);
-                hip_throw(std::runtime_error{
-                              std::string("error when loading code object: ") +
-                              hsa_err_msg});
-            }
-        };
-
         check_hsa_error(hsa_code_object_reader_create_from_memory(
             data, data_size, it->second.get()));
 
+        load_code_object_and_freeze_executable(*it->second, agent, executable);
+    }
+
+    static
+    void check_hsa_error(hsa_status_t s) {
+        if (s != HSA_STATUS_SUCCESS) {
+            const char* hsa_err_msg;
+            hsa_status_string(s, &hsa_err_msg);
+            hip_throw(std::runtime_error{
+                          std::string("error when loading code object: ") +
+                          hsa_err_msg});
+        }
+    }
+
+    static
+    void load_code_object_and_freeze_executable(
+        hsa_code_object_reader_t reader,
+        hsa_agent_t agent, hsa_executable_t executable) {
         check_hsa_error(hsa_executable_load_agent_code_object(
-            executable, agent, *it->second, nullptr, nullptr));
+            executable, agent, reader, nullptr, nullptr));
 
         check_hsa_error(hsa_executable_freeze(executable, nullptr));
     }
 
+    // Loads the code objects of the DSO for agent, fanning out across code
+    // objects on the shared loader pool. A code object reader is created once
+    // per code object and shared by all agents with a matching ISA. Blobs are
+    // views into the DSO mapping, so they are handed to the loader uncopied.
+    void load_executables(Dso_index& dso, hsa_agent_t agent) {
+        std::vector<
+            std::pair<hsa_agent_t, std::vector<Dso_index::Code_object*>>> work{
+                {agent, std::vector<Dso_index::Code_object*>{}}};
+
+        auto data = std::make_pair(&dso, &work.back().second);
+        hsa_agent_iterate_isas(agent, [](hsa_isa_t x, void* d) {
+            auto& p = *static_cast<decltype(data)*>(d);
+            const auto it = p.first->code_object_blobs.find(x);
+
+            if (it == p.first->code_object_blobs.end()) return HSA_STATUS_SUCCESS;
+
+            for (auto&& y : it->second) p.second->push_back(&y);
+
+            return HSA_STATUS_SUCCESS;
+        }, &data);
+
+        const auto tmp = hip_impl::load_executables<
+            hsa_agent_t, hsa_code_object_reader_t, hsa_executable_t>(
+            work,
+            code_object_load_pool(),
+            [](const Blob_view& x) {
+                hsa_code_object_reader_t r{};
+                check_hsa_error(hsa_code_object_reader_create_from_memory(
+                    x.data(), x.size(), &r));
+
+                return r;
+            },
+            [&, this](hsa_agent_t a, hsa_code_object_reader_t r, const Blob_view& x) {
+                hsa_executable_t executable = {};
+
+                hsa_executable_create_alt(
+                    HSA_PROFILE_FULL,
+                    HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT,
+                    nullptr,
+                    &executable);
+
+                return load_executable(x, r, executable, a, dso);
+            });
+
+        auto& executables = dso.executables.at(agent).second;
+        for (auto&& x : tmp.front()) {
+            if (x.handle) executables.push_back(x);
+        }
+    }
+
+    const std::vector<hsa_executable_t>& get_executables(Dso_index& dso,
+                                                         hsa_agent_t agent) {
+        index_kernels(dso);
+
+        const auto it = dso.executables.find(agent);
+        if (it == dso.executables.cend()) {
+            hip_throw(std::runtime_error{"invalid agent"});
+        }
+
+        std::call_once(it->second.first, [&, this]() {
+            load_executables(dso, agent);
+        });
 
+        return it->second.second;
+    }
+
+    // Executables of every loaded DSO for agent; this forces all of them to
+    // be indexed and loaded, in parallel, and is only needed for looking up
+    // globals by name.
     const std::vector<hsa_executable_t>& get_executables(hsa_agent_t agent) {
 
         if (executables.find(agent) == executables.cend()) {
@@ -466,48 +762,16 @@ public:
         }
 
         std::call_once(executables[agent].first, [this](hsa_agent_t aa) {
-            auto data = std::make_pair(this, &aa);
-            hsa_agent_iterate_isas(aa, [](hsa_isa_t x, void* d) {
-                auto& p = *static_cast<decltype(data)*>(d);
-                auto& impl = *(p.first);
-                for (const auto code_object_it : impl.get_code_object_blobs()) {
-                    const auto elf = code_object_it.first;
-                    const auto code_object_blobs = code_object_it.second;
-                    const auto it = code_object_blobs.find(x);
-
-                    if (it == code_object_blobs.cend()) continue;
-
-                    hsa_agent_t a = *static_cast<hsa_agent_t*>(p.second);
-
-                    std::lock_guard<std::mutex> lck{executables_cache_mutex};
-
-                    std::vector<hsa_executable_t>& current_exes =
-                            hip_impl::executables_cache(elf, x, a);
-                    // check the cache for already loaded executables
-                    if (current_exes.empty()) {
-                        // executables do not yet exist for this elf+isa+agent, create and cache them
-                        for (auto&& blob : it->second) {
-                            hsa_executable_t tmp = {};
-
-                            hsa_executable_create_alt(
-                                HSA_PROFILE_FULL,
-                                HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT,
-                                nullptr,
-                                &tmp);
-
-                            // TODO: this is massively inefficient and only meant for
-                            // illustration.
-                            tmp = impl.load_executable(blob.data(), blob.size(), true, tmp, a);
-
-                            if (tmp.handle) current_exes.push_back(tmp);
-                        }
-                    }
-                    // append cached executables to our agent's vector of executables
-                    impl.executables[a].second.insert(impl.executables[a].second.end(),
-                            current_exes.begin(), current_exes.end());
-                }
-                return HSA_STATUS_SUCCESS;
-            }, &data);
+            const auto dsos = all_dsos();
+            parallel_for(code_object_load_pool(), dsos.size(), [&](std::size_t i) {
+                get_executables(*dsos[i], aa);
+            });
+
+            for (auto&& dso : dsos) {
+                const auto& tmp = get_executables(*dso, aa);
+                executables[aa].second.insert(executables[aa].second.end(),
+                                              tmp.cbegin(), tmp.cend());
+            }
         }, agent);
 
         return executables[agent].second;
@@ -518,18 +782,11 @@ public:
                                      bool make_copy,
                                      hsa_executable_t executable,
                                      hsa_agent_t agent) {
-        ELFIO::elfio reader;
-        std::string ts = std::string(data, data_size);
-        std::stringstream tmp{ts};
-
-        if (!reader.load(tmp)) return hsa_executable_t{};
-        const auto code_object_dynsym = find_section_if(
-            reader, [](const ELFIO::section* x) {
-                return x->get_type() == SHT_DYNSYM;
-        });
+        const Elf_image code_object{data, data_size};
 
-        associate_code_object_symbols_with_host_allocation(reader,
-                                                           code_object_dynsym,
+        if (!code_object) return hsa_executable_t{};
+
+        associate_code_object_symbols_with_host_allocation(code_object, nullptr,
                                                            agent, executable);
 
         load_code_object_and_freeze_executable(data, data_size, make_copy, agent, executable);
@@ -537,111 +794,68 @@ public:
         return executable;
     }
 
-    std::vector<std::pair<std::uintptr_t, std::string>> function_names_for(
-        const ELFIO::elfio& reader, ELFIO::section* symtab) {
-        std::vector<std::pair<std::uintptr_t, std::string>> r;
-        ELFIO::symbol_section_accessor symbols{reader, symtab};
-
-        for (auto i = 0u; i != symbols.get_symbols_num(); ++i) {
-            // TODO: this is boyscout code, caching the temporaries
-            //       may be of worth.
-            auto tmp = read_symbol(symbols, i);
-
-            if (tmp.type != STT_FUNC) continue;
-            if (tmp.type == SHN_UNDEF) continue;
-            if (tmp.name.empty()) continue;
-
-            r.emplace_back(tmp.value, tmp.name);
-        }
-
-        return r;
-    }
-
-    const std::unordered_map<std::uintptr_t, std::string>& get_function_names() {
-
-        std::call_once(function_names.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
-                ELFIO::elfio tmp;
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
-
-                if (!tmp.load(elf)) return 0;
-
-                const auto it = find_section_if(tmp, [](const ELFIO::section* x) {
-                    return x->get_type() == SHT_SYMTAB;
-                });
-
-                if (!it) return 0;
+    hsa_executable_t load_executable(const Blob_view& blob,
+                                     hsa_code_object_reader_t reader,
+                                     hsa_executable_t executable,
+                                     hsa_agent_t agent,
+                                     Dso_index& owner) {
+        const Elf_image code_object{blob.data(), blob.size()};
 
-                auto& impl = *static_cast<program_state_impl*>(p);
-       
-                auto names = impl.function_names_for(tmp, it);
-                for (auto&& x : names) x.first += info->dlpi_addr;
+        if (!code_object) return hsa_executable_t{};
 
-                impl.function_names.second.insert(
-                    std::make_move_iterator(names.begin()),
-                    std::make_move_iterator(names.end()));
+        associate_code_object_symbols_with_host_allocation(code_object, &owner,
+                                                           agent, executable);
 
-                return 0;
-            }, this);
-        });
+        load_code_object_and_freeze_executable(reader, agent, executable);
 
-        return function_names.second;
+        return executable;
     }
 
     const std::unordered_map<
-        std::string, std::vector<hsa_executable_symbol_t>>& get_kernels(hsa_agent_t agent) {
+        std::uintptr_t,
+        Kernel_descriptor>& get_functions(Dso_index& dso, hsa_agent_t agent) {
 
-        if (kernels.find(agent) == kernels.cend()) {
+        const auto it = dso.functions.find(agent);
+        if (it == dso.functions.cend()) {
             hip_throw(std::runtime_error{"invalid agent"});
         }
 
-        std::call_once(kernels[agent].first, [this](hsa_agent_t aa) {
+        std::call_once(it->second.first, [&, this]() {
+            using Kernels = std::unordered_map<
+                std::string, std::vector<hsa_executable_symbol_t>>;
+
             static const auto copy_kernels = [](
-                hsa_executable_t, hsa_agent_t a, hsa_executable_symbol_t x, void* p) {
-                auto& impl = *static_cast<program_state_impl*>(p);
-                if (type(x) == HSA_SYMBOL_KIND_KERNEL) impl.kernels[a].second[hip_impl::name(x)].push_back(x);
+                hsa_executable_t, hsa_agent_t, hsa_executable_symbol_t x, void* p) {
+                auto& kernels = *static_cast<Kernels*>(p);
+                if (type(x) == HSA_SYMBOL_KIND_KERNEL) kernels[hip_impl::name(x)].push_back(x);
 
                 return HSA_STATUS_SUCCESS;
             };
 
-            for (auto&& executable : get_executables(aa)) {
+            Kernels kernels;
+            for (auto&& executable : get_executables(dso, agent)) {
                 hsa_executable_iterate_agent_symbols(
-                    executable, aa, copy_kernels, this);
+                    executable, agent, copy_kernels, &kernels);
             }
-        }, agent);
-
-        return kernels[agent].second;
-    }
-
-    const std::unordered_map<
-        std::uintptr_t,
-        Kernel_descriptor>& get_functions(hsa_agent_t agent) {
 
-        if (functions.find(agent) == functions.cend()) {
-            hip_throw(std::runtime_error{"invalid agent"});
-        }
+            for (auto&& function : dso.function_names) {
+                auto it1 = kernels.find(function.second);
 
-        std::call_once(functions[agent].first, [this](hsa_agent_t aa) {
-            for (auto&& function : get_function_names()) {
-                auto it = get_kernels(aa).find(function.second);
-
-                if (it == get_kernels(aa).cend()) {
-                    it = get_kernels(aa).find(function.second + ".kd");
-                    if (it == get_kernels(aa).cend())
-                        continue;
+                if (it1 == kernels.cend()) {
+                    it1 = kernels.find(function.second + ".kd");
+                    if (it1 == kernels.cend()) continue;
                 }
 
-                for (auto&& kernel_symbol : it->second) {
-                    functions[aa].second.emplace(
+                for (auto&& kernel_symbol : it1->second) {
+                    it->second.second.emplace(
                         function.first,
-                        Kernel_descriptor{kernel_object(kernel_symbol), it->first,
-                                          kernargs_size_align(function.first)});
+                        Kernel_descriptor{kernel_object(kernel_symbol), it1->first,
+                                          kernargs_size_align(function.first).size_align});
                 }
             }
-        }, agent);
+        });
 
-        return functions[agent].second;
+        return it->second.second;
     }
 
     static
@@ -797,7 +1011,8 @@ public:
 
     static
     void read_kernarg_metadata_v3(
-            const std::string& blob,
+            const char* blob,
+            std::size_t blob_size,
             std::unordered_map<
                 std::string,
                 std::vector<std::pair<std::size_t, std::size_t>>>& kernargs) {
@@ -808,7 +1023,7 @@ public:
             != AMD_COMGR_STATUS_SUCCESS)
             return;
 
-        if (amd_comgr_set_data(dataIn, blob.size(), blob.data())
+        if (amd_comgr_set_data(dataIn, blob_size, blob)
             != AMD_COMGR_STATUS_SUCCESS)
             return;
 
@@ -876,75 +1091,72 @@ public:
 
     static
     void read_kernarg_metadata(
-        const std::string& blob,
+        const char* blob,
+        std::size_t blob_size,
         std::unordered_map<
             std::string,
             std::vector<std::pair<std::size_t, std::size_t>>>& kernargs)
     {
-        std::istringstream istr{blob};
-        ELFIO::elfio reader;
-
-        if (!reader.load(istr)) return;
-
-        // TODO: this is inefficient.
-        auto it = find_section_if(reader, [](const ELFIO::section* x) {
-            return x->get_type() == SHT_NOTE;
-        });
+        const Elf_image reader{blob, blob_size};
 
-        if (!it) return;
+        if (!reader) return;
 
-        const ELFIO::note_section_accessor acc{reader, it};
-        auto n{acc.get_notes_num()};
-        while (n--) {
-            ELFIO::Elf_Word type{};
-            std::string name{};
-            void* desc{};
-            ELFIO::Elf_Word desc_size{};
+        // The last metadata note wins.
+        bool is_v3{false};
+        Blob_view v2_md{};
+        reader.for_each_note(
+            reader.section_by_type(elf::sht_note),
+            [&](std::uint32_t, Blob_view name, Blob_view desc) {
+            const std::string n{name.begin(), name.end()};
 
-            acc.get_note(n, type, name, desc, desc_size);
+            if (n == "AMDGPU") {
+                is_v3 = true;
+                return;
+            }
+            if (n != "AMD") return; // TODO: switch to using NT_AMD_AMDGPU_HSA_METADATA.
 
-            if (name == "AMDGPU") {
-                return read_kernarg_metadata_v3(blob, kernargs);
+            static constexpr const char kernels[]{"Kernels:"};
+            if (std::search(desc.begin(), desc.end(),
+                            kernels, kernels + sizeof(kernels) - 1) == desc.end()) {
+                return;
             }
-            if (name != "AMD") continue; // TODO: switch to using NT_AMD_AMDGPU_HSA_METADATA.
 
-            std::string tmp{
-                static_cast<char*>(desc), static_cast<char*>(desc) + desc_size};
+            is_v3 = false;
+            v2_md = desc;
+        });
 
-            auto dx = tmp.find("Kernels:");
+        if (is_v3) return read_kernarg_metadata_v3(blob, blob_size, kernargs);
+        if (v2_md.empty()) return;
 
-            if (dx == std::string::npos) continue;
+        const std::string tmp{v2_md.begin(), v2_md.end()};
 
-            return read_kernarg_metadata_v2(tmp, dx + 8u, kernargs); // Skip "Kernels:".
-        }
+        return read_kernarg_metadata_v2(
+            tmp, tmp.find("Kernels:") + 8u, kernargs); // Skip "Kernels:".
     }
 
-    const std::unordered_map<std::string,
-        std::vector<std::pair<std::size_t, std::size_t>>>& get_kernargs() {
-
-        std::call_once(kernargs.first, [this]() {
-            for (auto&& name_and_isa_blobs : get_code_object_blobs()) {
-                for (auto&& isa_blobs : name_and_isa_blobs.second) {
-                    for (auto&& blob : isa_blobs.second) {
-                        read_kernarg_metadata(blob, kernargs.second);
-                    }
-                }
-            }
-        });
-
-        return kernargs.second;
+    static
+    void read_kernarg_metadata(
+        const std::string& blob,
+        std::unordered_map<
+            std::string,
+            std::vector<std::pair<std::size_t, std::size_t>>>& kernargs)
+    {
+        read_kernarg_metadata(blob.data(), blob.size(), kernargs);
     }
 
     std::string name(std::uintptr_t function_address)
     {
-        const auto it = get_function_names().find(function_address);
+        const auto dso = dso_index(function_address);
 
-        if (it == get_function_names().cend())  {
-            hip_throw(std::runtime_error{
-                    "Invalid function passed to hipLaunchKernelGGL."});
+        if (dso) {
+            index_kernels(*dso);
+
+            const auto it = dso->function_names.find(function_address);
+            if (it != dso->function_names.cend()) return it->second;
         }
 
-        return it->second;
+        hip_throw(std::runtime_error{
+                "Invalid function passed to hipLaunchKernelGGL."});
     }
 
     std::string name(hsa_agent_t agent)
@@ -955,12 +1167,30 @@ public:
         return std::string{n};
     }
 
+    // Only the DSO that defines function_address is indexed, on the first
+    // launch of one of its kernels. Subsequent look-ups are served from a
+    // per-thread cache and do not take the index's lock; every thread drops
+    // its cache once the dynamic linker has unloaded a DSO.
     const Kernel_descriptor& kernel_descriptor(std::uintptr_t function_address,
             hsa_agent_t agent) {
+        thread_local Dso_memo<
+            Function_key, Kernel_descriptor, Function_key_hash> memo;
+        auto& cache = memo.get();
 
-        auto it0 = get_functions(agent).find(function_address);
+        const Function_key key{function_address, agent.handle};
+        const auto it = cache.find(key);
+        if (it != cache.cend()) return *it->second;
 
-        if (it0 != get_functions(agent).cend()) return it0->second;
+        if (const auto dso = dso_index(function_address)) {
+            const auto& functions = get_functions(*dso, agent);
+            const auto it0 = functions.find(function_address);
+
+            if (it0 != functions.cend()) {
+                cache.emplace(key, &it0->second);
+
+                return it0->second;
+            }
+        }
 
         // For hip-clang compiler + Hcc RT
         hipFunction_t f = ihipGetDeviceFunction((const void*)function_address);
@@ -972,24 +1202,31 @@ public:
                     ", for agent: " + name(agent)});
     }
 
-    const std::vector<std::pair<std::size_t, std::size_t>>& 
-        kernargs_size_align(std::uintptr_t kernel) {
+    const Kernarg_layout& kernargs_size_align(std::uintptr_t kernel) {
+        thread_local Dso_memo<std::uintptr_t, Kernarg_layout> memo;
+        auto& cache = memo.get();
 
-        auto it = get_function_names().find(kernel);
-        if (it == get_function_names().cend()) {
-            hip_throw(std::runtime_error{"Undefined __global__ function."});
-        }
+        const auto it = cache.find(kernel);
+        if (it != cache.cend()) return *it->second;
+
+        if (const auto dso = dso_index(kernel)) {
+            index_kernels(*dso);
+
+            const auto it0 = dso->kernarg_layouts.find(kernel);
+            if (it0 != dso->kernarg_layouts.cend()) {
+                cache.emplace(kernel, &it0->second);
+
+                return it0->second;
+            }
 
-        auto it1 = get_kernargs().find(it->second);
-        if (it1 == get_kernargs().end()) {
-            it1 = get_kernargs().find(it->second + ".kd");
-            if (it1 == get_kernargs().end()) {
+            const auto it1 = dso->function_names.find(kernel);
+            if (it1 != dso->function_names.cend()) {
                 hip_throw(std::runtime_error{
-                          "Missing metadata for __global__ function: " + it->second});
+                          "Missing metadata for __global__ function: " + it1->second});
             }
         }
 
-        return it1->second;
+        hip_throw(std::runtime_error{"Undefined __global__ function."});
     }
 };  // class program_state_impl
 
@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Copies between pageable host memory and device memory through a ring of
+// pinned staging chunks. The host-side std::memcpy into / out of one chunk
+// overlaps with the DMA of the others, so a large copy costs roughly
+// max(memcpy, DMA) rather than their sum, and the user buffer never has to be
+// pinned. This is independent of HSA: the DMA engine is a template parameter
+// providing
+//     void start(std::size_t slot, void* dst, const void* src, std::size_t n);
+//     void wait(std::size_t slot);
+// where at most one transfer per slot is in flight at any time, which lets the
+// scheduling be tested against a fake engine.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace hip_impl {
+
+// Upper bound on the number of staging chunks of a ring.
+constexpr std::size_t max_staging_depth{64};
+
+// depth chunks of chunk (> 0) bytes each, laid out contiguously from base.
+struct Staging_ring {
+    char* base;
+    std::size_t chunk;
+    std::size_t depth;
+
+    char* slot(std::size_t i) const noexcept { return base + i * chunk; }
+};
+
+namespace staged_copy_detail {
+    // Tracks the slots with a transfer in flight; any that are still pending
+    // when a copy unwinds are drained, so that the ring can be reused.
+    template<typename Dma>
+    class Pending {
+        Dma& dma_;
+        std::uint64_t slots_{};
+    public:
+        explicit
+        Pending(Dma& dma) : dma_(dma) {}
+        Pending(const Pending&) = delete;
+        ~Pending()
+        {
+            for (auto i = 0u; slots_; ++i) {
+                if (!(slots_ & (std::uint64_t{1} << i))) continue;
+
+                slots_ &= ~(std::uint64_t{1} << i);
+                #if defined(__cpp_exceptions)
+                    try { dma_.wait(i); } catch (...) {}
+                #else
+                    dma_.wait(i);
+                #endif
+            }
+        }
+
+        Pending& operator=(const Pending&) = delete;
+
+        void start(std::size_t slot, void* dst, const void* src, std::size_t n)
+        {
+            dma_.start(slot, dst, src, n);
+            slots_ |= std::uint64_t{1} << slot;
+        }
+
+        void wait(std::size_t slot)
+        {
+            if (!(slots_ & (std::uint64_t{1} << slot))) return;
+
+            slots_ &= ~(std::uint64_t{1} << slot);
+            dma_.wait(slot);
+        }
+
+        void wait_all()
+        {
+            for (auto i = 0u; slots_; ++i) wait(i);
+        }
+    };
+
+    inline
+    std::size_t depth_of(const Staging_ring& ring) noexcept
+    {
+        return std::min(std::max<std::size_t>(ring.depth, 1u),
+                        max_staging_depth);
+    }
+}  // namespace staged_copy_detail
+
+// Host to device: chunk i is copied into slot i % depth once the DMA that last
+// read that slot, chunk i - depth, has completed.
+template<typename Dma>
+inline
+void staged_h2d_copy(void* __restrict dst, const void* __restrict src,
+                     std::size_t n, const Staging_ring& ring, Dma& dma)
+{
+    const auto depth = staged_copy_detail::depth_of(ring);
+    staged_copy_detail::Pending<Dma> pending{dma};
+
+    for (std::size_t i = 0, dx = 0; dx < n; ++i, dx += ring.chunk) {
+        const auto slot = i % depth;
+        const auto len = std::min(ring.chunk, n - dx);
+
+        pending.wait(slot);
+        std::memcpy(ring.slot(slot), static_cast<const char*>(src) + dx, len);
+        pending.start(slot, static_cast<char*>(dst) + dx, ring.slot(slot), len);
+    }
+
+    pending.wait_all();
+}
+
+// Device to host: up to depth chunks are in flight into the ring; as soon as
+// the oldest one lands it is copied out and its slot is refilled with the
+// chunk depth positions further on.
+template<typename Dma>
+inline
+void staged_d2h_copy(void* __restrict dst, const void* __restrict src,
+                     std::size_t n, const Staging_ring& ring, Dma& dma)
+{
+    const auto depth = staged_copy_detail::depth_of(ring);
+    const auto chunk_cnt = (n + ring.chunk - 1) / ring.chunk;
+    staged_copy_detail::Pending<Dma> pending{dma};
+
+    const auto start = [&](std::size_t i) {
+        const auto dx = i * ring.chunk;
+        pending.start(i % depth, ring.slot(i % depth),
+                      static_cast<const char*>(src) + dx,
+                      std::min(ring.chunk, n - dx));
+    };
+
+    for (auto i = 0u; i != std::min(depth, chunk_cnt); ++i) start(i);
+
+    for (std::size_t i = 0; i != chunk_cnt; ++i) {
+        const auto slot = i % depth;
+        const auto dx = i * ring.chunk;
+
+        pending.wait(slot);
+        std::memcpy(static_cast<char*>(dst) + dx, ring.slot(slot),
+                    std::min(ring.chunk, n - dx));
+
+        if (i + depth < chunk_cnt) start(i + depth);
+    }
+}
+
+}  // namespace hip_impl
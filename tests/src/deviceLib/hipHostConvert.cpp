@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipHostConvert %cxx -std=c++11 -O2 -I%S/../../../src %S/%s -o %T/%t EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// The bulk host conversions between float and half or bfloat16 give the same
+// bits as the scalar routines on every instruction set the CPU supports: for
+// all 65536 halves and bfloat16 values, and for floats around every rounding
+// boundary.
+
+#include "fp16_convert.inl"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../host_test_common.h"
+
+using hip_impl::ConvertIsa;
+
+namespace {
+std::uint32_t bits(float f) {
+    std::uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float fromBits(std::uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Odd lengths and offsets so the scalar tails and unaligned accesses run too.
+void checkToFloat(ConvertIsa isa) {
+    std::vector<std::uint16_t> src(65536 + 7);
+    for (size_t i = 0; i != 65536; ++i) src[i + 3] = static_cast<std::uint16_t>(i);
+    std::vector<float> dst(src.size());
+
+    hip_impl::halfToFloat(&dst[3], &src[3], 65536 + 1, isa);
+    for (std::uint32_t i = 0; i != 65536; ++i) {
+        CHECK(bits(dst[i + 3]) == bits(__convert_half_to_float(i)));
+    }
+    hip_impl::bfloat16ToFloat(&dst[3], &src[3], 65536 + 1, isa);
+    for (std::uint32_t i = 0; i != 65536; ++i) {
+        CHECK(bits(dst[i + 3]) == (i << 16));
+    }
+}
+
+void checkFromFloat(ConvertIsa isa, const std::vector<float>& src) {
+    std::vector<std::uint16_t> dst(src.size());
+    const size_t n = src.size() - 1;
+
+    hip_impl::floatToHalf(&dst[1], &src[1], n, false, isa);
+    for (size_t i = 1; i <= n; ++i) {
+        CHECK(dst[i] == __convert_float_to_half(src[i]));
+    }
+    hip_impl::floatToHalf(&dst[1], &src[1], n, true, isa);
+    for (size_t i = 1; i <= n; ++i) {
+        CHECK(dst[i] == __convert_float_to_half_rtz(src[i]));
+    }
+    hip_impl::floatToBfloat16(&dst[1], &src[1], n, false, isa);
+    for (size_t i = 1; i <= n; ++i) {
+        CHECK(dst[i] == __convert_float_to_bfloat16(src[i]));
+    }
+    hip_impl::floatToBfloat16(&dst[1], &src[1], n, true, isa);
+    for (size_t i = 1; i <= n; ++i) {
+        CHECK(dst[i] == __convert_float_to_bfloat16_rtz(src[i]));
+    }
+}
+}  // namespace
+
+int main() {
+    // The scalar rounding toward zero agrees with the definition: the largest
+    // half not above the value in magnitude.
+    CHECK(__convert_float_to_half_rtz(1.0f) == 0x3c00);
+    CHECK(__convert_float_to_half_rtz(65519.0f) == 0x7bff);
+    CHECK(__convert_float_to_half_rtz(1e10f) == 0x7bff);
+    CHECK(__convert_float_to_half_rtz(-1e10f) == 0xfbff);
+    CHECK(__convert_float_to_half_rtz(fromBits(0x7f800000)) == 0x7c00);
+    CHECK(__convert_float_to_half_rtz(fromBits(0xff800001)) == 0xfe00);
+    CHECK(__convert_float_to_half_rtz(fromBits(0x33800000)) == 0x0001);  // 2^-24
+    CHECK(__convert_float_to_half_rtz(fromBits(0x337fffff)) == 0x0000);
+    CHECK(__convert_float_to_half_rtz(fromBits(0xb8800000)) == 0x8400);  // -2^-14
+    CHECK(__convert_float_to_half_rtz(fromBits(0x387fffff)) == 0x03ff);
+    for (std::uint32_t h = 0; h != 0x7c00; ++h) {
+        const float f = __convert_half_to_float(h);
+        CHECK(__convert_float_to_half_rtz(f) == h);
+        CHECK(__convert_float_to_half(f) == h);
+        CHECK(__convert_float_to_half_rtz(fromBits(bits(f) + 1)) == h);
+    }
+
+    // Every float whose low 16 bits are near a rounding boundary of either
+    // format, plus random ones.
+    std::vector<float> src;
+    src.push_back(0.0f);
+    const std::uint32_t lows[] = {0, 1, 2, 0x0fff, 0x1000, 0x1001, 0x1fff};
+    for (std::uint32_t high = 0; high != 65536; ++high) {
+        for (std::uint32_t top = 0; top != 8; ++top) {
+            for (std::uint32_t low : lows) {
+                src.push_back(fromBits((high << 16) | (top << 13) | low));
+            }
+        }
+        for (std::uint32_t low : {0x7fffu, 0x8000u, 0x8001u, 0xffffu}) {
+            src.push_back(fromBits((high << 16) | low));
+        }
+    }
+    std::mt19937 rng(1);
+    for (int i = 0; i != 1 << 22; ++i) src.push_back(fromBits(rng()));
+
+    const ConvertIsa best = hip_impl::bestConvertIsa();
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+        const ConvertIsa isa = static_cast<ConvertIsa>(level);
+        printf("%s\n", hip_impl::convertIsaName(isa));
+        checkToFloat(isa);
+        checkFromFloat(isa, src);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
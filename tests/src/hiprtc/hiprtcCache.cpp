@@ -0,0 +1,171 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hiprtcCache %cxx -std=c++11 -I%S/../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the hiprtc compilation cache with a stubbed compiler, so hipcc
+// is not needed either.
+
+#include "hiprtc_cache.inl"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../host_test_common.h"
+
+using hip_impl::Code_object_cache;
+
+static Code_object_cache::Key make_key(const std::string& source,
+                                       const std::string& options) {
+    Code_object_cache::Key key;
+    key.add("hipcc").add("prog.cpp").add(source).add(options).add("gfx900");
+    return key;
+}
+
+// Entries are written with the current time; this gives the ones written since
+// the last call the modification time t instead, t being well in the past, so
+// that eviction sees the entries in a known order however coarse the clock.
+static void stamp_new_entries(const std::string& dir, time_t t) {
+    DIR* d = opendir(dir.c_str());
+    CHECK(d);
+    while (const dirent* x = readdir(d)) {
+        const auto file = dir + '/' + x->d_name;
+        struct stat s;
+        if (x->d_name[0] == '.' || stat(file.c_str(), &s) != 0 ||
+            s.st_mtime < 1000000000) continue;
+
+        const timespec times[2]{{t, 0}, {t, 0}};
+        CHECK(utimensat(AT_FDCWD, file.c_str(), times, 0) == 0);
+    }
+    closedir(d);
+}
+
+int main() {
+    char tmpl[] = "/tmp/hiprtcCacheXXXXXX";
+    CHECK(mkdtemp(tmpl));
+    const std::string root = std::string(tmpl) + "/nested/cache";
+
+    int compiles = 0;
+    const auto stub = [&](const std::string& source) {
+        return [&, source](std::string& log, std::vector<char>& code) {
+            ++compiles;
+            log = "compiled " + source;
+            code.assign(source.rbegin(), source.rend());
+            code.resize(1024, 'x');
+            return true;
+        };
+    };
+
+    std::string log;
+    std::vector<char> code;
+
+    // Cold cache: the compiler runs and the result is published.
+    {
+        Code_object_cache cache{root, 1 << 20};
+        CHECK(cache.lookup_or_compile(make_key("a", "-O3"), log, code, stub("a")));
+        CHECK(compiles == 1 && cache.misses() == 1 && cache.hits() == 0);
+        CHECK(log == "compiled a" && code.size() == 1024 && code[0] == 'a');
+
+        // Any difference in the key is a miss.
+        CHECK(cache.lookup_or_compile(make_key("a", "-O2"), log, code, stub("a")));
+        CHECK(compiles == 2 && cache.misses() == 2);
+    }
+
+    // Warm restart: a new cache instance serves the entry without compiling.
+    {
+        Code_object_cache cache{root, 1 << 20};
+        log.clear();
+        code.clear();
+        CHECK(cache.lookup_or_compile(make_key("a", "-O3"), log, code, stub("a")));
+        CHECK(compiles == 2 && cache.hits() == 1 && cache.misses() == 0);
+        CHECK(log == "compiled a" && code.size() == 1024 && code[0] == 'a');
+    }
+
+    // Failed compilations are not cached.
+    {
+        Code_object_cache cache{root, 1 << 20};
+        const auto failing = [&](std::string&, std::vector<char>&) { ++compiles; return false; };
+        CHECK(!cache.lookup_or_compile(make_key("bad", ""), log, code, failing));
+        CHECK(!cache.lookup_or_compile(make_key("bad", ""), log, code, failing));
+        CHECK(compiles == 4 && cache.hits() == 0);
+    }
+
+    // LRU eviction keeps the cache below its size bound.
+    {
+        Code_object_cache cache{root, 3 * 1200};
+        stamp_new_entries(root, 100);
+        for (int i = 0; i < 8; ++i) {
+            const auto s = "evict" + std::to_string(i);
+            CHECK(cache.lookup_or_compile(make_key(s, ""), log, code, stub(s)));
+            stamp_new_entries(root, 101 + i);
+        }
+        CHECK(cache.evictions() >= 5);
+
+        // The most recent entry survived, the oldest did not.
+        const int before = compiles;
+        CHECK(cache.lookup_or_compile(make_key("evict7", ""), log, code, stub("evict7")));
+        CHECK(compiles == before);
+        CHECK(cache.lookup_or_compile(make_key("evict0", ""), log, code, stub("evict0")));
+        CHECK(compiles == before + 1);
+    }
+
+    // Concurrent publishers of the same key never expose a partial entry.
+    {
+        Code_object_cache cache{root, 1 << 20};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < 50; ++i) {
+                    std::string l;
+                    std::vector<char> c;
+                    const auto s = "shared" + std::to_string(i % 5);
+                    CHECK(cache.lookup_or_compile(make_key(s, ""), l, c,
+                        [&](std::string& log, std::vector<char>& code) {
+                            log = "compiled " + s;
+                            code.assign(s.rbegin(), s.rend());
+                            code.resize(1024, 'x');
+                            return true;
+                        }));
+                    CHECK(l == "compiled " + s && c.size() == 1024 && c[0] == s.back());
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        CHECK(cache.hits() + cache.misses() == 8 * 50);
+    }
+
+    std::string rm = std::string("rm -rf ") + tmpl;
+    CHECK(system(rm.c_str()) == 0);
+
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipLaunchConfigStack %cxx -std=c++11 -I%S/../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the per-thread stack of pending launch configurations used by the
+// triple-chevron path.
+
+#include "launch_config_stack.inl"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+struct Config {
+    unsigned grid;
+    unsigned block;
+};
+
+using Stack = Launch_config_stack<Config, 4, 32>;
+
+thread_local Stack stack;
+
+std::vector<char> args_of(const Stack::Entry& x)
+{
+    return std::vector<char>(x.args(), x.args() + x.args_size());
+}
+}  // namespace
+
+int main() {
+    // Nested configurations pop in reverse order; a full stack refuses more.
+    {
+        CHECK(stack.empty());
+        for (unsigned i = 0; i != 4; ++i) CHECK(stack.push(Config{i, 64}));
+        CHECK(!stack.push(Config{4, 64}));
+        CHECK(stack.size() == 4);
+        for (unsigned i = 4; i-- != 0;) {
+            CHECK(stack.top().config().grid == i);
+            stack.pop();
+        }
+        CHECK(stack.empty());
+    }
+
+    // Arguments are stored inline, gaps read as zero, and the popped entry
+    // stays readable until the next push.
+    {
+        CHECK(stack.push(Config{1, 1}));
+        const std::uint32_t a = 0x11223344;
+        const std::uint64_t b = 0x5566778899aabbccull;
+        stack.top().set_arg(8, &b, sizeof(b));
+        stack.top().set_arg(0, &a, sizeof(a));
+        CHECK(stack.top().args_size() == 16);
+
+        const auto& entry = stack.top();
+        stack.pop();
+        const auto args = args_of(entry);
+        std::uint32_t a1;
+        std::uint64_t b1;
+        std::memcpy(&a1, &args[0], sizeof(a1));
+        std::memcpy(&b1, &args[8], sizeof(b1));
+        CHECK(a1 == a && b1 == b);
+        for (int i = 4; i != 8; ++i) CHECK(args[i] == 0);
+
+        // A new push starts with no arguments.
+        CHECK(stack.push(Config{2, 2}));
+        CHECK(stack.top().args_size() == 0);
+        stack.pop();
+    }
+
+    // Arguments larger than the inline storage spill, keeping what was set
+    // inline, and the spill buffer is reused by later launches.
+    {
+        std::vector<char> big(100);
+        for (auto i = 0u; i != big.size(); ++i) big[i] = static_cast<char>(i + 1);
+
+        const char* spill = nullptr;
+        for (int round = 0; round != 3; ++round) {
+            CHECK(stack.push(Config{3, 3}));
+            stack.top().set_arg(0, big.data(), 16);
+            CHECK(stack.top().args() != nullptr && stack.top().args_size() == 16);
+            stack.top().set_arg(16, big.data() + 16, big.size() - 16);
+            CHECK(args_of(stack.top()) == big);
+
+            if (round == 0) spill = stack.top().args();
+            else CHECK(stack.top().args() == spill);
+            stack.pop();
+
+            // A small launch in between goes back to inline storage.
+            CHECK(stack.push(Config{4, 4}));
+            stack.top().set_arg(0, big.data(), 8);
+            CHECK(stack.top().args() != spill);
+            CHECK(args_of(stack.top()) == std::vector<char>(big.begin(), big.begin() + 8));
+            stack.pop();
+        }
+    }
+
+    // Every thread has its own stack.
+    {
+        CHECK(stack.push(Config{42, 42}));
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t != 8; ++t) {
+            threads.emplace_back([t]() {
+                for (unsigned i = 0; i != 10000; ++i) {
+                    CHECK(stack.empty());
+                    CHECK(stack.push(Config{t, i}));
+                    stack.top().set_arg(0, &i, sizeof(i));
+                    CHECK(stack.top().config().grid == t);
+                    unsigned j;
+                    std::memcpy(&j, stack.top().args(), sizeof(j));
+                    CHECK(j == i);
+                    stack.pop();
+                }
+            });
+        }
+        for (auto&& x : threads) x.join();
+        CHECK(stack.size() == 1 && stack.top().config().grid == 42);
+        stack.pop();
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
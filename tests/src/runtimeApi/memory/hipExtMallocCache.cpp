@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp EXCLUDE_HIP_PLATFORM nvcc hcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Small allocations share cached segments but stay disjoint, report their own
+// base and size, and are returned to the device by a trim.
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
+#include "test_common.h"
+
+#include <vector>
+
+#define COUNT 64
+#define SIZE 1000
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int device = 0;
+    HIPCHECK(hipGetDevice(&device));
+    HIPCHECK(hipExtMallocCacheTrim(device, 0));
+    HIPCHECK(hipExtMallocCacheResetPeakStats(device));
+
+    std::vector<char*> ptrs(COUNT);
+    for (int i = 0; i < COUNT; ++i) {
+        HIPCHECK(hipMalloc(&ptrs[i], SIZE));
+        HIPCHECK(hipMemset(ptrs[i], i, SIZE));
+
+        size_t size = 0;
+        HIPCHECK(hipMemPtrGetInfo(ptrs[i], &size));
+        HIPASSERT(size == SIZE);
+        hipDeviceptr_t base = nullptr;
+        HIPCHECK(hipMemGetAddressRange(&base, &size, ptrs[i] + SIZE / 2));
+        HIPASSERT(base == ptrs[i] && size == SIZE);
+    }
+
+    std::vector<char> host(SIZE);
+    for (int i = 0; i < COUNT; ++i) {
+        HIPCHECK(hipMemcpy(host.data(), ptrs[i], SIZE, hipMemcpyDeviceToHost));
+        for (int j = 0; j < SIZE; ++j) {
+            HIPASSERT(host[j] == static_cast<char>(i));
+        }
+    }
+
+    hipExtMallocCacheStats stats;
+    HIPCHECK(hipExtMallocCacheGetStats(device, &stats));
+    HIPASSERT(stats.allocatedBytes >= COUNT * SIZE);
+    HIPASSERT(stats.peakAllocatedBytes >= stats.allocatedBytes);
+    HIPASSERT(stats.reservedBytes >= stats.allocatedBytes);
+
+    // Freeing while a copy may still read the memory
+    for (int i = 0; i < COUNT; ++i) {
+        HIPCHECK(hipMemsetAsync(ptrs[i], 0, SIZE, 0));
+        HIPCHECK(hipFree(ptrs[i]));
+    }
+    HIPCHECK(hipExtMallocCacheTrim(device, 0));
+    HIPCHECK(hipExtMallocCacheGetStats(device, &stats));
+    HIPASSERT(stats.allocatedBytes == 0 && stats.pendingFreeBytes == 0);
+    HIPASSERT(stats.reservedBytes == 0 && stats.segmentCount == 0);
+
+    HIPASSERT(hipExtMallocCacheGetStats(device, nullptr) == hipErrorInvalidValue);
+    HIPASSERT(hipExtMallocCacheTrim(-1, 0) == hipErrorInvalidDevice);
+
+    passed();
+}
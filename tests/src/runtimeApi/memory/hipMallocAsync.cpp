@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Buffers allocated and freed in stream order on two streams keep the values
+// written to them until they are freed, however their memory is reused, and
+// the default pool reports and accepts its attributes.
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#include <cstdint>
+#include <vector>
+
+#define ITERATIONS 64
+#define SIZE (1 << 20)
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int device = 0;
+    HIPCHECK(hipGetDevice(&device));
+    hipMemPool_t pool;
+    HIPCHECK(hipDeviceGetDefaultMemPool(&pool, device));
+
+    hipStream_t streams[2];
+    for (auto& s : streams) {
+        HIPCHECK(hipStreamCreate(&s));
+    }
+
+    std::vector<std::vector<char>> host(ITERATIONS, std::vector<char>(SIZE));
+    for (int i = 0; i < ITERATIONS; ++i) {
+        hipStream_t stream = streams[i % 2];
+        char* a = nullptr;
+        char* b = nullptr;
+        HIPCHECK(hipMallocAsync(reinterpret_cast<void**>(&a), SIZE, stream));
+        HIPCHECK(hipMallocFromPoolAsync(reinterpret_cast<void**>(&b), SIZE, pool, stream));
+        HIPASSERT(a != nullptr && b != nullptr && a != b);
+        HIPCHECK(hipMemsetAsync(a, i, SIZE, stream));
+        HIPCHECK(hipMemcpyAsync(b, a, SIZE, hipMemcpyDeviceToDevice, stream));
+        HIPCHECK(hipFreeAsync(a, stream));
+        HIPCHECK(hipMemcpyAsync(host[i].data(), b, SIZE, hipMemcpyDeviceToHost, stream));
+        HIPCHECK(hipFreeAsync(b, stream));
+    }
+    for (auto& s : streams) {
+        HIPCHECK(hipStreamSynchronize(s));
+    }
+    for (int i = 0; i < ITERATIONS; ++i) {
+        for (int j = 0; j < SIZE; j += 4096) {
+            HIPASSERT(host[i][j] == static_cast<char>(i));
+        }
+    }
+
+    void* p = reinterpret_cast<void*>(1);
+    HIPCHECK(hipMallocAsync(&p, 0, streams[0]));
+    HIPASSERT(p == nullptr);
+    HIPCHECK(hipFreeAsync(nullptr, streams[0]));
+
+    // Attributes
+    uint64_t threshold = 0;
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolAttrReleaseThreshold, &threshold));
+    HIPASSERT(threshold == UINT64_MAX);
+    threshold = 4 * SIZE;
+    HIPCHECK(hipMemPoolSetAttribute(pool, hipMemPoolAttrReleaseThreshold, &threshold));
+    threshold = 0;
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolAttrReleaseThreshold, &threshold));
+    HIPASSERT(threshold == 4 * SIZE);
+
+    int enable = 0;
+    HIPCHECK(hipMemPoolSetAttribute(pool, hipMemPoolReuseAllowInternalDependencies, &enable));
+    enable = 1;
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolReuseAllowInternalDependencies, &enable));
+    HIPASSERT(enable == 0);
+    enable = 1;
+    HIPASSERT(hipMemPoolSetAttribute(pool, hipMemPoolReuseFollowEventDependencies, &enable) ==
+              hipErrorNotSupported);
+
+    uint64_t used = 0, reserved = 0;
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolAttrUsedMemCurrent, &used));
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolAttrReservedMemCurrent, &reserved));
+    HIPASSERT(used <= reserved);
+    HIPASSERT(hipMemPoolSetAttribute(pool, hipMemPoolAttrReservedMemCurrent, &reserved) ==
+              hipErrorInvalidValue);
+    uint64_t zero = 0;
+    HIPCHECK(hipMemPoolSetAttribute(pool, hipMemPoolAttrReservedMemHigh, &zero));
+
+    HIPCHECK(hipDeviceSynchronize());
+    HIPCHECK(hipMemPoolTrimTo(pool, 0));
+    HIPCHECK(hipMemPoolGetAttribute(pool, hipMemPoolAttrReservedMemCurrent, &reserved));
+    HIPASSERT(reserved == 0);
+
+    threshold = UINT64_MAX;
+    HIPCHECK(hipMemPoolSetAttribute(pool, hipMemPoolAttrReleaseThreshold, &threshold));
+    enable = 1;
+    HIPCHECK(hipMemPoolSetAttribute(pool, hipMemPoolReuseAllowInternalDependencies, &enable));
+
+    for (auto& s : streams) {
+        HIPCHECK(hipStreamDestroy(s));
+    }
+    passed();
+}
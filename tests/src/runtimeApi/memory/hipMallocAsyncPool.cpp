@@ -0,0 +1,317 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipMallocAsyncPool %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the stream-ordered side of the allocator behind hipMallocAsync and
+// hipFreeAsync for the VDI backend, on fake streams whose work completes when
+// the test says so.
+
+#include "hip_mem_pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+namespace {
+const size_t MB = 1 << 20;
+
+// Work queued on a stream up to a tick is done once its completed tick
+// reaches it.
+struct FakeStream {
+    std::atomic<uint64_t> queued_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<size_t> waits_{0};
+
+    void complete() { completed_ = queued_.load(); }
+};
+
+struct FakeDevice {
+    std::mutex lock_;
+    uintptr_t next_ = uintptr_t(1) << 32;
+    std::map<uintptr_t, size_t> segments_;
+    std::vector<FakeStream*> streams_;
+    // Fences captured or copied and not released yet
+    std::atomic<long> fences_{0};
+};
+
+struct FakeOps {
+    typedef std::vector<std::pair<FakeStream*, uint64_t>> Fence;
+    FakeDevice* device_ = nullptr;
+
+    void* allocate(size_t size) {
+        std::lock_guard<std::mutex> lock(device_->lock_);
+        const uintptr_t ptr = device_->next_;
+        device_->next_ += size + 2 * MB;
+        device_->segments_[ptr] = size;
+        return reinterpret_cast<void*>(ptr);
+    }
+    void deallocate(void* ptr) {
+        std::lock_guard<std::mutex> lock(device_->lock_);
+        CHECK(device_->segments_.erase(reinterpret_cast<uintptr_t>(ptr)) == 1);
+    }
+    void fence(Fence& fence, const void* stream) {
+        CHECK(fence.empty());
+        ++device_->fences_;
+        if (stream != nullptr) {
+            FakeStream* s = static_cast<FakeStream*>(const_cast<void*>(stream));
+            fence.emplace_back(s, s->queued_.load());
+            return;
+        }
+        for (FakeStream* s : device_->streams_) {
+            fence.emplace_back(s, s->queued_.load());
+        }
+    }
+    void copy(Fence& to, const Fence& from) {
+        CHECK(to.empty());
+        ++device_->fences_;
+        to = from;
+    }
+    bool completed(Fence& fence) {
+        for (auto& f : fence) {
+            if (f.first->completed_.load() < f.second) return false;
+        }
+        return true;
+    }
+    void wait(Fence& fence) {
+        for (auto& f : fence) {
+            uint64_t completed = f.first->completed_.load();
+            while (completed < f.second && !f.first->completed_.compare_exchange_weak(completed, f.second)) {
+            }
+        }
+    }
+    void streamWait(const void* stream, Fence&) {
+        ++static_cast<FakeStream*>(const_cast<void*>(stream))->waits_;
+    }
+    void release(Fence& fence) {
+        --device_->fences_;
+        fence.clear();
+    }
+};
+
+typedef hip::MemoryPool<FakeOps> Pool;
+
+FakeOps opsFor(FakeDevice& device) {
+    FakeOps ops;
+    ops.device_ = &device;
+    return ops;
+}
+
+uintptr_t address(void* ptr) { return reinterpret_cast<uintptr_t>(ptr); }
+}  // namespace
+
+int main() {
+    // Memory freed on a stream is reused by later work on the same stream
+    // before the free has completed, without any wait.
+    {
+        FakeDevice device;
+        FakeStream s1, s2;
+        device.streams_ = {&s1, &s2};
+        {
+            Pool pool(opsFor(device));
+            void* a = pool.allocate(20 * MB, &s1);
+            s1.queued_ = 1;
+            CHECK(pool.free(a, &s1));
+            CHECK(pool.stats().pending_ == 20 * MB);
+            CHECK(pool.allocate(20 * MB, &s1) == a);
+            CHECK(s1.waits_ == 0 && s1.completed_ == 0);
+            Pool::Stats stats = pool.stats();
+            CHECK(stats.segments_ == 1 && stats.pending_ == 0 && stats.hits_ == 1);
+
+            // Splitting a pending block leaves the rest pending on the stream.
+            s1.queued_ = 2;
+            pool.free(a, &s1);
+            void* b = pool.allocate(5 * MB, &s1);
+            void* c = pool.allocate(5 * MB, &s1);
+            CHECK(b == a && address(c) == address(a) + 5 * MB);
+            CHECK(pool.stats().pending_ == 10 * MB);
+
+            // Neither a synchronous allocation nor, once disabled, another
+            // stream takes memory whose free has not completed.
+            pool.setReuseInternalDependencies(false);
+            void* d = pool.allocate(5 * MB);
+            void* e = pool.allocate(5 * MB, &s2);
+            CHECK(address(d) < address(a) || address(d) >= address(a) + 20 * MB);
+            CHECK(address(e) == address(d) + 5 * MB);
+            CHECK(pool.stats().segments_ == 2);
+
+            s1.complete();
+            CHECK(pool.stats().pending_ == 0);
+            void* f = pool.allocate(10 * MB, &s2);
+            CHECK(address(f) == address(a) + 10 * MB);
+            CHECK(s2.waits_ == 0);
+            pool.free(b);
+            pool.free(c);
+            pool.free(d);
+            pool.free(e);
+            pool.free(f);
+        }
+        CHECK(device.segments_.empty());
+        CHECK(device.fences_ == 0);
+    }
+
+    // Another stream takes pending memory only after it is made to wait for
+    // the free, and a destroyed stream's memory is treated as another
+    // stream's even if a new stream gets its address.
+    {
+        FakeDevice device;
+        FakeStream s1, s2;
+        device.streams_ = {&s1, &s2};
+        Pool pool(opsFor(device));
+        void* a = pool.allocate(20 * MB, &s1);
+        s1.queued_ = 1;
+        pool.free(a, &s1);
+        CHECK(pool.allocate(20 * MB, &s2) == a);
+        CHECK(s2.waits_ == 1 && s1.waits_ == 0);
+        CHECK(pool.stats().segments_ == 1);
+
+        s2.queued_ = 1;
+        pool.free(a, &s2);
+        pool.forgetStream(&s2);
+        pool.forgetStream(&s2);
+        CHECK(pool.allocate(20 * MB, &s2) == a);
+        CHECK(s2.waits_ == 2);
+
+        // A free without a stream waits for every stream.
+        s1.queued_ = 2;
+        pool.free(a);
+        s2.complete();
+        CHECK(pool.stats().pending_ == 20 * MB);
+        s1.complete();
+        CHECK(pool.stats().pending_ == 0);
+        pool.trim(0);
+        CHECK(device.segments_.empty() && device.fences_ == 0);
+    }
+
+    // Unused memory above the release threshold goes back to the device when
+    // the host synchronizes; pending frees are not waited for.
+    {
+        FakeDevice device;
+        FakeStream s1;
+        device.streams_ = {&s1};
+        Pool pool(opsFor(device));
+        CHECK(pool.releaseThreshold() == ~size_t(0));
+        void* a = pool.allocate(20 * MB, &s1);
+        void* b = pool.allocate(20 * MB, &s1);
+        void* c = pool.allocate(20 * MB, &s1);
+        s1.queued_ = 1;
+        pool.free(a, &s1);
+        pool.free(b, &s1);
+        pool.releaseAboveThreshold();
+        CHECK(pool.stats().reserved_ == 60 * MB);
+
+        pool.setReleaseThreshold(30 * MB);
+        pool.releaseAboveThreshold();
+        CHECK(pool.stats().reserved_ == 60 * MB);
+        s1.complete();
+        pool.releaseAboveThreshold();
+        CHECK(pool.stats().reserved_ == 20 * MB);
+        CHECK(pool.stats().peakReserved_ == 60 * MB);
+        pool.resetPeakReserved();
+        CHECK(pool.stats().peakReserved_ == 20 * MB);
+        CHECK(pool.stats().peakAllocated_ == 60 * MB);
+        pool.resetPeakAllocated();
+        CHECK(pool.stats().peakAllocated_ == 20 * MB);
+
+        pool.setReleaseThreshold(0);
+        pool.free(c, &s1);
+        s1.queued_ = 2;
+        s1.complete();
+        pool.releaseAboveThreshold();
+        CHECK(pool.stats().reserved_ == 0 && device.segments_.empty());
+    }
+
+    // Streams allocating and freeing concurrently never get overlapping live
+    // allocations, and every fence is released.
+    {
+        FakeDevice device;
+        const int streams = 4;
+        std::vector<FakeStream> s(streams);
+        for (auto& x : s) device.streams_.push_back(&x);
+        {
+            Pool pool(opsFor(device));
+            std::mutex lock;
+            std::map<uintptr_t, uintptr_t> live;
+            std::vector<std::thread> threads;
+            for (int t = 0; t != streams; ++t) {
+                threads.emplace_back([&, t]() {
+                    std::mt19937 rng(t);
+                    FakeStream* stream = &s[t];
+                    std::vector<void*> mine;
+                    for (int i = 0; i != 20000; ++i) {
+                        if (mine.size() < 64 && (mine.empty() || rng() % 2)) {
+                            const size_t size = (rng() % 8 == 0) ? 1 + rng() % (12 * MB) : 1 + rng() % 4096;
+                            void* p = pool.allocate(size, (rng() % 4) ? stream : nullptr);
+                            CHECK(p != nullptr);
+                            std::lock_guard<std::mutex> guard(lock);
+                            const uintptr_t begin = address(p), end = begin + size;
+                            auto it = live.lower_bound(begin);
+                            CHECK(it == live.end() || it->first >= end);
+                            CHECK(it == live.begin() || (--it)->second <= begin);
+                            live[begin] = end;
+                            mine.push_back(p);
+                        } else {
+                            const size_t k = rng() % mine.size();
+                            {
+                                std::lock_guard<std::mutex> guard(lock);
+                                live.erase(address(mine[k]));
+                            }
+                            ++stream->queued_;
+                            CHECK(pool.free(mine[k], stream));
+                            mine[k] = mine.back();
+                            mine.pop_back();
+                        }
+                        if (i % 16 == 0) stream->complete();
+                    }
+                    for (void* p : mine) {
+                        {
+                            std::lock_guard<std::mutex> guard(lock);
+                            live.erase(address(p));
+                        }
+                        pool.free(p, stream);
+                    }
+                    pool.forgetStream(stream);
+                });
+            }
+            for (auto& t : threads) t.join();
+            pool.trim(0);
+            CHECK(device.segments_.empty());
+            CHECK(pool.stats().allocated_ == 0 && pool.stats().pending_ == 0);
+        }
+        CHECK(device.fences_ == 0);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipMallocCache %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the caching allocator behind hipMalloc for the VDI backend, on a
+// fake device whose work completes when the test says so.
+
+#include "hip_mem_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+namespace {
+const size_t MB = 1 << 20;
+
+// Fences are ticks of a counter: work queued up to a tick is done once the
+// completed tick reaches it.
+struct FakeDevice {
+    std::mutex lock_;
+    size_t capacity_ = ~size_t(0);
+    size_t used_ = 0;
+    uintptr_t next_ = uintptr_t(1) << 32;
+    std::map<uintptr_t, size_t> segments_;
+    std::atomic<uint64_t> queued_{0};
+    std::atomic<uint64_t> completed_{0};
+    size_t waits_ = 0;
+    size_t released_ = 0;
+};
+
+struct FakeOps {
+    typedef uint64_t Fence;
+    FakeDevice* device_ = nullptr;
+
+    void* allocate(size_t size) {
+        std::lock_guard<std::mutex> lock(device_->lock_);
+        if (device_->used_ + size > device_->capacity_) return nullptr;
+        const uintptr_t ptr = device_->next_;
+        device_->next_ += size + 2 * MB;
+        device_->used_ += size;
+        device_->segments_[ptr] = size;
+        return reinterpret_cast<void*>(ptr);
+    }
+    void deallocate(void* ptr) {
+        std::lock_guard<std::mutex> lock(device_->lock_);
+        auto it = device_->segments_.find(reinterpret_cast<uintptr_t>(ptr));
+        CHECK(it != device_->segments_.end());
+        device_->used_ -= it->second;
+        device_->segments_.erase(it);
+    }
+    void fence(Fence& fence, const void*) { fence = device_->queued_.load(); }
+    void copy(Fence& to, const Fence& from) { to = from; }
+    bool completed(Fence& fence) { return fence <= device_->completed_.load(); }
+    void wait(Fence& fence) {
+        ++device_->waits_;
+        uint64_t completed = device_->completed_.load();
+        while (completed < fence && !device_->completed_.compare_exchange_weak(completed, fence)) {
+        }
+    }
+    void streamWait(const void*, Fence&) { CHECK(false); }
+    void release(Fence&) { ++device_->released_; }
+};
+
+typedef hip::MemoryPool<FakeOps> Pool;
+
+FakeOps opsFor(FakeDevice& device) {
+    FakeOps ops;
+    ops.device_ = &device;
+    return ops;
+}
+
+uintptr_t address(void* ptr) { return reinterpret_cast<uintptr_t>(ptr); }
+}  // namespace
+
+int main() {
+    // Small requests are rounded, carved from one segment, and reused once
+    // the work queued before their free has completed.
+    {
+        FakeDevice device;
+        {
+            Pool pool(opsFor(device));
+            void* a = pool.allocate(1000);
+            void* b = pool.allocate(1000);
+            CHECK(a != nullptr && address(a) % 512 == 0);
+            CHECK(address(b) == address(a) + 1024);
+            Pool::Stats stats = pool.stats();
+            CHECK(stats.segments_ == 1 && stats.reserved_ == 2 * MB);
+            CHECK(stats.allocated_ == 2048 && stats.misses_ == 1 && stats.hits_ == 1);
+
+            void* base = nullptr;
+            size_t size = 0;
+            CHECK(pool.find(static_cast<char*>(b) + 1010, &base, &size));
+            CHECK(base == b && size == 1000);
+            CHECK(!pool.find(static_cast<char*>(b) + 1024 * 1024, &base, &size));
+
+            device.queued_ = 1;
+            CHECK(pool.free(a));
+            CHECK(!pool.free(a));
+            CHECK(pool.stats().pending_ == 1024);
+            void* c = pool.allocate(1000);
+            CHECK(c != a);
+
+            device.completed_ = 1;
+            CHECK(pool.allocate(1000) == a);
+            CHECK(pool.stats().pending_ == 0);
+            CHECK(device.released_ == 1);
+
+            // Freed neighbours merge back into the whole segment.
+            device.queued_ = 2;
+            pool.free(a);
+            pool.free(b);
+            pool.free(c);
+            device.completed_ = 2;
+            void* d = pool.allocate(MB);
+            CHECK(d == a);
+            CHECK(pool.stats().segments_ == 1);
+            CHECK(pool.stats().peakAllocated_ == MB);
+            CHECK(pool.free(d));
+        }
+        CHECK(device.segments_.empty());
+    }
+
+    // Large requests use their own segments, split and merged the same way.
+    {
+        FakeDevice device;
+        Pool pool(opsFor(device));
+        void* a = pool.allocate(5 * MB);
+        void* b = pool.allocate(5 * MB);
+        CHECK(address(b) == address(a) + 5 * MB);
+        CHECK(pool.stats().reserved_ == 20 * MB);
+        void* s = pool.allocate(100);
+        CHECK(pool.stats().segments_ == 2);
+
+        void* huge = pool.allocate(99 * MB + 1);
+        CHECK(device.segments_[address(huge)] == 100 * MB);
+
+        pool.free(a);
+        pool.free(b);
+        void* c = pool.allocate(15 * MB);
+        CHECK(c == a);
+        CHECK(pool.stats().segments_ == 3);
+
+        // Trimming waits for pending frees and returns unused segments.
+        device.queued_ = 5;
+        pool.free(huge);
+        pool.free(s);
+        pool.trim(0);
+        CHECK(device.completed_ == 5);
+        Pool::Stats stats = pool.stats();
+        CHECK(stats.segments_ == 1 && stats.reserved_ == 20 * MB);
+        CHECK(stats.peakReserved_ == 122 * MB);
+        pool.resetPeaks();
+        CHECK(pool.stats().peakReserved_ == 20 * MB);
+        pool.free(c);
+        pool.trim(0);
+        CHECK(device.segments_.empty() && pool.stats().reserved_ == 0);
+    }
+
+    // Out of memory, the pool gives back what it caches and waits for the
+    // frees in flight before failing.
+    {
+        FakeDevice device;
+        device.capacity_ = 40 * MB;
+        Pool pool(opsFor(device));
+        void* a = pool.allocate(30 * MB);
+        CHECK(a != nullptr);
+        device.queued_ = 1;
+        pool.free(a);
+        void* b = pool.allocate(30 * MB);
+        CHECK(b == a);
+        CHECK(device.waits_ == 1);
+        CHECK(pool.allocate(30 * MB) == nullptr);
+
+        device.queued_ = 2;
+        pool.free(b);
+        CHECK(pool.allocate(4 * MB) == a);
+        CHECK(device.waits_ == 2);
+        CHECK(device.segments_.size() == 1 && device.used_ == 30 * MB);
+        CHECK(pool.allocate(0) == nullptr);
+    }
+
+    // Concurrent allocations never overlap.
+    {
+        FakeDevice device;
+        Pool pool(opsFor(device));
+        std::mutex lock;
+        std::map<uintptr_t, uintptr_t> live;
+        std::vector<std::thread> threads;
+        for (int t = 0; t != 4; ++t) {
+            threads.emplace_back([&, t]() {
+                std::mt19937 rng(t);
+                std::vector<void*> mine;
+                for (int i = 0; i != 20000; ++i) {
+                    if (mine.size() < 64 && (mine.empty() || rng() % 2)) {
+                        const size_t size = (rng() % 8 == 0) ? 1 + rng() % (12 * MB) : 1 + rng() % 4096;
+                        void* p = pool.allocate(size);
+                        CHECK(p != nullptr);
+                        std::lock_guard<std::mutex> guard(lock);
+                        const uintptr_t begin = address(p), end = begin + size;
+                        auto it = live.lower_bound(begin);
+                        CHECK(it == live.end() || it->first >= end);
+                        CHECK(it == live.begin() || (--it)->second <= begin);
+                        live[begin] = end;
+                        mine.push_back(p);
+                    } else {
+                        const size_t k = rng() % mine.size();
+                        {
+                            std::lock_guard<std::mutex> guard(lock);
+                            live.erase(address(mine[k]));
+                        }
+                        ++device.queued_;
+                        CHECK(pool.free(mine[k]));
+                        mine[k] = mine.back();
+                        mine.pop_back();
+                    }
+                    if (i % 16 == 0) device.completed_ = device.queued_.load();
+                }
+                for (void* p : mine) {
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        live.erase(address(p));
+                    }
+                    pool.free(p);
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        pool.trim(0);
+        CHECK(device.segments_.empty());
+        CHECK(pool.stats().allocated_ == 0);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
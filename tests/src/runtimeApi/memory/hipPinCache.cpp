@@ -0,0 +1,342 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipPinCache %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the registration cache that keeps pageable host ranges pinned
+// across copies, against a fake pinner.
+
+#include "pin_cache.inl"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+constexpr std::size_t page = 4096;
+constexpr std::uintptr_t device_offset = std::uintptr_t{1} << 40;
+
+// Tracks the ranges that are pinned; the device sees host address p at
+// p + device_offset.
+struct Fake_pinner {
+    std::mutex mtx;
+    std::map<std::uintptr_t, std::size_t> pinned;
+    std::size_t pins{};
+    std::size_t unpins{};
+    bool fail{};
+
+    void* pin(void* p, std::size_t n)
+    {
+        std::lock_guard<std::mutex> lck{mtx};
+        if (fail) return nullptr;
+
+        const auto b = reinterpret_cast<std::uintptr_t>(p);
+        CHECK(b % page == 0 && n % page == 0);
+        CHECK(pinned.emplace(b, n).second);
+        ++pins;
+
+        return reinterpret_cast<void*>(b + device_offset);
+    }
+
+    void unpin(void* p)
+    {
+        std::lock_guard<std::mutex> lck{mtx};
+        CHECK(pinned.erase(reinterpret_cast<std::uintptr_t>(p)) == 1);
+        ++unpins;
+    }
+
+    std::size_t pinned_bytes()
+    {
+        std::lock_guard<std::mutex> lck{mtx};
+        std::size_t r = 0;
+        for (auto&& x : pinned) r += x.second;
+
+        return r;
+    }
+};
+
+struct Test_cache : Pin_cache {
+    Test_cache(Fake_pinner& f, std::size_t budget)
+        : Pin_cache{budget,
+                    [&f](void* p, std::size_t n) { return f.pin(p, n); },
+                    [&f](void* p) { f.unpin(p); },
+                    page} {}
+};
+
+const void* at(std::size_t pg, std::size_t offset = 0)
+{
+    return reinterpret_cast<const void*>(0x10000000u + pg * page + offset);
+}
+
+void* device_at(std::size_t pg, std::size_t offset = 0)
+{
+    return reinterpret_cast<void*>(
+        reinterpret_cast<std::uintptr_t>(at(pg, offset)) + device_offset);
+}
+}  // namespace
+
+int main() {
+    // A miss pins whole pages; repeated and contained requests hit.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 64 * page};
+        { auto h = c.acquire(at(0, 100), 2 * page); CHECK(h && h.get() == device_at(0, 100)); }
+        { auto h = c.acquire(at(0, 100), 2 * page); CHECK(h && h.get() == device_at(0, 100)); }
+        { auto h = c.acquire(at(1), 10); CHECK(h && h.get() == device_at(1)); }
+        CHECK(f.pins == 1 && f.pinned.at(reinterpret_cast<std::uintptr_t>(at(0))) == 3 * page);
+        CHECK(c.stats().hits == 2 && c.stats().misses == 1);
+        CHECK(c.stats().pinned_bytes == 3 * page);
+
+        // find() never pins.
+        CHECK(c.find(at(2), page) && !c.find(at(3), page));
+        CHECK(f.pins == 1);
+    }
+
+    // Overlapping requests are merged into one range.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 64 * page};
+        c.acquire(at(0), 3 * page);
+        c.acquire(at(10), 2 * page);
+        { auto h = c.acquire(at(2), 9 * page); CHECK(h && h.get() == device_at(2)); }
+        CHECK(f.pinned.size() == 1 && f.pinned.begin()->second == 12 * page);
+        CHECK(f.unpins == 2);
+        CHECK(c.stats().pinned_bytes == 12 * page);
+        CHECK(c.find(at(0), 12 * page));
+    }
+
+    // Least recently used ranges are evicted to stay under the budget; ranges
+    // in use are not.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 4 * page};
+        std::vector<std::pair<const void*, std::size_t>> evicted;
+        c.set_observer([&](const char* event, const void* p, std::size_t n,
+                           const Pin_cache::Stats&) {
+            if (std::string{event} == "evict") evicted.emplace_back(p, n);
+        });
+
+        c.acquire(at(0), page);
+        auto in_use = c.acquire(at(10), page);
+        c.acquire(at(20), page);
+        c.acquire(at(0), page);  // 0 is now more recent than 20.
+        c.acquire(at(30), page);
+        c.acquire(at(40), 2 * page);
+        CHECK(evicted.size() == 2);
+        CHECK(evicted[0].first == at(20) && evicted[1].first == at(0));
+        CHECK(c.find(at(10), page) && c.find(at(30), page) && c.find(at(40), 2 * page));
+        CHECK(c.stats().evictions == 2 && c.stats().pinned_bytes == 4 * page);
+        CHECK(f.pinned_bytes() == 4 * page);
+
+        // Too large for the budget: not cached, nothing evicted.
+        CHECK(!c.acquire(at(50), 5 * page));
+        CHECK(f.pinned_bytes() == 4 * page);
+
+        // Overlapping a range that is in use: not cached.
+        CHECK(!c.acquire(at(9), 2 * page));
+        CHECK(c.find(at(10), page));
+    }
+
+    // Invalidation unpins unused ranges at once and ranges in use on release.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 64 * page};
+        c.acquire(at(0), 2 * page);
+        auto h = c.acquire(at(10), 2 * page);
+        CHECK(!c.empty());
+
+        CHECK(c.invalidate(at(1), 10 * page) == 2);
+        CHECK(c.empty() && c.stats().invalidations == 2);
+        CHECK(f.pinned.size() == 1 && f.pinned.count(reinterpret_cast<std::uintptr_t>(at(10))));
+        CHECK(h.get() == device_at(10));
+
+        h = Pin_cache::Handle{};
+        CHECK(f.pinned.empty() && c.stats().pinned_bytes == 0);
+
+        // Invalidating unrelated memory is harmless.
+        c.acquire(at(0), page);
+        CHECK(c.invalidate(at(1), page) == 0);
+        CHECK(c.find(at(0), page));
+
+        // Only the ranges dropped are counted.
+        CHECK(c.invalidate(at(20), page) == 0);
+        CHECK(c.invalidate(at(0), 1) == 1 && c.empty());
+        CHECK(c.invalidate(at(0), 1) == 0);
+    }
+
+    // A zero budget disables the cache without counting misses.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 0};
+        CHECK(!c.acquire(at(0), page));
+        CHECK(f.pins == 0 && c.stats().misses == 0);
+    }
+
+    // Unmapped ranges are dropped by the next call into the cache; in-use
+    // ranges are unpinned on release.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 64 * page};
+        c.acquire(at(0), 2 * page);
+        c.acquire(at(10), 2 * page);
+        auto h = c.acquire(at(20), page);
+
+        c.unmapped(at(40), page);  // Outside the cache: ignored.
+        c.unmapped(at(1), page);
+        c.unmapped(at(20), page);
+        CHECK(f.pinned.size() == 3);
+
+        c.drop_unmapped();
+        CHECK(c.stats().invalidations == 2);
+        CHECK(!c.find(at(0), page) && c.find(at(10), page));
+        CHECK(f.pinned.size() == 2);
+        h = Pin_cache::Handle{};
+        CHECK(f.pinned.size() == 1);
+
+        // The same address mapped again is pinned afresh.
+        { auto h = c.acquire(at(0), 2 * page); CHECK(h && h.get() == device_at(0)); }
+        CHECK(f.pins == 4);
+
+        // More reports than the cache can hold drop everything.
+        for (int i = 0; i != 100; ++i) c.unmapped(at(0), page);
+        CHECK(!c.find(at(10), page) && c.empty());
+        CHECK(f.pinned.empty());
+    }
+
+    // Pinned ranges are watched; dropping one stops watching the parts that
+    // no cached range took over, and ranges that cannot be watched are not
+    // cached.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 64 * page};
+        std::map<std::uintptr_t, std::uintptr_t> watched;
+        bool watch_fails = false;
+        c.set_watch(
+            [&](void* p, std::size_t n) {
+                if (watch_fails) return false;
+                const auto b = reinterpret_cast<std::uintptr_t>(p);
+                CHECK(watched.emplace(b, b + n).second);
+                return true;
+            },
+            [&](void* p, std::size_t n) {
+                const auto b = reinterpret_cast<std::uintptr_t>(p);
+                CHECK(watched.count(b) && watched[b] == b + n);
+                watched.erase(b);
+            });
+        const auto addr = [](std::size_t pg) {
+            return reinterpret_cast<std::uintptr_t>(at(pg));
+        };
+
+        c.acquire(at(0), 2 * page);
+        c.acquire(at(4), 2 * page);
+        CHECK(watched.size() == 2);
+
+        // The union is watched; the merged ranges lie inside it and stay so.
+        watched.clear();
+        c.acquire(at(1), 4 * page);
+        CHECK(watched.size() == 1 && watched[addr(0)] == addr(6));
+
+        c.invalidate(at(0), 1);
+        CHECK(watched.empty());
+
+        watch_fails = true;
+        CHECK(!c.acquire(at(10), page));
+        CHECK(f.pinned.empty() && c.empty());
+    }
+
+    // A failing pin is reported as an empty handle and releases its budget.
+    {
+        Fake_pinner f;
+        Test_cache c{f, 4 * page};
+        f.fail = true;
+        CHECK(!c.acquire(at(0), page));
+        CHECK(c.empty() && c.stats().pinned_bytes == 0);
+    }
+
+    // Concurrent acquires, releases and invalidations keep the pins balanced.
+    {
+        Fake_pinner f;
+        {
+            Test_cache c{f, 32 * page};
+            std::vector<std::thread> threads;
+            for (int t = 0; t != 8; ++t) {
+                threads.emplace_back([&c, t]() {
+                    std::mt19937 gen(t);
+                    std::uniform_int_distribution<std::size_t> pg(0, 63);
+                    std::uniform_int_distribution<std::size_t> len(1, 4 * page);
+                    for (int i = 0; i != 20000; ++i) {
+                        const auto p = at(pg(gen), pg(gen));
+                        const auto n = len(gen);
+                        if (i % 16 == 0) {
+                            c.invalidate(p, n);
+                            continue;
+                        }
+                        auto h = c.acquire(p, n);
+                        if (h) {
+                            CHECK(reinterpret_cast<std::uintptr_t>(h.get()) ==
+                                  reinterpret_cast<std::uintptr_t>(p) + device_offset);
+                        }
+                    }
+                });
+            }
+            std::atomic<bool> done{false};
+            std::thread reporter{[&c, &done]() {
+                std::mt19937 gen(8);
+                std::uniform_int_distribution<std::size_t> pg(0, 63);
+                while (!done) {
+                    c.begin_unmapped();
+                    c.unmapped(at(pg(gen)), page);
+                    c.end_unmapped();
+                    std::this_thread::yield();
+                }
+            }};
+            for (auto&& x : threads) x.join();
+            done = true;
+            reporter.join();
+            c.drop_unmapped();
+
+            CHECK(c.stats().pinned_bytes == f.pinned_bytes());
+            CHECK(c.stats().pinned_bytes <= 32 * page);
+            printf("hits %zu misses %zu evictions %zu invalidations %zu\n",
+                   c.stats().hits, c.stats().misses, c.stats().evictions,
+                   c.stats().invalidations);
+        }
+        CHECK(f.pinned.empty() && f.pins == f.unpins);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
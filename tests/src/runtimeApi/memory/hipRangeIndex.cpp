@@ -0,0 +1,211 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipRangeIndex %cxx -std=c++11 -O2 -I%S/../../../../vdi %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc hcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the index the VDI backend uses to find the memory object of a
+// pointer, and compares its lookup rate from many threads with a std::map
+// under a mutex while ranges are added and removed.
+
+#include "hip_range_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+namespace {
+typedef hip::RangeIndex<uintptr_t> Index;
+
+const void* at(uintptr_t address) { return reinterpret_cast<const void*>(address); }
+
+const uintptr_t Base = uintptr_t(1) << 40;
+const size_t Ranges = 10000;
+const size_t Stride = 1 << 16;
+const size_t Lookups = 1 << 21;
+
+// Stable ranges: [Base + i * Stride, + size(i)), sizes from 1 byte to 60KB.
+size_t sizeOf(size_t i) { return 1 + (i * 2654435761u) % (Stride - 4096); }
+
+// A std::map under one lock, as the global memory object map is.
+struct LockedMap {
+    std::mutex lock_;
+    std::map<uintptr_t, std::pair<uintptr_t, uintptr_t>> map_;
+
+    bool find(const void* ptr, uintptr_t& value) {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = map_.upper_bound(address);
+        if (it == map_.begin() || address >= (--it)->second.first) return false;
+        value = it->second.second;
+        return true;
+    }
+    void insert(const void* base, size_t size, uintptr_t value) {
+        const uintptr_t b = reinterpret_cast<uintptr_t>(base);
+        std::lock_guard<std::mutex> lock(lock_);
+        map_[b] = std::make_pair(b + size, value);
+    }
+    void remove(const void* base) {
+        std::lock_guard<std::mutex> lock(lock_);
+        map_.erase(reinterpret_cast<uintptr_t>(base));
+    }
+};
+
+// Looks up Lookups random addresses per thread, half in stable ranges and half
+// in the region a writer keeps changing, and returns lookups per second.
+template <typename Map>
+double stress(Map& map, unsigned threads) {
+    for (size_t i = 0; i != Ranges; ++i) map.insert(at(Base + i * Stride), sizeOf(i), i);
+
+    std::atomic<bool> stop{false};
+    const uintptr_t churn = Base + (Ranges + 16) * Stride;
+    std::thread writer([&]() {
+        std::mt19937_64 rng(7);
+        std::vector<uintptr_t> live;
+        while (!stop) {
+            if (live.size() < 256 && (live.empty() || rng() % 2)) {
+                uintptr_t b = churn + (rng() % 4096) * Stride;
+                if (std::find(live.begin(), live.end(), b) != live.end()) continue;
+                map.insert(at(b), Stride / 2, b);
+                live.push_back(b);
+            } else {
+                size_t k = rng() % live.size();
+                map.remove(at(live[k]));
+                live[k] = live.back();
+                live.pop_back();
+            }
+        }
+    });
+
+    std::vector<std::thread> readers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t != threads; ++t) {
+        readers.emplace_back([&map, t, churn]() {
+            std::mt19937_64 rng(t);
+            for (size_t n = 0; n != Lookups; ++n) {
+                const uint64_t r = rng();
+                uintptr_t value = 0;
+                if (n % 2 == 0) {
+                    const size_t i = r % Ranges;
+                    const size_t offset = (r >> 32) % Stride;
+                    const bool found = map.find(at(Base + i * Stride + offset), value);
+                    CHECK(found == (offset < sizeOf(i)));
+                    CHECK(!found || value == i);
+                } else {
+                    const uintptr_t b = churn + (r % 4096) * Stride;
+                    const size_t offset = (r >> 32) % Stride;
+                    if (map.find(at(b + offset), value)) {
+                        CHECK(value == b && offset < Stride / 2);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& r : readers) r.join();
+    auto end = std::chrono::steady_clock::now();
+    stop = true;
+    writer.join();
+
+    return threads * double(Lookups) / std::chrono::duration<double>(end - start).count();
+}
+}  // namespace
+
+int main() {
+    // Single-threaded behavior.
+    {
+        Index index;
+        uintptr_t value = 0;
+        const void* base = nullptr;
+        CHECK(!index.find(at(Base), value));
+
+        CHECK(index.insert(at(Base + 100), 50, 1));
+        CHECK(!index.insert(at(Base + 100), 10, 2));
+        CHECK(index.find(at(Base + 149), value, &base) && value == 1 && base == at(Base + 100));
+        CHECK(!index.find(at(Base + 150), value));
+        CHECK(!index.find(at(Base + 99), value));
+
+        // A zero-sized range still covers its first byte.
+        CHECK(index.insert(at(Base + 150), 0, 3));
+        CHECK(index.find(at(Base + 150), value) && value == 3);
+
+        // A range over many granules, and one over every shard.
+        const uintptr_t large = Base + (uintptr_t(1) << 30);
+        CHECK(index.insert(at(large), 5 << 21, 4));
+        CHECK(index.find(at(large + (5 << 21) - 1), value) && value == 4);
+        const uintptr_t huge = Base + (uintptr_t(1) << 36);
+        CHECK(index.insert(at(huge), size_t(1) << 32, 5));
+        for (uintptr_t a = huge; a < huge + (uintptr_t(1) << 32); a += uintptr_t(3) << 20) {
+            CHECK(index.find(at(a), value) && value == 5);
+        }
+        CHECK(!index.find(at(huge + (uintptr_t(1) << 32)), value));
+        CHECK(index.size() == 4);
+
+        const uint64_t version = index.version();
+        CHECK(!index.remove(at(huge + 1)));
+        CHECK(index.remove(at(huge)));
+        CHECK(!index.find(at(huge), value));
+        CHECK(!index.find(at(huge + (uintptr_t(1) << 31)), value));
+        CHECK(index.find(at(large), value) && value == 4);
+
+        // A lookup made before a removal is not cached back.
+        CHECK(!index.insertIfUnchanged(version, at(huge), 1, 5));
+        CHECK(index.insertIfUnchanged(index.version(), at(huge), 1, 5));
+        CHECK(index.size() == 4);
+
+        // Nor is one made while the value of a removed range is destroyed,
+        // even after the removal.
+        CHECK(index.beginRemove(at(huge)));
+        const uint64_t during = index.version();
+        CHECK(!index.find(at(huge), value));
+        CHECK(!index.insertIfUnchanged(during, at(huge), 1, 5));
+        index.endRemove();
+        CHECK(!index.insertIfUnchanged(during, at(huge), 1, 5));
+        CHECK(index.insertIfUnchanged(index.version(), at(huge), 1, 5));
+        CHECK(index.size() == 4);
+    }
+
+    // Lookups from many threads while a writer adds and removes ranges.
+    {
+        const unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+        Index index;
+        const double indexRate = stress(index, threads);
+        LockedMap locked;
+        const double lockedRate = stress(locked, threads);
+        printf("%u threads: %.1fM lookups/s, %.1fM lookups/s with a locked map\n", threads,
+               indexRate * 1e-6, lockedRate * 1e-6);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
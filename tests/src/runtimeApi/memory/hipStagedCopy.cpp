@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipStagedCopy %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Drives the chunked staging pipeline used for pageable host copies against a
+// fake DMA engine that performs each transfer on its own thread, after a
+// delay. Since the fake engine only touches the staging ring when a transfer
+// completes, reusing a chunk too early corrupts the data.
+
+#include "staged_copy.inl"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+class Fake_dma {
+    struct Transfer {
+        std::size_t slot;
+        void* dst;
+        const void* src;
+        std::size_t n;
+    };
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Transfer> queue_;
+    std::vector<bool> in_flight_;
+    std::size_t in_flight_cnt_{};
+    bool done_{};
+    std::thread worker_;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lck{mtx_};
+        for (;;) {
+            cv_.wait(lck, [this]() { return done_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+
+            const auto t = queue_.front();
+            lck.unlock();
+
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            std::memcpy(t.dst, t.src, t.n);
+
+            lck.lock();
+            queue_.pop_front();
+            in_flight_[t.slot] = false;
+            --in_flight_cnt_;
+            cv_.notify_all();
+        }
+    }
+public:
+    std::size_t starts{};
+    std::size_t max_in_flight{};
+    std::size_t fail_at{SIZE_MAX};
+
+    explicit
+    Fake_dma(std::size_t depth)
+        : in_flight_(depth), worker_{[this]() { run(); }} {}
+    ~Fake_dma()
+    {
+        {
+            std::lock_guard<std::mutex> lck{mtx_};
+            done_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    void start(std::size_t slot, void* dst, const void* src, std::size_t n)
+    {
+        if (starts == fail_at) throw std::runtime_error{"DMA failed"};
+
+        std::lock_guard<std::mutex> lck{mtx_};
+        CHECK(slot < in_flight_.size() && !in_flight_[slot]);
+
+        ++starts;
+        in_flight_[slot] = true;
+        max_in_flight = std::max(max_in_flight, ++in_flight_cnt_);
+        queue_.push_back(Transfer{slot, dst, src, n});
+        cv_.notify_all();
+    }
+
+    void wait(std::size_t slot)
+    {
+        std::unique_lock<std::mutex> lck{mtx_};
+        cv_.wait(lck, [&]() { return !in_flight_[slot]; });
+    }
+
+    std::size_t in_flight()
+    {
+        std::lock_guard<std::mutex> lck{mtx_};
+        return in_flight_cnt_;
+    }
+};
+
+std::vector<char> pattern(std::size_t n, int seed)
+{
+    std::vector<char> r(n);
+    for (auto i = 0u; i != n; ++i) r[i] = static_cast<char>(i * 31 + seed);
+
+    return r;
+}
+
+void check_copies(std::size_t n, std::size_t chunk, std::size_t depth)
+{
+    std::vector<char> staging(chunk * depth);
+    const Staging_ring ring{staging.data(), chunk, depth};
+    const auto chunk_cnt = (n + chunk - 1) / chunk;
+
+    const auto host = pattern(n, 1);
+    std::vector<char> device(n);
+    {
+        Fake_dma dma{depth};
+        staged_h2d_copy(device.data(), host.data(), n, ring, dma);
+        CHECK(dma.in_flight() == 0);
+        CHECK(dma.starts == chunk_cnt);
+        CHECK(dma.max_in_flight == std::min(depth, chunk_cnt));
+    }
+    CHECK(device == host);
+
+    const auto device_data = pattern(n, 2);
+    std::vector<char> back(n);
+    {
+        Fake_dma dma{depth};
+        staged_d2h_copy(back.data(), device_data.data(), n, ring, dma);
+        CHECK(dma.in_flight() == 0);
+        CHECK(dma.starts == chunk_cnt);
+        CHECK(dma.max_in_flight == std::min(depth, chunk_cnt));
+    }
+    CHECK(back == device_data);
+}
+}  // namespace
+
+int main() {
+    constexpr std::size_t chunk = 4096;
+
+    // Sizes below, at and around chunk multiples, for a serial and several
+    // pipelined ring depths.
+    for (std::size_t depth : {1u, 2u, 3u, 8u}) {
+        for (std::size_t n : {std::size_t{1}, chunk - 1, chunk, chunk + 1,
+                              3 * chunk, 10 * chunk + 17}) {
+            check_copies(n, chunk, depth);
+        }
+    }
+
+    // An empty copy starts no transfer.
+    {
+        std::vector<char> staging(chunk);
+        Fake_dma dma{1};
+        staged_h2d_copy(nullptr, nullptr, 0, Staging_ring{staging.data(), chunk, 1}, dma);
+        staged_d2h_copy(nullptr, nullptr, 0, Staging_ring{staging.data(), chunk, 1}, dma);
+        CHECK(dma.starts == 0);
+    }
+
+    // A failing transfer propagates, after the transfers already in flight
+    // have drained, so the ring is free for the next copy.
+    for (int d2h = 0; d2h != 2; ++d2h) {
+        constexpr std::size_t depth = 3;
+        std::vector<char> staging(chunk * depth);
+        const Staging_ring ring{staging.data(), chunk, depth};
+        std::vector<char> src(8 * chunk), dst(8 * chunk);
+
+        Fake_dma dma{depth};
+        dma.fail_at = 5;
+        bool thrown = false;
+        try {
+            if (d2h) staged_d2h_copy(dst.data(), src.data(), src.size(), ring, dma);
+            else staged_h2d_copy(dst.data(), src.data(), src.size(), ring, dma);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        CHECK(dma.in_flight() == 0);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
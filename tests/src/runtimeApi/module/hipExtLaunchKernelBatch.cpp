@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* HIT_START
+ * BUILD_CMD: vcpy_kernel.code %hc --genco %S/vcpy_kernel.cpp -o vcpy_kernel.code EXCLUDE_HIP_PLATFORM nvcc
+ * BUILD: %t %s ../../test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// A batch copies a buffer along a chain of buffers, one launch per link, so
+// the result is only right if the launches run in array order. The arguments
+// alternate between kernelParams and extra.
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
+#include "test_common.h"
+
+#include <vector>
+
+#define LEN 64
+#define SIZE LEN * sizeof(float)
+#define CHAIN 65
+
+#define fileName "vcpy_kernel.code"
+#define kernel_name "hello_world"
+
+int main() {
+    std::vector<float> A(LEN), B(LEN);
+    for (int i = 0; i < LEN; ++i) {
+        A[i] = i * 1.0f;
+    }
+
+    hipModule_t Module;
+    hipFunction_t Function;
+    HIPCHECK(hipModuleLoad(&Module, fileName));
+    HIPCHECK(hipModuleGetFunction(&Function, Module, kernel_name));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    std::vector<float*> buffers(CHAIN);
+    for (auto& p : buffers) {
+        HIPCHECK(hipMalloc(&p, SIZE));
+        HIPCHECK(hipMemset(p, 0, SIZE));
+    }
+    HIPCHECK(hipMemcpy(buffers[0], A.data(), SIZE, hipMemcpyHostToDevice));
+
+    struct {
+        void* _a;
+        void* _b;
+    } args[CHAIN - 1];
+    size_t argsSize = sizeof(args[0]);
+    std::vector<void*> params(2 * (CHAIN - 1));
+    std::vector<void*> config(5 * (CHAIN - 1));
+
+    std::vector<hipExtKernelLaunchParams> launches(CHAIN - 1);
+    for (int i = 0; i < CHAIN - 1; ++i) {
+        hipExtKernelLaunchParams& l = launches[i];
+        l.function = Function;
+        l.gridDim = dim3(1);
+        l.blockDim = dim3(LEN);
+        l.sharedMem = 0;
+        l.kernelParams = nullptr;
+        l.extra = nullptr;
+        if (i % 2 == 0) {
+            params[2 * i] = &buffers[i];
+            params[2 * i + 1] = &buffers[i + 1];
+            l.kernelParams = &params[2 * i];
+        } else {
+            args[i]._a = buffers[i];
+            args[i]._b = buffers[i + 1];
+            void** c = &config[5 * i];
+            c[0] = HIP_LAUNCH_PARAM_BUFFER_POINTER;
+            c[1] = &args[i];
+            c[2] = HIP_LAUNCH_PARAM_BUFFER_SIZE;
+            c[3] = &argsSize;
+            c[4] = HIP_LAUNCH_PARAM_END;
+            l.extra = c;
+        }
+    }
+
+    HIPCHECK(hipExtLaunchKernelBatch(launches.data(), launches.size(), stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    HIPCHECK(hipMemcpy(B.data(), buffers[CHAIN - 1], SIZE, hipMemcpyDeviceToHost));
+    for (int i = 0; i < LEN; ++i) {
+        HIPASSERT(A[i] == B[i]);
+    }
+
+    // One bad launch fails the whole batch before anything is dispatched.
+    for (int i = 1; i < CHAIN; ++i) {
+        HIPCHECK(hipMemset(buffers[i], 0, SIZE));
+    }
+    launches.back().function = nullptr;
+    HIPASSERT(hipExtLaunchKernelBatch(launches.data(), launches.size(), stream) != hipSuccess);
+    HIPCHECK(hipStreamSynchronize(stream));
+    HIPCHECK(hipMemcpy(B.data(), buffers[1], SIZE, hipMemcpyDeviceToHost));
+    for (int i = 0; i < LEN; ++i) {
+        HIPASSERT(B[i] == 0.0f);
+    }
+
+    // An empty batch is a no-op.
+    HIPCHECK(hipExtLaunchKernelBatch(nullptr, 0, stream));
+
+    for (auto p : buffers) {
+        HIPCHECK(hipFree(p));
+    }
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipModuleUnload(Module));
+    passed();
+}
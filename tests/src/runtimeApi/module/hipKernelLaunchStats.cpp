@@ -0,0 +1,208 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipKernelLaunchStats %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the per-kernel launch statistics collected with HIP_KERNEL_STATS:
+// the latency histogram, the shape table under concurrent launches and the
+// copy to hipExtKernelLaunchStats.
+
+#include "launch_stats.inl"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+// Mirrors hipExtKernelLaunchStats, without the HIP headers
+struct Dim { unsigned x, y, z; };
+struct Shape {
+    Dim gridDim;
+    Dim blockDim;
+    unsigned sharedMemBytes;
+    unsigned long long launches;
+};
+struct Latency {
+    unsigned long long totalNs, p50Ns, p90Ns, p99Ns, maxNs;
+};
+struct Stats {
+    unsigned long long launches;
+    unsigned shapeCount;
+    unsigned long long otherShapeLaunches;
+    Shape shapes[4];
+    Latency enqueue;
+    Latency lockWait;
+};
+
+Launch_shape shape(std::uint32_t grid, std::uint32_t block, std::uint32_t lds = 0) {
+    return Launch_shape{{grid, 1, 1}, {block, 1, 1}, lds};
+}
+
+std::string dump(const Launch_stats_table& t) {
+    std::FILE* f = std::tmpfile();
+    t.dump(f);
+    std::rewind(f);
+    std::string r;
+    char buf[256];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) != 0;) r.append(buf, n);
+    std::fclose(f);
+    return r;
+}
+}  // namespace
+
+int main() {
+    // Buckets cover every duration, in order, and are at most 12.5% wide
+    {
+        using H = Latency_histogram;
+        CHECK(H::bucket(0) == 0 && H::bucket(7) == 7 && H::bucket(8) == 8 && H::bucket(15) == 15);
+        CHECK(H::bucket(16) == 16 && H::bucket(17) == 16 && H::bucket(18) == 17);
+        CHECK(H::bucket(std::uint64_t(1) << 40) == H::bucket_count - 1);
+        CHECK(H::bucket(~std::uint64_t(0)) == H::bucket_count - 1);
+        for (std::size_t b = 0; b + 1 != H::bucket_count; ++b) {
+            const std::uint64_t hi = H::bucket_limit(b);
+            CHECK(H::bucket(hi) == b && H::bucket(hi + 1) == b + 1);
+            const std::uint64_t lo = b ? H::bucket_limit(b - 1) + 1 : 0;
+            CHECK(hi - lo <= lo / 8);
+        }
+    }
+
+    // Percentiles are within a bucket of the exact ones
+    {
+        Latency_histogram h;
+        CHECK(h.count() == 0 && h.percentile(0.5) == 0 && h.max() == 0);
+
+        std::mt19937_64 rng{7};
+        std::vector<std::uint64_t> v;
+        std::uint64_t total = 0;
+        for (int i = 0; i != 100000; ++i) {
+            const std::uint64_t ns = std::uniform_int_distribution<std::uint64_t>{1000, 1000000}(rng);
+            v.push_back(ns);
+            total += ns;
+            h.record(ns);
+        }
+        std::sort(v.begin(), v.end());
+        CHECK(h.count() == v.size() && h.total() == total && h.max() == v.back());
+        for (double p : {0.5, 0.9, 0.99}) {
+            const std::uint64_t exact = v[static_cast<std::size_t>(p * v.size() + 0.5) - 1];
+            const std::uint64_t x = h.percentile(p);
+            CHECK(x >= exact && x - exact <= exact / 8);
+        }
+        CHECK(h.percentile(1.0) == v.back());
+    }
+
+    // Concurrent launches add each shape once, and count the rest as other
+    {
+        Kernel_launch_stats k{"k"};
+        constexpr int threads = 8, launches = 20000, shapes = 12;
+        std::vector<std::thread> ts;
+        for (int t = 0; t != threads; ++t) {
+            ts.emplace_back([&, t]() {
+                for (int i = 0; i != launches; ++i) {
+                    k.record(shape((t + i) % shapes + 1, 64), i, i % 2);
+                }
+            });
+        }
+        for (auto&& t : ts) t.join();
+
+        CHECK(k.launches == threads * launches);
+        CHECK(k.enqueue.count() == threads * launches && k.lock_wait.max() == 1);
+        std::vector<Launch_shape> seen;
+        std::uint64_t counted = 0;
+        k.shapes.for_each([&](const Launch_shape& s, std::uint64_t n) {
+            for (auto&& x : seen) CHECK(!(x == s));
+            seen.push_back(s);
+            counted += n;
+        });
+        CHECK(seen.size() == Launch_shapes::capacity);
+        CHECK(counted + k.shapes.other() == threads * launches);
+    }
+
+    // Functions share the statistics of their kernel, and a copy of a
+    // function looks them up again
+    {
+        Launch_stats_table t;
+        CHECK(t.find("a") == nullptr);
+        Launch_stats_ref f;
+        Kernel_launch_stats& a = f.get(t, "a");
+        CHECK(&a == t.find("a") && &f.get(t, "ignored") == &a);
+        Launch_stats_ref g{f};
+        CHECK(&g.get(t, "a") == &a && &g.get(t, "b") == &a);
+        Launch_stats_ref h;
+        h = f;
+        CHECK(&h.get(t, "b") == t.find("b") && t.find("b") != &a);
+    }
+
+    // Copy to hipExtKernelLaunchStats, with more shapes than it holds
+    {
+        Stats s;
+        s.launches = 5;
+        copy_launch_stats(nullptr, &s);
+        CHECK(s.launches == 0 && s.shapeCount == 0 && s.enqueue.maxNs == 0);
+
+        Kernel_launch_stats k{"k"};
+        for (std::uint32_t i = 1; i <= 10; ++i) {
+            for (std::uint32_t n = 0; n != i; ++n) {
+                k.record(Launch_shape{{i, 2, 3}, {64, 4, 1}, 256 * i}, 1000 * i, 10);
+            }
+        }
+        copy_launch_stats(&k, &s);
+        CHECK(s.launches == 55 && s.shapeCount == 4);
+        CHECK(s.shapes[0].gridDim.x == 1 && s.shapes[0].gridDim.y == 2 &&
+              s.shapes[0].gridDim.z == 3 && s.shapes[0].blockDim.x == 64 &&
+              s.shapes[0].blockDim.y == 4 && s.shapes[0].blockDim.z == 1 &&
+              s.shapes[0].sharedMemBytes == 256 && s.shapes[0].launches == 1);
+        CHECK(s.shapes[3].gridDim.x == 4 && s.shapes[3].launches == 4);
+        CHECK(s.otherShapeLaunches == 55 - 10);
+        CHECK(s.enqueue.totalNs == 385000 && s.enqueue.maxNs == 10000);
+        CHECK(s.enqueue.p50Ns >= 7000 && s.enqueue.p50Ns <= 7000 + 7000 / 8);
+        CHECK(s.enqueue.p90Ns >= s.enqueue.p50Ns && s.enqueue.p99Ns == 10000);
+        CHECK(s.lockWait.totalNs == 550 && s.lockWait.p50Ns == 10 && s.lockWait.maxNs == 10);
+    }
+
+    // The report at exit lists the kernels by decreasing enqueue time
+    {
+        Launch_stats_table t;
+        for (int i = 0; i != 3; ++i) t.get("fast").record(shape(1, 64), 2000, 0);
+        t.get("slow").record(shape(256, 256, 1024), 50000, 40000);
+        for (int i = 0; i != 9; ++i) t.get("many").record(shape(i + 1, 32), 100, 0);
+
+        const std::string r = dump(t);
+        printf("%s", r.c_str());
+        CHECK(r.find("slow") < r.find("fast") && r.find("fast") < r.find("many"));
+        CHECK(r.find("grid(256,1,1) block(256,1,1) dynamic LDS 1024") != std::string::npos);
+        CHECK(r.find("         1   other shapes") != std::string::npos);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
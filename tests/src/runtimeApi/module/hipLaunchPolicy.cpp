@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipLaunchPolicy %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the per-kernel launch policies selected with HIP_LAUNCH_POLICY:
+// glob matching, rule parsing, and the per-function cache.
+
+#include "launch_policy.inl"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+int main() {
+    // Glob matching
+    {
+        CHECK(glob_match("", ""));
+        CHECK(!glob_match("", "a"));
+        CHECK(glob_match("*", ""));
+        CHECK(glob_match("*", "_Z6vaddPfS_S_"));
+        CHECK(glob_match("gemm", "gemm") && !glob_match("gemm", "gemm_nt"));
+        CHECK(glob_match("gemm_*", "gemm_nt") && !glob_match("gemm_*", "sgemm_nt"));
+        CHECK(glob_match("*reduce*", "block_reduce_sum") && glob_match("*reduce*", "reduce"));
+        CHECK(glob_match("k?", "k1") && !glob_match("k?", "k") && !glob_match("k?", "k12"));
+        CHECK(glob_match("*a*b*c", "xxaxxbxxbxxc") && !glob_match("*a*b*c", "xxaxxbxxcx"));
+        CHECK(glob_match("**x", "x") && glob_match("a*", "a") && !glob_match("a*b", "a"));
+    }
+
+    // Rules, and the policy of each kernel
+    {
+        Launch_policy_table t;
+        CHECK(t.empty());
+        CHECK(t.add("gemm_*:block"));
+        CHECK(t.add("*reduce*:trace+sample=4"));
+        CHECK(t.add("ns::k:serialize"));
+        t.add("exact", launch_policy_block);
+        for (const char* bad : {"", "nopolicy", ":block", "k:", "k:bloc", "k:block+", "k:sample=4",
+                                "k:trace+sample=", "k:trace+sample=0", "k:trace+sample=2x",
+                                "k:trace+sample=99999999999"}) {
+            CHECK(!t.add(std::string{bad}));
+        }
+        CHECK(!t.empty());
+
+        CHECK(t.find("gemm_nt").flags() == launch_policy_block);
+        CHECK(t.find("gemm_nt").sample_period() == 0);
+        CHECK(&t.find("gemm_nt") == &t.find("gemm_nt"));
+        CHECK(t.find("gemm_reduce").flags() == (launch_policy_block | launch_policy_trace));
+        CHECK(t.find("gemm_reduce").sample_period() == 4);
+        CHECK(t.find("ns::k").flags() == launch_policy_serialize);
+        CHECK(t.find("exact").flags() == launch_policy_block);
+        CHECK(t.find("exactly").flags() == 0 && t.find("other").flags() == 0);
+
+        // The flags of a sampled kernel apply to one launch in every four
+        const Kernel_launch_policy& p = t.find("reduce");
+        int applied = 0;
+        for (int i = 0; i != 100; ++i) {
+            const std::uint32_t f = p.next_launch();
+            CHECK(f == 0 || f == launch_policy_trace);
+            applied += f != 0;
+        }
+        CHECK(applied == 25);
+        CHECK(t.find("gemm_nt").next_launch() == launch_policy_block);
+    }
+
+    // Functions keep the policy of their kernel, and a copy of a function
+    // looks it up again
+    {
+        Launch_policy_table t;
+        t.add("a", launch_policy_block);
+        t.add("b", launch_policy_trace);
+        Launch_policy_ref f;
+        CHECK(f.next_launch(t, "a") == launch_policy_block);
+        CHECK(f.next_launch(t, "b") == launch_policy_block);
+        Launch_policy_ref g{f};
+        CHECK(g.next_launch(t, "b") == launch_policy_trace);
+        Launch_policy_ref h;
+        h = f;
+        CHECK(h.next_launch(t, "none") == 0 && h.next_launch(t, "a") == 0);
+    }
+
+    // Concurrent first launches of many functions of a sampled kernel share
+    // one policy and one sample count
+    {
+        Launch_policy_table t;
+        CHECK(t.add("k*:block+sample=8"));
+        constexpr int threads = 8, launches = 8000;
+        std::vector<Launch_policy_ref> functions(4);
+        std::vector<int> applied(threads);
+        std::vector<std::thread> ts;
+        for (int i = 0; i != threads; ++i) {
+            ts.emplace_back([&, i]() {
+                for (int n = 0; n != launches; ++n) {
+                    applied[i] += functions[(i + n) % 4].next_launch(t, "k1") != 0;
+                }
+            });
+        }
+        for (auto&& x : ts) x.join();
+        int total = 0;
+        for (int x : applied) total += x;
+        CHECK(total == threads * launches / 8);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipMappedElf %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the section-header-only ELF reader used to index the code objects
+// of loaded DSOs, on this executable.
+
+#include "mapped_elf.inl"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+__attribute__((section(".kernel"), used))
+static const char fake_kernel_section[] = "__CLANG_OFFLOAD_BUNDLE__";
+
+int fake_global = 42;
+
+int main() {
+    const Mapped_file file{"/proc/self/exe"};
+    CHECK(file);
+
+    const auto image = file.image();
+    CHECK(image);
+
+    // Sections are found by name and by type, and handed out as views.
+    const auto kernel = image.data(image.section(".kernel"));
+    CHECK(kernel.size() >= sizeof(fake_kernel_section));
+    CHECK(kernel.data() >= file.data() && kernel.end() <= file.data() + file.size());
+    CHECK(std::memcmp(kernel.data(), fake_kernel_section, sizeof(fake_kernel_section)) == 0);
+
+    CHECK(image.section(".no_such_section").sh_type == elf::sht_null);
+    CHECK(image.data(image.section(".no_such_section")).empty());
+
+    // Both the function and the object symbol are visible in .symtab.
+    bool found_main = false;
+    bool found_global = false;
+    image.for_each_symbol(
+        image.section_by_type(elf::sht_symtab),
+        [&](const elf::Sym& x, const char* name) {
+        if (std::strcmp(name, "main") == 0) {
+            found_main = x.type() == elf::stt_func && x.st_shndx != elf::shn_undef;
+        }
+        if (std::strcmp(name, "fake_global") == 0) {
+            found_global = x.type() == elf::stt_object && x.st_size == sizeof(int);
+        }
+        return true;
+    });
+    CHECK(found_main && found_global);
+
+    // A truncated image is rejected instead of being read out of bounds.
+    CHECK(!Elf_image(file.data(), 16));
+    CHECK(!Elf_image(nullptr, 0));
+    const std::vector<char> not_elf(4096, 'x');
+    CHECK(!Elf_image(not_elf.data(), not_elf.size()));
+
+    // In-memory copies need no particular alignment.
+    std::vector<char> copy(file.size() + 1);
+    std::memcpy(copy.data() + 1, file.data(), file.size());
+    const Elf_image unaligned{copy.data() + 1, file.size()};
+    CHECK(unaligned);
+    CHECK(unaligned.data(unaligned.section(".kernel")).size() == kernel.size());
+
+    printf("PASSED!\n");
+    return 0;
+}
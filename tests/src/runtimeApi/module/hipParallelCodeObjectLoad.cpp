@@ -0,0 +1,230 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipParallelCodeObjectLoad %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc vdi
+ * TEST: %t
+ * HIT_END
+ */
+
+// Schedules code object loading against a stubbed loader whose calls sleep
+// for roughly as long as an HSA code object load does, checks that the loads
+// overlap, and reports how the time to load every agent's executables scales
+// with the agent count. Also loads many DSOs for one agent at once, as a
+// lookup of globals does.
+
+#include "code_object_loader.inl"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+constexpr int isa_cnt = 2;
+constexpr int code_objects_per_isa = 4;
+constexpr int load_ms = 5;
+constexpr std::size_t workers = 8;
+
+struct Reader { int id; };
+struct Executable { int agent; int reader; };
+
+std::atomic<int> readers_created{0};
+std::atomic<int> loads{0};
+std::atomic<int> loading{0};
+std::atomic<int> max_loading{0};
+
+const char code[isa_cnt * code_objects_per_isa]{};
+
+struct Process {
+    std::deque<Shared_code_object<Reader>> code_objects;
+
+    Process() {
+        for (int i = 0; i != isa_cnt * code_objects_per_isa; ++i) {
+            code_objects.emplace_back(Blob_view{&code[i], 1});
+        }
+    }
+
+    // Agents alternate between the ISAs.
+    std::vector<std::pair<int, std::vector<Shared_code_object<Reader>*>>> work(int agent_cnt) {
+        std::vector<std::pair<int, std::vector<Shared_code_object<Reader>*>>> r;
+        for (int a = 0; a != agent_cnt; ++a) {
+            r.emplace_back(a, std::vector<Shared_code_object<Reader>*>{});
+            for (int i = 0; i != code_objects_per_isa; ++i) {
+                r.back().second.push_back(
+                    &code_objects[(a % isa_cnt) * code_objects_per_isa + i]);
+            }
+        }
+        return r;
+    }
+};
+
+Reader create_reader(const Blob_view& x) {
+    ++readers_created;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return Reader{static_cast<int>(x.data() - code)};
+}
+
+Executable load(int agent, Reader r, const Blob_view&) {
+    ++loads;
+    const int n = ++loading;
+    for (int m = max_loading; n > m && !max_loading.compare_exchange_weak(m, n);) {}
+    std::this_thread::sleep_for(std::chrono::milliseconds(load_ms));
+    --loading;
+    return Executable{agent, r.id};
+}
+
+double load_all_ms(int agent_cnt, Worker_pool& pool) {
+    Process p;
+    const auto work = p.work(agent_cnt);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto r = load_executables<int, Reader, Executable>(
+        work, pool, create_reader, load);
+    const auto stop = std::chrono::steady_clock::now();
+
+    // Every agent gets its own code objects, in order.
+    CHECK(r.size() == static_cast<std::size_t>(agent_cnt));
+    for (int a = 0; a != agent_cnt; ++a) {
+        CHECK(r[a].size() == static_cast<std::size_t>(code_objects_per_isa));
+        for (int i = 0; i != code_objects_per_isa; ++i) {
+            CHECK(r[a][i].agent == a);
+            CHECK(r[a][i].reader == (a % isa_cnt) * code_objects_per_isa + i);
+        }
+    }
+
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// A DSO whose executables are loaded per agent, on first use, as
+// program_state_impl::get_executables does.
+struct Dso {
+    static constexpr int agent_cnt = 2;
+
+    Process p;
+    std::once_flag loaded[agent_cnt];
+    std::vector<Executable> executables[agent_cnt];
+
+    const std::vector<Executable>& get(int agent, Worker_pool& pool) {
+        std::call_once(loaded[agent], [&]() {
+            const auto work = p.work(agent_cnt);
+            executables[agent] = load_executables<int, Reader, Executable>(
+                {work[agent]}, pool, create_reader, load).front();
+        });
+
+        return executables[agent];
+    }
+};
+}  // namespace
+
+int main() {
+    Worker_pool pool{workers - 1};
+    Worker_pool serial_pool{0};
+
+    // Readers are shared between agents of the same ISA.
+    readers_created = 0;
+    loads = 0;
+    load_all_ms(8, pool);
+    CHECK(readers_created == isa_cnt * code_objects_per_isa);
+    CHECK(loads == 8 * code_objects_per_isa);
+
+    // Without pool threads, all the work runs on the calling thread.
+    {
+        const auto self = std::this_thread::get_id();
+        std::atomic<int> elsewhere{0};
+        parallel_for(serial_pool, 100, [&](std::size_t) {
+            elsewhere += std::this_thread::get_id() != self;
+        });
+        CHECK(elsewhere == 0);
+    }
+
+    // Loads overlap on the pool and not without it. The timings, against the
+    // serial baseline, are for information only.
+    max_loading = 0;
+    const double serial = load_all_ms(8, serial_pool);
+    CHECK(max_loading == 1);
+
+    printf("%8s %12s\n", "agents", "time (ms)");
+    max_loading = 0;
+    for (int agents = 1; agents <= 8; agents *= 2) {
+        printf("%8d %12.1f\n", agents, load_all_ms(agents, pool));
+    }
+    printf("%8s %12.1f\n", "serial", serial);
+    printf("at most %d loads at once\n", max_loading.load());
+    CHECK(max_loading > 1);
+
+    // A failing load is reported to the caller and stops the remaining work.
+    {
+        Process p;
+        std::atomic<int> attempted{0};
+        bool thrown = false;
+        try {
+            load_executables<int, Reader, Executable>(
+                p.work(8), pool, create_reader,
+                [&](int agent, Reader r, const Blob_view&) {
+                    ++attempted;
+                    if (agent == 0) throw std::runtime_error{"load failed"};
+                    std::this_thread::sleep_for(std::chrono::milliseconds(load_ms));
+                    return Executable{agent, r.id};
+                });
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        CHECK(attempted < 8 * code_objects_per_isa);
+    }
+
+    // Concurrent lookups of every DSO for one agent fan out across the DSOs,
+    // nesting the loads of their code objects on the same pool, load each
+    // DSO once, and load nothing for the other agent.
+    {
+        constexpr int dso_cnt = 6;
+        std::deque<Dso> dsos(dso_cnt);
+        loads = 0;
+
+        std::vector<std::thread> ts;
+        for (int t = 0; t != 3; ++t) {
+            ts.emplace_back([&]() {
+                parallel_for(pool, dso_cnt, [&](std::size_t i) {
+                    const auto& r = dsos[i].get(0, pool);
+                    CHECK(r.size() == static_cast<std::size_t>(code_objects_per_isa));
+                    for (auto&& x : r) CHECK(x.agent == 0);
+                });
+            });
+        }
+        for (auto&& x : ts) x.join();
+
+        CHECK(loads == dso_cnt * code_objects_per_isa);
+        for (auto&& x : dsos) CHECK(x.executables[1].empty());
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
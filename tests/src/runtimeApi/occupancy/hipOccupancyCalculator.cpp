@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipOccupancyCalculator %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the occupancy model shared by the HCC and VDI runtimes and the
+// hipOccupancy tool, and the kernel descriptor reader of the tool, on code
+// objects built in memory.
+
+#include "occupancy.inl"
+#include "kernel_descriptor.inl"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+// The model the HCC runtime used before it was shared.
+int reference_blocks(const Occupancy_limits& l, const Kernel_resources& k, int block_size,
+                     size_t dynamic_lds) {
+    if (block_size > int(l.max_threads_per_block)) return 0;
+    const size_t max_waves_per_simd = l.max_waves_per_cu / l.simds_per_cu;
+    const size_t waves = (block_size + l.wavefront_size - 1) / l.wavefront_size;
+    const size_t vgpr = l.simds_per_cu *
+        (k.vgprs == 0 ? max_waves_per_simd : std::min(max_waves_per_simd, l.vgprs_per_simd / k.vgprs));
+    int blocks = vgpr / waves;
+    const size_t sgpr = l.simds_per_cu *
+        (k.sgprs == 0 ? max_waves_per_simd : std::min(max_waves_per_simd, l.sgprs_per_simd / k.sgprs));
+    blocks = std::min(blocks, int(sgpr / waves));
+    if (k.lds + dynamic_lds != 0) blocks = std::min(blocks, int(l.lds_per_cu / (k.lds + dynamic_lds)));
+    return blocks;
+}
+
+// Appends a POD to an image being built.
+template <typename T>
+size_t append(std::vector<char>& image, const T& x) {
+    const size_t offset = image.size();
+    image.resize(offset + sizeof(x));
+    std::memcpy(image.data() + offset, &x, sizeof(x));
+    return offset;
+}
+
+size_t append(std::vector<char>& image, const std::string& s) {
+    const size_t offset = image.size();
+    image.insert(image.end(), s.begin(), s.end());
+    return offset;
+}
+
+// A code object with a v3 descriptor for "v3_kernel", a v2 amd_kernel_code_t
+// for "v2_kernel", and unrelated symbols.
+std::vector<char> make_code_object() {
+    std::vector<char> f(sizeof(elf::Ehdr), 0);
+
+    const std::string shstrtab{std::string{"\0.shstrtab\0.strtab\0.symtab\0.rodata\0", 35}};
+    const std::string strtab{std::string{"\0v3_kernel.kd\0v2_kernel\0v3_kernel\0data\0", 39}};
+
+    std::vector<char> rodata(64 + 256, 0);
+    const uint32_t lds_v3 = 4096, rsrc1 = (7 << 0) | (4 << 6);  // 32 VGPRs, 48 SGPRs
+    std::memcpy(&rodata[0], &lds_v3, 4);
+    std::memcpy(&rodata[48], &rsrc1, 4);
+    const uint32_t lds_v2 = 1000;
+    const uint16_t sgprs_v2 = 30, vgprs_v2 = 61;  // 32 SGPRs with VCC, 64 VGPRs
+    std::memcpy(&rodata[64 + 64], &lds_v2, 4);
+    std::memcpy(&rodata[64 + 84], &sgprs_v2, 2);
+    std::memcpy(&rodata[64 + 86], &vgprs_v2, 2);
+
+    const size_t shstrtab_off = append(f, shstrtab);
+    const size_t strtab_off = append(f, strtab);
+    const size_t rodata_off = append(f, std::string{rodata.begin(), rodata.end()});
+    while (f.size() % 8) f.push_back(0);
+
+    const uint64_t rodata_addr = 0x1000;
+    std::vector<elf::Sym> syms(5, elf::Sym{});
+    syms[1].st_name = 1;   // v3_kernel.kd
+    syms[1].st_info = elf::stt_object;
+    syms[1].st_shndx = 4;
+    syms[1].st_value = rodata_addr;
+    syms[1].st_size = 64;
+    syms[2].st_name = 14;  // v2_kernel
+    syms[2].st_info = elf::stt_amdgpu_hsa_kernel;
+    syms[2].st_shndx = 4;
+    syms[2].st_value = rodata_addr + 64;
+    syms[2].st_size = 256;
+    syms[3].st_name = 24;  // v3_kernel, the code
+    syms[3].st_info = elf::stt_func;
+    syms[3].st_shndx = 4;
+    syms[4].st_name = 34;  // data.kd would be a descriptor; data is not
+    syms[4].st_info = elf::stt_object;
+    syms[4].st_shndx = 4;
+    size_t symtab_off = f.size();
+    for (const auto& s : syms) append(f, s);
+
+    std::vector<elf::Shdr> shdrs(5, elf::Shdr{});
+    shdrs[1].sh_name = 1;
+    shdrs[1].sh_type = 3;
+    shdrs[1].sh_offset = shstrtab_off;
+    shdrs[1].sh_size = shstrtab.size();
+    shdrs[2].sh_name = 11;
+    shdrs[2].sh_type = 3;
+    shdrs[2].sh_offset = strtab_off;
+    shdrs[2].sh_size = strtab.size();
+    shdrs[3].sh_name = 19;
+    shdrs[3].sh_type = elf::sht_symtab;
+    shdrs[3].sh_offset = symtab_off;
+    shdrs[3].sh_size = syms.size() * sizeof(elf::Sym);
+    shdrs[3].sh_link = 2;
+    shdrs[3].sh_entsize = sizeof(elf::Sym);
+    shdrs[4].sh_name = 27;
+    shdrs[4].sh_type = 1;
+    shdrs[4].sh_addr = rodata_addr;
+    shdrs[4].sh_offset = rodata_off;
+    shdrs[4].sh_size = rodata.size();
+    const size_t shoff = f.size();
+    for (const auto& s : shdrs) append(f, s);
+
+    elf::Ehdr h{};
+    const unsigned char ident[]{0x7f, 'E', 'L', 'F', 2, 1, 1};
+    std::memcpy(h.e_ident, ident, sizeof(ident));
+    h.e_shoff = shoff;
+    h.e_shentsize = sizeof(elf::Shdr);
+    h.e_shnum = shdrs.size();
+    h.e_shstrndx = 1;
+    std::memcpy(f.data(), &h, sizeof(h));
+
+    return f;
+}
+
+std::vector<char> make_bundle(const std::vector<char>& code) {
+    const std::string host{"host-x86_64-unknown-linux"}, gpu{"hip-amdgcn-amd-amdhsa-gfx906"};
+    std::vector<char> b;
+    append(b, std::string{"__CLANG_OFFLOAD_BUNDLE__"});
+    append(b, uint64_t{2});
+    const size_t header = b.size() + 2 * 3 * sizeof(uint64_t) + host.size() + gpu.size();
+    append(b, uint64_t{header});
+    append(b, uint64_t{0});
+    append(b, uint64_t{host.size()});
+    append(b, host);
+    append(b, uint64_t{header});
+    append(b, uint64_t{code.size()});
+    append(b, uint64_t{gpu.size()});
+    append(b, gpu);
+    b.insert(b.end(), code.begin(), code.end());
+    return b;
+}
+}  // namespace
+
+int main() {
+    const Occupancy_limits l;
+
+    // Register, LDS and workgroup limits.
+    {
+        Kernel_resources k;
+        k.vgprs = 32;
+        k.sgprs = 16;
+        CHECK(max_active_blocks_per_cu(l, k, 64, 0) == 32);
+        CHECK(max_active_blocks_per_cu(l, k, 256, 0) == 8);
+        CHECK(max_active_blocks_per_cu(l, k, 1024, 0) == 2);
+        CHECK(max_active_blocks_per_cu(l, k, 1025, 0) == 0);
+        CHECK(max_active_blocks_per_cu(l, k, 0, 0) == 0);
+        CHECK(max_active_blocks_per_cu(l, k, 65, 0) == 16);
+
+        k.vgprs = 128;
+        CHECK(max_active_blocks_per_cu(l, k, 512, 0) == 1);
+        CHECK(max_active_blocks_per_cu(l, k, 1024, 0) == 0);
+        CHECK(max_block_size(l, k) == 512);
+
+        // Register counts are rounded up to their granularity.
+        k.vgprs = 125;
+        k.sgprs = 90;
+        CHECK(max_active_blocks_per_cu(l, k, 512, 0) == 1);
+        CHECK(max_active_blocks_per_cu(l, k, 64, 0) == 8);
+
+        k.vgprs = 0;
+        k.sgprs = 0;
+        k.lds = 16384;
+        CHECK(max_active_blocks_per_cu(l, k, 64, 0) == 4);
+        CHECK(max_active_blocks_per_cu(l, k, 64, 16384) == 2);
+
+        // Kernels may report their own wavefront size and register budget.
+        Kernel_resources w;
+        w.vgprs = 64;
+        w.wavefront_size = 32;
+        w.vgprs_per_simd = 512;
+        CHECK(max_active_blocks_per_cu(l, w, 64, 0) == 16);
+        CHECK(max_active_blocks_per_cu(l, w, 32, 0) == 32);
+    }
+
+    // The model matches the one HCC used, which the workgroup limit never
+    // tightens at 32 wavefronts per CU.
+    for (size_t vgprs = 0; vgprs <= 256; vgprs += 4) {
+        for (size_t sgprs = 0; sgprs <= 112; sgprs += 16) {
+            for (size_t lds : {0, 1, 4096, 20000, 65536}) {
+                Kernel_resources k;
+                k.vgprs = vgprs;
+                k.sgprs = sgprs;
+                k.lds = lds;
+                for (int block = 1; block <= 1088; block += (block < 130 ? 1 : 61)) {
+                    for (size_t dyn : {0, 8192}) {
+                        CHECK(max_active_blocks_per_cu(l, k, block, dyn) ==
+                              reference_blocks(l, k, block, dyn));
+                    }
+                }
+            }
+        }
+    }
+
+    // The potential block size keeps the most waves resident, prefers larger
+    // blocks on ties, and respects the limit.
+    {
+        Occupancy_limits d = l;
+        d.cu_count = 60;
+        Kernel_resources k;
+        k.vgprs = 32;
+        int grid = 0, block = 0;
+        max_potential_block_size(d, k, 0, 0, &grid, &block);
+        CHECK(block == 1024 && grid == 120);
+        max_potential_block_size(d, k, 0, 300, &grid, &block);
+        CHECK(block == 256 && grid == 480);
+        max_potential_block_size(d, k, 0, 20, &grid, &block);
+        CHECK(block == 20 && grid == 32 * 60);
+
+        // 12 waves fit in the VGPRs: one block of 768 threads, or two of 384.
+        k.vgprs = 84;
+        max_potential_block_size(d, k, 0, 0, &grid, &block);
+        CHECK(block == 768 && grid == 60);
+
+        k.vgprs = 128;
+        k.lds = 0;
+        max_potential_block_size(d, k, 0, 0, &grid, &block);
+        CHECK(block == 512 && grid == 60);
+
+        k.lds = 65537;
+        max_potential_block_size(d, k, 0, 0, &grid, &block);
+        CHECK(block == 0 && grid == 0);
+    }
+
+    // Descriptor decoding.
+    {
+        const auto v3 = kernel_resources_v3((7 << 0) | (4 << 6), 4096);
+        CHECK(v3.vgprs == 32 && v3.sgprs == 48 && v3.lds == 4096);
+        const auto v2 = kernel_resources_v2(61, 30, 1000);
+        CHECK(v2.vgprs == 64 && v2.sgprs == 32 && v2.lds == 1000);
+    }
+
+    // The calculator memoizes by resources, from any thread.
+    {
+        Occupancy_limits d = l;
+        d.cu_count = 60;
+        Occupancy_calculator calc{d};
+        Kernel_resources a, b;
+        a.vgprs = b.vgprs = 64;
+        a.sgprs = b.sgprs = 32;
+        CHECK(calc.max_active_blocks_per_cu(a, 256, 0) == max_active_blocks_per_cu(d, a, 256, 0));
+        CHECK(calc.size() == 1);
+        CHECK(calc.max_active_blocks_per_cu(b, 256, 0) == max_active_blocks_per_cu(d, a, 256, 0));
+        CHECK(calc.size() == 1);
+
+        // Dynamic and static LDS only count as their sum.
+        a.lds = 1024;
+        CHECK(calc.max_active_blocks_per_cu(a, 256, 1024) == max_active_blocks_per_cu(d, a, 256, 1024));
+        b.lds = 2048;
+        CHECK(calc.max_active_blocks_per_cu(b, 256, 0) == max_active_blocks_per_cu(d, b, 256, 0));
+        CHECK(calc.size() == 2);
+
+        int grid = 0, block = 0, g = 0, bl = 0;
+        calc.max_potential_block_size(a, 0, 0, &grid, &block);
+        max_potential_block_size(d, a, 0, 0, &g, &bl);
+        CHECK(grid == g && block == bl);
+        // Limits of 0 and of at least the largest block are the same query.
+        calc.max_potential_block_size(a, 0, 4096, &grid, &block);
+        CHECK(grid == g && block == bl);
+        CHECK(calc.size() == 3);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t != 8; ++t) {
+            threads.emplace_back([&calc, &d, t]() {
+                for (int i = 0; i != 20000; ++i) {
+                    Kernel_resources k;
+                    k.vgprs = 4 * (1 + (i + t) % 64);
+                    k.sgprs = 16 * (1 + i % 7);
+                    const int block = 64 * (1 + i % 16);
+                    CHECK(calc.max_active_blocks_per_cu(k, block, i % 3 * 1024) ==
+                          max_active_blocks_per_cu(d, k, block, i % 3 * 1024));
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        // The results held are bounded.
+        CHECK(calc.size() <= 4096);
+
+        Occupancy_limits e = d;
+        e.sgprs_per_simd = 512;
+        calc.reset(e);
+        CHECK(calc.size() == 0);
+        CHECK(calc.limits().sgprs_per_simd == 512);
+    }
+
+    // Kernel descriptors are read from code objects and offload bundles.
+    {
+        const auto code = make_code_object();
+        std::vector<std::string> names;
+        std::vector<Kernel_resources> found;
+        const auto collect = [&](const std::string& triple, const Elf_image& image) {
+            CHECK(triple.empty() || triple == "hip-amdgcn-amd-amdhsa-gfx906");
+            for_each_kernel_descriptor(image, [&](const std::string& name, const Kernel_resources& k) {
+                names.push_back(name);
+                found.push_back(k);
+            });
+        };
+
+        CHECK(for_each_code_object(Blob_view{code.data(), code.size()}, collect));
+        CHECK(names.size() == 2);
+        CHECK(names[0] == "v3_kernel" && names[1] == "v2_kernel");
+        CHECK(found[0].vgprs == 32 && found[0].sgprs == 48 && found[0].lds == 4096);
+        CHECK(found[1].vgprs == 64 && found[1].sgprs == 32 && found[1].lds == 1000);
+
+        names.clear();
+        found.clear();
+        const auto bundle = make_bundle(code);
+        CHECK(for_each_code_object(Blob_view{bundle.data(), bundle.size()}, collect));
+        CHECK(names.size() == 2);
+
+        // Truncated bundles and other files are rejected.
+        CHECK(!for_each_code_object(Blob_view{bundle.data(), 40}, collect));
+        const char text[] = "not a code object";
+        CHECK(!for_each_code_object(Blob_view{text, sizeof(text)}, collect));
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
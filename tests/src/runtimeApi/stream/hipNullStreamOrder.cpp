@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipNullStreamOrder %cxx -std=c++11 -I%S/../../../../vdi %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc hcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Checks the null stream ordering of the VDI backend against mock host queues
+// whose commands only complete when the test says so.
+// Every ordering call returns with the work still pending, so none of them
+// can wait on the host.
+
+#include "hip_stream_order.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+namespace amd {
+class HostQueue;
+
+class Command {
+ public:
+  HostQueue& queue_;
+  Command* previous_;
+  std::vector<Command*> waits_;
+  bool marker_;
+  int refs_ = 1;
+  bool complete_ = false;
+  size_t issuedAt_;
+  size_t completedAt_ = 0;
+
+  Command(HostQueue& queue, Command* previous, const std::vector<Command*>& waits,
+          bool marker, size_t now)
+      : queue_(queue), previous_(previous), waits_(waits), marker_(marker),
+        issuedAt_(now) {}
+
+  bool ready() const {
+    if (complete_ || (previous_ != nullptr && !previous_->complete_)) {
+      return false;
+    }
+    for (auto w : waits_) {
+      if (!w->complete_) return false;
+    }
+    return true;
+  }
+
+  // True if this command cannot start before \p other has completed
+  bool dependsOn(const Command* other) const {
+    std::vector<const Command*> stack(1, this);
+    std::set<const Command*> seen;
+    while (!stack.empty()) {
+      const Command* c = stack.back();
+      stack.pop_back();
+      if (c == other) return true;
+      if (c->issuedAt_ < other->issuedAt_ || !seen.insert(c).second) continue;
+      if (c->previous_ != nullptr) stack.push_back(c->previous_);
+      for (auto w : c->waits_) stack.push_back(w);
+    }
+    return false;
+  }
+};
+
+class HostQueue {
+ public:
+  std::vector<std::unique_ptr<Command>> commands_;
+  size_t lastCommandCalls_ = 0;
+
+  Command* enqueue(const std::vector<Command*>& waits, bool marker, size_t now) {
+    Command* previous = commands_.empty() ? nullptr : commands_.back().get();
+    commands_.emplace_back(new Command(*this, previous, waits, marker, now));
+    return commands_.back().get();
+  }
+
+  Command* getLastQueuedCommand(bool retain) {
+    ++lastCommandCalls_;
+    if (commands_.empty()) return nullptr;
+    Command* c = commands_.back().get();
+    if (retain) ++c->refs_;
+    return c;
+  }
+
+  size_t markers() const {
+    size_t r = 0;
+    for (auto& c : commands_) r += c->marker_;
+    return r;
+  }
+};
+}  // namespace amd
+
+namespace {
+size_t now = 1;
+
+struct MockOps {
+  typedef amd::HostQueue Queue;
+  typedef amd::Command Command;
+
+  static Command* lastCommand(Queue& queue) { return queue.getLastQueuedCommand(true); }
+  static bool completed(Command& command) { return command.complete_; }
+  static void release(Command& command) {
+    --command.refs_;
+    CHECK(command.refs_ >= 1);
+  }
+  static void wait(Queue& queue, const std::vector<Command*>& commands) {
+    queue.enqueue(commands, true, now++);
+  }
+};
+
+typedef hip::NullStreamOrder<MockOps> Order;
+
+// Completes one ready command at random, if any.
+bool completeOne(std::vector<amd::HostQueue*>& queues, std::mt19937& gen) {
+  std::vector<amd::Command*> ready;
+  for (auto q : queues) {
+    for (auto& c : q->commands_) {
+      if (c->ready()) ready.push_back(c.get());
+    }
+  }
+  if (ready.empty()) return false;
+  amd::Command* c = ready[std::uniform_int_distribution<size_t>(0, ready.size() - 1)(gen)];
+  c->complete_ = true;
+  c->completedAt_ = now++;
+  return true;
+}
+
+void checkReleased(const amd::HostQueue& queue) {
+  for (auto& c : queue.commands_) {
+    CHECK(c->refs_ == 1);
+  }
+}
+}  // namespace
+
+int main() {
+  // Blocking streams wait for earlier null stream work, the null stream waits
+  // for earlier blocking stream work, all with markers.
+  {
+    amd::HostQueue null, s1, s2;
+    {
+      Order order;
+      order.orderNull(null);
+      amd::Command* n1 = null.enqueue({}, false, now++);
+
+      order.orderBlocking(null, s1);
+      CHECK(s1.commands_.size() == 1 && s1.commands_[0]->waits_ ==
+            std::vector<amd::Command*>(1, n1));
+      amd::Command* a = s1.enqueue({}, false, now++);
+
+      // No new null stream work: no second marker.
+      order.orderBlocking(null, s1);
+      amd::Command* a2 = s1.enqueue({}, false, now++);
+      CHECK(s1.markers() == 1);
+
+      order.orderBlocking(null, s2);
+      amd::Command* b = s2.enqueue({}, false, now++);
+
+      order.orderNull(null);
+      amd::Command* n2 = null.enqueue({}, false, now++);
+      CHECK(n2->dependsOn(a2) && n2->dependsOn(b));
+      CHECK(a->dependsOn(n1) && b->dependsOn(n1));
+      CHECK(!n1->complete_ && !a->complete_ && !b->complete_);
+
+      // Nothing new on the blocking streams: no second marker.
+      order.orderNull(null);
+      null.enqueue({}, false, now++);
+      CHECK(null.markers() == 1);
+    }
+    checkReleased(null);
+    checkReleased(s1);
+    checkReleased(s2);
+  }
+
+  // Completed work is not waited for, and idle streams drop out after one
+  // round so the null stream only looks at streams with pending work.
+  {
+    amd::HostQueue null;
+    std::vector<std::unique_ptr<amd::HostQueue>> streams(100);
+    {
+      Order order;
+      for (auto& s : streams) {
+        s.reset(new amd::HostQueue);
+        order.orderBlocking(null, *s);
+        s->enqueue({}, false, now++);
+      }
+      CHECK(order.trackedQueues() == streams.size());
+
+      for (auto& s : streams) s->commands_.back()->complete_ = true;
+      order.orderNull(null);
+      CHECK(null.markers() == 0);
+      CHECK(order.trackedQueues() == streams.size());
+      order.orderNull(null);
+      CHECK(order.trackedQueues() == 0);
+
+      for (auto& s : streams) s->lastCommandCalls_ = 0;
+      order.orderBlocking(null, *streams[7]);
+      streams[7]->enqueue({}, false, now++);
+      order.orderNull(null);
+      CHECK(null.markers() == 1);
+      for (size_t i = 0; i != streams.size(); ++i) {
+        CHECK(streams[i]->lastCommandCalls_ == (i == 7 ? 1u : 0u));
+      }
+
+      // A destroyed stream is forgotten.
+      order.removeQueue(*streams[7]);
+      CHECK(order.trackedQueues() == 0);
+    }
+    checkReleased(null);
+    for (auto& s : streams) checkReleased(*s);
+  }
+
+  // Random interleavings of null, blocking and non-blocking stream work with
+  // random completions keep the legacy ordering.
+  for (int seed = 0; seed != 10; ++seed) {
+    std::mt19937 gen(seed);
+    amd::HostQueue null, nonBlocking;
+    std::vector<std::unique_ptr<amd::HostQueue>> blocking(4);
+    for (auto& s : blocking) s.reset(new amd::HostQueue);
+
+    std::vector<amd::HostQueue*> queues(1, &null);
+    queues.push_back(&nonBlocking);
+    for (auto& s : blocking) queues.push_back(s.get());
+
+    std::vector<amd::Command*> issued;
+    {
+      Order order;
+      for (int i = 0; i != 200; ++i) {
+        const size_t pick = std::uniform_int_distribution<size_t>(0, queues.size())(gen);
+        if (pick == queues.size()) {
+          completeOne(queues, gen);
+          continue;
+        }
+        amd::HostQueue* q = queues[pick];
+        if (q == &null) {
+          order.orderNull(null);
+        } else if (q != &nonBlocking) {
+          order.orderBlocking(null, *q);
+        }
+        issued.push_back(q->enqueue({}, false, now++));
+      }
+
+      for (size_t j = 0; j != issued.size(); ++j) {
+        const amd::Command* y = issued[j];
+        for (size_t i = 0; i != j; ++i) {
+          const amd::Command* x = issued[i];
+          const bool ordered = (&x->queue_ == &y->queue_) ||
+              ((&x->queue_ == &null || &y->queue_ == &null) &&
+               &x->queue_ != &nonBlocking && &y->queue_ != &nonBlocking);
+          if (!ordered) continue;
+          const bool doneBefore = x->complete_ && x->completedAt_ < y->issuedAt_;
+          CHECK(doneBefore || y->dependsOn(x));
+        }
+      }
+
+      // The non-blocking stream never waits and is never waited for.
+      CHECK(nonBlocking.markers() == 0);
+      for (auto q : queues) {
+        for (auto& c : q->commands_) {
+          for (auto w : c->waits_) CHECK(&w->queue_ != &nonBlocking);
+        }
+      }
+
+      // No marker waits on a command that was already complete.
+      for (auto q : queues) {
+        for (auto& c : q->commands_) {
+          for (auto w : c->waits_) {
+            CHECK(!w->complete_ || w->completedAt_ > c->issuedAt_);
+          }
+        }
+      }
+
+      while (completeOne(queues, gen)) {}
+      for (auto q : queues) {
+        for (auto& c : q->commands_) CHECK(c->complete_);
+      }
+    }
+    for (auto q : queues) checkReleased(*q);
+  }
+
+  printf("PASSED!\n");
+  return 0;
+}
@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipStreamCallbackExecutor %cxx -std=c++11 -I%S/../../../../vdi %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc hcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the executor that runs stream callbacks for the VDI backend off
+// the completion thread.
+
+#include "hip_callback_executor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+namespace {
+struct Task {
+    void (*fn_)(void*, int) = nullptr;
+    void* arg_ = nullptr;
+    int value_ = 0;
+
+    void run() { fn_(arg_, value_); }
+};
+
+typedef hip::CallbackExecutor<Task> Executor;
+
+// Records the values a stream's callbacks see, checking they never overlap.
+struct Stream {
+    std::vector<int> seen_;
+    std::atomic<int> running_{0};
+    std::atomic<bool> overlapped_{false};
+};
+
+void record(void* arg, int value) {
+    Stream* s = static_cast<Stream*>(arg);
+    if (s->running_.fetch_add(1) != 0) s->overlapped_ = true;
+    s->seen_.push_back(value);
+    if (value % 64 == 0) std::this_thread::yield();
+    s->running_.fetch_sub(1);
+}
+
+std::atomic<bool> gate{false};
+std::atomic<int> inside{0};
+
+void block(void*, int) {
+    ++inside;
+    while (!gate.load()) std::this_thread::yield();
+    --inside;
+}
+
+void count(void* arg, int) { ++*static_cast<std::atomic<int>*>(arg); }
+}  // namespace
+
+int main() {
+    // Callbacks of a stream run one at a time and in order, even when many
+    // threads queue on many streams through a small ring.
+    {
+        const int streams = 8, perStream = 5000;
+        std::vector<Stream> s(streams);
+        {
+            Executor executor(4, 16);
+            std::vector<std::thread> producers;
+            for (int t = 0; t != streams; ++t) {
+                producers.emplace_back([&executor, &s, t]() {
+                    for (int i = 0; i != perStream; ++i) {
+                        Task task;
+                        task.fn_ = record;
+                        task.arg_ = &s[t];
+                        task.value_ = i;
+                        executor.push(&s[t], task);
+                    }
+                });
+            }
+            for (auto& p : producers) p.join();
+
+            executor.wait(&s[3]);
+            CHECK(s[3].seen_.size() == perStream);
+            executor.waitAll();
+            for (auto& x : s) {
+                CHECK(!x.overlapped_);
+                CHECK(x.seen_.size() == perStream);
+                for (int i = 0; i != perStream; ++i) CHECK(x.seen_[i] == i);
+            }
+
+            // Records are recycled rather than allocated per callback.
+            const size_t records = executor.records();
+            for (int i = 0; i != 1000; ++i) {
+                Task task;
+                task.fn_ = record;
+                task.arg_ = &s[0];
+                task.value_ = perStream + i;
+                executor.push(&s[0], task);
+                executor.wait(&s[0]);
+            }
+            CHECK(executor.records() == records);
+            CHECK(s[0].seen_.size() == perStream + 1000);
+        }
+    }
+
+    // A slow callback only holds back its own stream: another stream's
+    // callbacks run and can be waited for meanwhile.
+    {
+        Executor executor(2);
+        int a, b;
+        Task slow;
+        slow.fn_ = block;
+        executor.push(&a, slow);
+        while (inside.load() != 1) std::this_thread::yield();
+
+        std::atomic<int> counted{0};
+        Task fast;
+        fast.fn_ = count;
+        fast.arg_ = &counted;
+        executor.push(&a, fast);
+        for (int i = 0; i != 100; ++i) executor.push(&b, fast);
+        executor.wait(&b);
+        CHECK(counted.load() == 100);
+
+        // Waiting on an idle stream returns at once.
+        int c;
+        executor.wait(&c);
+
+        std::thread waiter([&executor, &a]() { executor.wait(&a); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(counted.load() == 100);
+        gate = true;
+        waiter.join();
+        CHECK(counted.load() == 101);
+        CHECK(inside.load() == 0);
+    }
+
+    // The destructor runs every callback still queued.
+    {
+        std::atomic<int> counted{0};
+        {
+            Executor executor(1, 4);
+            Task task;
+            task.fn_ = count;
+            task.arg_ = &counted;
+            int s;
+            for (int i = 0; i != 1000; ++i) executor.push(&s, task);
+        }
+        CHECK(counted.load() == 1000);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp NVCC_OPTIONS -std=c++11
+ * TEST: %t
+ * HIT_END
+ */
+
+// Destroys a stream while its callback waits behind a kernel that is blocked
+// on the host: hipStreamDestroy must drain the stream and run the callback,
+// with the stream still valid, before it returns.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#ifdef __HIP_PLATFORM_HCC__
+#define HIPRT_CB
+#endif
+
+__global__ void wait_for_host(volatile int* flag) {
+    while (*flag == 0) {
+    }
+}
+
+hipStream_t created;
+std::atomic<bool> destroyed{false};
+std::atomic<int> ran{0};
+std::atomic<bool> failed{false};
+
+static void HIPRT_CB Callback(hipStream_t stream, hipError_t status, void* userData) {
+    if (stream != created || status != hipSuccess || destroyed) failed = true;
+    ++ran;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int* flag;
+    HIPCHECK(hipHostMalloc(&flag, sizeof(int), hipHostMallocCoherent));
+    *flag = 0;
+
+    HIPCHECK(hipStreamCreate(&created));
+    hipLaunchKernelGGL(wait_for_host, dim3(1), dim3(1), 0, created, flag);
+    HIPCHECK(hipStreamAddCallback(created, Callback, NULL, 0));
+
+    std::thread release([flag]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        __atomic_store_n(flag, 1, __ATOMIC_RELEASE);
+    });
+
+    HIPCHECK(hipStreamDestroy(created));
+    destroyed = true;
+    release.join();
+
+    HIPASSERT(ran == 1);
+    HIPASSERT(!failed);
+
+    HIPCHECK(hipHostFree(flag));
+    passed();
+}
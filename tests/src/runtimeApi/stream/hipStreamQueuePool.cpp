@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipStreamQueuePool %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the pool of hardware queues that streams share with
+// HIP_STREAM_QUEUES, against a fake queue factory.
+
+#include "hw_queue_pool.inl"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+// A handle to a queue, like hc::accelerator_view: copies share the queue,
+// which is destroyed with its last handle.
+struct Fake_queue {
+    struct State {
+        int id;
+        int priority;
+        std::atomic<int>* live;
+        ~State() { --*live; }
+    };
+    std::shared_ptr<State> state;
+};
+
+struct Fake_factory {
+    std::atomic<int> created{0};
+    std::atomic<int> live{0};
+
+    Hw_queue_pool<Fake_queue>::Factory make()
+    {
+        return [this](int priority) {
+            ++live;
+            return Fake_queue{std::shared_ptr<Fake_queue::State>(
+                new Fake_queue::State{created++, priority, &live})};
+        };
+    }
+};
+
+using Loads = std::vector<std::size_t>;
+}  // namespace
+
+int main() {
+    // Without queues per priority, every stream gets a queue of its own
+    {
+        Fake_factory f;
+        Hw_queue_pool<Fake_queue> pool;
+        pool.reset(f.make(), 0, Hw_queue_assignment::least_loaded);
+        CHECK(!pool.pooled());
+        Hw_queue_lease lease;
+        auto a = pool.acquire(1, &lease);
+        CHECK(!lease.pooled());
+        auto b = pool.acquire(1, &lease);
+        CHECK(a.state->id == 0 && b.state->id == 1 && b.state->priority == 1);
+        pool.release(lease);
+        CHECK(pool.queue_count() == 0 && f.live == 2);
+        a = b = Fake_queue{};
+        CHECK(f.live == 0);
+    }
+
+    // Least loaded: queues are created until there are enough, then shared
+    // by the fewest streams, and kept when their streams go
+    {
+        Fake_factory f;
+        Hw_queue_pool<Fake_queue> pool;
+        pool.reset(f.make(), 2, Hw_queue_assignment::least_loaded);
+        CHECK(pool.pooled());
+
+        std::vector<Hw_queue_lease> leases(5);
+        std::vector<Fake_queue> queues;
+        for (auto&& x : leases) queues.push_back(pool.acquire(0, &x));
+        CHECK(f.created == 2 && pool.loads(0) == (Loads{3, 2}));
+        for (int i = 0; i != 5; ++i) {
+            CHECK(leases[i].pooled() && leases[i].priority == 0 && leases[i].slot == i % 2u);
+            CHECK(queues[i].state->id == i % 2);
+        }
+
+        Hw_queue_lease high;
+        CHECK(pool.acquire(-1, &high).state->priority == -1);
+        CHECK(f.created == 3 && pool.loads(-1) == (Loads{1, 0}) && pool.queue_count() == 3);
+
+        pool.release(leases[0]);
+        pool.release(leases[2]);
+        CHECK(pool.loads(0) == (Loads{1, 2}));
+        Hw_queue_lease l;
+        CHECK(pool.acquire(0, &l).state->id == 0 && l.slot == 0);
+        CHECK(pool.loads(0) == (Loads{2, 2}));
+
+        // Releasing a stream that had no queue of the pool does nothing
+        pool.release(Hw_queue_lease{});
+        CHECK(pool.loads(0) == (Loads{2, 2}) && pool.loads(7).empty());
+    }
+
+    // Round robin, and trimming queues no stream uses
+    {
+        Fake_factory f;
+        Hw_queue_pool<Fake_queue> pool;
+        pool.reset(f.make(), 3, Hw_queue_assignment::round_robin);
+
+        std::vector<Hw_queue_lease> leases(7);
+        for (auto&& x : leases) pool.acquire(0, &x);
+        for (int i = 0; i != 7; ++i) CHECK(leases[i].slot == i % 3u);
+        CHECK(f.created == 3 && pool.loads(0) == (Loads{3, 2, 2}));
+
+        pool.release(leases[1]);
+        pool.release(leases[4]);
+        CHECK(pool.loads(0) == (Loads{3, 0, 2}));
+        pool.trim();
+        CHECK(pool.queue_count() == 2 && f.live == 2);
+
+        // The next stream on the trimmed slot gets a new queue
+        Hw_queue_lease l;
+        pool.acquire(0, &l);
+        CHECK(l.slot == 1 && f.created == 4 && pool.queue_count() == 3);
+        CHECK(pool.loads(0) == (Loads{3, 1, 2}));
+
+        for (int i : {0, 2, 3, 5, 6}) pool.release(leases[i]);
+        pool.trim();
+        CHECK(pool.loads(0) == (Loads{0, 1, 0}) && pool.queue_count() == 1 && f.live == 1);
+    }
+
+    // Streams created and destroyed from many threads never need more
+    // queues than the pool holds, and leave none in use
+    {
+        Fake_factory f;
+        Hw_queue_pool<Fake_queue> pool;
+        pool.reset(f.make(), 4, Hw_queue_assignment::least_loaded);
+
+        constexpr int threads = 8, streams = 2000;
+        std::vector<std::thread> ts;
+        for (int t = 0; t != threads; ++t) {
+            ts.emplace_back([&, t]() {
+                std::vector<Hw_queue_lease> held(4);
+                for (int i = 0; i != streams; ++i) {
+                    auto& x = held[i % held.size()];
+                    pool.release(x);
+                    const int priority = (t + i) % 3 - 1;
+                    const Fake_queue q = pool.acquire(priority, &x);
+                    CHECK(q.state->priority == priority);
+                }
+                for (auto&& x : held) pool.release(x);
+            });
+        }
+        for (auto&& t : ts) t.join();
+
+        CHECK(f.created <= 3 * 4 && pool.queue_count() == std::size_t(f.created));
+        for (int p = -1; p <= 1; ++p) CHECK(pool.loads(p) == (Loads{0, 0, 0, 0}));
+        pool.trim();
+        CHECK(pool.queue_count() == 0 && f.live == 0);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
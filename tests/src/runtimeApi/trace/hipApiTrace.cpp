@@ -0,0 +1,260 @@
+/*
+Copyright (c) 2020 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+/* HIT_START
+ * BUILD_CMD: hipApiTrace %cxx -std=c++11 -I%S/../../../../src %S/%s -o %T/%t -pthread EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+// Exercises the binary API trace written with HIP_TRACE_FILE: the per-thread
+// rings, the flusher and the Chrome trace converter.
+
+#include "api_trace.inl"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../host_test_common.h"
+
+using namespace hip_impl;
+
+namespace {
+enum Kind { kind_a = 7 };
+struct Dim { unsigned x, y, z; };
+
+std::vector<char> read_all(std::FILE* f) {
+    std::vector<char> r;
+    std::rewind(f);
+    char buf[4096];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) != 0;) r.insert(r.end(), buf, buf + n);
+    return r;
+}
+
+struct Parsed {
+    std::map<uint32_t, std::string> names;
+    std::vector<Api_trace_record> records;
+    uint64_t lost = 0;
+};
+
+Parsed parse(const std::vector<char>& d) {
+    Parsed r;
+    Api_trace_file_header h;
+    CHECK(d.size() >= sizeof(h));
+    std::memcpy(&h, d.data(), sizeof(h));
+    CHECK(std::memcmp(h.magic, "HIPTRACE", 8) == 0);
+    CHECK(h.record_size == sizeof(Api_trace_record));
+    for (size_t dx = sizeof(h); dx < d.size();) {
+        Api_trace_chunk c;
+        std::memcpy(&c, &d[dx], sizeof(c));
+        dx += sizeof(c);
+        CHECK(d.size() - dx >= c.size);
+        const char* p = &d[dx];
+        if (c.kind == api_trace::chunk_names) {
+            uint32_t id;
+            std::memcpy(&id, p, sizeof(id));
+            for (size_t i = sizeof(id); i < c.size; ++id) {
+                r.names[id] = p + i;
+                i += std::strlen(p + i) + 1;
+            }
+        } else if (c.kind == api_trace::chunk_records) {
+            CHECK(c.size % sizeof(Api_trace_record) == 0);
+            for (size_t i = 0; i < c.size; i += sizeof(Api_trace_record)) {
+                Api_trace_record x;
+                std::memcpy(&x, p + i, sizeof(x));
+                r.records.push_back(x);
+            }
+        } else {
+            CHECK(c.kind == api_trace::chunk_lost && c.size == 16);
+            uint64_t n;
+            std::memcpy(&n, p + 8, sizeof(n));
+            r.lost += n;
+        }
+        dx += c.size;
+    }
+    return r;
+}
+
+Api_trace_args args(uint32_t api, uint64_t seq) {
+    Api_trace_args r = make_api_trace_args(seq, api);
+    r.api = api;
+    r.seq = seq;
+    return r;
+}
+
+std::string convert(const std::vector<char>& d, bool* ok) {
+    std::FILE* f = std::tmpfile();
+    *ok = write_chrome_trace(d.data(), d.size(), f);
+    const auto out = read_all(f);
+    std::fclose(f);
+    return std::string(out.begin(), out.end());
+}
+}  // namespace
+
+int main() {
+    // Packing of arguments
+    {
+        int x = 0;
+        const Dim dim{1, 2, 3};
+        const char str[] = "abc";
+        auto a = make_api_trace_args(-1, kind_a, &x);
+        CHECK(a.args[0] == uint64_t(-1) && a.args[1] == 7 && a.args[2] == uint64_t(uintptr_t(&x)));
+        a = make_api_trace_args(dim, 1.5f, str, 4, 5);
+        double d;
+        std::memcpy(&d, &a.args[1], sizeof(d));
+        CHECK(a.args[0] == 0 && d == 1.5 && a.args[2] == uint64_t(uintptr_t(str)));
+        a = make_api_trace_args();
+        CHECK(a.args[0] == 0 && a.args[1] == 0 && a.args[2] == 0);
+        a = make_api_trace_args(nullptr, size_t(1) << 40);
+        CHECK(a.args[0] == 0 && a.args[1] == size_t(1) << 40);
+    }
+
+    // The ring wraps, and drops records when full
+    {
+        Api_trace_ring ring{8};
+        Api_trace_record r{};
+        uint64_t next = 0, seen = 0;
+        for (int round = 0; round != 5; ++round) {
+            for (int i = 0; i != 5; ++i) {
+                r.seq = next++;
+                CHECK(ring.push(r) == size_t(i + 1));
+            }
+            ring.drain([&](const Api_trace_record* p, size_t n) {
+                for (size_t i = 0; i != n; ++i) CHECK(p[i].seq == seen++);
+            });
+            CHECK(ring.empty());
+        }
+        for (int i = 0; i != 10; ++i) ring.push(r);
+        CHECK(ring.take_lost() == 2 && ring.take_lost() == 0);
+        CHECK(ring.drain([](const Api_trace_record*, size_t) {}) == 8);
+    }
+
+    // Records of many threads, some of which exit and have their rings
+    // reused, all make it to the file in order
+    {
+        std::FILE* f = std::tmpfile();
+        Api_trace_writer w{f, 1000000000, 42, 1024, std::chrono::milliseconds{1}};
+        const uint32_t malloc_id = w.name_id("hipMalloc");
+        const uint32_t free_id = w.name_id("hipFree");
+        CHECK(w.name_id("hipMalloc") == malloc_id && malloc_id != free_id);
+
+        constexpr int threads = 8, calls = 20000;
+        for (int wave = 0; wave != 2; ++wave) {
+            std::vector<std::thread> ts;
+            for (int t = 0; t != threads; ++t) {
+                ts.emplace_back([&, t, wave]() {
+                    const uint32_t tid = wave * threads + t + 1;
+                    for (int i = 1; i <= calls; ++i) {
+                        w.record(tid, args(i % 2 ? malloc_id : free_id, i), i * 10, i * 10 + 5,
+                                 i % 3);
+                        // Stay within what the flusher drains
+                        if (i % 512 == 0) std::this_thread::sleep_for(std::chrono::milliseconds{2});
+                    }
+                });
+            }
+            for (auto&& t : ts) t.join();
+        }
+        const uint32_t late_id = w.name_id("hipDeviceSynchronize");
+        w.record(1000, args(late_id, 1), 1, 2, 0);
+        w.close();
+        w.record(1000, args(late_id, 2), 1, 2, 0);  // dropped after close
+
+        const Parsed p = parse(read_all(f));
+        std::fclose(f);
+        CHECK(p.names.at(malloc_id) == "hipMalloc" && p.names.at(free_id) == "hipFree");
+        CHECK(p.names.at(late_id) == "hipDeviceSynchronize");
+
+        std::map<uint32_t, uint64_t> last;
+        for (auto&& r : p.records) {
+            CHECK(r.seq > last[r.tid]);
+            CHECK(p.lost != 0 || r.seq == last[r.tid] + 1);
+            last[r.tid] = r.seq;
+            if (r.tid == 1000) continue;
+            CHECK(r.api == (r.seq % 2 ? malloc_id : free_id));
+            CHECK(r.begin == r.seq * 10 && r.end == r.begin + 5 && r.status == int(r.seq % 3));
+            CHECK(r.args[0] == r.seq && r.args[1] == r.api && r.args[2] == 0);
+        }
+        CHECK(p.records.size() + p.lost == 2 * threads * calls + 1);
+        CHECK(last.size() == 2 * threads + 1);
+        CHECK(w.lost() == p.lost);
+        printf("%zu records, %llu lost\n", p.records.size(), (unsigned long long)p.lost);
+    }
+
+    // A full ring drops records rather than block, and says how many
+    {
+        std::FILE* f = std::tmpfile();
+        Api_trace_writer w{f, 1000000000, 42, 16, std::chrono::milliseconds{0}};
+        const uint32_t id = w.name_id("hipLaunchKernel");
+        for (int i = 1; i <= 100; ++i) w.record(1, args(id, i), i, i + 1, 0);
+        w.flush();
+        for (int i = 101; i <= 110; ++i) w.record(1, args(id, i), i, i + 1, 0);
+        w.close();
+        const Parsed p = parse(read_all(f));
+        std::fclose(f);
+        CHECK(p.lost == 84 && p.records.size() == 26);
+        CHECK(p.records[15].seq == 16 && p.records[16].seq == 101);
+        CHECK(w.lost() == p.lost);
+    }
+
+    // Conversion to Chrome trace JSON
+    {
+        std::FILE* f = std::tmpfile();
+        Api_trace_writer w{f, 2000000000, 42, 16, std::chrono::milliseconds{0}};
+        const uint32_t id = w.name_id("hipMemcpy");
+        Api_trace_args a = make_api_trace_args(0x1000, 0x2000, 4096);
+        a.api = id;
+        a.seq = 3;
+        w.record(5, a, 3000000000003ull, 3000000002003ull, 1);
+        for (int i = 0; i != 20; ++i) w.record(6, args(id, i + 1), 2, 4, 0);
+        w.close();
+        auto d = read_all(f);
+        std::fclose(f);
+
+        bool ok = false;
+        std::string json = convert(d, &ok);
+        CHECK(ok);
+        CHECK(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+        CHECK(json.find("{\"name\":\"hipMemcpy\",\"cat\":\"hip_api\",\"ph\":\"X\",\"pid\":42,"
+                        "\"tid\":5,\"ts\":1500000000.001,\"dur\":1.000,\"args\":{\"seq\":3,"
+                        "\"status\":1,\"args\":[\"0x1000\",\"0x2000\",\"0x1000\"]}}") !=
+              std::string::npos);
+        CHECK(json.find("{\"name\":\"5 records lost\",\"cat\":\"hip_api\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"pid\":42,\"tid\":5,\"ts\":1500000001.001}") != std::string::npos);
+        CHECK(json.find("\n]}\n") == json.size() - 4);
+
+        // A trace cut short converts up to the last complete chunk
+        d.resize(d.size() - 10);
+        json = convert(d, &ok);
+        CHECK(ok && json.find("\"tid\":5") != std::string::npos);
+
+        d[0] = 'X';
+        convert(d, &ok);
+        CHECK(!ok);
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
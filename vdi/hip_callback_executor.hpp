@@ -0,0 +1,377 @@
+/* Copyright (c) 2020-present Advanced Micro Devices, Inc.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+#ifndef HIP_CALLBACK_EXECUTOR_H
+#define HIP_CALLBACK_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace hip {
+
+/// Runs stream callbacks on a pool of worker threads, so that the thread that
+/// processes command completions only has to queue them. Callbacks of the same
+/// stream run one at a time, in the order they were queued; callbacks of
+/// different streams run concurrently.
+///
+/// Callbacks are queued on a bounded lock-free ring, which a dispatcher thread
+/// drains into per-stream queues and hands to the workers. Only the
+/// dispatcher touches the per-stream state, and workers report a finished
+/// callback through the same ring, so a queued callback never waits on a
+/// per-stream lock; a producer spins if the ring is full, and takes a lock
+/// only to wake the dispatcher when it sleeps. Records are recycled through a
+/// free list that is guarded by a lock of its own.
+///
+/// Task is copyable and provides void run().
+template <typename Task>
+class CallbackExecutor {
+  struct Fence;
+
+ public:
+  /// A callback taken from the free list by prepare(), which travels with it
+  /// until it has run
+  struct Record {
+    enum Kind { Run, Done, Wait };
+    Kind kind_ = Run;
+    const void* stream_ = nullptr;
+    Task task_;
+    Fence* fence_ = nullptr;
+  };
+
+ private:
+  /// Waited for by wait() and waitAll() until the callbacks queued before it
+  /// on one or more streams have run
+  struct Fence {
+    std::mutex lock_;
+    std::condition_variable cv_;
+    size_t remaining_ = 0;
+
+    void signal() {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (--remaining_ == 0) {
+        cv_.notify_all();
+      }
+    }
+  };
+
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    Record* record_;
+  };
+
+  /// Bounded ring, after Vyukov's MPMC queue, with a single consumer
+  std::unique_ptr<Cell[]> ring_;
+  const size_t mask_;
+  alignas(64) std::atomic<size_t> enqueuePos_{0};
+  alignas(64) size_t dequeuePos_ = 0;
+
+  /// Set by the dispatcher before it sleeps on an empty ring
+  std::atomic<bool> sleeping_{false};
+  std::mutex sleepLock_;
+  std::condition_variable sleepCv_;
+
+  /// Callbacks ready to run, handed from the dispatcher to the workers
+  std::mutex readyLock_;
+  std::condition_variable readyCv_;
+  std::deque<Record*> ready_;
+
+  std::mutex freeLock_;
+  std::vector<Record*> free_;
+  std::vector<std::unique_ptr<Record>> records_;
+
+  /// Per-stream queues, owned by the dispatcher. The front of a queue is the
+  /// callback that is running, if any.
+  std::unordered_map<const void*, std::deque<Record*>> streams_;
+
+  std::atomic<bool> stopping_{false};
+  std::thread dispatcher_;
+  std::vector<std::thread> workers_;
+
+  Record* acquire() {
+    std::lock_guard<std::mutex> lock(freeLock_);
+    if (free_.empty()) {
+      records_.emplace_back(new Record);
+      return records_.back().get();
+    }
+    Record* record = free_.back();
+    free_.pop_back();
+    return record;
+  }
+
+  void release(Record* record) {
+    std::lock_guard<std::mutex> lock(freeLock_);
+    free_.push_back(record);
+  }
+
+  void enqueue(Record* record) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = ring_[pos & mask_];
+      const size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+      if (sequence == pos) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.record_ = record;
+          cell.sequence_.store(pos + 1, std::memory_order_release);
+          break;
+        }
+      } else if (sequence < pos) {
+        // Full: wait for the dispatcher to make room
+        std::this_thread::yield();
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(sleepLock_);
+      sleepCv_.notify_one();
+    }
+  }
+
+  Record* dequeue() {
+    Cell& cell = ring_[dequeuePos_ & mask_];
+    if (cell.sequence_.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+      return nullptr;
+    }
+    Record* record = cell.record_;
+    cell.sequence_.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+    ++dequeuePos_;
+    return record;
+  }
+
+  void dispatch(Record* record) {
+    {
+      std::lock_guard<std::mutex> lock(readyLock_);
+      ready_.push_back(record);
+    }
+    readyCv_.notify_one();
+  }
+
+  /// Retires the fences at the front of \p queue and starts the callback
+  /// behind them, if any
+  void advance(std::deque<Record*>& queue) {
+    while (!queue.empty() && queue.front()->kind_ == Record::Wait) {
+      queue.front()->fence_->signal();
+      release(queue.front());
+      queue.pop_front();
+    }
+    if (!queue.empty()) {
+      dispatch(queue.front());
+    }
+  }
+
+  void process(Record* record) {
+    switch (record->kind_) {
+      case Record::Run: {
+        std::deque<Record*>& queue = streams_[record->stream_];
+        queue.push_back(record);
+        if (queue.size() == 1) {
+          dispatch(record);
+        }
+        break;
+      }
+      case Record::Done: {
+        auto it = streams_.find(record->stream_);
+        it->second.pop_front();
+        release(record);
+        advance(it->second);
+        if (it->second.empty()) {
+          streams_.erase(it);
+        }
+        break;
+      }
+      case Record::Wait: {
+        if (record->stream_ == nullptr) {
+          // Behind every stream that has pending callbacks
+          Fence* fence = record->fence_;
+          release(record);
+          for (auto& it : streams_) {
+            Record* wait = acquire();
+            wait->kind_ = Record::Wait;
+            wait->stream_ = it.first;
+            wait->fence_ = fence;
+            {
+              std::lock_guard<std::mutex> lock(fence->lock_);
+              ++fence->remaining_;
+            }
+            it.second.push_back(wait);
+          }
+          fence->signal();
+          break;
+        }
+        auto it = streams_.find(record->stream_);
+        if (it == streams_.end()) {
+          record->fence_->signal();
+          release(record);
+        } else {
+          it->second.push_back(record);
+        }
+        break;
+      }
+    }
+  }
+
+  void dispatcherLoop() {
+    for (;;) {
+      Record* record = dequeue();
+      if (record == nullptr) {
+        std::unique_lock<std::mutex> lock(sleepLock_);
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        record = dequeue();
+        if (record == nullptr) {
+          if (stopping_ && streams_.empty()) {
+            return;
+          }
+          sleepCv_.wait(lock);
+        }
+        sleeping_.store(false, std::memory_order_relaxed);
+        if (record == nullptr) {
+          continue;
+        }
+      }
+      process(record);
+    }
+  }
+
+  void workerLoop() {
+    for (;;) {
+      Record* record;
+      {
+        std::unique_lock<std::mutex> lock(readyLock_);
+        readyCv_.wait(lock, [this]() { return stopping_ || !ready_.empty(); });
+        if (ready_.empty()) {
+          return;
+        }
+        record = ready_.front();
+        ready_.pop_front();
+      }
+      record->task_.run();
+      record->kind_ = Record::Done;
+      enqueue(record);
+    }
+  }
+
+  /// Queues a fence for \p stream, or for every stream if nullptr, and waits
+  /// for it
+  void fence(const void* stream) {
+    Fence fence;
+    fence.remaining_ = 1;
+    Record* record = acquire();
+    record->kind_ = Record::Wait;
+    record->stream_ = stream;
+    record->fence_ = &fence;
+    enqueue(record);
+
+    std::unique_lock<std::mutex> lock(fence.lock_);
+    fence.cv_.wait(lock, [&fence]() { return fence.remaining_ == 0; });
+  }
+
+ public:
+  /// \p capacity is rounded up to a power of two
+  explicit CallbackExecutor(size_t workers, size_t capacity = 1024)
+      : mask_([capacity]() {
+          size_t size = 2;
+          while (size < capacity) {
+            size <<= 1;
+          }
+          return size - 1;
+        }()) {
+    ring_.reset(new Cell[mask_ + 1]);
+    for (size_t i = 0; i <= mask_; ++i) {
+      ring_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+    dispatcher_ = std::thread(&CallbackExecutor::dispatcherLoop, this);
+    for (size_t i = 0; i < (workers == 0 ? 1 : workers); ++i) {
+      workers_.emplace_back(&CallbackExecutor::workerLoop, this);
+    }
+  }
+
+  CallbackExecutor(const CallbackExecutor&) = delete;
+  CallbackExecutor& operator=(const CallbackExecutor&) = delete;
+
+  /// Runs every queued callback before returning
+  ~CallbackExecutor() {
+    waitAll();
+    {
+      std::lock_guard<std::mutex> lock(sleepLock_);
+      stopping_ = true;
+      sleepCv_.notify_one();
+    }
+    dispatcher_.join();
+    {
+      std::lock_guard<std::mutex> lock(readyLock_);
+      readyCv_.notify_all();
+    }
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  /// Takes a record for \p task on \p stream, which must not be nullptr,
+  /// from the free list, to be passed to submit() or discard() later; takes
+  /// the free list lock
+  Record* prepare(const void* stream, const Task& task) {
+    Record* record = acquire();
+    record->kind_ = Record::Run;
+    record->stream_ = stream;
+    record->task_ = task;
+    return record;
+  }
+
+  /// Queues a prepared callback; takes a lock only to wake a sleeping
+  /// dispatcher
+  void submit(Record* record) { enqueue(record); }
+
+  /// Returns a prepared callback that will not be submitted to the free list;
+  /// takes the free list lock
+  void discard(Record* record) { release(record); }
+
+  void push(const void* stream, const Task& task) { submit(prepare(stream, task)); }
+
+  /// Waits until the callbacks queued on \p stream so far have run. Must not
+  /// be called from a callback.
+  void wait(const void* stream) { fence(stream); }
+
+  /// Waits until the callbacks queued on every stream so far have run. Must
+  /// not be called from a callback.
+  void waitAll() { fence(nullptr); }
+
+  /// Number of records allocated so far, which bounds the callbacks that were
+  /// ever pending at once
+  size_t records() {
+    std::lock_guard<std::mutex> lock(freeLock_);
+    return records_.size();
+  }
+
+  size_t workers() const { return workers_.size(); }
+};
+
+};
+
+#endif // HIP_CALLBACK_EXECUTOR_H
@@ -80,14 +80,22 @@ void setCurrentDevice(unsigned int index) {
 
 amd::HostQueue* getQueue(hipStream_t stream) {
  if (stream == nullptr) {
-    syncStreams();
-    return getNullStream();
+    Device* device = getCurrentDevice();
+    amd::HostQueue* queue = device->defaultStream();
+    if (queue != nullptr) {
+      device->nullStreamOrder().orderNull(*queue);
+    }
+    return queue;
   } else {
     hip::Stream* s = reinterpret_cast<hip::Stream*>(stream);
+    amd::HostQueue* queue = s->asHostQueue();
     if ((s->flags & hipStreamNonBlocking) == 0) {
-      getNullStream()->finish();
+      amd::HostQueue* nullQueue = s->device->defaultStream();
+      if (nullQueue != nullptr) {
+        s->device->nullStreamOrder().orderBlocking(*nullQueue, *queue);
+      }
     }
-    return s->asHostQueue();
+    return queue;
   }
 }
 
@@ -441,6 +441,8 @@ hipError_t hipDeviceSynchronize ( void ) {
   }
 
   queue->finish();
+  hip::waitCallbacks(nullptr);
+  hip::getCurrentDevice()->memPool().releaseAboveThreshold();
   HIP_RETURN(hipSuccess);
 }
 
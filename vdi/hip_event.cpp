@@ -24,6 +24,44 @@
 
 namespace hip {
 
+/// Destroyed events a device keeps for reuse
+static const size_t MaxFreeEvents = 1024;
+
+Event* Device::acquireEvent(unsigned int flags) {
+  {
+    amd::ScopedLock lock(lock_);
+    if (!freeEvents_.empty()) {
+      Event* event = freeEvents_.back();
+      freeEvents_.pop_back();
+      event->flags = flags;
+      return event;
+    }
+  }
+  return new Event(this, flags);
+}
+
+void Device::releaseEvent(Event* event) {
+  event->reset(0);
+  {
+    amd::ScopedLock lock(lock_);
+    if (freeEvents_.size() < MaxFreeEvents) {
+      freeEvents_.push_back(event);
+      return;
+    }
+  }
+  delete event;
+}
+
+void Event::reset(unsigned int newFlags) {
+  amd::ScopedLock lock(lock_);
+
+  if (event_ != nullptr) {
+    event_->release();
+    event_ = nullptr;
+  }
+  flags = newFlags;
+}
+
 bool Event::ready() {
   if (event_->status() != CL_COMPLETE) {
     event_->notifyCmdQueue();
@@ -95,16 +133,21 @@ hipError_t Event::elapsedTime(Event& eStop, float& ms) {
 }
 
 hipError_t Event::streamWait(amd::HostQueue* hostQueue, uint flags) {
-  if ((event_ == nullptr) || (event_->command().queue() == hostQueue)) {
+  amd::ScopedLock lock(lock_);
+
+  // Nothing to wait for if the event was recorded on this queue or has
+  // already completed
+  if ((event_ == nullptr) || (event_->command().queue() == hostQueue) ||
+      (event_->status() == CL_COMPLETE)) {
     return hipSuccess;
   }
 
-  amd::ScopedLock lock(lock_);
-  bool retain = false;
-
   if (!event_->notifyCmdQueue()) {
     return hipErrorLaunchOutOfResources;
   }
+
+  // amd::Marker takes its wait list as a vector and copies it, so waiting
+  // still allocates; only an event that has completed avoids the marker
   amd::Command::EventWaitList eventWaitList;
   eventWaitList.push_back(event_);
 
@@ -121,7 +164,10 @@ hipError_t Event::streamWait(amd::HostQueue* hostQueue, uint flags) {
 void Event::addMarker(amd::HostQueue* queue, amd::Command* command) {
   amd::ScopedLock lock(lock_);
 
-  if (event_ == &command->event()) return;
+  if (event_ == &command->event()) {
+    command->release();
+    return;
+  }
 
   if (event_ != nullptr) {
     event_->release();
@@ -146,7 +192,7 @@ hipError_t ihipEventCreateWithFlags(hipEvent_t* event, unsigned flags) {
       (flags & releaseFlags) == releaseFlags;  // can't set both release flags
 
   if (!illegalFlags) {
-    hip::Event* e = new hip::Event(flags);
+    hip::Event* e = hip::getCurrentDevice()->acquireEvent(flags);
 
     if (e == nullptr) {
       return hipErrorOutOfMemory;
@@ -188,7 +234,8 @@ hipError_t hipEventDestroy(hipEvent_t event) {
     HIP_RETURN(hipErrorInvalidHandle);
   }
 
-  delete reinterpret_cast<hip::Event*>(event);
+  hip::Event* e = reinterpret_cast<hip::Event*>(event);
+  e->device()->releaseEvent(e);
 
   HIP_RETURN(hipSuccess);
 }
@@ -222,8 +269,19 @@ hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream) {
   hip::Stream* s = reinterpret_cast<hip::Stream*>(stream);
   amd::HostQueue* queue = hip::getQueue(stream);
 
-  amd::Command* command = (s != nullptr && (s->flags & hipStreamNonBlocking)) ?
-    queue->getLastQueuedCommand(true) : nullptr;
+  // Share the last command of the queue instead of queuing a new marker when
+  // the event is not timed. A timed event only shares a marker, e.g. from an
+  // earlier record or wait, or the last command of a non-blocking stream, and
+  // only while it has not completed; the timestamps of a completed command
+  // predate this record
+  amd::Command* command = queue->getLastQueuedCommand(true);
+  if ((command != nullptr) && !(e->flags & hipEventDisableTiming) &&
+      (((command->type() != CL_COMMAND_MARKER) &&
+        !(s != nullptr && (s->flags & hipStreamNonBlocking))) ||
+       (command->status() == CL_COMPLETE))) {
+    command->release();
+    command = nullptr;
+  }
 
   if (command == nullptr) {
     command = new amd::Marker(*queue, false);
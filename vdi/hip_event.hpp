@@ -37,7 +37,8 @@ public:
 
 class Event {
 public:
-  Event(unsigned int flags) : flags(flags), lock_("hipEvent_t"), event_(nullptr) {
+  Event(Device* device, unsigned int flags)
+    : flags(flags), lock_("hipEvent_t"), device_(device), event_(nullptr) {
     // No need to init event_ here as addMarker does that
   }
 
@@ -48,6 +49,10 @@ public:
   }
   unsigned int flags;
 
+  Device* device() const { return device_; }
+  /// Drops the recorded marker so the event can be handed out again by the pool
+  void reset(unsigned int newFlags);
+
   hipError_t query();
   hipError_t synchronize();
   hipError_t elapsedTime(Event& stop, float& ms);
@@ -57,7 +62,7 @@ public:
 
 private:
   amd::Monitor lock_;
-  amd::HostQueue* stream_;
+  Device* device_;
   amd::Event* event_;
 
   bool ready();
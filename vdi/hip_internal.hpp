@@ -26,6 +26,11 @@
 #include "trace_helper.h"
 #include "utils/debug.hpp"
 #include "hip_formatting.hpp"
+#include "hip_stream_order.hpp"
+#include "src/hip_mem_pool.hpp"
+#include "src/occupancy.inl"
+#include "src/launch_stats.inl"
+#include <atomic>
 #include <unordered_set>
 #include <thread>
 #include <stack>
@@ -58,8 +63,10 @@ typedef struct ihipIpcMemHandle_st {
   }
 
 // This macro should be called at the beginning of every HIP API.
+// ClPrint only evaluates its arguments when it prints the line, so the arguments are
+// captured and formatted on that path alone.
 #define HIP_INIT_API(cid, ...)                               \
-  ClPrint(amd::LOG_INFO, amd::LOG_API, "%-5d: [%zx] %s ( %s )", getpid(), std::this_thread::get_id(), __func__, ToString( __VA_ARGS__ ).c_str()); \
+  ClPrint(amd::LOG_INFO, amd::LOG_API, "%-5d: [%zx] %s ( %s )", getpid(), std::this_thread::get_id(), __func__, hip::ApiArgRecord{__VA_ARGS__}.toString().c_str()); \
   amd::Thread* thread = amd::Thread::current();              \
   if (!VDI_CHECK_THREAD(thread)) {                           \
     HIP_RETURN(hipErrorOutOfMemory);                         \
@@ -79,6 +86,42 @@ class accelerator_view;
 
 namespace hip {
 
+  /// VDI queue operations the null stream ordering is built on
+  struct HostQueueOps {
+    typedef amd::HostQueue Queue;
+    typedef amd::Command Command;
+
+    static Command* lastCommand(Queue& queue) { return queue.getLastQueuedCommand(true); }
+    static bool completed(Command& command) { return command.status() == CL_COMPLETE; }
+    static void release(Command& command) { command.release(); }
+    /// Enqueues a marker on queue that waits for the given commands
+    static void wait(Queue& queue, const std::vector<Command*>& commands);
+  };
+
+  /// VDI device memory operations the hipMalloc cache is built on. Streams are
+  /// identified by their amd::HostQueue.
+  struct DeviceMemoryOps {
+    /// Last commands of the queues that may still use freed memory (retained)
+    typedef std::vector<amd::Command*> Fence;
+
+    amd::Context* context_;
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+    void fence(Fence& fence, const void* stream);
+    void copy(Fence& to, const Fence& from);
+    bool completed(Fence& fence);
+    void wait(Fence& fence);
+    void streamWait(const void* stream, Fence& fence);
+    void release(Fence& fence);
+  };
+
+  class Event;
+
+  /// Occupancy limits of \p device; the VGPRs per SIMD and the wavefront size
+  /// are reported per kernel
+  hip_impl::Occupancy_limits occupancyLimits(const amd::Device& device);
+
   /// HIP Device class
   class Device {
     amd::Monitor lock_{"Device lock"};
@@ -91,8 +134,19 @@ namespace hip {
     int deviceId_;
     //Maintain list of user enabled peers
     std::list<int> userEnabledPeers;
+    /// Orders blocking streams against the default stream
+    NullStreamOrder<HostQueueOps> nullStreamOrder_;
+    /// Destroyed events kept for reuse by hipEventCreate, guarded by lock_
+    std::vector<Event*> freeEvents_;
+    /// Caches the device memory of hipMalloc and hipMallocAsync
+    MemoryPool<DeviceMemoryOps> memPool_;
+    /// Memoizes the occupancy of kernels on the device
+    hip_impl::Occupancy_calculator occupancy_;
   public:
-    Device(amd::Context* ctx, int devId): context_(ctx), deviceId_(devId) { assert(ctx != nullptr); }
+    Device(amd::Context* ctx, int devId): context_(ctx), deviceId_(devId),
+      memPool_(DeviceMemoryOps{ctx}), occupancy_(occupancyLimits(*ctx->devices()[0])) {
+      assert(ctx != nullptr);
+    }
     ~Device() {}
 
     amd::Context* asContext() const { return context_; }
@@ -120,6 +174,13 @@ namespace hip {
       }
     }
     amd::HostQueue* defaultStream();
+    NullStreamOrder<HostQueueOps>& nullStreamOrder() { return nullStreamOrder_; }
+    MemoryPool<DeviceMemoryOps>& memPool() { return memPool_; }
+    hip_impl::Occupancy_calculator& occupancy() { return occupancy_; }
+    /// Takes an event from the device's pool, or creates one
+    Event* acquireEvent(unsigned int flags);
+    /// Returns a destroyed event to the pool, or deletes it if the pool is full
+    void releaseEvent(Event* event);
   };
 
   extern std::once_flag g_ihipInitialized;
@@ -135,8 +196,8 @@ namespace hip {
   extern void setCurrentDevice(unsigned int index);
 
   /// Get VDI queue associated with hipStream
-  /// Note: This follows the CUDA spec to sync with default streams
-  ///       and Blocking streams
+  /// Note: This follows the CUDA spec to order work against the default
+  ///       stream and Blocking streams, with markers rather than host waits
   extern amd::HostQueue* getQueue(hipStream_t s);
   /// Get default stream associated with the VDI context
   extern amd::HostQueue* getNullStream(amd::Context&);
@@ -146,11 +207,16 @@ namespace hip {
   extern void syncStreams();
   /// Sync blocking streams on the given device
   extern void syncStreams(int devId);
+  /// Wait for the stream callbacks queued so far on queue, or on every queue
+  /// if nullptr, to run
+  extern void waitCallbacks(amd::HostQueue* queue);
 
 
   struct Function {
     amd::Kernel* function_;
     amd::Monitor lock_;
+    /// Launch statistics of the kernel, with HIP_KERNEL_STATS
+    hip_impl::Launch_stats_ref launchStats_;
 
     Function(amd::Kernel* f) : function_(f), lock_("function lock") {}
     hipFunction_t asHipFunction() { return reinterpret_cast<hipFunction_t>(this); }
@@ -160,7 +226,6 @@ namespace hip {
 
   struct Stream {
     amd::HostQueue* queue;
-    amd::Monitor lock;
     Device* device;
     amd::CommandQueue::Priority priority;
     unsigned int flags;
@@ -187,8 +252,12 @@ class PlatformState {
 
   std::unordered_map<const void*, std::vector<std::pair<hipModule_t, bool>>> modules_;
   bool initialized_{false};
+  // Bumped whenever resolved functions may be destroyed; invalidates the per-thread
+  // caches that getFunc() consults before taking lock_.
+  std::atomic<uint64_t> funcGeneration_{0};
 
   void digestFatBinary(const void* data, std::vector<std::pair<hipModule_t, bool>>& programs);
+  hipFunction_t resolveFunc(const void* hostFunction, int deviceId);
 public:
   void init();
   std::vector<std::pair<hipModule_t, bool>>* addFatBinary(const void*data)
@@ -200,6 +269,7 @@ public:
   }
   void removeFatBinary(std::vector<std::pair<hipModule_t, bool>>* module)
   {
+    funcGeneration_.fetch_add(1, std::memory_order_release);
     for (auto& mod : modules_) {
       if (&mod.second == module) {
         modules_.erase(&mod);
@@ -19,33 +19,141 @@
  THE SOFTWARE. */
 
 #include <hip/hip_runtime.h>
+#include <hip/hip_ext.h>
 #include "hip_internal.hpp"
 #include "hip_conversions.hpp"
+#include "hip_range_index.hpp"
 #include "platform/context.hpp"
 #include "platform/command.hpp"
 #include "platform/memory.hpp"
 
+#include <cstdlib>
+#include <limits>
+
+/// Caches the lookups of amd::MemObjMap, which takes a global lock, so that
+/// concurrent copies look their pointers up without one. Ranges are removed
+/// wherever HIP frees memory, after amd::MemObjMap has dropped them and
+/// before the memory object is released.
+static hip::RangeIndex<amd::Memory*>& memObjIndex() {
+  static hip::RangeIndex<amd::Memory*>* index = new hip::RangeIndex<amd::Memory*>();
+  return *index;
+}
+
+/// amd::SvmBuffer::free drops the memory object from amd::MemObjMap and
+/// releases it in one call, so its range leaves the index first, and is not
+/// added back by a lookup, before the address can be reused
+static void svmFree(amd::Context& context, void* ptr) {
+  memObjIndex().beginRemove(ptr);
+  amd::SvmBuffer::free(context, ptr);
+  memObjIndex().endRemove();
+}
+
 amd::Memory* getMemoryObject(const void* ptr, size_t& offset) {
-  amd::Memory *memObj = amd::MemObjMap::FindMemObj(ptr);
+  amd::Memory* memObj = nullptr;
+  const void* base = nullptr;
+  if (memObjIndex().find(ptr, memObj, &base)) {
+    offset = reinterpret_cast<size_t>(ptr) - reinterpret_cast<size_t>(base);
+    return memObj;
+  }
+
+  const uint64_t version = memObjIndex().version();
+  memObj = amd::MemObjMap::FindMemObj(ptr);
   if (memObj != nullptr) {
     if (memObj->getSvmPtr() != nullptr) {
       // SVM pointer
-      offset = reinterpret_cast<size_t>(ptr) - reinterpret_cast<size_t>(memObj->getSvmPtr());
+      base = memObj->getSvmPtr();
     } else if (memObj->getHostMem() != nullptr) {
       // Prepinned memory
-      offset = reinterpret_cast<size_t>(ptr) - reinterpret_cast<size_t>(memObj->getHostMem());
+      base = memObj->getHostMem();
     } else {
       ShouldNotReachHere();
     }
+    offset = reinterpret_cast<size_t>(ptr) - reinterpret_cast<size_t>(base);
+    // Device addresses of registered host memory are not cached, as the
+    // object's range is the host one
+    if (offset < memObj->getSize()) {
+      memObjIndex().insertIfUnchanged(version, base, memObj->getSize(), memObj);
+    }
   }
   return memObj;
 }
 
+namespace hip {
+
+void* DeviceMemoryOps::allocate(size_t size) {
+  if (context_->devices()[0]->info().maxMemAllocSize_ < size) {
+    return nullptr;
+  }
+  return amd::SvmBuffer::malloc(*context_, 0, size, context_->devices()[0]->info().memBaseAddrAlign_);
+}
+
+void DeviceMemoryOps::deallocate(void* ptr) {
+  svmFree(*context_, ptr);
+}
+
+void DeviceMemoryOps::copy(Fence& to, const Fence& from) {
+  for (auto command : from) {
+    command->retain();
+    to.push_back(command);
+  }
+}
+
+bool DeviceMemoryOps::completed(Fence& fence) {
+  for (auto command : fence) {
+    if (command->status() != CL_COMPLETE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void DeviceMemoryOps::wait(Fence& fence) {
+  for (auto command : fence) {
+    command->awaitCompletion();
+  }
+}
+
+void DeviceMemoryOps::release(Fence& fence) {
+  for (auto command : fence) {
+    command->release();
+  }
+  fence.clear();
+}
+
+};
+
+/// hipMalloc sub-allocates device memory from a per-device cache unless
+/// HIP_MALLOC_CACHE is 0
+static bool useMallocCache() {
+  static const bool enabled = []() {
+    const char* value = std::getenv("HIP_MALLOC_CACHE");
+    return (value == nullptr) || (std::atoi(value) != 0);
+  }();
+  return enabled;
+}
+
+/// Finds the hipMalloc allocation that contains \p ptr in the device caches
+static bool findCachedAllocation(const void* ptr, void** base, size_t* size) {
+  for (auto& dev : g_devices) {
+    if (dev->memPool().find(ptr, base, size)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 hipError_t ihipFree(void *ptr)
 {
   if (ptr == nullptr) {
     return hipSuccess;
   }
+  // Cached memory is reused once the work queued so far has completed, so
+  // the devices need not be synchronized
+  for (auto& dev : g_devices) {
+    if (dev->memPool().free(ptr)) {
+      return hipSuccess;
+    }
+  }
   if (amd::SvmBuffer::malloced(ptr)) {
     for (auto& dev : g_devices) {
       amd::HostQueue* queue = hip::getNullStream(*dev->asContext());
@@ -54,7 +162,7 @@ hipError_t ihipFree(void *ptr)
       }
       hip::syncStreams(dev->deviceId());
     }
-    amd::SvmBuffer::free(*hip::getCurrentDevice()->asContext(), ptr);
+    svmFree(*hip::getCurrentDevice()->asContext(), ptr);
     return hipSuccess;
   }
   return hipErrorInvalidValue;
@@ -81,7 +189,13 @@ hipError_t ihipMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
     return hipErrorOutOfMemory;
   }
 
-  *ptr = amd::SvmBuffer::malloc(*amdContext, flags, sizeBytes, amdContext->devices()[0]->info().memBaseAddrAlign_);
+  *ptr = nullptr;
+  if ((flags == 0) && useMallocCache()) {
+    *ptr = hip::getCurrentDevice()->memPool().allocate(sizeBytes);
+  }
+  if (*ptr == nullptr) {
+    *ptr = amd::SvmBuffer::malloc(*amdContext, flags, sizeBytes, amdContext->devices()[0]->info().memBaseAddrAlign_);
+  }
   if (*ptr == nullptr) {
     return hipErrorOutOfMemory;
   }
@@ -238,8 +352,7 @@ hipError_t hipFree(void* ptr) {
 hipError_t hipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind) {
   HIP_INIT_API(hipMemcpy, dst, src, sizeBytes, kind);
 
-  hip::syncStreams();
-  amd::HostQueue* queue = hip::getNullStream();
+  amd::HostQueue* queue = hip::getQueue(nullptr);
   HIP_RETURN(ihipMemcpy(dst, src, sizeBytes, kind, *queue));
 }
 
@@ -262,7 +375,10 @@ hipError_t hipMemPtrGetInfo(void *ptr, size_t *size) {
     HIP_RETURN(hipErrorInvalidValue);
   }
 
-  *size = svmMem->getSize();
+  void* base = nullptr;
+  if (!findCachedAllocation(ptr, &base, size)) {
+    *size = svmMem->getSize();
+  }
 
   HIP_RETURN(hipSuccess);
 }
@@ -314,8 +430,10 @@ hipError_t hipMemGetAddressRange(hipDeviceptr_t* pbase, size_t* psize, hipDevice
     HIP_RETURN(hipErrorInvalidDevicePointer);
   }
 
-  *pbase = svmMem->getSvmPtr();
-  *psize = svmMem->getSize();
+  if (!findCachedAllocation(ptr, pbase, psize)) {
+    *pbase = svmMem->getSvmPtr();
+    *psize = svmMem->getSize();
+  }
 
   HIP_RETURN(hipSuccess);
 }
@@ -686,7 +804,7 @@ hipError_t hipHostUnregister(void* hostPtr) {
   }
 
   if (amd::SvmBuffer::malloced(hostPtr)) {
-    amd::SvmBuffer::free(*hip::host_device->asContext(), hostPtr);
+    svmFree(*hip::host_device->asContext(), hostPtr);
     HIP_RETURN(hipSuccess);
   } else {
     size_t offset = 0;
@@ -698,6 +816,7 @@ hipError_t hipHostUnregister(void* hostPtr) {
         amd::MemObjMap::RemoveMemObj(reinterpret_cast<void*>(devMem->virtualAddress()));
       }
       amd::MemObjMap::RemoveMemObj(hostPtr);
+      memObjIndex().remove(reinterpret_cast<char*>(hostPtr) - offset);
       mem->release();
       HIP_RETURN(hipSuccess);
     }
@@ -1907,6 +2026,7 @@ hipError_t hipIpcCloseMemHandle(void* dev_ptr) {
 
   /* Remove the memory from MemObjMap */
   amd::MemObjMap::RemoveMemObj(amd_mem_obj);
+  memObjIndex().remove(reinterpret_cast<char*>(dev_ptr) - offset);
 
   /* detach the memory */
   device->IpcDetach(*amd_mem_obj);
@@ -1939,6 +2059,12 @@ hipError_t hipPointerGetAttributes(hipPointerAttribute_t* attributes, const void
     attributes->memoryType = (CL_MEM_SVM_FINE_GRAIN_BUFFER & memObj->getMemFlags())? hipMemoryTypeHost : hipMemoryTypeDevice;
     attributes->hostPointer = memObj->getSvmPtr();
     attributes->devicePointer = memObj->getSvmPtr();
+    void* base = nullptr;
+    size_t size = 0;
+    if (findCachedAllocation(ptr, &base, &size)) {
+      attributes->hostPointer = base;
+      attributes->devicePointer = base;
+    }
     attributes->isManaged = 0;
     attributes->allocationFlags = memObj->getMemFlags() >> 16;
 
@@ -2186,3 +2312,245 @@ hipError_t hipFreeHost(void *ptr) {
 
   HIP_RETURN(ihipFree(ptr));
 }
+
+hipError_t hipExtMallocCacheGetStats(int device, hipExtMallocCacheStats* stats) {
+  HIP_INIT_API(hipExtMallocCacheGetStats, device, stats);
+
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+  if (stats == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  const auto cache = g_devices[device]->memPool().stats();
+  stats->reservedBytes = cache.reserved_;
+  stats->allocatedBytes = cache.allocated_;
+  stats->pendingFreeBytes = cache.pending_;
+  stats->peakReservedBytes = cache.peakReserved_;
+  stats->peakAllocatedBytes = cache.peakAllocated_;
+  stats->segmentCount = cache.segments_;
+  stats->cacheHits = cache.hits_;
+  stats->cacheMisses = cache.misses_;
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtMallocCacheResetPeakStats(int device) {
+  HIP_INIT_API(hipExtMallocCacheResetPeakStats, device);
+
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  g_devices[device]->memPool().resetPeaks();
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtMallocCacheTrim(int device, size_t minBytesToKeep) {
+  HIP_INIT_API(hipExtMallocCacheTrim, device, minBytesToKeep);
+
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  g_devices[device]->memPool().trim(minBytesToKeep);
+
+  HIP_RETURN(hipSuccess);
+}
+
+/// The default memory pool of a device is its hipMalloc cache
+static hip::Device* asMemPoolDevice(hipMemPool_t memPool) {
+  for (auto& dev : g_devices) {
+    if (reinterpret_cast<hipMemPool_t>(dev) == memPool) {
+      return dev;
+    }
+  }
+  return nullptr;
+}
+
+static hipError_t ihipMallocAsync(void** ptr, size_t sizeBytes, hip::Device* device,
+                                  hipStream_t stream) {
+  if (ptr == nullptr) {
+    return hipErrorInvalidValue;
+  }
+  *ptr = nullptr;
+  if (sizeBytes == 0) {
+    return hipSuccess;
+  }
+  if (device->devices()[0]->info().maxMemAllocSize_ < sizeBytes) {
+    return hipErrorOutOfMemory;
+  }
+
+  amd::HostQueue* queue = hip::getQueue(stream);
+  if (queue == nullptr) {
+    return hipErrorInvalidValue;
+  }
+  *ptr = device->memPool().allocate(sizeBytes, queue);
+  if (*ptr == nullptr) {
+    return hipErrorOutOfMemory;
+  }
+  ClPrint(amd::LOG_INFO, amd::LOG_API, "%-5d: [%zx] ihipMallocAsync ptr=0x%zx", getpid(),
+          std::this_thread::get_id(), *ptr);
+  return hipSuccess;
+}
+
+hipError_t hipMallocAsync(void** ptr, size_t sizeBytes, hipStream_t stream) {
+  HIP_INIT_API(hipMallocAsync, ptr, sizeBytes, stream);
+
+  hip::Device* device = (stream == nullptr) ? hip::getCurrentDevice() :
+                        reinterpret_cast<hip::Stream*>(stream)->device;
+
+  HIP_RETURN(ihipMallocAsync(ptr, sizeBytes, device, stream));
+}
+
+hipError_t hipMallocFromPoolAsync(void** ptr, size_t sizeBytes, hipMemPool_t memPool,
+                                  hipStream_t stream) {
+  HIP_INIT_API(hipMallocFromPoolAsync, ptr, sizeBytes, memPool, stream);
+
+  hip::Device* device = asMemPoolDevice(memPool);
+  if (device == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  HIP_RETURN(ihipMallocAsync(ptr, sizeBytes, device, stream));
+}
+
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream) {
+  HIP_INIT_API(hipFreeAsync, ptr, stream);
+
+  if (ptr == nullptr) {
+    HIP_RETURN(hipSuccess);
+  }
+
+  amd::HostQueue* queue = hip::getQueue(stream);
+  if (queue == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  // Later work on the stream reuses the memory without waiting
+  for (auto& dev : g_devices) {
+    if (dev->memPool().free(ptr, queue)) {
+      HIP_RETURN(hipSuccess);
+    }
+  }
+
+  // Memory allocated outside the pools is freed synchronously
+  queue->finish();
+  HIP_RETURN(ihipFree(ptr));
+}
+
+hipError_t hipDeviceGetDefaultMemPool(hipMemPool_t* memPool, int device) {
+  HIP_INIT_API(hipDeviceGetDefaultMemPool, memPool, device);
+
+  if (memPool == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  *memPool = reinterpret_cast<hipMemPool_t>(g_devices[device]);
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipMemPoolSetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value) {
+  HIP_INIT_API(hipMemPoolSetAttribute, memPool, attr, value);
+
+  hip::Device* device = asMemPoolDevice(memPool);
+  if (device == nullptr || value == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  auto& pool = device->memPool();
+  switch (attr) {
+    case hipMemPoolReuseFollowEventDependencies:
+      // Streams are ordered by the pool itself, not by the application's events
+      HIP_RETURN((*static_cast<int*>(value) == 0) ? hipSuccess : hipErrorNotSupported);
+    case hipMemPoolReuseAllowOpportunistic:
+      HIP_RETURN((*static_cast<int*>(value) != 0) ? hipSuccess : hipErrorNotSupported);
+    case hipMemPoolReuseAllowInternalDependencies:
+      pool.setReuseInternalDependencies(*static_cast<int*>(value) != 0);
+      break;
+    case hipMemPoolAttrReleaseThreshold: {
+      const uint64_t threshold = *static_cast<uint64_t*>(value);
+      pool.setReleaseThreshold((threshold < std::numeric_limits<size_t>::max()) ?
+                               static_cast<size_t>(threshold) : std::numeric_limits<size_t>::max());
+      break;
+    }
+    case hipMemPoolAttrReservedMemHigh:
+      if (*static_cast<uint64_t*>(value) != 0) {
+        HIP_RETURN(hipErrorInvalidValue);
+      }
+      pool.resetPeakReserved();
+      break;
+    case hipMemPoolAttrUsedMemHigh:
+      if (*static_cast<uint64_t*>(value) != 0) {
+        HIP_RETURN(hipErrorInvalidValue);
+      }
+      pool.resetPeakAllocated();
+      break;
+    default:
+      HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipMemPoolGetAttribute(hipMemPool_t memPool, hipMemPoolAttr attr, void* value) {
+  HIP_INIT_API(hipMemPoolGetAttribute, memPool, attr, value);
+
+  hip::Device* device = asMemPoolDevice(memPool);
+  if (device == nullptr || value == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  auto& pool = device->memPool();
+  switch (attr) {
+    case hipMemPoolReuseFollowEventDependencies:
+      *static_cast<int*>(value) = 0;
+      break;
+    case hipMemPoolReuseAllowOpportunistic:
+      *static_cast<int*>(value) = 1;
+      break;
+    case hipMemPoolReuseAllowInternalDependencies:
+      *static_cast<int*>(value) = pool.reuseInternalDependencies() ? 1 : 0;
+      break;
+    case hipMemPoolAttrReleaseThreshold: {
+      const size_t threshold = pool.releaseThreshold();
+      *static_cast<uint64_t*>(value) = (threshold == std::numeric_limits<size_t>::max()) ?
+                                       std::numeric_limits<uint64_t>::max() : threshold;
+      break;
+    }
+    case hipMemPoolAttrReservedMemCurrent:
+      *static_cast<uint64_t*>(value) = pool.stats().reserved_;
+      break;
+    case hipMemPoolAttrReservedMemHigh:
+      *static_cast<uint64_t*>(value) = pool.stats().peakReserved_;
+      break;
+    case hipMemPoolAttrUsedMemCurrent:
+      *static_cast<uint64_t*>(value) = pool.stats().allocated_;
+      break;
+    case hipMemPoolAttrUsedMemHigh:
+      *static_cast<uint64_t*>(value) = pool.stats().peakAllocated_;
+      break;
+    default:
+      HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipMemPoolTrimTo(hipMemPool_t memPool, size_t minBytesToKeep) {
+  HIP_INIT_API(hipMemPoolTrimTo, memPool, minBytesToKeep);
+
+  hip::Device* device = asMemPoolDevice(memPool);
+  if (device == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  device->memPool().trim(minBytesToKeep);
+
+  HIP_RETURN(hipSuccess);
+}
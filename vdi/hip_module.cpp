@@ -19,7 +19,9 @@
  THE SOFTWARE. */
 
 #include <hip/hip_runtime.h>
+#include <hip/hip_ext.h>
 #include <libelf.h>
+#include <cstdlib>
 #include <fstream>
 
 #include "hip_internal.hpp"
@@ -336,25 +338,32 @@ hipError_t hipFuncGetAttributes(hipFuncAttributes* attr, const void* func)
   HIP_RETURN(hipSuccess);
 }
 
-hipError_t ihipModuleLaunchKernel(hipFunction_t f,
-                                 uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
-                                 uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
-                                 uint32_t sharedMemBytes, hipStream_t hStream,
-                                 void **kernelParams, void **extra,
-                                 hipEvent_t startEvent, hipEvent_t stopEvent, uint32_t flags = 0,
-                                 uint32_t params = 0, uint32_t gridId = 0, uint32_t numGrids = 0,
-                                 uint64_t prevGridSum = 0, uint64_t allGridSum = 0, uint32_t firstDevice = 0) {
-  HIP_INIT_API(NONE, f, gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY, blockDimZ,
-    sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent, flags, params);
-
-  hip::Function* function = hip::Function::asFunction(f);
-  amd::Kernel* kernel = function->function_;
-
-  amd::ScopedLock lock(function->lock_);
+/// Per-kernel launch statistics, or nullptr unless HIP_KERNEL_STATS is set. The table is never
+/// deleted, as kernels may still be launched while the process exits.
+static hip_impl::Launch_stats_table* launchStats() {
+  static hip_impl::Launch_stats_table* const table = []() -> hip_impl::Launch_stats_table* {
+    const char* value = std::getenv("HIP_KERNEL_STATS");
+    if ((value == nullptr) || (std::atoi(value) == 0)) {
+      return nullptr;
+    }
+    std::atexit([]() { launchStats()->dump(stderr); });
+    return new hip_impl::Launch_stats_table;
+  }();
+  return table;
+}
 
-  hip::Event* eStart = reinterpret_cast<hip::Event*>(startEvent);
-  hip::Event* eStop = reinterpret_cast<hip::Event*>(stopEvent);
-  amd::HostQueue* queue = hip::getQueue(hStream);
+/// Creates the command for a launch of \p f on \p queue and captures its arguments, without
+/// enqueuing it. The caller holds the lock of \p f, and enqueues or releases \p command.
+static hipError_t ihipCreateKernelCommand(amd::HostQueue* queue, hipFunction_t f,
+                                          uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
+                                          uint32_t blockDimX, uint32_t blockDimY,
+                                          uint32_t blockDimZ, uint32_t sharedMemBytes,
+                                          void **kernelParams, void **extra,
+                                          uint32_t params, uint32_t gridId, uint32_t numGrids,
+                                          uint64_t prevGridSum, uint64_t allGridSum,
+                                          uint32_t firstDevice,
+                                          amd::NDRangeKernelCommand*& command) {
+  amd::Kernel* kernel = hip::Function::asFunction(f)->function_;
   const amd::Device& device = queue->vdev()->device();
 
   // Make sure dispatch doesn't exceed max workgroup size limit
@@ -367,11 +376,11 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f,
       return hipErrorLaunchFailure;
     }
     int num_blocks = 0;
-    int num_grids = 0;
     int block_size = blockDimX * blockDimY * blockDimZ;
     hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-      &num_blocks, &num_grids, device, f, block_size, sharedMemBytes, true);
-    if (((gridDimX * gridDimY * gridDimZ) / block_size) > unsigned(num_grids)) {
+      &num_blocks, device, f, block_size, sharedMemBytes);
+    size_t num_grids = size_t(num_blocks) * device.info().numRTCUs_;
+    if (((gridDimX * gridDimY * gridDimZ) / block_size) > num_grids) {
       return hipErrorCooperativeLaunchTooLarge;
     }
   }
@@ -380,9 +389,6 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f,
       return hipErrorLaunchFailure;
     }
   }
-  if (!queue) {
-    return hipErrorOutOfMemory;
-  }
 
   size_t globalWorkOffset[3] = {0};
   size_t globalWorkSize[3] = { gridDimX, gridDimY, gridDimZ };
@@ -417,7 +423,7 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f,
     }
   }
 
-  amd::NDRangeKernelCommand* command = new amd::NDRangeKernelCommand(
+  command = new amd::NDRangeKernelCommand(
     *queue, waitList, *kernel, ndrange, sharedMemBytes,
     params, gridId, numGrids, prevGridSum, allGridSum, firstDevice);
   if (!command) {
@@ -427,11 +433,63 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f,
   // Capture the kernel arguments
   if (CL_SUCCESS != command->captureAndValidate()) {
     delete command;
+    command = nullptr;
     return hipErrorOutOfMemory;
   }
 
+  return hipSuccess;
+}
+
+/// Records a launch of \p function that was enqueued now, having started at \p start and
+/// waited for the lock of \p function until \p locked
+static void recordLaunchStats(hip_impl::Launch_stats_table& stats, hip::Function* function,
+                              uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
+                              uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
+                              uint32_t sharedMemBytes, uint64_t start, uint64_t locked) {
+  const hip_impl::Launch_shape shape{{gridDimX / std::max(blockDimX, 1u),
+                                      gridDimY / std::max(blockDimY, 1u),
+                                      gridDimZ / std::max(blockDimZ, 1u)},
+                                     {blockDimX, blockDimY, blockDimZ}, sharedMemBytes};
+  function->launchStats_.get(stats, function->function_->name())
+      .record(shape, hip_impl::launch_stats_now() - start, locked - start);
+}
+
+/// Enqueues a launch of \p f on \p queue, which is already resolved and ordered against the
+/// null stream
+static hipError_t ihipEnqueueKernel(amd::HostQueue* queue, hipFunction_t f,
+                                    uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
+                                    uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
+                                    uint32_t sharedMemBytes, void **kernelParams, void **extra,
+                                    hipEvent_t startEvent, hipEvent_t stopEvent,
+                                    uint32_t params = 0, uint32_t gridId = 0, uint32_t numGrids = 0,
+                                    uint64_t prevGridSum = 0, uint64_t allGridSum = 0,
+                                    uint32_t firstDevice = 0) {
+  hip::Function* function = hip::Function::asFunction(f);
+
+  hip_impl::Launch_stats_table* stats = launchStats();
+  const uint64_t start = (stats != nullptr) ? hip_impl::launch_stats_now() : 0;
+  amd::ScopedLock lock(function->lock_);
+  const uint64_t locked = (stats != nullptr) ? hip_impl::launch_stats_now() : 0;
+
+  hip::Event* eStart = reinterpret_cast<hip::Event*>(startEvent);
+  hip::Event* eStop = reinterpret_cast<hip::Event*>(stopEvent);
+
+  amd::NDRangeKernelCommand* command = nullptr;
+  hipError_t status = ihipCreateKernelCommand(queue, f, gridDimX, gridDimY, gridDimZ,
+                                              blockDimX, blockDimY, blockDimZ, sharedMemBytes,
+                                              kernelParams, extra, params, gridId, numGrids,
+                                              prevGridSum, allGridSum, firstDevice, command);
+  if (status != hipSuccess) {
+    return status;
+  }
+
   command->enqueue();
 
+  if (stats != nullptr) {
+    recordLaunchStats(*stats, function, gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY,
+                      blockDimZ, sharedMemBytes, start, locked);
+  }
+
   if(startEvent != nullptr) {
     eStart->addMarker(queue, command);
     command->retain();
@@ -445,6 +503,27 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f,
   return hipSuccess;
 }
 
+hipError_t ihipModuleLaunchKernel(hipFunction_t f,
+                                 uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
+                                 uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
+                                 uint32_t sharedMemBytes, hipStream_t hStream,
+                                 void **kernelParams, void **extra,
+                                 hipEvent_t startEvent, hipEvent_t stopEvent, uint32_t flags = 0,
+                                 uint32_t params = 0, uint32_t gridId = 0, uint32_t numGrids = 0,
+                                 uint64_t prevGridSum = 0, uint64_t allGridSum = 0, uint32_t firstDevice = 0) {
+  HIP_INIT_API(NONE, f, gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY, blockDimZ,
+    sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent, flags, params);
+
+  amd::HostQueue* queue = hip::getQueue(hStream);
+  if (!queue) {
+    return hipErrorOutOfMemory;
+  }
+
+  return ihipEnqueueKernel(queue, f, gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY,
+                           blockDimZ, sharedMemBytes, kernelParams, extra, startEvent, stopEvent,
+                           params, gridId, numGrids, prevGridSum, allGridSum, firstDevice);
+}
+
 hipError_t hipModuleLaunchKernel(hipFunction_t f,
                                  uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
                                  uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
@@ -513,6 +592,110 @@ hipError_t hipModuleLaunchKernelExt(hipFunction_t f, uint32_t gridDimX,
                                 sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent));
 }
 
+hipError_t hipExtLaunchKernelBatch(const hipExtKernelLaunchParams* launchParamsList,
+                                   unsigned int numLaunches, hipStream_t stream,
+                                   unsigned int flags)
+{
+  HIP_INIT_API(hipExtLaunchKernelBatch, launchParamsList, numLaunches, stream, flags);
+
+  if (numLaunches == 0) {
+    HIP_RETURN(hipSuccess);
+  }
+  if (launchParamsList == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  // The stream is resolved, and ordered against the null stream, once for the whole batch
+  amd::HostQueue* queue = hip::getQueue(stream);
+  if (queue == nullptr) {
+    HIP_RETURN(hipErrorOutOfMemory);
+  }
+  const amd::Device& device = queue->vdev()->device();
+
+  // Every launch is checked before any is enqueued, so a bad entry launches nothing
+  for (unsigned int i = 0; i < numLaunches; ++i) {
+    const hipExtKernelLaunchParams& l = launchParamsList[i];
+    if (l.function == nullptr) {
+      HIP_RETURN(hipErrorInvalidResourceHandle);
+    }
+    const size_t blockSize = static_cast<size_t>(l.blockDim.x) * l.blockDim.y * l.blockDim.z;
+    if (blockSize == 0 || blockSize > device.info().maxWorkGroupSize_ ||
+        static_cast<size_t>(l.gridDim.x) * l.blockDim.x > UINT32_MAX ||
+        static_cast<size_t>(l.gridDim.y) * l.blockDim.y > UINT32_MAX ||
+        static_cast<size_t>(l.gridDim.z) * l.blockDim.z > UINT32_MAX) {
+      HIP_RETURN(hipErrorInvalidConfiguration);
+    }
+    if (l.kernelParams != nullptr && l.extra != nullptr) {
+      HIP_RETURN(hipErrorInvalidValue);
+    }
+    if (l.extra != nullptr &&
+        (l.extra[0] != HIP_LAUNCH_PARAM_BUFFER_POINTER ||
+         l.extra[2] != HIP_LAUNCH_PARAM_BUFFER_SIZE || l.extra[4] != HIP_LAUNCH_PARAM_END)) {
+      HIP_RETURN(hipErrorNotInitialized);
+    }
+  }
+
+  // Every command is created, and its arguments captured, before any is enqueued, so a launch
+  // that fails to set up launches nothing either
+  hip_impl::Launch_stats_table* stats = launchStats();
+  std::vector<amd::NDRangeKernelCommand*> commands(numLaunches, nullptr);
+  std::vector<std::pair<uint64_t, uint64_t>> times((stats != nullptr) ? numLaunches : 0);
+  for (unsigned int i = 0; i < numLaunches; ++i) {
+    const hipExtKernelLaunchParams& l = launchParamsList[i];
+    hip::Function* function = hip::Function::asFunction(l.function);
+
+    const uint64_t start = (stats != nullptr) ? hip_impl::launch_stats_now() : 0;
+    amd::ScopedLock lock(function->lock_);
+    if (stats != nullptr) {
+      times[i] = std::make_pair(start, hip_impl::launch_stats_now());
+    }
+
+    hipError_t status = ihipCreateKernelCommand(queue, l.function, l.gridDim.x * l.blockDim.x,
+                                                l.gridDim.y * l.blockDim.y,
+                                                l.gridDim.z * l.blockDim.z, l.blockDim.x,
+                                                l.blockDim.y, l.blockDim.z, l.sharedMem,
+                                                l.kernelParams, l.extra, 0, 0, 0, 0, 0, 0,
+                                                commands[i]);
+    if (status != hipSuccess) {
+      for (unsigned int j = 0; j < i; ++j) {
+        commands[j]->release();
+      }
+      HIP_RETURN(status);
+    }
+  }
+
+  for (unsigned int i = 0; i < numLaunches; ++i) {
+    commands[i]->enqueue();
+    if (stats != nullptr) {
+      const hipExtKernelLaunchParams& l = launchParamsList[i];
+      recordLaunchStats(*stats, hip::Function::asFunction(l.function),
+                        l.gridDim.x * l.blockDim.x, l.gridDim.y * l.blockDim.y,
+                        l.gridDim.z * l.blockDim.z, l.blockDim.x, l.blockDim.y, l.blockDim.z,
+                        l.sharedMem, times[i].first, times[i].second);
+    }
+    commands[i]->release();
+  }
+
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtKernelGetLaunchStats(hipFunction_t f, hipExtKernelLaunchStats* stats)
+{
+  HIP_INIT_API(hipExtKernelGetLaunchStats, f, stats);
+
+  if (stats == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  if (f == nullptr) {
+    HIP_RETURN(hipErrorInvalidResourceHandle);
+  }
+
+  hip_impl::Launch_stats_table* table = launchStats();
+  hip_impl::copy_launch_stats((table != nullptr) ? table->find(FunctionName(f)) : nullptr, stats);
+
+  HIP_RETURN(hipSuccess);
+}
+
 hipError_t hipLaunchCooperativeKernel(const void* f,
                                       dim3 gridDim, dim3 blockDim,
                                       void **kernelParams, uint32_t sharedMemBytes, hipStream_t hStream)
@@ -19,13 +19,20 @@
  THE SOFTWARE. */
 
 #include <hip/hip_runtime.h>
+#include <hip/hip_ext.h>
 
 #include "hip_internal.hpp"
 #include "platform/program.hpp"
 #include "platform/runtime.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
 #include <unordered_map>
 #include "elfio.hpp"
+#include "src/mapped_elf.inl"
+#include "src/fp16_convert.inl"
 
 constexpr unsigned __hipFatMAGIC2 = 0x48495046; // "HIPF"
 
@@ -62,20 +69,111 @@ hipError_t hipModuleGetGlobal(hipDeviceptr_t* dptr, size_t* bytes,
 hipError_t ihipCreateGlobalVarObj(const char* name, hipModule_t hmod, amd::Memory** amd_mem_obj,
                                   hipDeviceptr_t* dptr, size_t* bytes);
 
-static bool isCompatibleCodeObject(const std::string& codeobj_target_id,
-                                   const char* device_name) {
-  // Workaround for device name mismatch.
-  // Device name may contain feature strings delimited by '+', e.g.
-  // gfx900+xnack. Currently HIP-Clang does not include feature strings
-  // in code object target id in fat binary. Therefore drop the feature
-  // strings from device name before comparing it with code object target id.
-  std::string short_name(device_name);
-  auto feature_loc = short_name.find('+');
-  if (feature_loc != std::string::npos) {
-    short_name.erase(feature_loc);
+namespace {
+// Non-owning view of a character range. The fat binary parser only ever
+// refers into the binary (or into device names), so nothing is copied.
+class StringView {
+ public:
+  StringView() = default;
+  StringView(const char* data, size_t size) : data_(data), size_(size) {}
+  explicit StringView(const char* str) : data_(str), size_(std::strlen(str)) {}
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  bool startsWith(const char* prefix, size_t prefixSize) const {
+    return size_ >= prefixSize && std::memcmp(data_, prefix, prefixSize) == 0;
   }
-  return codeobj_target_id == short_name;
+  StringView substr(size_t pos, size_t n = SIZE_MAX) const {
+    pos = std::min(pos, size_);
+    return StringView(data_ + pos, std::min(n, size_ - pos));
+  }
+  size_t find(char c) const {
+    const void* p = std::memchr(data_, c, size_);
+    return p ? static_cast<const char*>(p) - data_ : SIZE_MAX;
+  }
+
+  bool operator==(const StringView& x) const {
+    return size_ == x.size_ && std::memcmp(data_, x.data_, size_) == 0;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+struct StringViewHash {
+  size_t operator()(const StringView& x) const {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < x.size(); ++i) {
+      h = (h ^ static_cast<unsigned char>(x.data()[i])) * 0x100000001b3ull;
+    }
+    return static_cast<size_t>(h);
+  }
+};
+
+// Device name without feature strings.
+// Workaround for device name mismatch.
+// Device name may contain feature strings delimited by '+', e.g.
+// gfx900+xnack. Currently HIP-Clang does not include feature strings
+// in code object target id in fat binary. Therefore drop the feature
+// strings from device name before comparing it with code object target id.
+StringView deviceTargetId(const char* device_name) {
+  StringView name(device_name);
+  return name.substr(0, name.find('+'));
+}
+
+// Target id of an AMDGCN code object bundle, or an empty view for any other
+// bundle triple.
+StringView codeObjectTargetId(StringView triple) {
+  if (triple.startsWith(HIP_AMDGCN_AMDHSA_TRIPLE, sizeof(HIP_AMDGCN_AMDHSA_TRIPLE) - 1)) {
+    return triple.substr(sizeof(HIP_AMDGCN_AMDHSA_TRIPLE)); //For code objects created by CLang
+  }
+  if (triple.startsWith(HCC_AMDGCN_AMDHSA_TRIPLE, sizeof(HCC_AMDGCN_AMDHSA_TRIPLE) - 1)) {
+    return triple.substr(sizeof(HCC_AMDGCN_AMDHSA_TRIPLE)); //For code objects created by Hcc
+  }
+  return StringView();
+}
+
+// Calls fn(triple, image, size) for every bundle of the offload bundle in data,
+// in a single pass over the bundle descriptors. size bounds the bundle when it
+// is known. Returns false if data is not an offload bundle.
+template <typename F>
+bool forEachBundle(const void* data, size_t size, F fn) {
+  constexpr size_t magicSize = sizeof(CLANG_OFFLOAD_BUNDLER_MAGIC_STR) - 1;
+  constexpr size_t headerSize = offsetof(__ClangOffloadBundleHeader, desc);
+  constexpr size_t descSize = offsetof(__ClangOffloadBundleDesc, triple);
+
+  if (data == nullptr || size < headerSize ||
+      std::memcmp(data, CLANG_OFFLOAD_BUNDLER_MAGIC_STR, magicSize) != 0) {
+    return false;
+  }
+
+  const auto obheader = reinterpret_cast<const __ClangOffloadBundleHeader*>(data);
+  const char* const first = reinterpret_cast<const char*>(data);
+  const char* it = first + headerSize;
+  for (uint64_t i = 0; i < obheader->numBundles; ++i) {
+    const size_t left = size - (it - first);
+    if (left < descSize) {
+      break;
+    }
+    const auto desc = reinterpret_cast<const __ClangOffloadBundleDesc*>(it);
+    if (left - descSize < desc->tripleSize) {
+      break;
+    }
+    it += descSize + desc->tripleSize;
+
+    if (desc->offset > size || desc->size > size - desc->offset) {
+      continue;
+    }
+    fn(StringView(desc->triple, desc->tripleSize), first + desc->offset,
+       static_cast<size_t>(desc->size));
+  }
+  return true;
 }
+}  // namespace
 
 // Extracts code objects from fat binary in data for device names given in devices.
 // Returns true if code objects are extracted successfully.
@@ -83,44 +181,32 @@ hipError_t __hipExtractCodeObjectFromFatBinary(const void* data,
                                          const std::vector<const char*>& devices,
                                          std::vector<std::pair<const void*, size_t>>& code_objs)
 {
-  std::string magic((const char*)data, sizeof(CLANG_OFFLOAD_BUNDLER_MAGIC_STR) - 1);
-  if (magic.compare(CLANG_OFFLOAD_BUNDLER_MAGIC_STR)) {
-    return hipErrorInvalidKernelFile;
+  // Devices are grouped by target id up front, so that each bundle costs one
+  // lookup regardless of the number of devices.
+  std::unordered_map<StringView, std::vector<size_t>, StringViewHash> devicesByTarget;
+  devicesByTarget.reserve(devices.size());
+  for (size_t dev = 0; dev < devices.size(); ++dev) {
+    devicesByTarget[deviceTargetId(devices[dev])].push_back(dev);
   }
 
-  code_objs.resize(devices.size());
-  const auto obheader = reinterpret_cast<const __ClangOffloadBundleHeader*>(data);
-  const auto* desc = &obheader->desc[0];
-  unsigned num_code_objs = 0;
-  for (uint64_t i = 0; i < obheader->numBundles; ++i,
-       desc = reinterpret_cast<const __ClangOffloadBundleDesc*>(
-           reinterpret_cast<uintptr_t>(&desc->triple[0]) + desc->tripleSize)) {
-
-    std::size_t offset = 0;
-    if (!std::strncmp(desc->triple, HIP_AMDGCN_AMDHSA_TRIPLE,
-        sizeof(HIP_AMDGCN_AMDHSA_TRIPLE) - 1)) {
-      offset = sizeof(HIP_AMDGCN_AMDHSA_TRIPLE); //For code objects created by CLang
-    } else if (!std::strncmp(desc->triple, HCC_AMDGCN_AMDHSA_TRIPLE,
-               sizeof(HCC_AMDGCN_AMDHSA_TRIPLE) - 1)) {
-      offset = sizeof(HCC_AMDGCN_AMDHSA_TRIPLE); //For code objects created by Hcc
-    } else {
-      continue;
+  code_objs.assign(devices.size(), std::pair<const void*, size_t>(nullptr, 0));
+  size_t num_code_objs = 0;
+  const bool bundled = forEachBundle(data, SIZE_MAX,
+      [&](StringView triple, const void* image, size_t size) {
+    const auto it = devicesByTarget.find(codeObjectTargetId(triple));
+    if (it == devicesByTarget.cend()) {
+      return;
     }
-    std::string target(desc->triple + offset, desc->tripleSize - offset);
-
-    const void *image = reinterpret_cast<const void*>(
-        reinterpret_cast<uintptr_t>(obheader) + desc->offset);
-    size_t size = desc->size;
-
-    for (size_t dev = 0; dev < devices.size(); ++dev) {
-      const char* name = devices[dev];
-
-      if (!isCompatibleCodeObject(target, name)) {
-          continue;
+    for (size_t dev : it->second) {
+      if (code_objs[dev].first == nullptr) {
+        num_code_objs++;
       }
       code_objs[dev] = std::make_pair(image, size);
-      num_code_objs++;
     }
+  });
+
+  if (!bundled) {
+    return hipErrorInvalidKernelFile;
   }
   if (num_code_objs == devices.size())
     return hipSuccess;
@@ -190,6 +276,7 @@ void PlatformState::init()
 
 bool PlatformState::unregisterFunc(hipModule_t hmod) {
   amd::ScopedLock lock(lock_);
+  funcGeneration_.fetch_add(1, std::memory_order_release);
   auto mod_it = module_map_.find(hmod);
   if (mod_it != module_map_.cend()) {
     PlatformState::Module* mod_ptr = mod_it->second;
@@ -387,7 +474,43 @@ bool PlatformState::createFunc(hipFunction_t* hfunc, hipModule_t hmod, const cha
 }
 
 
+namespace {
+// Functions this thread has already resolved, indexed by host function and then by device.
+// Entries are only ever added by their own thread, so lookups need no synchronization; the
+// whole cache is dropped once PlatformState's function generation moves on.
+struct FuncCache {
+  uint64_t generation = 0;
+  std::unordered_map<const void*, std::vector<hipFunction_t>> functions;
+};
+
+thread_local FuncCache funcCache_;
+}
+
 hipFunction_t PlatformState::getFunc(const void* hostFunction, int deviceId) {
+  const uint64_t generation = funcGeneration_.load(std::memory_order_acquire);
+  if (funcCache_.generation != generation) {
+    funcCache_.functions.clear();
+    funcCache_.generation = generation;
+  }
+
+  const auto it = funcCache_.functions.find(hostFunction);
+  if (it != funcCache_.functions.cend() && static_cast<size_t>(deviceId) < it->second.size() &&
+      it->second[deviceId] != nullptr) {
+    return it->second[deviceId];
+  }
+
+  hipFunction_t function = resolveFunc(hostFunction, deviceId);
+  if (function != nullptr) {
+    std::vector<hipFunction_t>& cached = funcCache_.functions[hostFunction];
+    if (cached.size() <= static_cast<size_t>(deviceId)) {
+      cached.resize(deviceId + 1, nullptr);
+    }
+    cached[deviceId] = function;
+  }
+  return function;
+}
+
+hipFunction_t PlatformState::resolveFunc(const void* hostFunction, int deviceId) {
   amd::ScopedLock lock(lock_);
   const auto it = functions_.find(hostFunction);
   if (it != functions_.cend()) {
@@ -712,62 +835,63 @@ hipError_t ihipCreateGlobalVarObj(const char* name, hipModule_t hmod, amd::Memor
 }
 
 
-namespace hip_impl {
-hipError_t ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    int* numBlocks, int* numGrids,
-    const amd::Device& device, hipFunction_t func, int  blockSize,
-    size_t dynamicSMemSize, bool bCalcPotentialBlkSz)
-{
-  hip::Function* function = hip::Function::asFunction(func);
-  const amd::Kernel& kernel = *function->function_;
+hip_impl::Occupancy_limits hip::occupancyLimits(const amd::Device& device) {
+  hip_impl::Occupancy_limits limits;
+  limits.simds_per_cu = device.info().simdPerCU_;
+  // Limited by SPI 32 per CU, hence 8 per SIMD
+  limits.max_waves_per_cu = 8 * limits.simds_per_cu;
+  limits.sgprs_per_simd = (device.info().gfxipVersion_ < 800) ? 512 : 800;
+  limits.lds_per_cu = device.info().localMemSize_;
+  limits.max_threads_per_block = device.info().maxWorkGroupSize_;
+  limits.cu_count = device.info().numRTCUs_;
+  return limits;
+}
 
-  const device::Kernel::WorkGroupInfo* wrkGrpInfo = kernel.getDeviceKernel(device)->workGroupInfo();
-  if (blockSize == 0) {
-    if (bCalcPotentialBlkSz == false){
-      return hipErrorInvalidValue;
-    }
-    else {
-      blockSize = device.info().maxWorkGroupSize_; // maxwavefrontperblock
+namespace hip_impl {
+/// Memoized occupancy of the HIP device that owns \p device
+static Occupancy_calculator& occupancyCalculator(const amd::Device& device) {
+  for (auto d : g_devices) {
+    if (d->devices()[0] == &device) {
+      return d->occupancy();
     }
   }
+  return hip::getCurrentDevice()->occupancy();
+}
 
-  // Make sure the requested block size is smaller than max supported
-  if (blockSize > int(device.info().maxWorkGroupSize_)) {
-    numBlocks = 0;
-    numGrids = 0;
-    return hipSuccess;
-  }
-
-  // Find threads accupancy per CU => simd_per_cu * GPR usage
-  constexpr size_t MaxWavesPerSimd = 8;  // Limited by SPI 32 per CU, hence 8 per SIMD
-  size_t VgprWaves = MaxWavesPerSimd;
-  if (wrkGrpInfo->usedVGPRs_ > 0) {
-    VgprWaves = wrkGrpInfo->availableVGPRs_ / amd::alignUp(wrkGrpInfo->usedVGPRs_, 4);
-  }
-
-  size_t GprWaves = VgprWaves;
-  if (wrkGrpInfo->usedSGPRs_ > 0) {
-    const size_t maxSGPRs = (device.info().gfxipVersion_ < 800) ? 512 : 800;
-    size_t SgprWaves = maxSGPRs / amd::alignUp(wrkGrpInfo->usedSGPRs_, 16);
-    GprWaves = std::min(VgprWaves, SgprWaves);
-  }
+static Kernel_resources kernelResources(const amd::Device& device, hipFunction_t func) {
+  const amd::Kernel& kernel = *hip::Function::asFunction(func)->function_;
+  const device::Kernel::WorkGroupInfo* wrkGrpInfo = kernel.getDeviceKernel(device)->workGroupInfo();
 
-  size_t alu_accupancy = device.info().simdPerCU_ * std::min(MaxWavesPerSimd, GprWaves);
-  alu_accupancy *= wrkGrpInfo->wavefrontSize_;
-  // Calculate blocks occupancy per CU
-  *numBlocks = alu_accupancy / amd::alignUp(blockSize, wrkGrpInfo->wavefrontSize_);
+  Kernel_resources resources;
+  resources.vgprs = wrkGrpInfo->usedVGPRs_;
+  resources.sgprs = wrkGrpInfo->usedSGPRs_;
+  resources.lds = wrkGrpInfo->usedLDSSize_;
+  resources.wavefront_size = wrkGrpInfo->wavefrontSize_;
+  resources.vgprs_per_simd = wrkGrpInfo->availableVGPRs_;
+  return resources;
+}
 
-  size_t total_used_lds = wrkGrpInfo->usedLDSSize_ + dynamicSMemSize;
-  if (total_used_lds != 0) {
-    // Calculate LDS occupancy per CU. lds_per_cu / (static_lsd + dynamic_lds)
-    int lds_occupancy = static_cast<int>(device.info().localMemSize_ / total_used_lds);
-    *numBlocks = std::min(*numBlocks, lds_occupancy);
+hipError_t ihipOccupancyMaxActiveBlocksPerMultiprocessor(
+    int* numBlocks, const amd::Device& device, hipFunction_t func, int blockSize,
+    size_t dynamicSMemSize)
+{
+  if ((numBlocks == nullptr) || (func == nullptr) || (blockSize <= 0)) {
+    return hipErrorInvalidValue;
   }
+  *numBlocks = occupancyCalculator(device).max_active_blocks_per_cu(
+    kernelResources(device, func), blockSize, dynamicSMemSize);
+  return hipSuccess;
+}
 
-  if (bCalcPotentialBlkSz) {
-    *numGrids = *numBlocks * device.info().numRTCUs_;
+hipError_t ihipOccupancyMaxPotentialBlockSize(
+    int* gridSize, int* blockSize, const amd::Device& device, hipFunction_t func,
+    size_t dynamicSMemSize, int blockSizeLimit)
+{
+  if ((gridSize == nullptr) || (blockSize == nullptr) || (func == nullptr)) {
+    return hipErrorInvalidValue;
   }
-
+  occupancyCalculator(device).max_potential_block_size(
+    kernelResources(device, func), dynamicSMemSize, blockSizeLimit, gridSize, blockSize);
   return hipSuccess;
 }
 }
@@ -778,23 +902,13 @@ hipError_t hipOccupancyMaxPotentialBlockSize(int* gridSize, int* blockSize,
                                              int blockSizeLimit)
 {
   HIP_INIT_API(hipOccupancyMaxPotentialBlockSize, f, dynSharedMemPerBlk, blockSizeLimit);
-  if ((gridSize == nullptr) || (blockSize == nullptr)) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
   hipFunction_t func = PlatformState::instance().getFunc(f, ihipGetDevice());
   if (func == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
+    HIP_RETURN(hipErrorInvalidValue);
   }
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-  int num_grids = 0;
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, &num_grids, device, func, 0, dynSharedMemPerBlk,true);
-  if (ret == hipSuccess) {
-    *blockSize = num_blocks;
-    *gridSize = num_grids;
-  }
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxPotentialBlockSize(
+    gridSize, blockSize, device, func, dynSharedMemPerBlk, blockSizeLimit));
 }
 
 hipError_t hipModuleOccupancyMaxPotentialBlockSize(int* gridSize, int* blockSize,
@@ -802,19 +916,9 @@ hipError_t hipModuleOccupancyMaxPotentialBlockSize(int* gridSize, int* blockSize
                                              int blockSizeLimit)
 {
   HIP_INIT_API(hipModuleOccupancyMaxPotentialBlockSize, f, dynSharedMemPerBlk, blockSizeLimit);
-  if ((gridSize == nullptr) || (blockSize == nullptr)) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-  int num_grids = 0;
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, &num_grids, device, f, 0, dynSharedMemPerBlk,true);
-  if (ret == hipSuccess) {
-    *blockSize = num_blocks;
-    *gridSize = num_grids;
-  }
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxPotentialBlockSize(
+    gridSize, blockSize, device, f, dynSharedMemPerBlk, blockSizeLimit));
 }
 
 hipError_t hipModuleOccupancyMaxPotentialBlockSizeWithFlags(int* gridSize, int* blockSize,
@@ -822,35 +926,18 @@ hipError_t hipModuleOccupancyMaxPotentialBlockSizeWithFlags(int* gridSize, int*
                                              int blockSizeLimit, unsigned int flags)
 {
   HIP_INIT_API(hipModuleOccupancyMaxPotentialBlockSizeWithFlags, f, dynSharedMemPerBlk, blockSizeLimit, flags);
-  if ((gridSize == nullptr) || (blockSize == nullptr)) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-  int num_grids = 0;
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, &num_grids, device, f, 0, dynSharedMemPerBlk,true);
-  if (ret == hipSuccess) {
-    *blockSize = num_blocks;
-    *gridSize = num_grids;
-  }
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxPotentialBlockSize(
+    gridSize, blockSize, device, f, dynSharedMemPerBlk, blockSizeLimit));
 }
 
 hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(int* numBlocks, 
                                              hipFunction_t f, int blockSize, size_t dynSharedMemPerBlk)
 {
   HIP_INIT_API(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor, f, blockSize, dynSharedMemPerBlk);
-  if (numBlocks == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, nullptr, device, f, blockSize, dynSharedMemPerBlk, false);
-  *numBlocks = num_blocks;
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
+    numBlocks, device, f, blockSize, dynSharedMemPerBlk));
 }
 
 hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(int* numBlocks,
@@ -858,38 +945,22 @@ hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(int* numB
                                                               size_t dynSharedMemPerBlk, unsigned int flags)
 {
   HIP_INIT_API(hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags, f, blockSize, dynSharedMemPerBlk, flags);
-  if (numBlocks == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, nullptr, device, f, blockSize, dynSharedMemPerBlk, false);
-  *numBlocks = num_blocks;
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
+    numBlocks, device, f, blockSize, dynSharedMemPerBlk));
 }
 
 hipError_t hipOccupancyMaxActiveBlocksPerMultiprocessor(int* numBlocks,
                                                         const void* f, int blockSize, size_t dynamicSMemSize)
 {
   HIP_INIT_API(hipOccupancyMaxActiveBlocksPerMultiprocessor, f, blockSize, dynamicSMemSize);
-  if (numBlocks == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
-
   hipFunction_t func = PlatformState::instance().getFunc(f, ihipGetDevice());
   if (func == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
+    HIP_RETURN(hipErrorInvalidValue);
   }
-
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, nullptr, device, func, blockSize, dynamicSMemSize, false);
-  *numBlocks = num_blocks;
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
+    numBlocks, device, func, blockSize, dynamicSMemSize));
 }
 
 hipError_t hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(int* numBlocks,
@@ -897,22 +968,13 @@ hipError_t hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(int* numBlocks,
                                                                  int  blockSize, size_t dynamicSMemSize, unsigned int flags)
 {
   HIP_INIT_API(hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags, f, blockSize, dynamicSMemSize, flags);
-  if (numBlocks == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
-  }
-
   hipFunction_t func = PlatformState::instance().getFunc(f, ihipGetDevice());
   if (func == nullptr) {
-    return HIP_RETURN(hipErrorInvalidValue);
+    HIP_RETURN(hipErrorInvalidValue);
   }
-
   const amd::Device& device = *hip::getCurrentDevice()->devices()[0];
-
-  int num_blocks = 0;
-  hipError_t ret = hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    &num_blocks, nullptr, device, func, blockSize, dynamicSMemSize, false);
-  *numBlocks = num_blocks;
-  HIP_RETURN(ret);
+  HIP_RETURN(hip_impl::ihipOccupancyMaxActiveBlocksPerMultiprocessor(
+    numBlocks, device, func, blockSize, dynamicSMemSize));
 }
 }
 
@@ -1025,72 +1087,48 @@ const std::unordered_map<uintptr_t, std::string>& function_names()
   return r;
 }
 
-std::vector<char> bundles_for_process() {
-  static constexpr const char self[] = "/proc/self/exe";
-  static constexpr const char kernel_section[] = ".kernel";
-  std::vector<char> r;
-
-  ELFIO::elfio reader;
-
-  if (reader.load(self)) {
-    auto it = find_section_if(
-        reader, [](const ELFIO::section* x) { return x->get_name() == kernel_section; });
-
-    if (it) r.insert(r.end(), it->get_data(), it->get_data() + it->get_size());
-  }
-
-  return r;
-}
-
 const std::vector<hipModule_t>& modules() {
     static std::vector<hipModule_t> r;
     static std::once_flag f;
 
     std::call_once(f, []() {
-      static std::vector<std::vector<char>> bundles{bundles_for_process()};
+      // The .kernel sections are used in place; the mappings are kept for the
+      // lifetime of the process since the modules may refer into them.
+      static std::deque<hip_impl::Mapped_file> files;
 
       dl_iterate_phdr(
           [](dl_phdr_info* info, std::size_t, void*) {
-        ELFIO::elfio tmp;
-        if (tmp.load(info->dlpi_name)) {
-          const auto it = find_section_if(
-              tmp, [](const ELFIO::section* x) { return x->get_name() == ".kernel"; });
+        const char* elf = (info->dlpi_name[0] != '\0') ? info->dlpi_name : "/proc/self/exe";
+        files.emplace_back(elf);
 
-          if (it) bundles.emplace_back(it->get_data(), it->get_data() + it->get_size());
+        const auto image = files.back().image();
+        if (image.data(image.section(".kernel")).empty()) {
+          files.pop_back();
         }
         return 0;
       },
       nullptr);
 
-      for (auto&& bundle : bundles) {
-        if (bundle.empty()) {
-          continue;
-        }
-        std::string magic(&bundle[0], sizeof(CLANG_OFFLOAD_BUNDLER_MAGIC_STR) - 1);
-        if (magic.compare(CLANG_OFFLOAD_BUNDLER_MAGIC_STR))
-          continue;
-
-        const auto obheader = reinterpret_cast<const __ClangOffloadBundleHeader*>(&bundle[0]);
-        const auto* desc = &obheader->desc[0];
-        for (uint64_t i = 0; i < obheader->numBundles; ++i,
-             desc = reinterpret_cast<const __ClangOffloadBundleDesc*>(
-                 reinterpret_cast<uintptr_t>(&desc->triple[0]) + desc->tripleSize)) {
-
-          std::string triple(desc->triple, sizeof(HCC_AMDGCN_AMDHSA_TRIPLE) - 1);
-          if (triple.compare(HCC_AMDGCN_AMDHSA_TRIPLE))
-            continue;
-
-          std::string target(desc->triple + sizeof(HCC_AMDGCN_AMDHSA_TRIPLE),
-                             desc->tripleSize - sizeof(HCC_AMDGCN_AMDHSA_TRIPLE));
-
-          if (isCompatibleCodeObject(target, hip::getCurrentDevice()->devices()[0]->info().name_)) {
-            hipModule_t module;
-            if (hipSuccess == hipModuleLoadData(&module, reinterpret_cast<const void*>(
-                reinterpret_cast<uintptr_t>(obheader) + desc->offset)))
-              r.push_back(module);
-              break;
+      const StringView target = deviceTargetId(hip::getCurrentDevice()->devices()[0]->info().name_);
+
+      for (auto&& file : files) {
+        const auto image = file.image();
+        const auto bundle = image.data(image.section(".kernel"));
+
+        bool found = false;
+        forEachBundle(bundle.data(), bundle.size(),
+            [&](StringView triple, const void* code, size_t) {
+          if (found ||
+              !triple.startsWith(HCC_AMDGCN_AMDHSA_TRIPLE, sizeof(HCC_AMDGCN_AMDHSA_TRIPLE) - 1) ||
+              !(codeObjectTargetId(triple) == target)) {
+            return;
           }
-        }
+          found = true;
+
+          hipModule_t module;
+          if (hipSuccess == hipModuleLoadData(&module, code))
+            r.push_back(module);
+        });
       }
     });
 
@@ -1188,38 +1226,6 @@ extern "C" hipError_t hipLaunchKernel(const void *hostFunction,
                                     sharedMemBytes, stream, args, nullptr));
 }
 
-// conversion routines between float and half precision
-static inline std::uint32_t f32_as_u32(float f) { union { float f; std::uint32_t u; } v; v.f = f; return v.u; }
-static inline float u32_as_f32(std::uint32_t u) { union { float f; std::uint32_t u; } v; v.u = u; return v.f; }
-static inline int clamp_int(int i, int l, int h) { return std::min(std::max(i, l), h); }
-
-// half float, the f16 is in the low 16 bits of the input argument
-static inline float __convert_half_to_float(std::uint32_t a) noexcept {
-  std::uint32_t u = ((a << 13) + 0x70000000U) & 0x8fffe000U;
-  std::uint32_t v = f32_as_u32(u32_as_f32(u) * u32_as_f32(0x77800000U)/*0x1.0p+112f*/) + 0x38000000U;
-  u = (a & 0x7fff) != 0 ? v : u;
-  return u32_as_f32(u) * u32_as_f32(0x07800000U)/*0x1.0p-112f*/;
-}
-
-// float half with nearest even rounding
-// The lower 16 bits of the result is the bit pattern for the f16
-static inline std::uint32_t __convert_float_to_half(float a) noexcept {
-  std::uint32_t u = f32_as_u32(a);
-  int e = static_cast<int>((u >> 23) & 0xff) - 127 + 15;
-  std::uint32_t m = ((u >> 11) & 0xffe) | ((u & 0xfff) != 0);
-  std::uint32_t i = 0x7c00 | (m != 0 ? 0x0200 : 0);
-  std::uint32_t n = ((std::uint32_t)e << 12) | m;
-  std::uint32_t s = (u >> 16) & 0x8000;
-  int b = clamp_int(1-e, 0, 13);
-  std::uint32_t d = (0x1000 | m) >> b;
-  d |= (d << b) != (0x1000 | m);
-  std::uint32_t v = e < 1 ? d : n;
-  v = (v >> 2) + (((v & 0x7) == 3) | ((v & 0x7) > 5));
-  v = e > 30 ? 0x7c00 : v;
-  v = e == 143 ? i : v;
-  return s | v;
-}
-
 extern "C" float __gnu_h2f_ieee(unsigned short h){
   return __convert_half_to_float((std::uint32_t) h);
 }
@@ -1227,3 +1233,43 @@ extern "C" float __gnu_h2f_ieee(unsigned short h){
 extern "C" unsigned short __gnu_f2h_ieee(float f){
   return (unsigned short)__convert_float_to_half(f);
 }
+
+hipError_t hipExtConvertFloatToHalf(uint16_t* dst, const float* src, size_t count,
+                                    hipExtRoundingMode mode) {
+  if (count != 0 && (dst == nullptr || src == nullptr)) {
+    return hipErrorInvalidValue;
+  }
+  if (mode != hipExtRoundNearestEven && mode != hipExtRoundTowardZero) {
+    return hipErrorInvalidValue;
+  }
+  hip_impl::floatToHalf(dst, src, count, mode == hipExtRoundTowardZero);
+  return hipSuccess;
+}
+
+hipError_t hipExtConvertHalfToFloat(float* dst, const uint16_t* src, size_t count) {
+  if (count != 0 && (dst == nullptr || src == nullptr)) {
+    return hipErrorInvalidValue;
+  }
+  hip_impl::halfToFloat(dst, src, count);
+  return hipSuccess;
+}
+
+hipError_t hipExtConvertFloatToBfloat16(uint16_t* dst, const float* src, size_t count,
+                                        hipExtRoundingMode mode) {
+  if (count != 0 && (dst == nullptr || src == nullptr)) {
+    return hipErrorInvalidValue;
+  }
+  if (mode != hipExtRoundNearestEven && mode != hipExtRoundTowardZero) {
+    return hipErrorInvalidValue;
+  }
+  hip_impl::floatToBfloat16(dst, src, count, mode == hipExtRoundTowardZero);
+  return hipSuccess;
+}
+
+hipError_t hipExtConvertBfloat16ToFloat(float* dst, const uint16_t* src, size_t count) {
+  if (count != 0 && (dst == nullptr || src == nullptr)) {
+    return hipErrorInvalidValue;
+  }
+  hip_impl::bfloat16ToFloat(dst, src, count);
+  return hipSuccess;
+}
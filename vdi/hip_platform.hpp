@@ -23,7 +23,10 @@
 
 namespace hip_impl {
 hipError_t ihipOccupancyMaxActiveBlocksPerMultiprocessor(
-    int* numBlocks, int* numGrids,
-    const amd::Device& device, hipFunction_t func, int  blockSize,
-    size_t dynamicSMemSize, bool bCalcPotentialBlkSz);
-}
\ No newline at end of file
+    int* numBlocks, const amd::Device& device, hipFunction_t func, int blockSize,
+    size_t dynamicSMemSize);
+
+hipError_t ihipOccupancyMaxPotentialBlockSize(
+    int* gridSize, int* blockSize, const amd::Device& device, hipFunction_t func,
+    size_t dynamicSMemSize, int blockSizeLimit);
+}
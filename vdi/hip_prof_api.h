@@ -170,7 +170,8 @@ template <int cid_>
 class api_callbacks_spawner_t {
  public:
   api_callbacks_spawner_t() :
-    api_data_(NULL)
+    api_data_(NULL),
+    synced_(false)
   {
     if (!is_enabled()) return;
 
@@ -178,7 +179,11 @@ class api_callbacks_spawner_t {
       fprintf(stderr, "HIP %s bad id %d\n", __FUNCTION__, cid_);
       abort();
     }
+    // The arguments are only recorded for an API with an activity callback; the others
+    // skip the semaphore and the record, as when no callback is set at all
+    if (entry(cid_).act == NULL) return;
     callbacks_table.sem_sync(cid_);
+    synced_ = true;
 
     hip_act_callback_t act = entry(cid_).act;
     if (act != NULL) api_data_ = (hip_api_data_t*) act(cid_, NULL, NULL, NULL);
@@ -194,7 +199,7 @@ class api_callbacks_spawner_t {
   }
 
   ~api_callbacks_spawner_t() {
-    if (!is_enabled()) return;
+    if (!synced_) return;
 
     if (api_data_ != NULL) {
       hip_api_callback_t fun = entry(cid_).fun;
@@ -222,6 +227,7 @@ class api_callbacks_spawner_t {
   }
 
   hip_api_data_t* api_data_;
+  bool synced_;
 };
 
 template <>
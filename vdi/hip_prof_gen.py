@@ -574,6 +574,10 @@ api_map = {
   'hipConfigureCall': '',
   'hipHccModuleLaunchKernel': '',
   'hipExtModuleLaunchKernel': '',
+  'hipExtLaunchKernelBatch': '',
+  'hipExtMallocCacheGetStats': '',
+  'hipExtMallocCacheResetPeakStats': '',
+  'hipExtMallocCacheTrim': '',
 }
 # API options map
 opts_map = {}
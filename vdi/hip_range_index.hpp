@@ -0,0 +1,283 @@
+/* Copyright (c) 2020-present Advanced Micro Devices, Inc.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+#ifndef HIP_RANGE_INDEX_H
+#define HIP_RANGE_INDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hip {
+
+/// Maps address ranges to values, for lookups from many threads at once.
+///
+/// The address space is split into granules of 2^GranuleShift bytes, which are
+/// hashed onto Shards shards. A range is stored in the shard of every granule it
+/// covers, so a lookup only searches the one sorted shard of its address.
+/// Shards are immutable snapshots: a lookup never takes a lock or writes shared
+/// state other than its thread's reader counter, and a writer replaces the
+/// snapshot of a shard and waits for the readers that may still see the old one
+/// before freeing it.
+///
+/// Ranges must not overlap. T is copyable.
+template <typename T, unsigned Shards = 256, unsigned GranuleShift = 21>
+class RangeIndex {
+  struct Entry {
+    uintptr_t begin_;
+    uintptr_t end_;
+    T value_;
+  };
+  typedef std::vector<Entry> Shard;
+
+  /// Readers in flight for each of the two generations, striped by thread
+  struct alignas(64) Readers {
+    std::atomic<size_t> count_[2];
+  };
+  static constexpr unsigned ReaderSlots = 64;
+
+  std::atomic<const Shard*> shards_[Shards];
+  Readers readers_[ReaderSlots];
+  std::atomic<unsigned> generation_{0};
+
+  /// Serializes writers
+  std::mutex lock_;
+  /// Bumped by every removal, see version()
+  std::atomic<uint64_t> version_{0};
+  /// Removals between beginRemove() and endRemove()
+  size_t removing_ = 0;
+  size_t size_ = 0;
+
+  static Readers& slot(Readers* readers) {
+    static std::atomic<unsigned> next{0};
+    static thread_local unsigned index = next++ % ReaderSlots;
+    return readers[index];
+  }
+
+  static unsigned shardOf(uintptr_t address) { return (address >> GranuleShift) % Shards; }
+
+  /// Calls f with each shard the range [begin, end) is stored in
+  template <typename F>
+  static void forEachShard(uintptr_t begin, uintptr_t end, F f) {
+    const uintptr_t first = begin >> GranuleShift;
+    const uintptr_t last = (end - 1) >> GranuleShift;
+    if (last - first >= Shards - 1) {
+      for (unsigned i = 0; i < Shards; ++i) {
+        f(i);
+      }
+      return;
+    }
+    for (uintptr_t granule = first; granule <= last; ++granule) {
+      f(granule % Shards);
+    }
+  }
+
+  /// Waits for the readers that started before the call. Writer lock held.
+  void synchronize() {
+    const unsigned old = generation_.load(std::memory_order_relaxed);
+    generation_.store(old ^ 1, std::memory_order_seq_cst);
+    for (auto& readers : readers_) {
+      while (readers.count_[old].load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /// Publishes the new snapshots of the given shards and frees the old ones.
+  /// Writer lock held.
+  void publish(std::vector<std::pair<unsigned, Shard*>>& updates) {
+    std::vector<std::unique_ptr<const Shard>> retired;
+    for (auto& update : updates) {
+      retired.emplace_back(shards_[update.first].exchange(update.second, std::memory_order_seq_cst));
+    }
+    synchronize();
+  }
+
+ public:
+  RangeIndex() {
+    for (auto& shard : shards_) {
+      shard.store(nullptr, std::memory_order_relaxed);
+    }
+    for (auto& readers : readers_) {
+      readers.count_[0].store(0, std::memory_order_relaxed);
+      readers.count_[1].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  RangeIndex(const RangeIndex&) = delete;
+  RangeIndex& operator=(const RangeIndex&) = delete;
+
+  ~RangeIndex() {
+    for (auto& shard : shards_) {
+      delete shard.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// Finds the range that contains \p ptr. Returns false if there is none.
+  bool find(const void* ptr, T& value, const void** base = nullptr) const {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    Readers& readers = slot(const_cast<Readers*>(readers_));
+    unsigned generation;
+    for (;;) {
+      generation = generation_.load(std::memory_order_seq_cst);
+      readers.count_[generation].fetch_add(1, std::memory_order_seq_cst);
+      if (generation_.load(std::memory_order_seq_cst) == generation) {
+        break;
+      }
+      readers.count_[generation].fetch_sub(1, std::memory_order_release);
+    }
+
+    bool found = false;
+    const Shard* shard = shards_[shardOf(address)].load(std::memory_order_seq_cst);
+    if (shard != nullptr) {
+      auto it = std::upper_bound(shard->begin(), shard->end(), address,
+                                 [](uintptr_t a, const Entry& e) { return a < e.begin_; });
+      if (it != shard->begin() && address < (--it)->end_) {
+        value = it->value_;
+        if (base != nullptr) {
+          *base = reinterpret_cast<const void*>(it->begin_);
+        }
+        found = true;
+      }
+    }
+
+    readers.count_[generation].fetch_sub(1, std::memory_order_release);
+    return found;
+  }
+
+  /// Adds [\p base, \p base + \p size); a size of 0 is taken as 1. Returns
+  /// false if a range already starts at \p base.
+  bool insert(const void* base, size_t size, const T& value) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return insertLocked(base, size, value);
+  }
+
+  /// Adds the range unless a range was removed since version() returned
+  /// \p version, so that a value looked up elsewhere before a concurrent
+  /// removal is not added back. Returns false if it was not added.
+  bool insertIfUnchanged(uint64_t version, const void* base, size_t size, const T& value) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (version_.load(std::memory_order_relaxed) != version || removing_ != 0) {
+      return false;
+    }
+    return insertLocked(base, size, value);
+  }
+
+  /// Removes the range that starts at \p base. Returns false if there is none.
+  bool remove(const void* base) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return removeLocked(base);
+  }
+
+  /// Removes the range that starts at \p base before the value it maps to is
+  /// destroyed. Until endRemove(), insertIfUnchanged() adds nothing, so a
+  /// value looked up while it is being destroyed is not added back. Returns
+  /// false if there is no such range.
+  bool beginRemove(const void* base) {
+    std::lock_guard<std::mutex> lock(lock_);
+    ++removing_;
+    return removeLocked(base);
+  }
+
+  /// Ends a beginRemove(), once the value is destroyed
+  void endRemove() {
+    std::lock_guard<std::mutex> lock(lock_);
+    --removing_;
+    version_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Changes whenever a range is removed
+  uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return size_;
+  }
+
+ private:
+  /// Writer lock held
+  bool removeLocked(const void* base) {
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(base);
+    version_.fetch_add(1, std::memory_order_relaxed);
+
+    const Entry* found = findLocked(begin);
+    if (found == nullptr) {
+      return false;
+    }
+    const uintptr_t end = found->end_;
+
+    std::vector<std::pair<unsigned, Shard*>> updates;
+    forEachShard(begin, end, [&](unsigned index) {
+      const Shard* old = shards_[index].load(std::memory_order_relaxed);
+      Shard* updated = new Shard;
+      updated->reserve(old->size() - 1);
+      for (const Entry& e : *old) {
+        if (e.begin_ != begin) {
+          updated->push_back(e);
+        }
+      }
+      updates.emplace_back(index, updated);
+    });
+    publish(updates);
+    --size_;
+    return true;
+  }
+
+  /// Finds the range that starts at \p begin. Writer lock held.
+  const Entry* findLocked(uintptr_t begin) const {
+    const Shard* shard = shards_[shardOf(begin)].load(std::memory_order_relaxed);
+    if (shard == nullptr) {
+      return nullptr;
+    }
+    auto it = std::lower_bound(shard->begin(), shard->end(), begin,
+                               [](const Entry& e, uintptr_t a) { return e.begin_ < a; });
+    return (it == shard->end() || it->begin_ != begin) ? nullptr : &*it;
+  }
+
+  bool insertLocked(const void* base, size_t size, const T& value) {
+    const Entry entry = {reinterpret_cast<uintptr_t>(base),
+                         reinterpret_cast<uintptr_t>(base) + std::max<size_t>(size, 1), value};
+    if (findLocked(entry.begin_) != nullptr) {
+      return false;
+    }
+
+    std::vector<std::pair<unsigned, Shard*>> updates;
+    forEachShard(entry.begin_, entry.end_, [&](unsigned index) {
+      const Shard* old = shards_[index].load(std::memory_order_relaxed);
+      Shard* updated = (old == nullptr) ? new Shard : new Shard(*old);
+      updated->insert(std::upper_bound(updated->begin(), updated->end(), entry.begin_,
+                                       [](uintptr_t a, const Entry& e) { return a < e.begin_; }),
+                      entry);
+      updates.emplace_back(index, updated);
+    });
+    publish(updates);
+    ++size_;
+    return true;
+  }
+};
+
+};
+
+#endif // HIP_RANGE_INDEX_H
@@ -21,27 +21,59 @@
 #include <hip/hip_runtime.h>
 #include "hip_internal.hpp"
 #include "hip_event.hpp"
+#include "hip_callback_executor.hpp"
 #include "thread/monitor.hpp"
 
+#include <cstdlib>
+
 static amd::Monitor streamSetLock("Guards global stream set");
 static std::unordered_set<hip::Stream*> streamSet;
 
 // Internal structure for stream callback handler
 class StreamCallback {
    public:
-    StreamCallback(hipStream_t stream, hipStreamCallback_t callback, void* userData,
-                  amd::Command* command)
-        : stream_(stream), callBack_(callback),
-          userData_(userData), command_(command) {
-        };
-    hipStream_t stream_;
-    hipStreamCallback_t callBack_;
-    void* userData_;
-    amd::Command* command_;
+    hipStream_t stream_ = nullptr;
+    hipStreamCallback_t callBack_ = nullptr;
+    void* userData_ = nullptr;
+    amd::Command* command_ = nullptr;
+
+    void run() {
+      callBack_(stream_, hipSuccess, userData_);
+      command_->release();
+    }
 };
 
+typedef hip::CallbackExecutor<StreamCallback> CallbackExecutor;
+
+static std::once_flag callbackExecutorCreated;
+static std::atomic<CallbackExecutor*> callbackExecutor(nullptr);
+
+/// Created on the first callback, with HIP_CALLBACK_THREADS workers (4 by
+/// default), and never destroyed, since callbacks may still be pending when
+/// the process exits
+static CallbackExecutor& getCallbackExecutor() {
+  std::call_once(callbackExecutorCreated, []() {
+    const char* threads = std::getenv("HIP_CALLBACK_THREADS");
+    size_t workers = (threads != nullptr) ? std::strtoul(threads, nullptr, 10) : 4;
+    callbackExecutor = new CallbackExecutor(workers);
+  });
+  return *callbackExecutor;
+}
+
 namespace hip {
 
+void waitCallbacks(amd::HostQueue* queue) {
+  CallbackExecutor* executor = callbackExecutor.load();
+  if (executor == nullptr) {
+    return;
+  }
+  if (queue == nullptr) {
+    executor->waitAll();
+  } else {
+    executor->wait(queue);
+  }
+}
+
 void syncStreams(int devId) {
   amd::ScopedLock lock(streamSetLock);
 
@@ -56,8 +88,56 @@ void syncStreams() {
   syncStreams(getCurrentDevice()->deviceId());
 }
 
+// Captures the work queued on stream, or for hipFree the work it used to wait
+// for: the null stream of every device and every blocking stream
+void DeviceMemoryOps::fence(Fence& fence, const void* stream) {
+  auto capture = [&fence](amd::HostQueue* queue) {
+    amd::Command* command = (queue != nullptr) ? queue->getLastQueuedCommand(true) : nullptr;
+    if (command == nullptr) {
+      return;
+    }
+    if (command->status() == CL_COMPLETE) {
+      command->release();
+      return;
+    }
+    // Make sure the command gets to the device, so the fence completes
+    command->event().notifyCmdQueue();
+    fence.push_back(command);
+  };
+
+  if (stream != nullptr) {
+    capture(static_cast<amd::HostQueue*>(const_cast<void*>(stream)));
+    return;
+  }
+  for (auto& dev : g_devices) {
+    capture(getNullStream(*dev->asContext()));
+  }
+  amd::ScopedLock lock(streamSetLock);
+  for (const auto& it : streamSet) {
+    capture(it->queue);
+  }
+}
+
+void DeviceMemoryOps::streamWait(const void* stream, Fence& fence) {
+  if (!fence.empty()) {
+    HostQueueOps::wait(*static_cast<amd::HostQueue*>(const_cast<void*>(stream)), fence);
+  }
+}
+
+void HostQueueOps::wait(amd::HostQueue& queue, const std::vector<amd::Command*>& commands) {
+  amd::Command::EventWaitList eventWaitList;
+  for (auto command : commands) {
+    command->event().notifyCmdQueue();
+    eventWaitList.push_back(&command->event());
+  }
+
+  amd::Command* command = new amd::Marker(queue, false, eventWaitList);
+  command->enqueue();
+  command->release();
+}
+
 Stream::Stream(hip::Device* dev, amd::CommandQueue::Priority p, unsigned int f) :
-  queue(nullptr), lock("Stream Callback lock"), device(dev), priority(p), flags(f) {}
+  queue(nullptr), device(dev), priority(p), flags(f) {}
 
 void Stream::create() {
   cl_command_queue_properties properties = CL_QUEUE_PROFILING_ENABLE;
@@ -89,15 +169,10 @@ void Stream::finish() {
 
 };
 
+// Runs on the thread that processes command completions, which only hands the
+// callback over to the executor
 void CL_CALLBACK ihipStreamCallback(cl_event event, cl_int command_exec_status, void* user_data) {
-  hipError_t status = hipSuccess;
-  StreamCallback* cbo = reinterpret_cast<StreamCallback*>(user_data);
-  {
-    amd::ScopedLock lock(reinterpret_cast<hip::Stream*>(cbo->stream_)->lock);
-    cbo->callBack_(cbo->stream_, status, cbo->userData_);
-  }
-  cbo->command_->release();
-  delete cbo;
+  getCallbackExecutor().submit(reinterpret_cast<CallbackExecutor::Record*>(user_data));
 }
 
 static hipError_t ihipStreamCreate(hipStream_t *stream, unsigned int flags, amd::CommandQueue::Priority priority) {
@@ -179,6 +254,11 @@ hipError_t hipStreamSynchronize(hipStream_t stream) {
 
   amd::HostQueue* hostQueue = hip::getQueue(stream);
   hostQueue->finish();
+  hip::waitCallbacks(hostQueue);
+
+  hip::Device* device = (stream == nullptr) ? hip::getCurrentDevice() :
+                        reinterpret_cast<hip::Stream*>(stream)->device;
+  device->memPool().releaseAboveThreshold();
 
   HIP_RETURN(hipSuccess);
 }
@@ -190,10 +270,26 @@ hipError_t hipStreamDestroy(hipStream_t stream) {
     HIP_RETURN(hipErrorInvalidHandle);
   }
 
-  amd::ScopedLock lock(streamSetLock);
-
   hip::Stream* hStream = reinterpret_cast<hip::Stream*>(stream);
 
+  if (hStream->queue != nullptr) {
+    // A callback is only handed to the executor once the command it waits for
+    // completes, so the queue is drained first; the callbacks then run while
+    // the stream is still valid
+    hStream->finish();
+    hip::waitCallbacks(hStream->queue);
+    // Memory freed on the stream must not be taken for free by a later stream
+    // that gets the same queue address
+    for (auto& dev : g_devices) {
+      dev->memPool().forgetStream(hStream->queue);
+    }
+  }
+
+  amd::ScopedLock lock(streamSetLock);
+
+  if (hStream->queue != nullptr) {
+    hStream->device->nullStreamOrder().removeQueue(*hStream->queue);
+  }
   hStream->destroy();
   streamSet.erase(hStream);
 
@@ -250,8 +346,7 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
                                 unsigned int flags) {
   HIP_INIT_API(hipStreamAddCallback, stream, callback, userData, flags);
 
-  amd::HostQueue* hostQueue = reinterpret_cast<hip::Stream*>
-                              (stream)->asHostQueue();
+  amd::HostQueue* hostQueue = hip::getQueue(stream);
   amd::Command* command = hostQueue->getLastQueuedCommand(true);
   if (command == nullptr) {
     amd::Command::EventWaitList eventWaitList;
@@ -259,9 +354,17 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
     command->enqueue();
   }
   amd::Event& event = command->event();
-  StreamCallback* cbo = new StreamCallback(stream, callback, userData, command);
 
-  if(!event.setCallback(CL_COMPLETE, ihipStreamCallback, reinterpret_cast<void*>(cbo))) {
+  StreamCallback cb;
+  cb.stream_ = stream;
+  cb.callBack_ = callback;
+  cb.userData_ = userData;
+  cb.command_ = command;
+  CallbackExecutor& executor = getCallbackExecutor();
+  CallbackExecutor::Record* record = executor.prepare(hostQueue, cb);
+
+  if(!event.setCallback(CL_COMPLETE, ihipStreamCallback, reinterpret_cast<void*>(record))) {
+    executor.discard(record);
     command->release();
     return hipErrorInvalidHandle;
   }
@@ -0,0 +1,163 @@
+/* Copyright (c) 2020-present Advanced Micro Devices, Inc.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+#ifndef HIP_STREAM_ORDER_H
+#define HIP_STREAM_ORDER_H
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace hip {
+
+/// Orders the blocking streams of a device against its null stream, following
+/// the legacy default stream semantics: work on a blocking stream waits for
+/// the work queued before it on the null stream, and work on the null stream
+/// waits for the work queued before it on every blocking stream. The waits
+/// are queued as markers with cross-queue wait lists, so the host never
+/// blocks, and the null stream only looks at the blocking streams that were
+/// used since it last ordered itself after them.
+///
+/// Ops abstracts the command queue, which lets the ordering be tested without
+/// a device:
+///   using Queue, Command;
+///   static Command* lastCommand(Queue&);   // Retained, or nullptr if none
+///   static bool completed(Command&);
+///   static void release(Command&);
+///   static void wait(Queue&, const std::vector<Command*>&);
+template <typename Ops>
+class NullStreamOrder {
+  using Queue = typename Ops::Queue;
+  using Command = typename Ops::Command;
+
+  struct QueueState {
+    /// Last null stream command this queue was made to wait for (retained)
+    Command* waited_ = nullptr;
+    /// Last command of this queue the null stream was made to wait for
+    /// (retained)
+    Command* ordered_ = nullptr;
+    /// Set when the queue is handed out for new work, cleared by the null
+    /// stream. A queue whose last command has completed is only forgotten
+    /// once it has not been used for a full null stream round, since work
+    /// handed out concurrently may not have been queued yet.
+    bool used_ = false;
+  };
+
+  std::mutex lock_;
+  /// Blocking queues that may hold work the null stream has not waited for
+  std::unordered_map<Queue*, QueueState> queues_;
+
+  static void forget(QueueState& state) {
+    if (state.waited_ != nullptr) {
+      Ops::release(*state.waited_);
+    }
+    if (state.ordered_ != nullptr) {
+      Ops::release(*state.ordered_);
+    }
+  }
+
+ public:
+  NullStreamOrder() = default;
+  NullStreamOrder(const NullStreamOrder&) = delete;
+  NullStreamOrder& operator=(const NullStreamOrder&) = delete;
+  ~NullStreamOrder() {
+    for (auto& it : queues_) {
+      forget(it.second);
+    }
+  }
+
+  /// Called before work is queued on the blocking queue \p queue
+  void orderBlocking(Queue& nullQueue, Queue& queue) {
+    if (&nullQueue == &queue) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    QueueState& state = queues_[&queue];
+    state.used_ = true;
+
+    Command* last = Ops::lastCommand(nullQueue);
+    if (last == nullptr) {
+      return;
+    }
+    if (last == state.waited_ || Ops::completed(*last)) {
+      Ops::release(*last);
+      return;
+    }
+    Ops::wait(queue, std::vector<Command*>(1, last));
+    if (state.waited_ != nullptr) {
+      Ops::release(*state.waited_);
+    }
+    state.waited_ = last;
+  }
+
+  /// Called before work is queued on the null stream \p nullQueue
+  void orderNull(Queue& nullQueue) {
+    std::vector<Command*> waitList;
+    std::lock_guard<std::mutex> lock(lock_);
+
+    for (auto it = queues_.begin(); it != queues_.end();) {
+      QueueState& state = it->second;
+      Command* last = Ops::lastCommand(*it->first);
+      if (last != nullptr && last != state.ordered_ && !Ops::completed(*last)) {
+        waitList.push_back(last);
+        if (state.ordered_ != nullptr) {
+          Ops::release(*state.ordered_);
+        }
+        state.ordered_ = last;
+      } else {
+        if (last != nullptr) {
+          Ops::release(*last);
+        }
+        if (!state.used_) {
+          forget(state);
+          it = queues_.erase(it);
+          continue;
+        }
+      }
+      state.used_ = false;
+      ++it;
+    }
+
+    if (!waitList.empty()) {
+      Ops::wait(nullQueue, waitList);
+    }
+  }
+
+  /// Forgets \p queue, which is about to be destroyed
+  void removeQueue(Queue& queue) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = queues_.find(&queue);
+    if (it == queues_.end()) {
+      return;
+    }
+    forget(it->second);
+    queues_.erase(it);
+  }
+
+  /// Number of blocking queues the null stream currently looks at
+  size_t trackedQueues() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return queues_.size();
+  }
+};
+
+};
+
+#endif // HIP_STREAM_ORDER_H
@@ -24,6 +24,8 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <type_traits>
 //---
 // Helper functions to convert HIP function arguments into strings.
 // Handles POD data types as well as enumerations (ie hipMemcpyKind).
@@ -252,3 +254,88 @@ inline std::string ToString(T first, Args... args) {
     return ToString(first) + ", " + ToString(args...);
 }
 
+
+//---
+// Deferred argument capture for the API log.
+// HIP_INIT_API only builds an ApiArgRecord when the API log line is printed. The record copies
+// every argument by value into a fixed-size slot together with a pointer to its formatter, so
+// no stringstream is touched until the record is formatted. Arguments larger than a slot are
+// kept by address and must be formatted while the API frame is still live.
+namespace hip {
+
+class ApiArgRecord {
+ public:
+  static constexpr size_t kMaxArgs = 16;
+  static constexpr size_t kSlotSize = 16;
+
+  ApiArgRecord() : count_(0) {}
+
+  template <typename... Args>
+  explicit ApiArgRecord(const Args&... args) : count_(0) {
+    int dummy[] = {0, (capture(args), 0)...};
+    (void)dummy;
+  }
+
+  size_t count() const { return count_; }
+
+  void toStream(std::ostream& os) const {
+    for (size_t i = 0; i < count_; ++i) {
+      if (i != 0) {
+        os << ", ";
+      }
+      slots_[i].format_(os, slots_[i].data_);
+    }
+  }
+
+  std::string toString() const {
+    std::ostringstream ss;
+    toStream(ss);
+    return ss.str();
+  }
+
+ private:
+  typedef void (*FormatFn)(std::ostream& os, const unsigned char* data);
+
+  struct Slot {
+    FormatFn format_;
+    alignas(8) unsigned char data_[kSlotSize];
+  };
+
+  template <typename T>
+  static void formatByValue(std::ostream& os, const unsigned char* data) {
+    T v;
+    memcpy(&v, data, sizeof(T));
+    os << ToString(v);
+  }
+
+  template <typename T>
+  static void formatByAddress(std::ostream& os, const unsigned char* data) {
+    const T* p;
+    memcpy(&p, data, sizeof(p));
+    os << ToString(*p);
+  }
+
+  template <typename T>
+  typename std::enable_if<(sizeof(T) <= kSlotSize) && std::is_trivially_copyable<T>::value>::type
+  capture(const T& v) {
+    if (count_ == kMaxArgs) return;
+    Slot& slot = slots_[count_++];
+    slot.format_ = &formatByValue<T>;
+    memcpy(slot.data_, &v, sizeof(T));
+  }
+
+  template <typename T>
+  typename std::enable_if<!((sizeof(T) <= kSlotSize) && std::is_trivially_copyable<T>::value)>::type
+  capture(const T& v) {
+    if (count_ == kMaxArgs) return;
+    Slot& slot = slots_[count_++];
+    slot.format_ = &formatByAddress<T>;
+    const T* p = &v;
+    memcpy(slot.data_, &p, sizeof(p));
+  }
+
+  size_t count_;
+  Slot slots_[kMaxArgs];
+};
+
+}  // namespace hip